@@ -359,18 +359,33 @@ function BuildClient(settings, family, platform)
 end
 
 function BuildServer(settings, family, platform)
-	local server = Compile(settings, Collect("src/engine/server/*.cpp"))
+	local server_files = {}
+	for i,v in ipairs(Collect("src/engine/server/*.cpp")) do
+		if PathFilename(v) ~= "main.cpp" then
+			table.insert(server_files, v)
+		end
+	end
+	local server_main = Compile(settings, "src/engine/server/main.cpp")
+	local server = Compile(settings, server_files)
 	
 	local game_server = Compile(settings, CollectRecursive("src/game/server/*.cpp"), SharedServerFiles())
 	
-	return Link(settings, "teeworlds_srv", libs["zlib"], libs["md5"], server, game_server)
+	-- the benchmark and the packet replay run the complete server in-process,
+	-- the demo tool needs the snapshot item sizes of the protocol
+	Link(settings, "server_bench", Compile(settings, "src/tools/server_bench.cpp"), libs["zlib"], libs["md5"], server, game_server)
+	Link(settings, "packet_replay", Compile(settings, "src/tools/packet_replay.cpp"), libs["zlib"], libs["md5"], server, game_server)
+	Link(settings, "demo_tool", Compile(settings, "src/tools/demo_tool.cpp"), libs["zlib"], libs["md5"], server, game_server)
+	
+	return Link(settings, "teeworlds_srv", libs["zlib"], libs["md5"], server_main, server, game_server)
 end
 
 function BuildTools(settings)
 	local tools = {}
 	for i,v in ipairs(Collect("src/tools/*.cpp", "src/tools/*.c")) do
 		local toolname = PathFilename(PathBase(v))
-		tools[i] = Link(settings, toolname, Compile(settings, v), libs["zlib"], libs["md5"], libs["wavpack"], libs["png"])
+		if toolname ~= "server_bench" and toolname ~= "packet_replay" and toolname ~= "demo_tool" then
+			table.insert(tools, Link(settings, toolname, Compile(settings, v), libs["zlib"], libs["md5"], libs["wavpack"], libs["png"]))
+		end
 	end
 	PseudoTarget(settings.link.Output(settings, "pseudo_tools") .. settings.link.extension, tools)
 end
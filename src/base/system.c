@@ -292,16 +292,37 @@ typedef struct MEMTAIL
 static struct MEMHEADER *first = 0;
 static const int MEM_GUARD_VAL = 0xbaadc0de;
 
+static MEMSTATS memory_stats = {0};
+
+static void mem_stats_inc(volatile unsigned *counter)
+{
+#if defined(__GNUC__)
+	__sync_add_and_fetch(counter, 1);
+#elif defined(CONF_FAMILY_WINDOWS)
+	InterlockedIncrement((volatile long *)counter);
+#else
+	(*counter)++;
+#endif
+}
+
 void *mem_alloc_debug(const char *filename, int line, unsigned size, unsigned alignment)
 {
+	mem_stats_inc(&memory_stats.total_allocations);
 	return malloc(size);
 }
 
 void mem_free(void *p)
 {
+	if(p)
+		mem_stats_inc(&memory_stats.total_frees);
 	free(p);
 }
 
+const MEMSTATS *mem_stats()
+{
+	return &memory_stats;
+}
+
 void mem_copy(void *dest, const void *source, unsigned size)
 {
 	memcpy(dest, source, size);
@@ -1009,9 +1030,10 @@ static int priv_net_close_all_sockets(NETSOCKET sock)
 	return 0;
 }
 
-static int priv_net_create_socket(int domain, int type, struct sockaddr *addr, int sockaddrlen, int use_random_port)
+static int priv_net_create_socket(int domain, int type, struct sockaddr *addr, int sockaddrlen, int flags)
 {
 	int sock, e;
+	int use_random_port = flags&NETSOCKET_FLAG_RANDOMPORT;
 
 	/* create socket */
 	sock = socket(domain, type, 0);
@@ -1038,6 +1060,15 @@ static int priv_net_create_socket(int domain, int type, struct sockaddr *addr, i
 	}
 #endif
 
+	/* let other sockets bind the same port, the system spreads the traffic */
+#if defined(SO_REUSEPORT)
+	if(flags&NETSOCKET_FLAG_REUSEPORT)
+	{
+		int reuse = 1;
+		setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, (const char*)&reuse, sizeof(reuse));
+	}
+#endif
+
 	/* bind the socket */
 	while(1)
 	{
@@ -1078,7 +1109,7 @@ static int priv_net_create_socket(int domain, int type, struct sockaddr *addr, i
 	return sock;
 }
 
-NETSOCKET net_udp_create(NETADDR bindaddr, int use_random_port)
+NETSOCKET net_udp_create(NETADDR bindaddr, int flags)
 {
 	NETSOCKET sock = invalid_socket;
 	NETADDR tmpbindaddr = bindaddr;
@@ -1093,7 +1124,7 @@ NETSOCKET net_udp_create(NETADDR bindaddr, int use_random_port)
 		/* bind, we should check for error */
 		tmpbindaddr.type = NETTYPE_IPV4;
 		netaddr_to_sockaddr_in(&tmpbindaddr, &addr);
-		socket = priv_net_create_socket(AF_INET, SOCK_DGRAM, (struct sockaddr *)&addr, sizeof(addr), use_random_port);
+		socket = priv_net_create_socket(AF_INET, SOCK_DGRAM, (struct sockaddr *)&addr, sizeof(addr), flags);
 		if(socket >= 0)
 		{
 			sock.type |= NETTYPE_IPV4;
@@ -1115,7 +1146,7 @@ NETSOCKET net_udp_create(NETADDR bindaddr, int use_random_port)
 		/* bind, we should check for error */
 		tmpbindaddr.type = NETTYPE_IPV6;
 		netaddr_to_sockaddr_in6(&tmpbindaddr, &addr);
-		socket = priv_net_create_socket(AF_INET6, SOCK_DGRAM, (struct sockaddr *)&addr, sizeof(addr), use_random_port);
+		socket = priv_net_create_socket(AF_INET6, SOCK_DGRAM, (struct sockaddr *)&addr, sizeof(addr), flags);
 		if(socket >= 0)
 		{
 			sock.type |= NETTYPE_IPV6;
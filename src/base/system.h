@@ -116,6 +116,22 @@ void *mem_alloc_debug(const char *filename, int line, unsigned size, unsigned al
 */
 void mem_free(void *block);
 
+typedef struct
+{
+	volatile unsigned total_allocations;
+	volatile unsigned total_frees;
+} MEMSTATS;
+
+/*
+	Function: mem_stats
+		Returns how many blocks were allocated and freed through
+		<mem_alloc> and <mem_free> so far.
+
+	Remarks:
+		- The counters wrap around, compare differences between two reads.
+*/
+const MEMSTATS *mem_stats();
+
 /*
 	Function: mem_copy
 		Copies a a memory block.
@@ -691,19 +707,28 @@ int net_addr_from_str(NETADDR *addr, const char *string);
 
 /* Group: Network UDP */
 
+enum
+{
+	NETSOCKET_FLAG_RANDOMPORT=1,
+	NETSOCKET_FLAG_REUSEPORT=2,
+};
+
 /*
 	Function: net_udp_create
 		Creates a UDP socket and binds it to a port.
 
 	Parameters:
 		bindaddr - Address to bind the socket to.
-		use_random_port - use a random port
+		flags - NETSOCKET_FLAG_RANDOMPORT to use a random port,
+			NETSOCKET_FLAG_REUSEPORT to allow several sockets on the same
+			port that share the incoming packets, where the system
+			supports it
 
 	Returns:
 		On success it returns an handle to the socket. On failure it
 		returns NETSOCKET_INVALID.
 */
-NETSOCKET net_udp_create(NETADDR bindaddr, int use_random_port);
+NETSOCKET net_udp_create(NETADDR bindaddr, int flags);
 
 /*
 	Function: net_udp_send
@@ -486,7 +486,7 @@ void CClient::OnEnterGame()
 	m_aSnapshots[SNAP_PREV] = 0;
 	m_SnapshotStorage.PurgeAll();
 	m_ReceivedSnapshots = 0;
-	m_SnapshotParts = 0;
+	m_SnapshotAssembler.Reset();
 	m_PredTick = 0;
 	m_CurrentRecvTick = 0;
 	m_CurGameTick = 0;
@@ -1066,11 +1066,14 @@ void CClient::ProcessConnlessPacket(CNetChunk *pPacket)
 	}
 
 	// server list from master server
-	if(pPacket->m_DataSize >= (int)sizeof(SERVERBROWSE_LIST) &&
-		mem_comp(pPacket->m_pData, SERVERBROWSE_LIST, sizeof(SERVERBROWSE_LIST)) == 0)
+	bool List = pPacket->m_DataSize >= (int)sizeof(SERVERBROWSE_LIST) &&
+		mem_comp(pPacket->m_pData, SERVERBROWSE_LIST, sizeof(SERVERBROWSE_LIST)) == 0;
+	bool Delta = pPacket->m_DataSize >= (int)sizeof(SERVERBROWSE_DELTA) &&
+		mem_comp(pPacket->m_pData, SERVERBROWSE_DELTA, sizeof(SERVERBROWSE_DELTA)) == 0;
+	if(List || Delta)
 	{
 		// check for valid master server address
-		bool Valid = false;
+		int MasterIndex = -1;
 		for(int i = 0; i < IMasterServer::MAX_MASTERSERVERS; ++i)
 		{
 			if(m_pMasterServer->IsValid(i))
@@ -1078,42 +1081,22 @@ void CClient::ProcessConnlessPacket(CNetChunk *pPacket)
 				NETADDR Addr = m_pMasterServer->GetAddr(i);
 				if(net_addr_comp(&pPacket->m_Address, &Addr, true) == 0)
 				{
-					Valid = true;
+					MasterIndex = i;
 					break;
 				}
 			}
 		}
-		if(!Valid)
+		if(MasterIndex < 0)
 			return;
 
-		int Size = pPacket->m_DataSize-sizeof(SERVERBROWSE_LIST);
-		int Num = Size/sizeof(CMastersrvAddr);
-		CMastersrvAddr *pAddrs = (CMastersrvAddr *)((char*)pPacket->m_pData+sizeof(SERVERBROWSE_LIST));
-		for(int i = 0; i < Num; i++)
+		if(List)
 		{
-			NETADDR Addr;
-
-			static unsigned char s_aIPV4Mapping[] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF};
-
-			// copy address
-			if(!mem_comp(s_aIPV4Mapping, pAddrs[i].m_aIp, sizeof(s_aIPV4Mapping)))
-			{
-				mem_zero(&Addr, sizeof(Addr));
-				Addr.type = NETTYPE_IPV4;
-				Addr.ip[0] = pAddrs[i].m_aIp[12];
-				Addr.ip[1] = pAddrs[i].m_aIp[13];
-				Addr.ip[2] = pAddrs[i].m_aIp[14];
-				Addr.ip[3] = pAddrs[i].m_aIp[15];
-			}
-			else
-			{
-				Addr.type = NETTYPE_IPV6;
-				mem_copy(Addr.ip, pAddrs[i].m_aIp, sizeof(Addr.ip));
-			}
-			Addr.port = (pAddrs[i].m_aPort[0]<<8) | pAddrs[i].m_aPort[1];
-
-			m_ServerBrowser.Set(Addr, CServerBrowser::SET_MASTER_ADD, -1, 0x0);
+			int Size = pPacket->m_DataSize-sizeof(SERVERBROWSE_LIST);
+			int Num = Size/sizeof(CMastersrvAddr);
+			m_ServerBrowser.AddMasterList(MasterIndex, (const CMastersrvAddr *)((const char*)pPacket->m_pData+sizeof(SERVERBROWSE_LIST)), Num);
 		}
+		else
+			m_ServerBrowser.AddMasterDelta(MasterIndex, (const unsigned char *)pPacket->m_pData, pPacket->m_DataSize);
 	}
 
 	// server info
@@ -1394,33 +1377,17 @@ void CClient::ProcessServerPacket(CNetChunk *pPacket)
 
 			if(GameTick >= m_CurrentRecvTick)
 			{
-				if(GameTick != m_CurrentRecvTick)
-				{
-					m_SnapshotParts = 0;
-					m_CurrentRecvTick = GameTick;
-				}
-
-				// TODO: clean this up abit
-				mem_copy((char*)m_aSnapshotIncomingData + Part*MAX_SNAPSHOT_PACKSIZE, pData, PartSize);
-				m_SnapshotParts |= 1<<Part;
-
-				if(m_SnapshotParts == (unsigned)((1<<NumParts)-1))
+				m_CurrentRecvTick = GameTick;
+				CompleteSize = m_SnapshotAssembler.AddPart(GameTick, Part, NumParts, pData, PartSize);
+				if(CompleteSize >= 0)
 				{
 					static CSnapshot Emptysnap;
 					CSnapshot *pDeltaShot = &Emptysnap;
 					int PurgeTick;
-					void *pDeltaData;
-					int DeltaSize;
-					unsigned char aTmpBuffer2[CSnapshot::MAX_SIZE];
 					unsigned char aTmpBuffer3[CSnapshot::MAX_SIZE];
 					CSnapshot *pTmpBuffer3 = (CSnapshot*)aTmpBuffer3;	// Fix compiler warning for strict-aliasing
 					int SnapSize;
 
-					CompleteSize = (NumParts-1) * MAX_SNAPSHOT_PACKSIZE + PartSize;
-
-					// reset snapshoting
-					m_SnapshotParts = 0;
-
 					// find snapshot that we should use as delta
 					Emptysnap.Clear();
 
@@ -1447,23 +1414,8 @@ void CClient::ProcessServerPacket(CNetChunk *pPacket)
 						}
 					}
 
-					// decompress snapshot
-					pDeltaData = m_SnapshotDelta.EmptyDelta();
-					DeltaSize = sizeof(int)*3;
-
-					if(CompleteSize)
-					{
-						int IntSize = CVariableInt::Decompress(m_aSnapshotIncomingData, CompleteSize, aTmpBuffer2, sizeof(aTmpBuffer2));
-
-						if(IntSize < 0) // failure during decompression, bail
-							return;
-
-						pDeltaData = aTmpBuffer2;
-						DeltaSize = IntSize;
-					}
-
-					// unpack delta
-					SnapSize = m_SnapshotDelta.UnpackDelta(pDeltaShot, pTmpBuffer3, pDeltaData, DeltaSize);
+					// decompress and unpack delta
+					SnapSize = m_SnapshotAssembler.Unpack(&m_SnapshotDelta, pDeltaShot, pTmpBuffer3, CompleteSize);
 					if(SnapSize < 0)
 					{
 						m_pConsole->Print(IConsole::OUTPUT_LEVEL_DEBUG, "client", "delta unpack failed!");
@@ -1927,7 +1879,7 @@ bool CClient::LimitFps()
 void CClient::Run()
 {
 	m_LocalStartTime = time_get();
-	m_SnapshotParts = 0;
+	m_SnapshotAssembler.Reset();
 
 	// init SDL
 	{
@@ -2370,6 +2322,8 @@ void CClient::DemoRecorder_Start(const char *pFilename, bool WithTimestamp)
 		}
 		else
 			str_format(aFilename, sizeof(aFilename), "demos/%s.demo", pFilename);
+		m_DemoRecorder.SetKeyFrameInterval(Config()->m_DemoKeyframeInterval*SERVER_TICK_SPEED);
+		m_DemoRecorder.SetBlockCompression(Config()->m_DemoBlockCompression);
 		m_DemoRecorder.Start(Storage(), m_pConsole, aFilename, GameClient()->NetVersion(), m_aCurrentMap, m_CurrentMapSha256, m_CurrentMapCrc, "client");
 	}
 }
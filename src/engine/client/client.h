@@ -86,7 +86,6 @@ class CClient : public IClient, public CDemoPlayer::IListener
 	char m_aServerAddressStr[256];
 	char m_aServerPassword[128];
 
-	unsigned m_SnapshotParts;
 	int64 m_LocalStartTime;
 
 	int64 m_LastRenderTime;
@@ -165,7 +164,7 @@ class CClient : public IClient, public CDemoPlayer::IListener
 	CSnapshotStorage::CHolder *m_aSnapshots[NUM_SNAPSHOT_TYPES];
 
 	int m_ReceivedSnapshots;
-	char m_aSnapshotIncomingData[CSnapshot::MAX_SIZE];
+	CSnapshotAssembler m_SnapshotAssembler;
 
 	class CSnapshotStorage::CHolder m_aDemorecSnapshotHolders[NUM_SNAPSHOT_TYPES];
 	char *m_aDemorecSnapshotData[NUM_SNAPSHOT_TYPES][2][CSnapshot::MAX_SIZE];
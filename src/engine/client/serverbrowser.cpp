@@ -39,6 +39,40 @@ inline int GetNewToken()
 	return random_int();
 }
 
+static void PackInt(unsigned char *pDst, unsigned Value)
+{
+	pDst[0] = (Value>>24)&0xff;
+	pDst[1] = (Value>>16)&0xff;
+	pDst[2] = (Value>>8)&0xff;
+	pDst[3] = Value&0xff;
+}
+
+static unsigned UnpackInt(const unsigned char *pSrc)
+{
+	return (pSrc[0]<<24) | (pSrc[1]<<16) | (pSrc[2]<<8) | pSrc[3];
+}
+
+static void UnpackAddr(const CMastersrvAddr *pSrc, NETADDR *pAddr)
+{
+	static unsigned char s_aIPV4Mapping[] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF};
+
+	mem_zero(pAddr, sizeof(*pAddr));
+	if(!mem_comp(s_aIPV4Mapping, pSrc->m_aIp, sizeof(s_aIPV4Mapping)))
+	{
+		pAddr->type = NETTYPE_IPV4;
+		pAddr->ip[0] = pSrc->m_aIp[12];
+		pAddr->ip[1] = pSrc->m_aIp[13];
+		pAddr->ip[2] = pSrc->m_aIp[14];
+		pAddr->ip[3] = pSrc->m_aIp[15];
+	}
+	else
+	{
+		pAddr->type = NETTYPE_IPV6;
+		mem_copy(pAddr->ip, pSrc->m_aIp, sizeof(pAddr->ip));
+	}
+	pAddr->port = (pSrc->m_aPort[0]<<8) | pSrc->m_aPort[1];
+}
+
 //
 void CServerBrowser::CServerlist::Clear()
 {
@@ -49,6 +83,20 @@ void CServerBrowser::CServerlist::Clear()
 	mem_zero(m_aServerlistIp, sizeof(m_aServerlistIp));
 }
 
+void CServerBrowser::CMasterList::Reset(int Request)
+{
+	m_Request = Request;
+	m_RequestTime = time_get();
+	m_Full = false;
+	m_PendingEpoch = 0;
+	m_PendingGeneration = 0;
+	m_NumPackets = -1;
+	m_NumReceived = 0;
+	m_NumListPackets = 0;
+	m_aPacketSizes.clear();
+	m_aDeltas.clear();
+}
+
 //
 CServerBrowser::CServerBrowser()
 {
@@ -75,7 +123,14 @@ CServerBrowser::CServerBrowser()
 
 	m_ActServerlistType = 0;
 	m_BroadcastTime = 0;
-	m_MasterRefreshTime = 0;
+
+	for(int i = 0; i < IMasterServer::MAX_MASTERSERVERS; ++i)
+	{
+		m_aMasterLists[i].m_Epoch = 0;
+		m_aMasterLists[i].m_Generation = 0;
+		m_aMasterLists[i].Reset(CMasterList::REQUEST_NONE);
+	}
+	m_CacheApplied = false;
 }
 
 void CServerBrowser::Init(class CNetClient *pNetClient, const char *pNetVersion)
@@ -89,6 +144,8 @@ void CServerBrowser::Init(class CNetClient *pNetClient, const char *pNetVersion)
 
 	m_ServerBrowserFavorites.Init(pNetClient, m_pConsole, Kernel()->RequestInterface<IEngine>(), pConfigManager);
 	m_ServerBrowserFilter.Init(Config(), Kernel()->RequestInterface<IFriends>(), pNetVersion);
+
+	LoadServerlist();
 }
 
 void CServerBrowser::Set(const NETADDR &Addr, int SetType, int Token, const CServerInfo *pInfo)
@@ -96,20 +153,6 @@ void CServerBrowser::Set(const NETADDR &Addr, int SetType, int Token, const CSer
 	CServerEntry *pEntry = 0;
 	switch(SetType)
 	{
-	case SET_MASTER_ADD:
-		{
-			if(!(m_RefreshFlags&IServerBrowser::REFRESHFLAG_INTERNET))
-				return;
-
-			m_MasterRefreshTime = 0;
-
-			if(!Find(IServerBrowser::TYPE_INTERNET, Addr))
-			{
-				pEntry = Add(IServerBrowser::TYPE_INTERNET, Addr);
-				QueueRequest(pEntry);
-			}
-		}
-		break;
 	case SET_FAV_ADD:
 		{
 			if(!(m_RefreshFlags&IServerBrowser::REFRESHFLAG_INTERNET))
@@ -171,6 +214,7 @@ void CServerBrowser::Update(bool ForceResort)
 	if(m_NeedRefresh && !m_pMasterServer->IsRefreshing())
 	{
 		CNetChunk Packet;
+		unsigned char aData[sizeof(SERVERBROWSE_GETDELTA)+8];
 
 		m_NeedRefresh = 0;
 		m_InfoUpdated = false;
@@ -178,32 +222,34 @@ void CServerBrowser::Update(bool ForceResort)
 		mem_zero(&Packet, sizeof(Packet));
 		Packet.m_ClientID = -1;
 		Packet.m_Flags = NETSENDFLAG_CONNLESS;
-		Packet.m_DataSize = sizeof(SERVERBROWSE_GETLIST);
-		Packet.m_pData = SERVERBROWSE_GETLIST;
+		Packet.m_DataSize = sizeof(aData);
+		Packet.m_pData = aData;
+		mem_copy(aData, SERVERBROWSE_GETDELTA, sizeof(SERVERBROWSE_GETDELTA));
 
+		// ask for the changes since the lists we have
 		for(int i = 0; i < IMasterServer::MAX_MASTERSERVERS; i++)
 		{
 			if(!m_pMasterServer->IsValid(i))
 				continue;
 
+			m_aMasterLists[i].Reset(CMasterList::REQUEST_DELTA);
+			PackInt(aData+sizeof(SERVERBROWSE_GETDELTA), m_aMasterLists[i].m_Epoch);
+			PackInt(aData+sizeof(SERVERBROWSE_GETDELTA)+4, m_aMasterLists[i].m_Generation);
 			Packet.m_Address = m_pMasterServer->GetAddr(i);
 			m_pNetClient->Send(&Packet);
 		}
 
-		m_MasterRefreshTime = Now;
-
 		if(Config()->m_Debug)
-			m_pConsole->Print(IConsole::OUTPUT_LEVEL_DEBUG, "client_srvbrowse", "requesting server list");
+			m_pConsole->Print(IConsole::OUTPUT_LEVEL_DEBUG, "client_srvbrowse", "requesting server list changes");
 	}
 
-	// load server list backup from file in case the masters don't response
-	if(m_MasterRefreshTime && m_MasterRefreshTime+2*Timeout < Now)
+	// unanswered or incomplete list requests
+	for(int i = 0; i < IMasterServer::MAX_MASTERSERVERS; i++)
 	{
-		LoadServerlist();
-		m_MasterRefreshTime = 0;
-
-		if(Config()->m_Debug)
-			m_pConsole->Print(IConsole::OUTPUT_LEVEL_DEBUG, "client_srvbrowse", "using backup server list");
+		const CMasterList *pList = &m_aMasterLists[i];
+		if((pList->m_Request == CMasterList::REQUEST_DELTA || pList->m_Request == CMasterList::REQUEST_ANSWERED) &&
+			pList->m_RequestTime+Timeout < Now && m_pMasterServer->IsValid(i))
+			TimeoutMasterList(i);
 	}
 
 	// do timeouts
@@ -261,6 +307,94 @@ void CServerBrowser::Update(bool ForceResort)
 	m_ServerBrowserFilter.Sort(m_aServerlist[m_ActServerlistType].m_ppServerlist, m_aServerlist[m_ActServerlistType].m_NumServers, ForceResort ? CServerBrowserFilter::RESORT_FLAG_FORCE : 0);
 }
 
+void CServerBrowser::AddMasterList(int MasterIndex, const CMastersrvAddr *pAddrs, int Num)
+{
+	// a full list answers a delta request, otherwise the servers are just added
+	CMasterList *pList = &m_aMasterLists[MasterIndex];
+	bool FullList = pList->m_Request == CMasterList::REQUEST_DELTA || pList->m_Request == CMasterList::REQUEST_ANSWERED;
+	if(FullList)
+	{
+		pList->m_Request = CMasterList::REQUEST_ANSWERED;
+		pList->m_RequestTime = time_get();
+		pList->m_NumListPackets++;
+	}
+
+	bool Added = false;
+	for(int i = 0; i < Num; i++)
+	{
+		NETADDR Addr;
+		UnpackAddr(&pAddrs[i], &Addr);
+		Added |= AddMasterServer(MasterIndex, Addr, FullList);
+	}
+	if(Added)
+		m_ServerBrowserFilter.Sort(m_aServerlist[m_ActServerlistType].m_ppServerlist, m_aServerlist[m_ActServerlistType].m_NumServers, CServerBrowserFilter::RESORT_FLAG_FORCE);
+
+	if(FullList && pList->m_Full && pList->m_NumListPackets >= pList->m_NumPackets)
+		CompleteMasterList(MasterIndex);
+}
+
+void CServerBrowser::AddMasterDelta(int MasterIndex, const unsigned char *pData, int DataSize)
+{
+	CMasterList *pList = &m_aMasterLists[MasterIndex];
+	if(DataSize < SERVERBROWSE_DELTA_HEADER_SIZE ||
+		(pList->m_Request != CMasterList::REQUEST_DELTA && pList->m_Request != CMasterList::REQUEST_ANSWERED))
+		return;
+
+	const unsigned char *pHeader = pData+sizeof(SERVERBROWSE_DELTA);
+	unsigned Epoch = UnpackInt(pHeader);
+	unsigned From = UnpackInt(pHeader+4);
+	unsigned To = UnpackInt(pHeader+8);
+	int Index = (pHeader[12]<<8) | pHeader[13];
+	int NumPackets = (pHeader[14]<<8) | pHeader[15];
+
+	if(pList->m_NumPackets < 0)
+	{
+		// either the full list or the changes since the list we have
+		if(From != 0 && (Epoch != pList->m_Epoch || From != pList->m_Generation || NumPackets == 0))
+			return;
+
+		// the packet count comes from the network, the master sends the
+		// full list instead of larger deltas
+		if(From != 0 && NumPackets > SERVERBROWSE_MAX_DELTA_PACKETS)
+			return;
+
+		pList->m_Request = CMasterList::REQUEST_ANSWERED;
+		pList->m_Full = From == 0;
+		pList->m_PendingEpoch = Epoch;
+		pList->m_PendingGeneration = To;
+		pList->m_NumPackets = NumPackets;
+		if(!pList->m_Full)
+		{
+			pList->m_aPacketSizes.set_size(NumPackets);
+			for(int i = 0; i < NumPackets; i++)
+				pList->m_aPacketSizes[i] = -1;
+			pList->m_aDeltas.set_size(NumPackets*SERVERBROWSE_MAX_DELTAS_PER_PACKET);
+		}
+	}
+	else if(pList->m_Full || From == 0 || Epoch != pList->m_PendingEpoch || To != pList->m_PendingGeneration || NumPackets != pList->m_NumPackets)
+		return;
+
+	pList->m_RequestTime = time_get();
+	if(pList->m_Full)
+	{
+		// the list packets may have arrived already
+		if(pList->m_NumListPackets >= pList->m_NumPackets)
+			CompleteMasterList(MasterIndex);
+		return;
+	}
+
+	if(Index >= NumPackets || pList->m_aPacketSizes[Index] >= 0)
+		return;
+
+	int Num = min((DataSize-SERVERBROWSE_DELTA_HEADER_SIZE)/(int)sizeof(CMastersrvDelta), (int)SERVERBROWSE_MAX_DELTAS_PER_PACKET);
+	mem_copy(&pList->m_aDeltas[Index*SERVERBROWSE_MAX_DELTAS_PER_PACKET], pData+SERVERBROWSE_DELTA_HEADER_SIZE, Num*sizeof(CMastersrvDelta));
+	pList->m_aPacketSizes[Index] = Num;
+
+	// the changes have to be applied in order
+	if(++pList->m_NumReceived == pList->m_NumPackets)
+		CompleteMasterList(MasterIndex);
+}
+
 // interface functions
 void CServerBrowser::SetType(int Type)
 {
@@ -317,6 +451,7 @@ void CServerBrowser::Refresh(int RefreshFlags)
 		{
 			m_pNetClient->PurgeStoredPacket(pEntry->m_TrackID);
 		}
+		UpdateCache();
 		m_aServerlist[IServerBrowser::TYPE_INTERNET].Clear();
 		if(m_ActServerlistType == IServerBrowser::TYPE_INTERNET)
 			m_ServerBrowserFilter.Clear();
@@ -324,6 +459,18 @@ void CServerBrowser::Refresh(int RefreshFlags)
 		m_pLastReqServer = 0;
 		m_NumRequests = 0;
 
+		// start with the servers we know, the masters only send the changes
+		for(int i = 0; i < m_aCachedServers.size(); i++)
+		{
+			if(Find(IServerBrowser::TYPE_INTERNET, m_aCachedServers[i].m_Addr))
+				continue;
+			CServerEntry *pEntry = Add(IServerBrowser::TYPE_INTERNET, m_aCachedServers[i].m_Addr);
+			pEntry->m_MasterMask = m_aCachedServers[i].m_MasterMask;
+			QueueRequest(pEntry);
+		}
+		m_CacheApplied = true;
+		m_ServerBrowserFilter.Sort(m_aServerlist[m_ActServerlistType].m_ppServerlist, m_aServerlist[m_ActServerlistType].m_NumServers, CServerBrowserFilter::RESORT_FLAG_FORCE);
+
 		m_NeedRefresh = 1;
 		for(int i = 0; i < m_ServerBrowserFavorites.m_NumFavoriteServers; i++)
 			if(m_ServerBrowserFavorites.m_aFavoriteServers[i].m_State >= CServerBrowserFavorites::FAVSTATE_ADDR)
@@ -490,6 +637,205 @@ CServerEntry *CServerBrowser::Find(int ServerlistType, const NETADDR &Addr)
 	return (CServerEntry*)0;
 }
 
+void CServerBrowser::Remove(int ServerlistType, CServerEntry *pEntry)
+{
+	CServerlist *pList = &m_aServerlist[ServerlistType];
+
+	// remove from the hash list
+	for(CServerEntry **ppEntry = &pList->m_aServerlistIp[AddrHash(&pEntry->m_Addr)]; *ppEntry; ppEntry = &(*ppEntry)->m_pNextIp)
+	{
+		if(*ppEntry == pEntry)
+		{
+			*ppEntry = pEntry->m_pNextIp;
+			break;
+		}
+	}
+
+	if(pEntry->m_InfoState == CServerEntry::STATE_PENDING)
+		m_pNetClient->PurgeStoredPacket(pEntry->m_TrackID);
+	RemoveRequest(pEntry);
+	if(pEntry->m_InfoState == CServerEntry::STATE_READY)
+	{
+		pList->m_NumPlayers -= pEntry->m_Info.m_NumPlayers;
+		pList->m_NumClients -= pEntry->m_Info.m_NumClients;
+	}
+
+	// the last entry takes the free position, the heap keeps the memory until the list gets cleared
+	int Index = pEntry->m_Info.m_ServerIndex;
+	pList->m_NumServers--;
+	pList->m_ppServerlist[Index] = pList->m_ppServerlist[pList->m_NumServers];
+	pList->m_ppServerlist[Index]->m_Info.m_ServerIndex = Index;
+}
+
+bool CServerBrowser::AddMasterServer(int MasterIndex, const NETADDR &Addr, bool FullList)
+{
+	if(!(m_RefreshFlags&IServerBrowser::REFRESHFLAG_INTERNET))
+		return false;
+
+	bool Added = false;
+	CServerEntry *pEntry = Find(IServerBrowser::TYPE_INTERNET, Addr);
+	if(!pEntry)
+	{
+		pEntry = Add(IServerBrowser::TYPE_INTERNET, Addr);
+		QueueRequest(pEntry);
+		Added = true;
+	}
+	pEntry->m_MasterMask |= 1<<MasterIndex;
+	if(FullList)
+		pEntry->m_FullListMask |= 1<<MasterIndex;
+	return Added;
+}
+
+bool CServerBrowser::RemoveMasterServer(int MasterIndex, CServerEntry *pEntry)
+{
+	// servers stay as long as a master lists them or they are favorites
+	pEntry->m_MasterMask &= ~(1<<MasterIndex);
+	if(pEntry->m_MasterMask || pEntry->m_Info.m_Favorite)
+		return false;
+	Remove(IServerBrowser::TYPE_INTERNET, pEntry);
+	return true;
+}
+
+bool CServerBrowser::PruneMasterList(int MasterIndex)
+{
+	// drops the servers of the master that were not in its full list
+	CServerlist *pList = &m_aServerlist[IServerBrowser::TYPE_INTERNET];
+	int Bit = 1<<MasterIndex;
+	bool Removed = false;
+	for(int i = pList->m_NumServers-1; i >= 0; i--)
+	{
+		CServerEntry *pEntry = pList->m_ppServerlist[i];
+		bool Listed = pEntry->m_FullListMask&Bit;
+		pEntry->m_FullListMask &= ~Bit;
+		if((pEntry->m_MasterMask&Bit) && !Listed)
+			Removed |= RemoveMasterServer(MasterIndex, pEntry);
+	}
+	return Removed;
+}
+
+void CServerBrowser::CompleteMasterList(int MasterIndex)
+{
+	CMasterList *pList = &m_aMasterLists[MasterIndex];
+	bool Changed = false;
+	if(pList->m_Full)
+		Changed = PruneMasterList(MasterIndex);
+	else
+	{
+		for(int p = 0; p < pList->m_NumPackets; p++)
+		{
+			const CMastersrvDelta *pDeltas = &pList->m_aDeltas[p*SERVERBROWSE_MAX_DELTAS_PER_PACKET];
+			for(int i = 0; i < pList->m_aPacketSizes[p]; i++)
+			{
+				NETADDR Addr;
+				UnpackAddr(&pDeltas[i].m_Addr, &Addr);
+				if(pDeltas[i].m_Type == CMastersrvDelta::TYPE_ADDED)
+					Changed |= AddMasterServer(MasterIndex, Addr, false);
+				else if(pDeltas[i].m_Type == CMastersrvDelta::TYPE_REMOVED)
+				{
+					CServerEntry *pEntry = Find(IServerBrowser::TYPE_INTERNET, Addr);
+					if(pEntry)
+						Changed |= RemoveMasterServer(MasterIndex, pEntry);
+				}
+			}
+		}
+	}
+
+	if(Config()->m_Debug)
+	{
+		char aBuf[128];
+		str_format(aBuf, sizeof(aBuf), "master %d: %s from generation %u to %u", MasterIndex, pList->m_Full ? "full list" : "changes",
+			pList->m_Generation, pList->m_PendingGeneration);
+		m_pConsole->Print(IConsole::OUTPUT_LEVEL_DEBUG, "client_srvbrowse", aBuf);
+	}
+
+	pList->m_Epoch = pList->m_PendingEpoch;
+	pList->m_Generation = pList->m_PendingGeneration;
+	pList->Reset(CMasterList::REQUEST_NONE);
+
+	if(Changed)
+		m_ServerBrowserFilter.Sort(m_aServerlist[m_ActServerlistType].m_ppServerlist, m_aServerlist[m_ActServerlistType].m_NumServers, CServerBrowserFilter::RESORT_FLAG_FORCE);
+}
+
+void CServerBrowser::TimeoutMasterList(int MasterIndex)
+{
+	CMasterList *pList = &m_aMasterLists[MasterIndex];
+	CNetChunk Packet;
+	mem_zero(&Packet, sizeof(Packet));
+	Packet.m_ClientID = -1;
+	Packet.m_Address = m_pMasterServer->GetAddr(MasterIndex);
+	Packet.m_Flags = NETSENDFLAG_CONNLESS;
+
+	// nothing can build on a list of this master until it sent a complete one
+	pList->m_Epoch = 0;
+	pList->m_Generation = 0;
+
+	if(pList->m_Request == CMasterList::REQUEST_DELTA)
+	{
+		// the master doesn't know deltas, it gets asked for the whole list
+		pList->Reset(CMasterList::REQUEST_LIST);
+		Packet.m_DataSize = sizeof(SERVERBROWSE_GETLIST);
+		Packet.m_pData = SERVERBROWSE_GETLIST;
+		m_pNetClient->Send(&Packet);
+
+		if(Config()->m_Debug)
+			m_pConsole->Print(IConsole::OUTPUT_LEVEL_DEBUG, "client_srvbrowse", "requesting server list");
+	}
+	else if(!pList->m_Full)
+	{
+		// a packet of the changes got lost, start over with the full list
+		unsigned char aData[sizeof(SERVERBROWSE_GETDELTA)+8];
+		mem_copy(aData, SERVERBROWSE_GETDELTA, sizeof(SERVERBROWSE_GETDELTA));
+		PackInt(aData+sizeof(SERVERBROWSE_GETDELTA), 0);
+		PackInt(aData+sizeof(SERVERBROWSE_GETDELTA)+4, 0);
+		pList->Reset(CMasterList::REQUEST_DELTA);
+		Packet.m_DataSize = sizeof(aData);
+		Packet.m_pData = aData;
+		m_pNetClient->Send(&Packet);
+
+		if(Config()->m_Debug)
+			m_pConsole->Print(IConsole::OUTPUT_LEVEL_DEBUG, "client_srvbrowse", "server list changes incomplete, requesting full list");
+	}
+	else
+	{
+		// a packet of the full list got lost, keep the servers without pruning
+		CServerlist *pServerlist = &m_aServerlist[IServerBrowser::TYPE_INTERNET];
+		for(int i = 0; i < pServerlist->m_NumServers; i++)
+			pServerlist->m_ppServerlist[i]->m_FullListMask &= ~(1<<MasterIndex);
+		pList->Reset(CMasterList::REQUEST_NONE);
+	}
+}
+
+int CServerBrowser::CachedMasterMask() const
+{
+	// only masters that keep their lists up to date with deltas
+	int Mask = 0;
+	for(int i = 0; i < IMasterServer::MAX_MASTERSERVERS; i++)
+		if(m_aMasterLists[i].m_Generation)
+			Mask |= 1<<i;
+	return Mask;
+}
+
+void CServerBrowser::UpdateCache()
+{
+	// before the first refresh the cache still holds the loaded list
+	if(!m_CacheApplied)
+		return;
+
+	const CServerlist *pList = &m_aServerlist[IServerBrowser::TYPE_INTERNET];
+	int CachedMask = CachedMasterMask();
+	m_aCachedServers.clear();
+	for(int i = 0; i < pList->m_NumServers; i++)
+	{
+		int MasterMask = pList->m_ppServerlist[i]->m_MasterMask&CachedMask;
+		if(!MasterMask)
+			continue;
+		CCachedServer Server;
+		Server.m_Addr = pList->m_ppServerlist[i]->m_Addr;
+		Server.m_MasterMask = MasterMask;
+		m_aCachedServers.add(Server);
+	}
+}
+
 void CServerBrowser::QueueRequest(CServerEntry *pEntry)
 {
 	// add it to the list of servers that we should request info from
@@ -583,6 +929,7 @@ void CServerBrowser::RequestImpl(const NETADDR &Addr, CServerEntry *pEntry)
 void CServerBrowser::SetInfo(int ServerlistType, CServerEntry *pEntry, const CServerInfo &Info)
 {
 	bool Fav = pEntry->m_Info.m_Favorite;
+	int ServerIndex = pEntry->m_Info.m_ServerIndex;
 	pEntry->m_Info = Info;
 	pEntry->m_Info.m_Flags &= FLAG_PASSWORD|FLAG_TIMESCORE;
 	if(str_comp(pEntry->m_Info.m_aGameType, "DM") == 0 || str_comp(pEntry->m_Info.m_aGameType, "TDM") == 0 || str_comp(pEntry->m_Info.m_aGameType, "CTF") == 0 ||
@@ -598,6 +945,7 @@ void CServerBrowser::SetInfo(int ServerlistType, CServerEntry *pEntry, const CSe
 		str_comp(pEntry->m_Info.m_aMap, "lms1") == 0)
 		pEntry->m_Info.m_Flags |= FLAG_PUREMAP;
 	pEntry->m_Info.m_Favorite = Fav;
+	pEntry->m_Info.m_ServerIndex = ServerIndex;
 	pEntry->m_Info.m_NetAddr = pEntry->m_Addr;
 
 	m_aServerlist[ServerlistType].m_NumPlayers += pEntry->m_Info.m_NumPlayers;
@@ -630,18 +978,45 @@ void CServerBrowser::LoadServerlist()
 		return;
 	}
 
-	// extract server list
+	// extract server list, lists without masks get replaced by the full lists of the masters
 	const json_value &rEntry = (*pJsonData)["serverlist"];
+	const json_value &rMasks = (*pJsonData)["masks"];
+	m_aCachedServers.clear();
 	for(unsigned i = 0; i < rEntry.u.array.length; ++i)
 	{
 		if(rEntry[i].type == json_string)
 		{
-			NETADDR Addr = { 0 };
-			if(!net_addr_from_str(&Addr, rEntry[i]))
-				Set(Addr, SET_MASTER_ADD, -1, 0);
+			CCachedServer Server;
+			mem_zero(&Server, sizeof(Server));
+			if(net_addr_from_str(&Server.m_Addr, rEntry[i]))
+				continue;
+			Server.m_MasterMask = (1<<IMasterServer::MAX_MASTERSERVERS)-1;
+			if(rMasks[i].type == json_integer)
+				Server.m_MasterMask = rMasks[i].u.integer;
+			m_aCachedServers.add(Server);
 		}
 	}
 
+	// the generations of the masters the list is based on
+	const json_value &rMasters = (*pJsonData)["masters"];
+	for(unsigned i = 0; i < rMasters.u.array.length && i < IMasterServer::MAX_MASTERSERVERS; ++i)
+	{
+		if(rMasters[i]["epoch"].type == json_integer && rMasters[i]["generation"].type == json_integer)
+		{
+			m_aMasterLists[i].m_Epoch = rMasters[i]["epoch"].u.integer;
+			m_aMasterLists[i].m_Generation = rMasters[i]["generation"].u.integer;
+		}
+	}
+
+	// servers of masters without a list would never be removed
+	int CachedMask = CachedMasterMask();
+	for(int i = m_aCachedServers.size()-1; i >= 0; i--)
+	{
+		m_aCachedServers[i].m_MasterMask &= CachedMask;
+		if(!m_aCachedServers[i].m_MasterMask)
+			m_aCachedServers.remove_index_fast(i);
+	}
+
 	// clean up
 	json_value_free(pJsonData);
 }
@@ -652,12 +1027,35 @@ void CServerBrowser::SaveServerlist()
 	if(!File)
 		return;
 
+	UpdateCache();
+
 	CJsonWriter Writer(File);
 	Writer.BeginObject(); // root
 	Writer.WriteAttribute("serverlist");
 	Writer.BeginArray();
-	for(int i = 0; i < m_aServerlist[IServerBrowser::TYPE_INTERNET].m_NumServers; ++i)
-		Writer.WriteStrValue(m_aServerlist[IServerBrowser::TYPE_INTERNET].m_ppServerlist[i]->m_Info.m_aAddress);
+	for(int i = 0; i < m_aCachedServers.size(); ++i)
+	{
+		char aAddrStr[NETADDR_MAXSTRSIZE];
+		net_addr_str(&m_aCachedServers[i].m_Addr, aAddrStr, sizeof(aAddrStr), true);
+		Writer.WriteStrValue(aAddrStr);
+	}
+	Writer.EndArray();
+	Writer.WriteAttribute("masks");
+	Writer.BeginArray();
+	for(int i = 0; i < m_aCachedServers.size(); ++i)
+		Writer.WriteIntValue(m_aCachedServers[i].m_MasterMask);
+	Writer.EndArray();
+	Writer.WriteAttribute("masters");
+	Writer.BeginArray();
+	for(int i = 0; i < IMasterServer::MAX_MASTERSERVERS; ++i)
+	{
+		Writer.BeginObject();
+		Writer.WriteAttribute("epoch");
+		Writer.WriteIntValue(m_aMasterLists[i].m_Epoch);
+		Writer.WriteAttribute("generation");
+		Writer.WriteIntValue(m_aMasterLists[i].m_Generation);
+		Writer.EndObject();
+	}
 	Writer.EndArray();
 	Writer.EndObject();
 }
@@ -3,7 +3,11 @@
 #ifndef ENGINE_CLIENT_SERVERBROWSER_H
 #define ENGINE_CLIENT_SERVERBROWSER_H
 
+#include <base/tl/array.h>
+
+#include <engine/masterserver.h>
 #include <engine/serverbrowser.h>
+#include <mastersrv/mastersrv.h>
 #include "serverbrowser_entry.h"
 #include "serverbrowser_fav.h"
 #include "serverbrowser_filter.h"
@@ -13,8 +17,7 @@ class CServerBrowser : public IServerBrowser
 public:
 	enum
 	{
-		SET_MASTER_ADD=1,
-		SET_FAV_ADD,
+		SET_FAV_ADD=1,
 		SET_TOKEN,
 	};
 		
@@ -22,6 +25,8 @@ public:
 	void Init(class CNetClient *pClient, const char *pNetVersion);
 	void Set(const NETADDR &Addr, int SetType, int Token, const CServerInfo *pInfo);
 	void Update(bool ForceResort);	
+	void AddMasterList(int MasterIndex, const CMastersrvAddr *pAddrs, int Num);
+	void AddMasterDelta(int MasterIndex, const unsigned char *pData, int DataSize);
 
 	// interface functions
 	int GetType() { return m_ActServerlistType; };
@@ -102,10 +107,55 @@ private:
 
 	int m_RefreshFlags;
 	int64 m_BroadcastTime;
-	int64 m_MasterRefreshTime;
+
+	// the internet list remembers which masters list which servers, so the
+	// lists can be kept up to date with deltas from one refresh to the next
+	class CMasterList
+	{
+	public:
+		enum
+		{
+			REQUEST_NONE=0,
+			REQUEST_DELTA, // waiting for the first answer
+			REQUEST_ANSWERED,
+			REQUEST_LIST, // the master doesn't know deltas
+		};
+
+		unsigned m_Epoch;
+		unsigned m_Generation; // 0 if there is no list of this master
+
+		int m_Request;
+		int64 m_RequestTime; // of the request or the last answer to it
+		bool m_Full;
+		unsigned m_PendingEpoch;
+		unsigned m_PendingGeneration;
+		int m_NumPackets; // -1 until the first delta packet arrived
+		int m_NumReceived;
+		int m_NumListPackets;
+		array<int> m_aPacketSizes; // -1 for missing packets
+		array<CMastersrvDelta> m_aDeltas;
+
+		void Reset(int Request);
+	} m_aMasterLists[IMasterServer::MAX_MASTERSERVERS];
+
+	struct CCachedServer
+	{
+		NETADDR m_Addr;
+		int m_MasterMask;
+	};
+	array<CCachedServer> m_aCachedServers;
+	bool m_CacheApplied; // the internet list took over the cached servers
 
 	CServerEntry *Add(int ServerlistType, const NETADDR &Addr);
 	CServerEntry *Find(int ServerlistType, const NETADDR &Addr);
+	void Remove(int ServerlistType, CServerEntry *pEntry);
+	bool AddMasterServer(int MasterIndex, const NETADDR &Addr, bool FullList);
+	bool RemoveMasterServer(int MasterIndex, CServerEntry *pEntry);
+	bool PruneMasterList(int MasterIndex);
+	void CompleteMasterList(int MasterIndex);
+	void TimeoutMasterList(int MasterIndex);
+	int CachedMasterMask() const;
+	void UpdateCache();
 	void QueueRequest(CServerEntry *pEntry);
 	void RemoveRequest(CServerEntry *pEntry);
 	void RequestImpl(const NETADDR &Addr, CServerEntry *pEntry);
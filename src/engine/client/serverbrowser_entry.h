@@ -20,6 +20,9 @@ public:
 	int m_TrackID;
 	class CServerInfo m_Info;
 
+	int m_MasterMask; // masters that list the server
+	int m_FullListMask; // masters that sent it with the full list that is coming in
+
 	CServerEntry *m_pNextIp; // ip hashed list
 
 	CServerEntry *m_pPrevReq; // request list
@@ -63,10 +63,23 @@ public:
 		int GetAccessLevel() const { return m_AccessLevel; }
 	};
 
+	class CDeferredStats
+	{
+	public:
+		int m_QueueDepth;
+		int m_MaxQueueDepth;
+		int m_LastExecuted; // lines executed by the last ExecuteDeferred()
+		int64 m_NumDeferred;
+		int64 m_NumExecuted;
+		int64 m_NumDropped; // lines whose context was gone
+	};
+
 	typedef void (*FPrintCallback)(const char *pStr, void *pUser, bool Highlighted);
 	typedef void (*FPossibleCallback)(int Index, const char *pCmd, void *pUser);
 	typedef void (*FCommandCallback)(IResult *pResult, void *pUserData);
 	typedef void (*FChainCommandCallback)(IResult *pResult, void *pUserData, FCommandCallback pfnCallback, void *pCallbackUserData);
+	typedef int (*FGetContextCallback)(void *pUser);
+	typedef bool (*FSetContextCallback)(int Context, void *pUser);
 
 	static void EmptyPossibleCommandCallback(int Index, const char *pCmd, void *pUser) {};
 
@@ -94,6 +107,18 @@ public:
 	virtual void ExecuteLineStroked(int Stroke, const char *pStr) = 0;
 	virtual bool ExecuteFile(const char *pFilename) = 0;
 
+	// with a budget, files stop executing once it is used up and carry their
+	// remaining lines over to the following ExecuteDeferred() calls. the
+	// budget is shared by everything executed between two of these calls,
+	// so call it once per tick
+	virtual void SetExecutionBudget(int Microseconds) = 0;
+	virtual void ExecuteDeferred() = 0;
+	// the owner's state of who issued a line (e.g. the rcon client), deferred
+	// lines are executed with the context they were issued with. they are
+	// dropped if the set callback rejects the context
+	virtual void SetContextCallbacks(FGetContextCallback pfnGetContext, FSetContextCallback pfnSetContext, void *pUser) = 0;
+	virtual void GetDeferredStats(CDeferredStats *pStats) const = 0;
+
 	virtual int RegisterPrintCallback(int OutputLevel, FPrintCallback pfnPrintCallback, void *pUserData) = 0;
 	virtual void SetPrintOutputLevel(int Index, int OutputLevel) = 0;
 	virtual void Print(int Level, const char *pFrom, const char *pStr, bool Highlighted=false) = 0;
@@ -25,6 +25,12 @@ struct CDemoHeader
 	unsigned char m_aTimelineMarkers[MAX_TIMELINE_MARKERS][4];
 };
 
+// since version 5, directly behind the header
+struct CDemoHeaderExt
+{
+	unsigned char m_aIndexOffset[4]; // file offset of the keyframe index, 0 if there is none
+};
+
 class IDemoPlayer : public IInterface
 {
 	MACRO_INTERFACE("demoplayer", 0)
@@ -0,0 +1,87 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+
+#include <base/system.h>
+
+#include <engine/config.h>
+#include <engine/console.h>
+#include <engine/engine.h>
+#include <engine/map.h>
+#include <engine/masterserver.h>
+
+#include <engine/shared/demo.h>
+#include <engine/shared/econ.h>
+#include <engine/shared/mapchecker.h>
+#include <engine/shared/netban.h>
+#include <engine/shared/network.h>
+
+#include "register.h"
+#include "server.h"
+
+#if defined(CONF_FAMILY_WINDOWS)
+	#define WIN32_LEAN_AND_MEAN
+	#include <windows.h>
+#endif
+
+int main(int argc, const char **argv) // ignore_convention
+{
+#if defined(CONF_FAMILY_WINDOWS)
+	for(int i = 1; i < argc; i++) // ignore_convention
+	{
+		if(str_comp("-s", argv[i]) == 0 || str_comp("--silent", argv[i]) == 0) // ignore_convention
+		{
+			ShowWindow(GetConsoleWindow(), SW_HIDE);
+			break;
+		}
+	}
+#endif
+
+	bool UseDefaultConfig = false;
+	for(int i = 1; i < argc; i++) // ignore_convention
+	{
+		if(str_comp("-d", argv[i]) == 0 || str_comp("--default", argv[i]) == 0) // ignore_convention
+		{
+			UseDefaultConfig = true;
+			break;
+		}
+	}
+
+	if(secure_random_init() != 0)
+	{
+		dbg_msg("secure", "could not initialize secure RNG");
+		return -1;
+	}
+
+	CServerKernel Kernel;
+	if(!Kernel.Init("Teeworlds_Server", argc, argv)) // ignore_convention
+		return -1;
+
+	CServer *pServer = Kernel.m_pServer;
+	IConsole *pConsole = Kernel.m_pConsole;
+	IConfigManager *pConfigManager = Kernel.m_pConfigManager;
+	Kernel.m_pEngineMasterServer->Load();
+
+	if(!UseDefaultConfig)
+	{
+		// register all console commands
+		pServer->RegisterCommands();
+
+		// execute autoexec file
+		pConsole->ExecuteFile("autoexec.cfg");
+
+		// parse the command line arguments
+		if(argc > 1) // ignore_convention
+			pConsole->ParseArguments(argc-1, &argv[1]); // ignore_convention
+	}
+
+	// restore empty config strings to their defaults
+	pConfigManager->RestoreStrings();
+
+	Kernel.m_pEngine->InitLogfile();
+
+	pServer->InitRconPasswordIfUnset();
+
+	// run the server
+	dbg_msg("server", "starting...");
+	return pServer->Run();
+}
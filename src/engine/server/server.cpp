@@ -24,6 +24,7 @@
 #include <engine/shared/packer.h>
 #include <engine/shared/protocol.h>
 #include <engine/shared/snapshot.h>
+#include <engine/shared/tickprofiler.h>
 
 #include <mastersrv/mastersrv.h>
 
@@ -57,90 +58,139 @@ static void StrRtrim(char *pStr)
 
 CSnapIDPool::CSnapIDPool()
 {
+	m_NumIDs = MIN_IDS;
+	m_pIDs = (CID *)mem_alloc(m_NumIDs*sizeof(CID), 1);
 	Reset();
 }
 
+CSnapIDPool::~CSnapIDPool()
+{
+	mem_free(m_pIDs);
+}
+
 void CSnapIDPool::Reset()
 {
-	for(int i = 0; i < MAX_IDS; i++)
+	for(int i = 0; i < m_NumIDs; i++)
 	{
-		m_aIDs[i].m_Next = i+1;
-		m_aIDs[i].m_State = 0;
+		m_pIDs[i].m_Next = i+1;
+		m_pIDs[i].m_State = STATE_FREE;
 	}
 
-	m_aIDs[MAX_IDS-1].m_Next = -1;
+	m_pIDs[m_NumIDs-1].m_Next = -1;
 	m_FirstFree = 0;
-	m_FirstTimed = -1;
-	m_LastTimed = -1;
+	for(int i = 0; i < NUM_SLOTS; i++)
+	{
+		m_aSlots[i].m_First = -1;
+		m_aSlots[i].m_Last = -1;
+		m_aSlots[i].m_Num = 0;
+	}
+	m_WheelSecond = time_get()/time_freq();
 	m_Usage = 0;
 	m_InUsage = 0;
+	m_PeakUsage = 0;
+	m_PeakInUsage = 0;
 }
 
+void CSnapIDPool::Grow()
+{
+	if(m_NumIDs == MAX_IDS)
+		return;
+
+	int NewNum = min(m_NumIDs*2, (int)MAX_IDS);
+	CID *pNewIDs = (CID *)mem_alloc(NewNum*sizeof(CID), 1);
+	mem_copy(pNewIDs, m_pIDs, m_NumIDs*sizeof(CID));
+	mem_free(m_pIDs);
+	m_pIDs = pNewIDs;
+
+	// put the new ids in front of the free list
+	for(int i = m_NumIDs; i < NewNum; i++)
+	{
+		m_pIDs[i].m_Next = i+1;
+		m_pIDs[i].m_State = STATE_FREE;
+	}
+	m_pIDs[NewNum-1].m_Next = m_FirstFree;
+	m_FirstFree = m_NumIDs;
+	m_NumIDs = NewNum;
+}
 
-void CSnapIDPool::RemoveFirstTimeout()
+void CSnapIDPool::ReleaseSlot(int Slot)
 {
-	int NextTimed = m_aIDs[m_FirstTimed].m_Next;
+	CSlot *pSlot = &m_aSlots[Slot];
+	if(pSlot->m_First == -1)
+		return;
+
+	for(int ID = pSlot->m_First; ID != -1; ID = m_pIDs[ID].m_Next)
+		m_pIDs[ID].m_State = STATE_FREE;
 
-	// add it to the free list
-	m_aIDs[m_FirstTimed].m_Next = m_FirstFree;
-	m_aIDs[m_FirstTimed].m_State = 0;
-	m_FirstFree = m_FirstTimed;
+	// add the whole slot to the free list
+	m_pIDs[pSlot->m_Last].m_Next = m_FirstFree;
+	m_FirstFree = pSlot->m_First;
+	m_Usage -= pSlot->m_Num;
 
-	// remove it from the timed list
-	m_FirstTimed = NextTimed;
-	if(m_FirstTimed == -1)
-		m_LastTimed = -1;
+	pSlot->m_First = -1;
+	pSlot->m_Last = -1;
+	pSlot->m_Num = 0;
+}
 
-	m_Usage--;
+void CSnapIDPool::ReleaseTimeouts(int64 Second)
+{
+	// every slot is passed at most once, ids that timed out long ago are
+	// released together with the rest
+	int Steps = (int)min(Second-m_WheelSecond, (int64)NUM_SLOTS);
+	for(int i = 1; i <= Steps; i++)
+		ReleaseSlot((m_WheelSecond+i)%NUM_SLOTS);
+	if(Second > m_WheelSecond)
+		m_WheelSecond = Second;
 }
 
 int CSnapIDPool::NewID()
 {
-	int64 Now = time_get();
+	ReleaseTimeouts(time_get()/time_freq());
 
-	// process timed ids
-	while(m_FirstTimed != -1 && m_aIDs[m_FirstTimed].m_Timeout < Now)
-		RemoveFirstTimeout();
+	if(m_FirstFree == -1)
+		Grow();
 
 	int ID = m_FirstFree;
 	dbg_assert(ID != -1, "id error");
 	if(ID == -1)
 		return ID;
-	m_FirstFree = m_aIDs[m_FirstFree].m_Next;
-	m_aIDs[ID].m_State = 1;
+	m_FirstFree = m_pIDs[m_FirstFree].m_Next;
+	m_pIDs[ID].m_State = STATE_ALLOCATED;
 	m_Usage++;
 	m_InUsage++;
+	m_PeakUsage = max(m_PeakUsage, m_Usage);
+	m_PeakInUsage = max(m_PeakInUsage, m_InUsage);
 	return ID;
 }
 
 void CSnapIDPool::TimeoutIDs()
 {
-	// process timed ids
-	while(m_FirstTimed != -1)
-		RemoveFirstTimeout();
+	for(int i = 0; i < NUM_SLOTS; i++)
+		ReleaseSlot(i);
 }
 
 void CSnapIDPool::FreeID(int ID)
 {
 	if(ID < 0)
 		return;
-	dbg_assert(m_aIDs[ID].m_State == 1, "id is not allocated");
+	dbg_assert(ID < m_NumIDs && m_pIDs[ID].m_State == STATE_ALLOCATED, "id is not allocated");
+
+	// advance the wheel first, the slot might still hold ids of a previous round
+	int64 Second = time_get()/time_freq();
+	ReleaseTimeouts(Second);
 
 	m_InUsage--;
-	m_aIDs[ID].m_State = 2;
-	m_aIDs[ID].m_Timeout = time_get()+time_freq()*5;
-	m_aIDs[ID].m_Next = -1;
+	m_pIDs[ID].m_State = STATE_TIMED;
+	m_pIDs[ID].m_Next = -1;
 
-	if(m_LastTimed != -1)
-	{
-		m_aIDs[m_LastTimed].m_Next = ID;
-		m_LastTimed = ID;
-	}
+	// the second the id is freed in has already begun, so wait one more
+	CSlot *pSlot = &m_aSlots[(Second+TIMEOUT+1)%NUM_SLOTS];
+	if(pSlot->m_Last != -1)
+		m_pIDs[pSlot->m_Last].m_Next = ID;
 	else
-	{
-		m_FirstTimed = ID;
-		m_LastTimed = ID;
-	}
+		pSlot->m_First = ID;
+	pSlot->m_Last = ID;
+	pSlot->m_Num++;
 }
 
 
@@ -293,6 +343,9 @@ CServer::CServer() : m_DemoRecorder(&m_SnapshotDelta)
 	m_RconPasswordSet = 0;
 	m_GeneratedRconPassword = 0;
 
+	m_NextPerfStatsTime = 0;
+	m_pNetTransport = 0;
+
 	Init();
 }
 
@@ -535,8 +588,12 @@ int CServer::SendMsg(CMsgPacker *pMsg, int Flags, int ClientID)
 
 void CServer::DoSnapshot()
 {
+	int64 PhaseStart = time_get();
 	GameServer()->OnPreSnap();
 
+	// coalesce all chunks of a client into as few packets as possible
+	m_NetServer.BeginSendBatch();
+
 	// create snapshot for demo recording
 	if(m_DemoRecorder.IsRecording())
 	{
@@ -551,6 +608,7 @@ void CServer::DoSnapshot()
 		// write snapshot
 		m_DemoRecorder.RecordSnapshot(Tick(), aData, SnapshotSize);
 	}
+	m_TickProfiler.Add(CTickProfiler::PHASE_SNAP, time_get()-PhaseStart);
 
 	// create snapshots for all clients
 	for(int i = 0; i < MAX_CLIENTS; i++)
@@ -580,6 +638,7 @@ void CServer::DoSnapshot()
 			int DeltaTick = -1;
 			int DeltaSize;
 
+			PhaseStart = time_get();
 			m_SnapshotBuilder.Init();
 
 			GameServer()->OnSnap(i);
@@ -595,6 +654,10 @@ void CServer::DoSnapshot()
 			// save it the snapshot
 			m_aClients[i].m_Snapshots.Add(m_CurrentGameTick, time_get(), SnapshotSize, pData, 0);
 
+			int64 Now = time_get();
+			m_TickProfiler.Add(CTickProfiler::PHASE_SNAP, Now-PhaseStart);
+			PhaseStart = Now;
+
 			// find snapshot that we can perform delta against
 			EmptySnap.Clear();
 
@@ -613,6 +676,10 @@ void CServer::DoSnapshot()
 			// create delta
 			DeltaSize = m_SnapshotDelta.CreateDelta(pDeltashot, pData, aDeltaData);
 
+			Now = time_get();
+			m_TickProfiler.Add(CTickProfiler::PHASE_DELTA, Now-PhaseStart);
+			PhaseStart = Now;
+
 			if(DeltaSize)
 			{
 				// compress it
@@ -623,6 +690,10 @@ void CServer::DoSnapshot()
 				SnapshotSize = CVariableInt::Compress(aDeltaData, DeltaSize, aCompData, sizeof(aCompData));
 				NumPackets = (SnapshotSize+MaxSize-1)/MaxSize;
 
+				Now = time_get();
+				m_TickProfiler.Add(CTickProfiler::PHASE_COMPRESS, Now-PhaseStart);
+				PhaseStart = Now;
+
 				for(int n = 0, Left = SnapshotSize; Left > 0; n++)
 				{
 					int Chunk = Left < MaxSize ? Left : MaxSize;
@@ -659,10 +730,18 @@ void CServer::DoSnapshot()
 				Msg.AddInt(m_CurrentGameTick-DeltaTick);
 				SendMsg(&Msg, MSGFLAG_FLUSH, i);
 			}
+			m_TickProfiler.Add(CTickProfiler::PHASE_SEND, time_get()-PhaseStart);
 		}
 	}
 
+	// send the packets, paced over the tick
+	PhaseStart = time_get();
+	m_NetServer.EndSendBatch(time_freq()/SERVER_TICK_SPEED*Config()->m_SvSnapPacing/100);
+	m_TickProfiler.Add(CTickProfiler::PHASE_SEND, time_get()-PhaseStart);
+
+	PhaseStart = time_get();
 	GameServer()->OnPostSnap();
+	m_TickProfiler.Add(CTickProfiler::PHASE_SNAP, time_get()-PhaseStart);
 }
 
 
@@ -765,6 +844,30 @@ void CServer::SendRconLineAuthed(const char *pLine, void *pUser, bool Highlighte
 	ReentryGuard--;
 }
 
+int CServer::GetConsoleContext(void *pUser)
+{
+	// rcon clients keep the auth level they issued the line with
+	CServer *pThis = (CServer *)pUser;
+	if(pThis->m_RconClientID >= 0)
+		return pThis->m_RconClientID | (pThis->m_RconAuthLevel<<8);
+	return pThis->m_RconClientID;
+}
+
+bool CServer::SetConsoleContext(int Context, void *pUser)
+{
+	CServer *pThis = (CServer *)pUser;
+	int ClientID = Context >= 0 ? Context&0xff : Context;
+	int AuthLevel = Context >= 0 ? Context>>8 : AUTHED_ADMIN;
+
+	// the rcon client may have left or lost its rights since the line was issued
+	if(ClientID >= MAX_CLIENTS || (ClientID >= 0 && (pThis->m_aClients[ClientID].m_State == CClient::STATE_EMPTY || pThis->m_aClients[ClientID].m_Authed != AuthLevel)))
+		return false;
+
+	pThis->m_RconClientID = ClientID;
+	pThis->m_RconAuthLevel = AuthLevel;
+	return true;
+}
+
 void CServer::SendRconCmdAdd(const IConsole::CCommandInfo *pCommandInfo, int ClientID)
 {
 	CMsgPacker Msg(NETMSG_RCON_CMD_ADD, true);
@@ -1315,10 +1418,11 @@ void CServer::InitInterfaces(CConfig *pConfig, IConsole *pConsole, IGameServer *
 	m_pStorage = pStorage;
 }
 
-int CServer::Run()
+int CServer::Start()
 {
 	//
 	m_PrintCBIndex = Console()->RegisterPrintCallback(Config()->m_ConsoleOutputLevel, SendRconLineAuthed, this);
+	Console()->SetContextCallbacks(GetConsoleContext, SetConsoleContext, this);
 
 	// list maps
 	m_pMapListHeap = new CHeap();
@@ -1351,7 +1455,7 @@ int CServer::Run()
 	}
 
 	if(!m_NetServer.Open(BindAddr, Config(), Console(), Kernel()->RequestInterface<IEngine>(), &m_ServerBan,
-		Config()->m_SvMaxClients, Config()->m_SvMaxClientsPerIP, NewClientCallback, DelClientCallback, this))
+		Config()->m_SvMaxClients, Config()->m_SvMaxClientsPerIP, NewClientCallback, DelClientCallback, this, m_pNetTransport))
 	{
 		dbg_msg("server", "couldn't open socket. port %d might already be in use", Config()->m_SvPort);
 		return -1;
@@ -1383,98 +1487,53 @@ int CServer::Run()
 		dbg_msg("server", "+-------------------------+");
 	}
 
-	// start game
-	{
-		m_GameStartTime = time_get();
-
-		while(m_RunServer)
-		{
-			// load new map
-			if(m_MapReload || m_CurrentGameTick >= 0x6FFFFFFF) //	force reload to make sure the ticks stay within a valid range
-			{
-				m_MapReload = false;
-
-				// load map
-				if(LoadMap(Config()->m_SvMap))
-				{
-					// new map loaded
-					bool aSpecs[MAX_CLIENTS];
-					for(int c = 0; c < MAX_CLIENTS; c++)
-						aSpecs[c] = GameServer()->IsClientSpectator(c);
+	m_GameStartTime = time_get();
+	return 0;
+}
 
-					GameServer()->OnShutdown();
+void CServer::DoTick()
+{
+	m_CurrentGameTick++;
 
-					for(int c = 0; c < MAX_CLIENTS; c++)
-					{
-						if(m_aClients[c].m_State <= CClient::STATE_AUTH)
-							continue;
+	m_TickProfiler.BeginTick(m_CurrentGameTick);
+	int64 PhaseStart = time_get();
 
-						SendMap(c);
-						m_aClients[c].Reset();
-						m_aClients[c].m_State = aSpecs[c] ? CClient::STATE_CONNECTING_AS_SPEC : CClient::STATE_CONNECTING;
-					}
+	// queued external console commands
+	m_Econ.ExecuteCommands();
 
-					m_GameStartTime = time_get();
-					m_CurrentGameTick = 0;
-					Kernel()->ReregisterInterface(GameServer());
-					GameServer()->OnInit();
-				}
-				else
-				{
-					str_format(aBuf, sizeof(aBuf), "failed to load map. mapname='%s'", Config()->m_SvMap);
-					Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
-					str_copy(Config()->m_SvMap, m_aCurrentMap, sizeof(Config()->m_SvMap));
-				}
-			}
+	// continue long running config files, the budget only applies
+	// once the server runs so the startup configs execute in full
+	Console()->SetExecutionBudget(Config()->m_SvConsoleBudget);
+	Console()->ExecuteDeferred();
 
-			int64 Now = time_get();
-			bool NewTicks = false;
-			bool ShouldSnap = false;
-			while(Now > TickStartTime(m_CurrentGameTick+1))
+	// apply new input
+	for(int c = 0; c < MAX_CLIENTS; c++)
+	{
+		if(m_aClients[c].m_State == CClient::STATE_EMPTY)
+			continue;
+		for(int i = 0; i < 200; i++)
+		{
+			if(m_aClients[c].m_aInputs[i].m_GameTick == Tick())
 			{
-				m_CurrentGameTick++;
-				NewTicks = true;
-				if((m_CurrentGameTick%2) == 0)
-					ShouldSnap = true;
-
-				// apply new input
-				for(int c = 0; c < MAX_CLIENTS; c++)
-				{
-					if(m_aClients[c].m_State == CClient::STATE_EMPTY)
-						continue;
-					for(int i = 0; i < 200; i++)
-					{
-						if(m_aClients[c].m_aInputs[i].m_GameTick == Tick())
-						{
-							if(m_aClients[c].m_State == CClient::STATE_INGAME)
-								GameServer()->OnClientPredictedInput(c, m_aClients[c].m_aInputs[i].m_aData);
-							break;
-						}
-					}
-				}
-
-				GameServer()->OnTick();
+				if(m_aClients[c].m_State == CClient::STATE_INGAME)
+					GameServer()->OnClientPredictedInput(c, m_aClients[c].m_aInputs[i].m_aData);
+				break;
 			}
+		}
+	}
 
-			// snap game
-			if(NewTicks)
-			{
-				if(Config()->m_SvHighBandwidth || ShouldSnap)
-					DoSnapshot();
-
-				UpdateClientRconCommands();
-				UpdateClientMapListEntries();
-			}
+	int64 TickStart = time_get();
+	m_TickProfiler.Add(CTickProfiler::PHASE_INPUT, TickStart-PhaseStart);
 
-			// master server stuff
-			m_Register.RegisterUpdate(m_NetServer.NetType());
+	GameServer()->OnTick();
+	m_TickProfiler.Add(CTickProfiler::PHASE_TICK, time_get()-TickStart);
+}
 
-			PumpNetwork();
+void CServer::Stop()
+{
+	// finish the demo, this also waits for its writer
+	m_DemoRecorder.Stop();
 
-			// wait for incoming data
-			m_NetServer.Wait(clamp(int((TickStartTime(m_CurrentGameTick+1)-time_get())*1000/time_freq()), 1, 1000/SERVER_TICK_SPEED/2));
-		}
-	}
 	// disconnect all clients on shutdown
 	m_NetServer.Close();
 	m_Econ.Shutdown();
@@ -1492,6 +1551,108 @@ int CServer::Run()
 		delete m_pMapListHeap;
 		m_pMapListHeap = 0;
 	}
+}
+
+int CServer::Run()
+{
+	if(Start() != 0)
+		return -1;
+
+	while(m_RunServer)
+	{
+		// load new map
+		if(m_MapReload || m_CurrentGameTick >= 0x6FFFFFFF) //	force reload to make sure the ticks stay within a valid range
+		{
+			m_MapReload = false;
+
+			// load map
+			if(LoadMap(Config()->m_SvMap))
+			{
+				// new map loaded
+				bool aSpecs[MAX_CLIENTS];
+				for(int c = 0; c < MAX_CLIENTS; c++)
+					aSpecs[c] = GameServer()->IsClientSpectator(c);
+
+				GameServer()->OnShutdown();
+
+				for(int c = 0; c < MAX_CLIENTS; c++)
+				{
+					if(m_aClients[c].m_State <= CClient::STATE_AUTH)
+						continue;
+
+					SendMap(c);
+					m_aClients[c].Reset();
+					m_aClients[c].m_State = aSpecs[c] ? CClient::STATE_CONNECTING_AS_SPEC : CClient::STATE_CONNECTING;
+				}
+
+				m_GameStartTime = time_get();
+				m_CurrentGameTick = 0;
+				Kernel()->ReregisterInterface(GameServer());
+				GameServer()->OnInit();
+			}
+			else
+			{
+				char aBuf[256];
+				str_format(aBuf, sizeof(aBuf), "failed to load map. mapname='%s'", Config()->m_SvMap);
+				Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
+				str_copy(Config()->m_SvMap, m_aCurrentMap, sizeof(Config()->m_SvMap));
+			}
+		}
+
+		int64 Now = time_get();
+		bool NewTicks = false;
+		bool ShouldSnap = false;
+		while(Now > TickStartTime(m_CurrentGameTick+1))
+		{
+			DoTick();
+			NewTicks = true;
+			if((m_CurrentGameTick%2) == 0)
+				ShouldSnap = true;
+		}
+
+		// snap game
+		if(NewTicks)
+		{
+			if(Config()->m_SvHighBandwidth || ShouldSnap)
+				DoSnapshot();
+
+			UpdateClientRconCommands();
+			UpdateClientMapListEntries();
+		}
+
+		int64 PhaseStart = time_get();
+
+		// master server stuff
+		m_Register.RegisterUpdate(m_NetServer.NetType());
+
+		PumpNetwork();
+
+		int64 WaitStart = time_get();
+		m_TickProfiler.Add(CTickProfiler::PHASE_NETWORK, WaitStart-PhaseStart);
+
+		// stream the tick profile to the external console
+		if(Config()->m_EcPerfStats && WaitStart > m_NextPerfStatsTime)
+		{
+			char aLine[512];
+			m_TickProfiler.FormatLine(aLine, sizeof(aLine), Config()->m_EcPerfStats*SERVER_TICK_SPEED);
+			IConsole::CDeferredStats ConsoleStats;
+			Console()->GetDeferredStats(&ConsoleStats);
+			char aQueue[64];
+			str_format(aQueue, sizeof(aQueue), " console_queue=%d/%d", ConsoleStats.m_QueueDepth, ConsoleStats.m_MaxQueueDepth);
+			str_append(aLine, aQueue, sizeof(aLine));
+			m_Econ.Send(-1, aLine);
+			m_NextPerfStatsTime = WaitStart + Config()->m_EcPerfStats*time_freq();
+		}
+
+		// wait for incoming data or the next paced send
+		int64 WaitUntil = TickStartTime(m_CurrentGameTick+1);
+		if(m_NetServer.NextScheduledFlush() && m_NetServer.NextScheduledFlush() < WaitUntil)
+			WaitUntil = m_NetServer.NextScheduledFlush();
+		m_NetServer.Wait(clamp(int((WaitUntil-WaitStart)*1000/time_freq()), 1, 1000/SERVER_TICK_SPEED/2));
+		m_TickProfiler.Add(CTickProfiler::PHASE_SLACK, time_get()-WaitStart);
+	}
+
+	Stop();
 	return 0;
 }
 
@@ -1578,6 +1739,16 @@ void CServer::ConStatus(IConsole::IResult *pResult, void *pUser)
 	}
 }
 
+void CServer::ConSnapIDs(IConsole::IResult *pResult, void *pUser)
+{
+	CServer *pThis = (CServer *)pUser;
+	const CSnapIDPool *pPool = &pThis->m_IDPool;
+	char aBuf[256];
+	str_format(aBuf, sizeof(aBuf), "snap ids: live=%d timed=%d capacity=%d peak_live=%d peak=%d",
+		pPool->NumLive(), pPool->NumTimed(), pPool->Capacity(), pPool->PeakLive(), pPool->PeakUsage());
+	pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
+}
+
 void CServer::ConShutdown(IConsole::IResult *pResult, void *pUser)
 {
 	((CServer *)pUser)->m_RunServer = false;
@@ -1592,6 +1763,8 @@ void CServer::DemoRecorder_HandleAutoStart()
 		char aDate[20];
 		str_timestamp(aDate, sizeof(aDate));
 		str_format(aFilename, sizeof(aFilename), "demos/%s_%s.demo", "auto/autorecord", aDate);
+		m_DemoRecorder.SetKeyFrameInterval(Config()->m_DemoKeyframeInterval*SERVER_TICK_SPEED);
+		m_DemoRecorder.SetBlockCompression(Config()->m_DemoBlockCompression);
 		m_DemoRecorder.Start(Storage(), m_pConsole, aFilename, GameServer()->NetVersion(), m_aCurrentMap, m_CurrentMapSha256, m_CurrentMapCrc, "server");
 		if(Config()->m_SvAutoDemoMax)
 		{
@@ -1619,6 +1792,8 @@ void CServer::ConRecord(IConsole::IResult *pResult, void *pUser)
 		str_timestamp(aDate, sizeof(aDate));
 		str_format(aFilename, sizeof(aFilename), "demos/demo_%s.demo", aDate);
 	}
+	pServer->m_DemoRecorder.SetKeyFrameInterval(pServer->Config()->m_DemoKeyframeInterval*SERVER_TICK_SPEED);
+	pServer->m_DemoRecorder.SetBlockCompression(pServer->Config()->m_DemoBlockCompression);
 	pServer->m_DemoRecorder.Start(pServer->Storage(), pServer->Console(), aFilename, pServer->GameServer()->NetVersion(), pServer->m_aCurrentMap, pServer->m_CurrentMapSha256, pServer->m_CurrentMapCrc, "server");
 }
 
@@ -1632,6 +1807,46 @@ void CServer::ConMapReload(IConsole::IResult *pResult, void *pUser)
 	((CServer *)pUser)->m_MapReload = true;
 }
 
+void CServer::ConPerfStats(IConsole::IResult *pResult, void *pUser)
+{
+	CServer *pThis = (CServer *)pUser;
+	int NumTicks = pResult->NumArguments() ? max(pResult->GetInteger(0), 1) : SERVER_TICK_SPEED*5;
+
+	CTickProfiler::CPhaseStats aStats[CTickProfiler::NUM_PHASES];
+	int Num = pThis->m_TickProfiler.GetStats(aStats, NumTicks);
+
+	char aBuf[256];
+	str_format(aBuf, sizeof(aBuf), "tick phase times in microseconds over the last %d ticks", Num);
+	pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "perf", aBuf);
+	for(int p = 0; p < CTickProfiler::NUM_PHASES; p++)
+	{
+		str_format(aBuf, sizeof(aBuf), "%-8s avg=%d p50=%d p90=%d p99=%d max=%d", CTickProfiler::PhaseName(p),
+			aStats[p].m_Avg, aStats[p].m_P50, aStats[p].m_P90, aStats[p].m_P99, aStats[p].m_Max);
+		pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "perf", aBuf);
+	}
+
+	// histogram since the last reset, skipping empty buckets
+	for(int p = 0; p < CTickProfiler::NUM_PHASES; p++)
+	{
+		str_format(aBuf, sizeof(aBuf), "%-8s", CTickProfiler::PhaseName(p));
+		for(int b = 0; b < CTickProfiler::NUM_BUCKETS; b++)
+		{
+			unsigned Count = pThis->m_TickProfiler.HistogramCount(p, b);
+			if(!Count)
+				continue;
+			char aBucket[32];
+			str_format(aBucket, sizeof(aBucket), " <%d:%u", 1<<b, Count);
+			str_append(aBuf, aBucket, sizeof(aBuf));
+		}
+		pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "perf", aBuf);
+	}
+}
+
+void CServer::ConPerfStatsReset(IConsole::IResult *pResult, void *pUser)
+{
+	((CServer *)pUser)->m_TickProfiler.Reset();
+}
+
 void CServer::ConLogout(IConsole::IResult *pResult, void *pUser)
 {
 	CServer *pServer = (CServer *)pUser;
@@ -1757,6 +1972,7 @@ void CServer::RegisterCommands()
 	// register console commands
 	Console()->Register("kick", "i[id] ?r[reason]", CFGFLAG_SERVER, ConKick, this, "Kick player with specified id for any reason");
 	Console()->Register("status", "", CFGFLAG_SERVER, ConStatus, this, "List players");
+	Console()->Register("snap_ids", "", CFGFLAG_SERVER, ConSnapIDs, this, "Show the usage of the snapshot ids");
 	Console()->Register("shutdown", "", CFGFLAG_SERVER, ConShutdown, this, "Shut down");
 	Console()->Register("logout", "", CFGFLAG_SERVER|CFGFLAG_BASICACCESS, ConLogout, this, "Logout of rcon");
 
@@ -1765,6 +1981,9 @@ void CServer::RegisterCommands()
 
 	Console()->Register("reload", "", CFGFLAG_SERVER, ConMapReload, this, "Reload the map");
 
+	Console()->Register("perf_stats", "?i[ticks]", CFGFLAG_SERVER, ConPerfStats, this, "Show the time spent in the phases of the last ticks");
+	Console()->Register("perf_stats_reset", "", CFGFLAG_SERVER, ConPerfStatsReset, this, "Reset the tick profiler");
+
 	Console()->Chain("sv_name", ConchainSpecialInfoupdate, this);
 	Console()->Chain("password", ConchainSpecialInfoupdate, this);
 
@@ -1806,111 +2025,72 @@ void CServer::SnapSetStaticsize(int ItemType, int Size)
 	m_SnapshotDelta.SetStaticsize(ItemType, Size);
 }
 
-static CServer *CreateServer() { return new CServer(); }
-
-int main(int argc, const char **argv) // ignore_convention
+CServerKernel::CServerKernel()
 {
-#if defined(CONF_FAMILY_WINDOWS)
-	for(int i = 1; i < argc; i++) // ignore_convention
-	{
-		if(str_comp("-s", argv[i]) == 0 || str_comp("--silent", argv[i]) == 0) // ignore_convention
-		{
-			ShowWindow(GetConsoleWindow(), SW_HIDE);
-			break;
-		}
-	}
-#endif
-
-	bool UseDefaultConfig = false;
-	for(int i = 1; i < argc; i++) // ignore_convention
-	{
-		if(str_comp("-d", argv[i]) == 0 || str_comp("--default", argv[i]) == 0) // ignore_convention
-		{
-			UseDefaultConfig = true;
-			break;
-		}
-	}
+	m_pServer = 0;
+	m_pKernel = 0;
+	m_pEngine = 0;
+	m_pEngineMap = 0;
+	m_pGameServer = 0;
+	m_pConsole = 0;
+	m_pEngineMasterServer = 0;
+	m_pStorage = 0;
+	m_pConfigManager = 0;
+}
 
-	if(secure_random_init() != 0)
-	{
-		dbg_msg("secure", "could not initialize secure RNG");
-		return -1;
-	}
+CServerKernel::~CServerKernel()
+{
+	delete m_pServer;
+	delete m_pKernel;
+	delete m_pEngine;
+	delete m_pEngineMap;
+	delete m_pGameServer;
+	delete m_pConsole;
+	delete m_pEngineMasterServer;
+	delete m_pStorage;
+	delete m_pConfigManager;
+}
 
-	CServer *pServer = CreateServer();
-	IKernel *pKernel = IKernel::Create();
+bool CServerKernel::Init(const char *pAppname, int argc, const char **argv) // ignore_convention
+{
+	m_pServer = new CServer();
+	m_pKernel = IKernel::Create();
 
 	// create the components
 	int FlagMask = CFGFLAG_SERVER|CFGFLAG_ECON;
-	IEngine *pEngine = CreateEngine("Teeworlds_Server");
-	IEngineMap *pEngineMap = CreateEngineMap();
-	IGameServer *pGameServer = CreateGameServer();
-	IConsole *pConsole = CreateConsole(CFGFLAG_SERVER|CFGFLAG_ECON);
-	IEngineMasterServer *pEngineMasterServer = CreateEngineMasterServer();
-	IStorage *pStorage = CreateStorage("Teeworlds", IStorage::STORAGETYPE_SERVER, argc, argv); // ignore_convention
-	IConfigManager *pConfigManager = CreateConfigManager();
+	m_pEngine = CreateEngine(pAppname);
+	m_pEngineMap = CreateEngineMap();
+	m_pGameServer = CreateGameServer();
+	m_pConsole = CreateConsole(FlagMask);
+	m_pEngineMasterServer = CreateEngineMasterServer();
+	m_pStorage = CreateStorage("Teeworlds", IStorage::STORAGETYPE_SERVER, argc, argv); // ignore_convention
+	m_pConfigManager = CreateConfigManager();
 
-	pServer->InitRegister(&pServer->m_NetServer, pEngineMasterServer, pConfigManager->Values(), pConsole);
+	m_pServer->InitRegister(&m_pServer->m_NetServer, m_pEngineMasterServer, m_pConfigManager->Values(), m_pConsole);
 
 	{
 		bool RegisterFail = false;
 
-		RegisterFail = RegisterFail || !pKernel->RegisterInterface(pServer); // register as both
-		RegisterFail = RegisterFail || !pKernel->RegisterInterface(pEngine);
-		RegisterFail = RegisterFail || !pKernel->RegisterInterface(static_cast<IEngineMap*>(pEngineMap)); // register as both
-		RegisterFail = RegisterFail || !pKernel->RegisterInterface(static_cast<IMap*>(pEngineMap));
-		RegisterFail = RegisterFail || !pKernel->RegisterInterface(pGameServer);
-		RegisterFail = RegisterFail || !pKernel->RegisterInterface(pConsole);
-		RegisterFail = RegisterFail || !pKernel->RegisterInterface(pStorage);
-		RegisterFail = RegisterFail || !pKernel->RegisterInterface(pConfigManager);
-		RegisterFail = RegisterFail || !pKernel->RegisterInterface(static_cast<IEngineMasterServer*>(pEngineMasterServer)); // register as both
-		RegisterFail = RegisterFail || !pKernel->RegisterInterface(static_cast<IMasterServer*>(pEngineMasterServer));
+		RegisterFail = RegisterFail || !m_pKernel->RegisterInterface(m_pServer); // register as both
+		RegisterFail = RegisterFail || !m_pKernel->RegisterInterface(m_pEngine);
+		RegisterFail = RegisterFail || !m_pKernel->RegisterInterface(static_cast<IEngineMap*>(m_pEngineMap)); // register as both
+		RegisterFail = RegisterFail || !m_pKernel->RegisterInterface(static_cast<IMap*>(m_pEngineMap));
+		RegisterFail = RegisterFail || !m_pKernel->RegisterInterface(m_pGameServer);
+		RegisterFail = RegisterFail || !m_pKernel->RegisterInterface(m_pConsole);
+		RegisterFail = RegisterFail || !m_pKernel->RegisterInterface(m_pStorage);
+		RegisterFail = RegisterFail || !m_pKernel->RegisterInterface(m_pConfigManager);
+		RegisterFail = RegisterFail || !m_pKernel->RegisterInterface(static_cast<IEngineMasterServer*>(m_pEngineMasterServer)); // register as both
+		RegisterFail = RegisterFail || !m_pKernel->RegisterInterface(static_cast<IMasterServer*>(m_pEngineMasterServer));
 
 		if(RegisterFail)
-			return -1;
+			return false;
 	}
 
-	pEngine->Init();
-	pConfigManager->Init(FlagMask);
-	pConsole->Init();
-	pEngineMasterServer->Init();
-	pEngineMasterServer->Load();
-
-	pServer->InitInterfaces(pConfigManager->Values(), pConsole, pGameServer, pEngineMap, pStorage);
-	if(!UseDefaultConfig)
-	{
-		// register all console commands
-		pServer->RegisterCommands();
-
-		// execute autoexec file
-		pConsole->ExecuteFile("autoexec.cfg");
-
-		// parse the command line arguments
-		if(argc > 1) // ignore_convention
-			pConsole->ParseArguments(argc-1, &argv[1]); // ignore_convention
-	}
-
-	// restore empty config strings to their defaults
-	pConfigManager->RestoreStrings();
-
-	pEngine->InitLogfile();
-
-	pServer->InitRconPasswordIfUnset();
-
-	// run the server
-	dbg_msg("server", "starting...");
-	int Ret = pServer->Run();
-
-	// free
-	delete pServer;
-	delete pKernel;
-	delete pEngine;
-	delete pEngineMap;
-	delete pGameServer;
-	delete pConsole;
-	delete pEngineMasterServer;
-	delete pStorage;
-	delete pConfigManager;
+	m_pEngine->Init();
+	m_pConfigManager->Init(FlagMask);
+	m_pConsole->Init();
+	m_pEngineMasterServer->Init();
 
-	return Ret;
+	m_pServer->InitInterfaces(m_pConfigManager->Values(), m_pConsole, m_pGameServer, m_pEngineMap, m_pStorage);
+	return true;
 }
@@ -5,39 +5,74 @@
 
 #include <engine/server.h>
 #include <engine/shared/memheap.h>
+#include <engine/shared/tickprofiler.h>
 
 class CSnapIDPool
 {
 	enum
 	{
-		MAX_IDS = 16*1024,
+		MAX_IDS = 0x10000, // snap item ids are 16 bit
+		MIN_IDS = 1024,
+
+		// freed ids are kept for TIMEOUT seconds so clients don't mix up
+		// the old and the new item, they are released a whole second at once
+		TIMEOUT = 5,
+		NUM_SLOTS = 8,
+	};
+
+	enum
+	{
+		STATE_FREE = 0,
+		STATE_ALLOCATED,
+		STATE_TIMED,
 	};
 
 	class CID
 	{
 	public:
-		short m_Next;
-		short m_State; // 0 = free, 1 = allocated, 2 = timed
-		int m_Timeout;
+		int m_Next;
+		int m_State;
 	};
 
-	CID m_aIDs[MAX_IDS];
+	class CSlot
+	{
+	public:
+		int m_First;
+		int m_Last;
+		int m_Num;
+	};
+
+	CID *m_pIDs;
+	int m_NumIDs;
+
+	CSlot m_aSlots[NUM_SLOTS];
+	int64 m_WheelSecond;
 
 	int m_FirstFree;
-	int m_FirstTimed;
-	int m_LastTimed;
 	int m_Usage;
 	int m_InUsage;
+	int m_PeakUsage;
+	int m_PeakInUsage;
+
+	void Grow();
+	void ReleaseSlot(int Slot);
+	void ReleaseTimeouts(int64 Second);
 
 public:
 
 	CSnapIDPool();
+	~CSnapIDPool();
 
 	void Reset();
-	void RemoveFirstTimeout();
 	int NewID();
 	void TimeoutIDs();
 	void FreeID(int ID);
+
+	int Capacity() const { return m_NumIDs; }
+	int NumLive() const { return m_InUsage; }
+	int NumTimed() const { return m_Usage-m_InUsage; }
+	int PeakUsage() const { return m_PeakUsage; }
+	int PeakLive() const { return m_PeakInUsage; }
 };
 
 
@@ -146,6 +181,7 @@ public:
 	CSnapshotBuilder m_SnapshotBuilder;
 	CSnapIDPool m_IDPool;
 	CNetServer m_NetServer;
+	INetTransport *m_pNetTransport; // 0 = udp socket on sv_port
 	CEcon m_Econ;
 	CServerBan m_ServerBan;
 
@@ -196,6 +232,9 @@ public:
 	CRegister m_Register;
 	CMapChecker m_MapChecker;
 
+	CTickProfiler m_TickProfiler;
+	int64 m_NextPerfStatsTime;
+
 	CServer();
 
 	virtual void SetClientName(int ClientID, const char *pName);
@@ -236,6 +275,8 @@ public:
 	void SendConnectionReady(int ClientID);
 	void SendRconLine(int ClientID, const char *pLine);
 	static void SendRconLineAuthed(const char *pLine, void *pUser, bool Highlighted);
+	static int GetConsoleContext(void *pUser);
+	static bool SetConsoleContext(int Context, void *pUser);
 
 	void SendRconCmdAdd(const IConsole::CCommandInfo *pCommandInfo, int ClientID);
 	void SendRconCmdRem(const IConsole::CCommandInfo *pCommandInfo, int ClientID);
@@ -257,16 +298,22 @@ public:
 
 	void InitRegister(CNetServer *pNetServer, IEngineMasterServer *pMasterServer, CConfig *pConfig, IConsole *pConsole);
 	void InitInterfaces(CConfig *pConfig, IConsole *pConsole, IGameServer *pGameServer, IEngineMap *pMap, IStorage *pStorage);
+	int Start();
+	void DoTick();
+	void Stop();
 	int Run();
 
 	static int MapListEntryCallback(const char *pFilename, int IsDir, int DirType, void *pUser);
 
 	static void ConKick(IConsole::IResult *pResult, void *pUser);
 	static void ConStatus(IConsole::IResult *pResult, void *pUser);
+	static void ConSnapIDs(IConsole::IResult *pResult, void *pUser);
 	static void ConShutdown(IConsole::IResult *pResult, void *pUser);
 	static void ConRecord(IConsole::IResult *pResult, void *pUser);
 	static void ConStopRecord(IConsole::IResult *pResult, void *pUser);
 	static void ConMapReload(IConsole::IResult *pResult, void *pUser);
+	static void ConPerfStats(IConsole::IResult *pResult, void *pUser);
+	static void ConPerfStatsReset(IConsole::IResult *pResult, void *pUser);
 	static void ConSaveConfig(IConsole::IResult *pResult, void *pUser);
 	static void ConLogout(IConsole::IResult *pResult, void *pUser);
 	static void ConchainSpecialInfoupdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData);
@@ -287,4 +334,25 @@ public:
 	void SnapSetStaticsize(int ItemType, int Size);
 };
 
+// creates a server with the engine components it needs and registers them,
+// used by the server executable and by the tools that run a server
+class CServerKernel
+{
+public:
+	CServer *m_pServer;
+	IKernel *m_pKernel;
+	class IEngine *m_pEngine;
+	class IEngineMap *m_pEngineMap;
+	IGameServer *m_pGameServer;
+	IConsole *m_pConsole;
+	class IEngineMasterServer *m_pEngineMasterServer;
+	class IStorage *m_pStorage;
+	class IConfigManager *m_pConfigManager;
+
+	CServerKernel();
+	~CServerKernel();
+
+	bool Init(const char *pAppname, int argc, const char **argv);
+};
+
 #endif
@@ -343,7 +343,12 @@ bool CConsole::LineIsValid(const char *pStr)
 
 void CConsole::ExecuteLineStroked(int Stroke, const char *pStr)
 {
-	while(pStr && *pStr)
+	ExecuteLineParts(Stroke, pStr, 0);
+}
+
+const char *CConsole::ExecuteLineParts(int Stroke, const char *pStr, const char *pStop)
+{
+	while(pStr && *pStr && pStr != pStop)
 	{
 		CResult Result;
 		const char *pEnd = pStr;
@@ -374,10 +379,12 @@ void CConsole::ExecuteLineStroked(int Stroke, const char *pStr)
 		}
 
 		if(ParseStart(&Result, pStr, (pEnd-pStr) + 1) != 0)
-			return;
+			return 0;
 
 		if(!*Result.m_pCommand)
-			return;
+			return 0;
+
+		int64 NumDeferred = m_DeferredStats.m_NumDeferred;
 
 		CCommand *pCommand = FindCommand(Result.m_pCommand, m_FlagMask);
 
@@ -425,8 +432,16 @@ void CConsole::ExecuteLineStroked(int Stroke, const char *pStr)
 			Print(OUTPUT_LEVEL_STANDARD, "console", aBuf);
 		}
 
+		// a file of this part got deferred, the parts after it have to wait too
+		if(Stroke && pNextPart && *pNextPart && m_DeferredStats.m_NumDeferred != NumDeferred)
+		{
+			DeferLine(pNextPart);
+			return pNextPart;
+		}
+
 		pStr = pNextPart;
 	}
+	return 0;
 }
 
 int CConsole::PossibleCommands(const char *pStr, int FlagMask, bool Temp, FPossibleCallback pfnCallback, void *pUser)
@@ -457,9 +472,41 @@ int CConsole::PossibleMaps(const char *pStr, FPossibleCallback pfnCallback, void
 	return Index;
 }
 
+unsigned CConsole::CommandHash(const char *pName)
+{
+	unsigned Hash = 5381;
+	for(; *pName; pName++)
+	{
+		unsigned char c = *pName;
+		if(c >= 'A' && c <= 'Z')
+			c += 'a'-'A';
+		Hash = (Hash<<5) + Hash + c;
+	}
+	return Hash&(COMMAND_HASH_SIZE-1);
+}
+
+void CConsole::AddCommandHash(CCommand *pCommand)
+{
+	unsigned Hash = CommandHash(pCommand->m_pName);
+	pCommand->m_pNextHash = m_apCommandHash[Hash];
+	m_apCommandHash[Hash] = pCommand;
+}
+
+void CConsole::RemoveCommandHash(CCommand *pCommand)
+{
+	for(CCommand **ppCommand = &m_apCommandHash[CommandHash(pCommand->m_pName)]; *ppCommand; ppCommand = &(*ppCommand)->m_pNextHash)
+	{
+		if(*ppCommand == pCommand)
+		{
+			*ppCommand = pCommand->m_pNextHash;
+			break;
+		}
+	}
+}
+
 CConsole::CCommand *CConsole::FindCommand(const char *pName, int FlagMask)
 {
-	for(CCommand *pCommand = m_pFirstCommand; pCommand; pCommand = pCommand->m_pNext)
+	for(CCommand *pCommand = m_apCommandHash[CommandHash(pName)]; pCommand; pCommand = pCommand->m_pNextHash)
 	{
 		if(pCommand->m_Flags&FlagMask && str_comp_nocase(pCommand->m_pName, pName) == 0)
 		{
@@ -472,8 +519,12 @@ CConsole::CCommand *CConsole::FindCommand(const char *pName, int FlagMask)
 
 void CConsole::ExecuteLine(const char *pStr)
 {
-	CConsole::ExecuteLineStroked(1, pStr); // press it
-	CConsole::ExecuteLineStroked(0, pStr); // then release it
+	const char *pDeferred = ExecuteLineParts(1, pStr, 0); // press it
+
+	// releasing only does something for stroke commands, deferred parts
+	// get released once they run
+	if(str_find(pStr, "+"))
+		ExecuteLineParts(0, pStr, pDeferred); // then release it
 }
 
 void CConsole::ExecuteLineFlag(const char *pStr, int FlagMask)
@@ -487,10 +538,14 @@ void CConsole::ExecuteLineFlag(const char *pStr, int FlagMask)
 
 bool CConsole::ExecuteFile(const char *pFilename)
 {
-	// make sure that this isn't being executed already
+	// make sure that this isn't being executed already, deferred lines
+	// continue the stack of the files they came from
 	for(CExecFile *pCur = m_pFirstExec; pCur; pCur = pCur->m_pPrev)
 		if(str_comp(pFilename, pCur->m_pFilename) == 0)
 			return false;
+	for(CDeferredExec *pCur = m_pDeferredExec; pCur; pCur = pCur->m_pPrev)
+		if(str_comp(pFilename, pCur->m_aFilename) == 0)
+			return false;
 
 	if(!m_pStorage)
 		return false;
@@ -500,6 +555,7 @@ bool CConsole::ExecuteFile(const char *pFilename)
 	CExecFile *pPrev = m_pFirstExec;
 	ThisFile.m_pFilename = pFilename;
 	ThisFile.m_pPrev = m_pFirstExec;
+	ThisFile.m_pDeferred = 0;
 	m_pFirstExec = &ThisFile;
 
 	// exec the file
@@ -515,9 +571,33 @@ bool CConsole::ExecuteFile(const char *pFilename)
 		Print(IConsole::OUTPUT_LEVEL_STANDARD, "console", aBuf);
 		lr.Init(File);
 
+		// a file started outside of a slice gets its own budget, and it
+		// has to queue up behind lines that are still waiting
+		bool StartSlice = m_ExecutionBudget && !m_SliceStart;
+		if(StartSlice)
+			m_SliceStart = time_get();
+		bool Defer = m_ExecutionBudget && !m_ExecutingDeferred && m_pFirstDeferred;
+
 		while((pLine = lr.Get()))
+		{
+			if(Defer || BudgetUsed())
+			{
+				DeferLine(pLine);
+				Defer = true;
+				continue;
+			}
+
+			// keep the order if a nested file got deferred
+			int64 NumDeferred = m_DeferredStats.m_NumDeferred;
 			ExecuteLine(pLine);
+			Defer = m_DeferredStats.m_NumDeferred != NumDeferred;
+		}
 
+		if(StartSlice)
+		{
+			m_SliceUsed += time_get()-m_SliceStart;
+			m_SliceStart = 0;
+		}
 		io_close(File);
 	}
 	else
@@ -534,9 +614,151 @@ bool CConsole::ExecuteFile(const char *pFilename)
 	}
 
 	m_pFirstExec = pPrev;
+	ReleaseDeferredExec(ThisFile.m_pDeferred);
 	return (bool)File;
 }
 
+CConsole::CDeferredExec *CConsole::DeferredExec(CExecFile *pFile)
+{
+	// files started by a deferred line sit on top of its stack
+	if(!pFile)
+		return m_pDeferredExec;
+
+	if(!pFile->m_pDeferred)
+	{
+		int Length = str_length(pFile->m_pFilename);
+		CDeferredExec *pExec = (CDeferredExec *)mem_alloc(sizeof(CDeferredExec)+Length, 1);
+		pExec->m_pPrev = DeferredExec(pFile->m_pPrev);
+		if(pExec->m_pPrev)
+			pExec->m_pPrev->m_Refs++;
+		pExec->m_Refs = 1; // held by the file until it is done
+		mem_copy(pExec->m_aFilename, pFile->m_pFilename, Length+1);
+		pFile->m_pDeferred = pExec;
+	}
+	return pFile->m_pDeferred;
+}
+
+void CConsole::ReleaseDeferredExec(CDeferredExec *pExec)
+{
+	while(pExec && --pExec->m_Refs == 0)
+	{
+		CDeferredExec *pPrev = pExec->m_pPrev;
+		mem_free(pExec);
+		pExec = pPrev;
+	}
+}
+
+void CConsole::DeferLine(const char *pLine)
+{
+	int Length = str_length(pLine);
+	CDeferredLine *pEntry = (CDeferredLine *)mem_alloc(sizeof(CDeferredLine)+Length, 1);
+	pEntry->m_pNext = 0;
+	pEntry->m_pExec = DeferredExec(m_pFirstExec);
+	if(pEntry->m_pExec)
+		pEntry->m_pExec->m_Refs++;
+	pEntry->m_FlagMask = m_FlagMask;
+	pEntry->m_AccessLevel = m_AccessLevel;
+	pEntry->m_Context = m_pfnGetContext ? m_pfnGetContext(m_pContextUserData) : 0;
+	mem_copy(pEntry->m_aLine, pLine, Length+1);
+
+	CDeferredLine **ppFirst = m_ExecutingDeferred ? &m_pFirstInsert : &m_pFirstDeferred;
+	CDeferredLine **ppLast = m_ExecutingDeferred ? &m_pLastInsert : &m_pLastDeferred;
+	if(*ppLast)
+		(*ppLast)->m_pNext = pEntry;
+	else
+		*ppFirst = pEntry;
+	*ppLast = pEntry;
+
+	m_DeferredStats.m_QueueDepth++;
+	m_DeferredStats.m_MaxQueueDepth = max(m_DeferredStats.m_MaxQueueDepth, m_DeferredStats.m_QueueDepth);
+	m_DeferredStats.m_NumDeferred++;
+}
+
+void CConsole::SetExecutionBudget(int Microseconds)
+{
+	m_ExecutionBudget = (int64)Microseconds*time_freq()/1000000;
+}
+
+void CConsole::SetContextCallbacks(FGetContextCallback pfnGetContext, FSetContextCallback pfnSetContext, void *pUser)
+{
+	m_pfnGetContext = pfnGetContext;
+	m_pfnSetContext = pfnSetContext;
+	m_pContextUserData = pUser;
+}
+
+void CConsole::ExecuteDeferred()
+{
+	if(m_ExecutingDeferred)
+		return;
+
+	// a new budget starts here
+	m_SliceUsed = 0;
+	m_DeferredStats.m_LastExecuted = 0;
+	if(!m_pFirstDeferred)
+		return;
+
+	m_SliceStart = time_get();
+	m_ExecutingDeferred = true;
+	while(m_pFirstDeferred)
+	{
+		// always make progress, then stop once the budget is used up
+		if(m_DeferredStats.m_LastExecuted && BudgetUsed())
+			break;
+
+		CDeferredLine *pEntry = m_pFirstDeferred;
+		m_pFirstDeferred = pEntry->m_pNext;
+		if(!m_pFirstDeferred)
+			m_pLastDeferred = 0;
+		m_DeferredStats.m_QueueDepth--;
+
+		int FlagMask = m_FlagMask;
+		int AccessLevel = m_AccessLevel;
+		// lines whose context is gone (e.g. the rcon client left) are dropped
+		int Context = 0;
+		bool Valid = true;
+		if(m_pfnGetContext && m_pfnSetContext)
+		{
+			Context = m_pfnGetContext(m_pContextUserData);
+			Valid = m_pfnSetContext(pEntry->m_Context, m_pContextUserData);
+		}
+		if(Valid)
+		{
+			m_FlagMask = pEntry->m_FlagMask;
+			m_AccessLevel = pEntry->m_AccessLevel;
+			m_pDeferredExec = pEntry->m_pExec;
+			ExecuteLine(pEntry->m_aLine);
+			m_pDeferredExec = 0;
+			m_FlagMask = FlagMask;
+			m_AccessLevel = AccessLevel;
+		}
+		if(m_pfnGetContext && m_pfnSetContext)
+			m_pfnSetContext(Context, m_pContextUserData);
+		ReleaseDeferredExec(pEntry->m_pExec);
+		mem_free(pEntry);
+
+		if(!Valid)
+		{
+			m_DeferredStats.m_NumDropped++;
+			continue;
+		}
+		m_DeferredStats.m_LastExecuted++;
+		m_DeferredStats.m_NumExecuted++;
+
+		// continue with what the line deferred itself
+		if(m_pFirstInsert)
+		{
+			m_pLastInsert->m_pNext = m_pFirstDeferred;
+			if(!m_pFirstDeferred)
+				m_pLastDeferred = m_pLastInsert;
+			m_pFirstDeferred = m_pFirstInsert;
+			m_pFirstInsert = m_pLastInsert = 0;
+		}
+	}
+	m_ExecutingDeferred = false;
+	m_SliceUsed += time_get()-m_SliceStart;
+	m_SliceStart = 0;
+}
+
 void CConsole::Con_Echo(IResult *pResult, void *pUserData)
 {
 	((CConsole*)pUserData)->Print(IConsole::OUTPUT_LEVEL_STANDARD, "console", pResult->GetString(0));
@@ -547,6 +769,16 @@ void CConsole::Con_Exec(IResult *pResult, void *pUserData)
 	((CConsole*)pUserData)->ExecuteFile(pResult->GetString(0));
 }
 
+void CConsole::ConConsoleQueue(IResult *pResult, void *pUser)
+{
+	CConsole *pConsole = static_cast<CConsole *>(pUser);
+	const CDeferredStats *pStats = &pConsole->m_DeferredStats;
+	char aBuf[256];
+	str_format(aBuf, sizeof(aBuf), "deferred lines: depth=%d max_depth=%d last_executed=%d deferred=%lld executed=%lld dropped=%lld",
+		pStats->m_QueueDepth, pStats->m_MaxQueueDepth, pStats->m_LastExecuted, pStats->m_NumDeferred, pStats->m_NumExecuted, pStats->m_NumDropped);
+	pConsole->Print(OUTPUT_LEVEL_STANDARD, "console", aBuf);
+}
+
 void CConsole::ConModCommandAccess(IResult *pResult, void *pUser)
 {
 	CConsole* pConsole = static_cast<CConsole *>(pUser);
@@ -808,7 +1040,19 @@ CConsole::CConsole(int FlagMask)
 	m_pLastMapEntry = 0;
 	m_ExecutionQueue.Reset();
 	m_pFirstCommand = 0;
+	mem_zero(m_apCommandHash, sizeof(m_apCommandHash));
 	m_pFirstExec = 0;
+	m_pDeferredExec = 0;
+	m_pFirstDeferred = m_pLastDeferred = 0;
+	m_pFirstInsert = m_pLastInsert = 0;
+	m_ExecutingDeferred = false;
+	m_ExecutionBudget = 0;
+	m_SliceStart = 0;
+	m_SliceUsed = 0;
+	m_pfnGetContext = 0;
+	m_pfnSetContext = 0;
+	m_pContextUserData = 0;
+	mem_zero(&m_DeferredStats, sizeof(m_DeferredStats));
 	mem_zero(m_aPrintCB, sizeof(m_aPrintCB));
 	m_NumPrintCB = 0;
 
@@ -818,6 +1062,7 @@ CConsole::CConsole(int FlagMask)
 	// register some basic commands
 	Register("echo", "r[text]", CFGFLAG_SERVER|CFGFLAG_CLIENT, Con_Echo, this, "Echo the text");
 	Register("exec", "r[file]", CFGFLAG_SERVER|CFGFLAG_CLIENT, Con_Exec, this, "Execute the specified file");
+	Register("console_queue", "", CFGFLAG_SERVER|CFGFLAG_CLIENT, ConConsoleQueue, this, "Show the state of the deferred command queue");
 	Register("eval_if", "s[config] s[comparison] s[value] s[command] ?s[else] ?s[command]", CFGFLAG_SERVER|CFGFLAG_CLIENT|CFGFLAG_STORE, Con_EvalIf, this, "Execute command if condition is true");
 
 	Register("toggle", "s[config-option] i[value1] i[value2]", CFGFLAG_SERVER|CFGFLAG_CLIENT, ConToggle, this, "Toggle config value");
@@ -845,6 +1090,13 @@ CConsole::~CConsole()
 		delete m_pTempMapListHeap;
 		m_pTempMapListHeap = 0;
 	}
+	while(m_pFirstDeferred)
+	{
+		CDeferredLine *pNext = m_pFirstDeferred->m_pNext;
+		ReleaseDeferredExec(m_pFirstDeferred->m_pExec);
+		mem_free(m_pFirstDeferred);
+		m_pFirstDeferred = pNext;
+	}
 }
 
 void CConsole::Init()
@@ -948,7 +1200,10 @@ void CConsole::Register(const char *pName, const char *pParams,
 	pCommand->m_Temp = false;
 
 	if(DoAdd)
+	{
 		AddCommandSorted(pCommand);
+		AddCommandHash(pCommand);
+	}
 }
 
 void CConsole::RegisterTemp(const char *pName, const char *pParams,	int Flags, const char *pHelp)
@@ -983,6 +1238,7 @@ void CConsole::RegisterTemp(const char *pName, const char *pParams,	int Flags, c
 	pCommand->m_Temp = true;
 
 	AddCommandSorted(pCommand);
+	AddCommandHash(pCommand);
 }
 
 void CConsole::DeregisterTemp(const char *pName)
@@ -1012,6 +1268,7 @@ void CConsole::DeregisterTemp(const char *pName)
 	// add to recycle list
 	if(pRemoved)
 	{
+		RemoveCommandHash(pRemoved);
 		pRemoved->m_pNext = m_pRecycleList;
 		m_pRecycleList = pRemoved;
 	}
@@ -1033,6 +1290,18 @@ void CConsole::DeregisterTempAll()
 		}
 	}
 
+	// remove temp entries from the index
+	for(int i = 0; i < COMMAND_HASH_SIZE; i++)
+	{
+		for(CCommand **ppCommand = &m_apCommandHash[i]; *ppCommand; )
+		{
+			if((*ppCommand)->m_Temp)
+				*ppCommand = (*ppCommand)->m_pNextHash;
+			else
+				ppCommand = &(*ppCommand)->m_pNextHash;
+		}
+	}
+
 	m_TempCommands.Reset();
 	m_pRecycleList = 0;
 }
@@ -1137,7 +1406,7 @@ void CConsole::StoreCommands(bool Store)
 
 const IConsole::CCommandInfo *CConsole::GetCommandInfo(const char *pName, int FlagMask, bool Temp)
 {
-	for(CCommand *pCommand = m_pFirstCommand; pCommand; pCommand = pCommand->m_pNext)
+	for(CCommand *pCommand = m_apCommandHash[CommandHash(pName)]; pCommand; pCommand = pCommand->m_pNextHash)
 	{
 		if(pCommand->m_Flags&FlagMask && pCommand->m_Temp == Temp)
 		{
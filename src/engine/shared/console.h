@@ -14,6 +14,7 @@ class CConsole : public IConsole
 	public:
 		CCommand(bool BasicAccess) : CCommandInfo(BasicAccess) {};
 		CCommand *m_pNext;
+		CCommand *m_pNextHash;
 		int m_Flags;
 		bool m_Temp;
 		FCommandCallback m_pfnCallback;
@@ -39,14 +40,70 @@ class CConsole : public IConsole
 	const char *m_paStrokeStr[2];
 	CCommand *m_pFirstCommand;
 
+	// case insensitive name index over all commands, newest first per bucket
+	enum
+	{
+		COMMAND_HASH_SIZE=1024, // must be a power of two
+	};
+	CCommand *m_apCommandHash[COMMAND_HASH_SIZE];
+
+	static unsigned CommandHash(const char *pName);
+	void AddCommandHash(CCommand *pCommand);
+	void RemoveCommandHash(CCommand *pCommand);
+
+	// the exec stack of deferred lines, shared by all lines of a file
+	class CDeferredExec
+	{
+	public:
+		CDeferredExec *m_pPrev;
+		int m_Refs;
+		char m_aFilename[1];
+	};
+
 	class CExecFile
 	{
 	public:
 		const char *m_pFilename;
 		CExecFile *m_pPrev;
+		CDeferredExec *m_pDeferred; // created once the file defers a line
 	};
 
 	CExecFile *m_pFirstExec;
+	CDeferredExec *m_pDeferredExec; // exec stack of the running deferred line
+
+	CDeferredExec *DeferredExec(CExecFile *pFile);
+	void ReleaseDeferredExec(CDeferredExec *pExec);
+
+	class CDeferredLine
+	{
+	public:
+		CDeferredLine *m_pNext;
+		CDeferredExec *m_pExec;
+		int m_FlagMask;
+		int m_AccessLevel;
+		int m_Context;
+		char m_aLine[1];
+	};
+
+	// lines deferred while a deferred line runs are collected in the insert
+	// list and go in front of the queue, so nested files keep their order
+	CDeferredLine *m_pFirstDeferred;
+	CDeferredLine *m_pLastDeferred;
+	CDeferredLine *m_pFirstInsert;
+	CDeferredLine *m_pLastInsert;
+	bool m_ExecutingDeferred;
+	int64 m_ExecutionBudget;
+	int64 m_SliceStart;
+	int64 m_SliceUsed; // time used by earlier slices since the last ExecuteDeferred()
+	CDeferredStats m_DeferredStats;
+
+	FGetContextCallback m_pfnGetContext;
+	FSetContextCallback m_pfnSetContext;
+	void *m_pContextUserData;
+
+	void DeferLine(const char *pLine);
+	bool BudgetUsed() const { return m_ExecutionBudget && m_SliceStart && m_SliceUsed+time_get()-m_SliceStart >= m_ExecutionBudget; }
+
 	class CConfig *m_pConfig;
 	class IStorage *m_pStorage;
 	int m_AccessLevel;
@@ -62,9 +119,12 @@ class CConsole : public IConsole
 	static void ConToggleStroke(IResult *pResult, void *pUser);
 	static void ConModCommandAccess(IResult *pResult, void *pUser);
 	static void ConModCommandStatus(IResult *pResult, void *pUser);
+	static void ConConsoleQueue(IResult *pResult, void *pUser);
 
 	void ExecuteFileRecurse(const char *pFilename);
 	void ExecuteLineStroked(int Stroke, const char *pStr);
+	// returns the remaining parts if they were deferred
+	const char *ExecuteLineParts(int Stroke, const char *pStr, const char *pStop);
 
 	struct
 	{
@@ -203,6 +263,11 @@ public:
 	virtual void ExecuteLineFlag(const char *pStr, int FlagMask);
 	virtual bool ExecuteFile(const char *pFilename);
 
+	virtual void SetExecutionBudget(int Microseconds);
+	virtual void ExecuteDeferred();
+	virtual void GetDeferredStats(CDeferredStats *pStats) const { *pStats = m_DeferredStats; }
+	virtual void SetContextCallbacks(FGetContextCallback pfnGetContext, FSetContextCallback pfnSetContext, void *pUser);
+
 	virtual int RegisterPrintCallback(int OutputLevel, FPrintCallback pfnPrintCallback, void *pUserData);
 	virtual void SetPrintOutputLevel(int Index, int OutputLevel);
 	virtual void Print(int Level, const char *pFrom, const char *pStr, bool Highlighted=false);
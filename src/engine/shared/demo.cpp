@@ -2,6 +2,9 @@
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
 #include <base/math.h>
 #include <base/system.h>
+#include <base/tl/threading.h>
+
+#include <zlib.h>
 
 #include <engine/console.h>
 #include <engine/storage.h>
@@ -14,22 +17,88 @@
 #include "snapshot.h"
 
 static const unsigned char gs_aHeaderMarker[7] = {'T', 'W', 'D', 'E', 'M', 'O', 0};
-static const unsigned char gs_ActVersion = 4;
+static const unsigned char gs_aIndexMarker[8] = {'T', 'W', 'D', 'I', 'N', 'D', 'E', 'X'};
+static const unsigned char gs_BlockVersion = 6; // chunks in zlib compressed blocks
+static const unsigned char gs_ActVersion = 5;
+static const unsigned char gs_OldVersion = 4; // without the extended header
 static const int gs_LengthOffset = 152;
 static const int gs_NumMarkersOffset = 176;
+static const int gs_IndexOffsetOffset = sizeof(CDemoHeader);
+
+/*
+	Tickmarker
+		7	= Always set
+		6	= Keyframe flag
+		0-5	= Delta tick
+
+	Normal
+		7 = Not set
+		5-6	= Type
+		0-4	= Size
+
+	End (since version 5)
+		0-7 = Not set, the keyframe index follows
+
+	Keyframe index (since version 5)
+		char marker[8] = "TWDINDEX"
+		int32 first tick
+		int32 last tick
+		int32 num keyframes
+		num keyframes * (int32 file position, int32 tick)
+
+	Blocks (version 6)
+		The chunks up to and including the end chunk are not huffman coded
+		but grouped into zlib compressed blocks, the index follows the last
+		block. Every keyframe starts a new block and its index entry points
+		to the block.
+
+		int32 raw size
+		int32 compressed size
+		compressed data
+*/
+
+enum
+{
+	CHUNK_END = 0x00,
+	CHUNKTYPEFLAG_TICKMARKER = 0x80,
+	CHUNKTICKFLAG_KEYFRAME = 0x40, // only when tickmarker is set
+
+	CHUNKMASK_TICK = 0x3f,
+	CHUNKMASK_TYPE = 0x60,
+	CHUNKMASK_SIZE = 0x1f,
+
+	CHUNKTYPE_RAW = 0, // only between the recorder and its writer, written as is
+	CHUNKTYPE_SNAPSHOT = 1,
+	CHUNKTYPE_MESSAGE = 2,
+	CHUNKTYPE_DELTA = 3,
+
+	CHUNKFLAG_BIGSIZE = 0x10,
+	MAX_CHUNK_SIZE = 0xffff, // the largest size the chunk header can hold
+
+	INDEX_HEADER_SIZE = 8+3*4,
+
+	BLOCK_SIZE = 256*1024,
+	BLOCK_HEADER_SIZE = 2*4,
+	BLOCK_POS_SHIFT = 24, // stream positions in blocks are the block file position and the offset in it
+};
 
 CDemoRecorder::CDemoRecorder(class CSnapshotDelta *pSnapshotDelta)
 {
 	m_File = 0;
 	m_LastTickMarker = -1;
+	m_KeyFrameInterval = SERVER_TICK_SPEED*5;
+	m_BlockCompression = false;
 	m_pSnapshotDelta = pSnapshotDelta;
+	m_pQueue = 0;
+	m_pBlock = 0;
+	m_pCompressedBlock = 0;
+	m_pWriterThread = 0;
 	m_Huffman.Init();
 }
 
 // Record
 int CDemoRecorder::Start(class IStorage *pStorage, class IConsole *pConsole, const char *pFilename, const char *pNetVersion, const char *pMap, SHA256_DIGEST Sha256, unsigned Crc, const char *pType)
 {
-	CDemoHeader Header;
 	if(m_File)
 		return -1;
 
@@ -81,13 +150,55 @@ int CDemoRecorder::Start(class IStorage *pStorage, class IConsole *pConsole, con
 		return -1;
 	}
 
-	// write header
+	WriteHeader(DemoFile, pNetVersion, pMap, io_length(MapFile), Crc, pType);
+
+	// write map data
+	unsigned char aChunk[1024*64];
+	while(1)
+	{
+		int Bytes = io_read(MapFile, &aChunk, sizeof(aChunk));
+		if(Bytes <= 0)
+			break;
+		io_write(DemoFile, &aChunk, Bytes);
+	}
+	io_close(MapFile);
+
+	StartWriter(DemoFile, pFilename);
+
+	return 0;
+}
+
+int CDemoRecorder::Start(class IStorage *pStorage, class IConsole *pConsole, const char *pFilename, const char *pNetVersion, const char *pMap, unsigned Crc, const char *pType, const void *pMapData, unsigned MapSize)
+{
+	if(m_File)
+		return -1;
+
+	m_pConsole = pConsole;
+
+	IOHANDLE DemoFile = pStorage->OpenFile(pFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+	if(!DemoFile)
+	{
+		char aBuf[256];
+		str_format(aBuf, sizeof(aBuf), "Unable to open '%s' for recording", pFilename);
+		m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "demo_recorder", aBuf);
+		return -1;
+	}
+
+	WriteHeader(DemoFile, pNetVersion, pMap, MapSize, Crc, pType);
+	io_write(DemoFile, pMapData, MapSize);
+	StartWriter(DemoFile, pFilename);
+
+	return 0;
+}
+
+void CDemoRecorder::WriteHeader(IOHANDLE DemoFile, const char *pNetVersion, const char *pMap, unsigned MapSize, unsigned Crc, const char *pType)
+{
+	CDemoHeader Header;
 	mem_zero(&Header, sizeof(Header));
 	mem_copy(Header.m_aMarker, gs_aHeaderMarker, sizeof(Header.m_aMarker));
-	Header.m_Version = gs_ActVersion;
+	Header.m_Version = m_BlockCompression ? gs_BlockVersion : gs_ActVersion;
 	str_copy(Header.m_aNetversion, pNetVersion, sizeof(Header.m_aNetversion));
 	str_copy(Header.m_aMapName, pMap, sizeof(Header.m_aMapName));
-	unsigned MapSize = io_length(MapFile);
 	uint_to_bytes_be(Header.m_aMapSize, MapSize);
 	uint_to_bytes_be(Header.m_aMapCrc, Crc);
 	str_copy(Header.m_aType, pType, sizeof(Header.m_aType));
@@ -97,17 +208,15 @@ int CDemoRecorder::Start(class IStorage *pStorage, class IConsole *pConsole, con
 	// Header.m_aTimelineMarkers - add this on stop
 	io_write(DemoFile, &Header, sizeof(Header));
 
-	// write map data
-	unsigned char aChunk[1024*64];
-	while(1)
-	{
-		int Bytes = io_read(MapFile, &aChunk, sizeof(aChunk));
-		if(Bytes <= 0)
-			break;
-		io_write(DemoFile, &aChunk, Bytes);
-	}
-	io_close(MapFile);
+	// write extended header
+	CDemoHeaderExt HeaderExt;
+	mem_zero(&HeaderExt, sizeof(HeaderExt));
+	// HeaderExt.m_aIndexOffset - add this on stop
+	io_write(DemoFile, &HeaderExt, sizeof(HeaderExt));
+}
 
+void CDemoRecorder::StartWriter(IOHANDLE DemoFile, const char *pFilename)
+{
 	m_LastKeyFrame = -1;
 	m_LastTickMarker = -1;
 	m_FirstTick = -1;
@@ -118,37 +227,28 @@ int CDemoRecorder::Start(class IStorage *pStorage, class IConsole *pConsole, con
 	m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "demo_recorder", aBuf);
 	m_File = DemoFile;
 
-	return 0;
+	// start the writer
+	m_pQueue = (unsigned char *)mem_alloc(QUEUE_SIZE, 1);
+	m_QueueWritePos = 0;
+	m_QueueReadPos = 0;
+	m_StopWriter = false;
+	m_NumQueueStalls = 0;
+	m_WriteBufferSize = 0;
+	m_NumWriteErrors = 0;
+	m_FilePos = io_tell(DemoFile);
+	m_lKeyFrameIndex.clear();
+	// the writer gets its own delta, the one passed in keeps being used
+	// and changed by its owner while recording
+	m_WriterDelta.CopyStaticsizes(m_pSnapshotDelta);
+	if(m_BlockCompression)
+	{
+		m_pBlock = (unsigned char *)mem_alloc(BLOCK_SIZE, 1);
+		m_pCompressedBlock = (unsigned char *)mem_alloc(compressBound(BLOCK_SIZE), 1);
+	}
+	m_BlockSize = 0;
+	m_pWriterThread = thread_init(WriterThread, this);
 }
 
-/*
-	Tickmarker
-		7	= Always set
-		6	= Keyframe flag
-		0-5	= Delta tick
-
-	Normal
-		7 = Not set
-		5-6	= Type
-		0-4	= Size
-*/
-
-enum
-{
-	CHUNKTYPEFLAG_TICKMARKER = 0x80,
-	CHUNKTICKFLAG_KEYFRAME = 0x40, // only when tickmarker is set
-
-	CHUNKMASK_TICK = 0x3f,
-	CHUNKMASK_TYPE = 0x60,
-	CHUNKMASK_SIZE = 0x1f,
-
-	CHUNKTYPE_SNAPSHOT = 1,
-	CHUNKTYPE_MESSAGE = 2,
-	CHUNKTYPE_DELTA = 3,
-
-	CHUNKFLAG_BIGSIZE = 0x10
-};
-
 void CDemoRecorder::WriteTickMarker(int Tick, int Keyframe)
 {
 	if(m_LastTickMarker == -1 || Tick-m_LastTickMarker > 63 || Keyframe)
@@ -160,13 +260,13 @@ void CDemoRecorder::WriteTickMarker(int Tick, int Keyframe)
 		if(Keyframe)
 			aChunk[0] |= CHUNKTICKFLAG_KEYFRAME;
 
-		io_write(m_File, aChunk, sizeof(aChunk));
+		Write(CHUNKTYPE_RAW, aChunk, sizeof(aChunk));
 	}
 	else
 	{
 		unsigned char aChunk[1];
 		aChunk[0] = CHUNKTYPEFLAG_TICKMARKER | (Tick-m_LastTickMarker);
-		io_write(m_File, aChunk, sizeof(aChunk));
+		Write(CHUNKTYPE_RAW, aChunk, sizeof(aChunk));
 	}
 
 	m_LastTickMarker = Tick;
@@ -174,29 +274,157 @@ void CDemoRecorder::WriteTickMarker(int Tick, int Keyframe)
 		m_FirstTick = Tick;
 }
 
+void CDemoRecorder::QueueCopy(unsigned Pos, const void *pData, int Size)
+{
+	unsigned Offset = Pos&(QUEUE_SIZE-1);
+	int First = min(Size, (int)(QUEUE_SIZE-Offset));
+	mem_copy(m_pQueue+Offset, pData, First);
+	mem_copy(m_pQueue, (const unsigned char *)pData+First, Size-First);
+}
+
+void CDemoRecorder::QueueFetch(unsigned Pos, void *pData, int Size)
+{
+	unsigned Offset = Pos&(QUEUE_SIZE-1);
+	int First = min(Size, (int)(QUEUE_SIZE-Offset));
+	mem_copy(pData, m_pQueue+Offset, First);
+	mem_copy((unsigned char *)pData+First, m_pQueue, Size-First);
+}
+
 void CDemoRecorder::Write(int Type, const void *pData, int Size)
 {
 	if(!m_File)
 		return;
 
-	char aBuffer[64*1024];
-	char aBuffer2[64*1024];
+	// entries are a type/size int followed by the data, padded to 4 bytes
+	unsigned EntrySize = sizeof(unsigned) + ((Size+3)&~3);
+	if(Size < 0 || Size+3 > COMPRESS_BUFFER_SIZE)
+	{
+		atomic_inc(&m_NumWriteErrors);
+		return;
+	}
+
+	// the writer fell behind, wait for it instead of losing chunks
+	if(QUEUE_SIZE - (m_QueueWritePos-m_QueueReadPos) < EntrySize)
+	{
+		m_NumQueueStalls++;
+		while(QUEUE_SIZE - (m_QueueWritePos-m_QueueReadPos) < EntrySize)
+			thread_yield();
+	}
+
+	unsigned Header = (Type<<24) | Size;
+	QueueCopy(m_QueueWritePos, &Header, sizeof(Header));
+	QueueCopy(m_QueueWritePos+sizeof(Header), pData, Size);
+	sync_barrier();
+	m_QueueWritePos += EntrySize;
+}
+
+void CDemoRecorder::WriterThread(void *pUser)
+{
+	CDemoRecorder *pSelf = (CDemoRecorder *)pUser;
+
+	while(1)
+	{
+		// check the stop flag first, everything queued before it was set gets written
+		bool Stop = pSelf->m_StopWriter;
+		sync_barrier();
+		unsigned WritePos = pSelf->m_QueueWritePos;
+		sync_barrier();
+
+		if(pSelf->m_QueueReadPos == WritePos)
+		{
+			if(Stop)
+				break;
+			thread_sleep(1);
+			continue;
+		}
+
+		while(pSelf->m_QueueReadPos != WritePos)
+		{
+			unsigned ReadPos = pSelf->m_QueueReadPos;
+			unsigned Header;
+			pSelf->QueueFetch(ReadPos, &Header, sizeof(Header));
+			int Type = Header>>24;
+			int Size = Header&0xffffff;
+			unsigned char *pData = pSelf->m_aaCompressBuffer[1];
+			pSelf->QueueFetch(ReadPos+sizeof(Header), pData, Size);
+			sync_barrier();
+			pSelf->m_QueueReadPos = ReadPos + sizeof(Header) + ((Size+3)&~3);
+
+			if(Type == CHUNKTYPE_RAW)
+			{
+				// remember where the keyframes start
+				if(Size == 5 && (pData[0]&CHUNKTICKFLAG_KEYFRAME))
+				{
+					pSelf->FinishBlock();
+					pSelf->m_lKeyFrameIndex.add(pSelf->m_FilePos);
+					pSelf->m_lKeyFrameIndex.add(bytes_be_to_uint(pData+1));
+				}
+				pSelf->WriteStream(pData, Size);
+			}
+			else if(Type == CHUNKTYPE_SNAPSHOT || Type == CHUNKTYPE_DELTA)
+				pSelf->WriteSnapshot(Type, pData, Size);
+			else
+				pSelf->WriteChunk(Type, pData, Size);
+		}
+	}
+
+	pSelf->FlushBuffer();
+}
+
+void CDemoRecorder::WriteSnapshot(int Type, const unsigned char *pData, int Size)
+{
+	unsigned char *pBuffer = m_aaCompressBuffer[0];
+	int DataSize;
+	if(Type == CHUNKTYPE_SNAPSHOT)
+		DataSize = ((CSnapshot *)pData)->Serialize((char *)pBuffer);
+	else
+	{
+		// nothing changed, the player repeats the last snapshot
+		DataSize = m_WriterDelta.CreateDelta((CSnapshot *)m_aLastSnapshotData, (CSnapshot *)pData, pBuffer);
+		if(!DataSize)
+			return;
+	}
+
+	mem_copy(m_aLastSnapshotData, pData, Size);
+	WriteChunk(Type, pBuffer, DataSize);
+}
+
+void CDemoRecorder::WriteChunk(int Type, const unsigned char *pData, int Size)
+{
+	unsigned char *pBuffer = m_aaCompressBuffer[0];
+	unsigned char *pBuffer2 = m_aaCompressBuffer[1];
 
 	/* pad the data with 0 so we get an alignment of 4,
 	else the compression won't work and miss some bytes */
-	mem_copy(aBuffer2, pData, Size);
+	if(pData != pBuffer2)
+		mem_copy(pBuffer2, pData, Size);
 	while(Size&3)
-		aBuffer2[Size++] = 0;
-	Size = CVariableInt::Compress(aBuffer2, Size, aBuffer, sizeof(aBuffer)); // buffer2 -> buffer
+		pBuffer2[Size++] = 0;
+	Size = CVariableInt::Compress(pBuffer2, Size, pBuffer, COMPRESS_BUFFER_SIZE); // buffer2 -> buffer
 	if(Size < 0)
 	{
-		m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "demo_recorder", "error during intpack compression");
+		atomic_inc(&m_NumWriteErrors);
 		return;
 	}
-	Size = m_Huffman.Compress(aBuffer, Size, aBuffer2, sizeof(aBuffer2)); // buffer -> buffer2
-	if(Size < 0)
+	if(m_pBlock)
+	{
+		// the block compression replaces the huffman coding
+		mem_copy(pBuffer2, pBuffer, Size);
+	}
+	else
+	{
+		Size = m_Huffman.Compress(pBuffer, Size, pBuffer2, COMPRESS_BUFFER_SIZE); // buffer -> buffer2
+		if(Size < 0)
+		{
+			atomic_inc(&m_NumWriteErrors);
+			return;
+		}
+	}
+
+	// the chunk header can describe at most MAX_CHUNK_SIZE bytes, one less than the buffers hold
+	if(Size > MAX_CHUNK_SIZE)
 	{
-		m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "demo_recorder", "error during network compression");
+		atomic_inc(&m_NumWriteErrors);
 		return;
 	}
 
@@ -205,7 +433,7 @@ void CDemoRecorder::Write(int Type, const void *pData, int Size)
 	if(Size < 30)
 	{
 		aChunk[0] |= Size;
-		io_write(m_File, aChunk, 1);
+		WriteStream(aChunk, 1);
 	}
 	else
 	{
@@ -213,49 +441,140 @@ void CDemoRecorder::Write(int Type, const void *pData, int Size)
 		{
 			aChunk[0] |= 30;
 			aChunk[1] = Size&0xff;
-			io_write(m_File, aChunk, 2);
+			WriteStream(aChunk, 2);
 		}
 		else
 		{
 			aChunk[0] |= 31;
 			aChunk[1] = Size&0xff;
 			aChunk[2] = Size>>8;
-			io_write(m_File, aChunk, 3);
+			WriteStream(aChunk, 3);
 		}
 	}
 
-	io_write(m_File, aBuffer2, Size);
+	WriteStream(pBuffer2, Size);
 }
 
-void CDemoRecorder::RecordSnapshot(int Tick, const void *pData, int Size)
+void CDemoRecorder::WriteStream(const void *pData, int Size)
 {
-	char aTmpData[CSnapshot::MAX_SIZE];
+	if(!m_pBlock)
+	{
+		WriteBuffered(pData, Size);
+		return;
+	}
 
-	if(m_LastKeyFrame == -1 || (Tick-m_LastKeyFrame) > SERVER_TICK_SPEED*5)
+	if(m_BlockSize+Size > BLOCK_SIZE)
+		FinishBlock();
+	mem_copy(m_pBlock+m_BlockSize, pData, Size);
+	m_BlockSize += Size;
+}
+
+void CDemoRecorder::FinishBlock()
+{
+	if(!m_pBlock || !m_BlockSize)
+		return;
+
+	unsigned long CompressedSize = compressBound(BLOCK_SIZE);
+	if(compress((Bytef *)m_pCompressedBlock, &CompressedSize, (Bytef *)m_pBlock, m_BlockSize) != Z_OK)
 	{
-		// write full tickmarker
-		WriteTickMarker(Tick, 1);
+		atomic_inc(&m_NumWriteErrors);
+		m_BlockSize = 0;
+		return;
+	}
+
+	unsigned char aHeader[BLOCK_HEADER_SIZE];
+	uint_to_bytes_be(aHeader, m_BlockSize);
+	uint_to_bytes_be(aHeader+4, CompressedSize);
+	WriteBuffered(aHeader, sizeof(aHeader));
+	WriteBuffered(m_pCompressedBlock, CompressedSize);
+	m_BlockSize = 0;
+}
+
+void CDemoRecorder::WriteBuffered(const void *pData, int Size)
+{
+	if(m_WriteBufferSize+Size > WRITE_BUFFER_SIZE)
+		FlushBuffer();
+	m_FilePos += Size;
+	if(Size > WRITE_BUFFER_SIZE)
+	{
+		io_write(m_File, pData, Size);
+		return;
+	}
+	mem_copy(m_aWriteBuffer+m_WriteBufferSize, pData, Size);
+	m_WriteBufferSize += Size;
+}
+
+void CDemoRecorder::FlushBuffer()
+{
+	if(!m_WriteBufferSize)
+		return;
+	io_write(m_File, m_aWriteBuffer, m_WriteBufferSize);
+	m_WriteBufferSize = 0;
+}
+
+void CDemoRecorder::WriteIndex()
+{
+	// end the chunks, the index follows
+	unsigned char End = CHUNK_END;
+	if(m_pBlock)
+	{
+		WriteStream(&End, sizeof(End));
+		FinishBlock();
+		FlushBuffer();
+		mem_free(m_pBlock);
+		mem_free(m_pCompressedBlock);
+		m_pBlock = 0;
+		m_pCompressedBlock = 0;
+	}
+	else
+		io_write(m_File, &End, sizeof(End));
+	int IndexOffset = io_tell(m_File);
+
+	int NumKeyFrames = m_lKeyFrameIndex.size()/2;
+	unsigned char aHeader[INDEX_HEADER_SIZE];
+	mem_copy(aHeader, gs_aIndexMarker, sizeof(gs_aIndexMarker));
+	uint_to_bytes_be(aHeader+8, m_FirstTick);
+	uint_to_bytes_be(aHeader+12, m_LastTickMarker);
+	uint_to_bytes_be(aHeader+16, NumKeyFrames);
+	io_write(m_File, aHeader, sizeof(aHeader));
+	for(int i = 0; i < m_lKeyFrameIndex.size(); i++)
+	{
+		unsigned char aValue[4];
+		uint_to_bytes_be(aValue, m_lKeyFrameIndex[i]);
+		io_write(m_File, aValue, sizeof(aValue));
+	}
+	m_lKeyFrameIndex.clear();
+
+	// point the extended header to it
+	io_seek(m_File, gs_IndexOffsetOffset, IOSEEK_START);
+	CDemoHeaderExt HeaderExt;
+	uint_to_bytes_be(HeaderExt.m_aIndexOffset, IndexOffset);
+	io_write(m_File, &HeaderExt, sizeof(HeaderExt));
+}
 
-		// write snapshot
-		int SnapSize = ((CSnapshot*)pData)->Serialize(aTmpData);
-		Write(CHUNKTYPE_SNAPSHOT, aTmpData, SnapSize);
+void CDemoRecorder::SetKeyFrameInterval(int Ticks)
+{
+	m_KeyFrameInterval = max(Ticks, 1);
+}
+
+void CDemoRecorder::SetBlockCompression(bool Enable)
+{
+	m_BlockCompression = Enable;
+}
 
+void CDemoRecorder::RecordSnapshot(int Tick, const void *pData, int Size)
+{
+	// the snapshot is queued as is, the writer serializes it or creates the delta
+	if(m_LastKeyFrame == -1 || (Tick-m_LastKeyFrame) > m_KeyFrameInterval)
+	{
+		WriteTickMarker(Tick, 1);
+		Write(CHUNKTYPE_SNAPSHOT, pData, Size);
 		m_LastKeyFrame = Tick;
-		mem_copy(m_aLastSnapshotData, pData, Size);
 	}
 	else
 	{
-		// write tickmarker
 		WriteTickMarker(Tick, 0);
-
-		// create delta
-		int DeltaSize = m_pSnapshotDelta->CreateDelta((CSnapshot*)m_aLastSnapshotData, (CSnapshot*)pData, &aTmpData);
-		if(DeltaSize)
-		{
-			// record delta
-			Write(CHUNKTYPE_DELTA, aTmpData, DeltaSize);
-			mem_copy(m_aLastSnapshotData, pData, Size);
-		}
+		Write(CHUNKTYPE_DELTA, pData, Size);
 	}
 }
 
@@ -269,6 +588,15 @@ int CDemoRecorder::Stop()
 	if(!m_File)
 		return -1;
 
+	// let the writer finish the queue
+	m_StopWriter = true;
+	thread_wait(m_pWriterThread);
+	m_pWriterThread = 0;
+	mem_free(m_pQueue);
+	m_pQueue = 0;
+
+	WriteIndex();
+
 	// add the demo length to the header
 	io_seek(m_File, gs_LengthOffset, IOSEEK_START);
 	unsigned char aLength[4];
@@ -291,6 +619,13 @@ int CDemoRecorder::Stop()
 	m_File = 0;
 	m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "demo_recorder", "Stopped recording");
 
+	if(m_NumWriteErrors || m_NumQueueStalls)
+	{
+		char aBuf[128];
+		str_format(aBuf, sizeof(aBuf), "%u chunks were dropped, waited %u times for the writer", m_NumWriteErrors, m_NumQueueStalls);
+		m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "demo_recorder", aBuf);
+	}
+
 	return 0;
 }
 
@@ -320,9 +655,30 @@ CDemoPlayer::CDemoPlayer(class CSnapshotDelta *pSnapshotDelta)
 	m_File = 0;
 	m_aErrorMsg[0] = 0;
 	m_pKeyFrames = 0;
+	m_ExtractMap = true;
+
+	m_pListener = 0;
+	m_pBlock = 0;
+	m_pCompressedBlock = 0;
 
 	m_pSnapshotDelta = pSnapshotDelta;
 	m_LastSnapshotDataSize = -1;
+
+	mem_zero(m_aSeekCache, sizeof(m_aSeekCache));
+	m_NumSeekCacheEntries = 0;
+	m_SeekCacheUse = 0;
+	m_LastSeekCacheSlot = -1;
+
+	m_Batching = false;
+	m_BatchSnapshot = 0;
+	m_NumBatchSnapshots = 0;
+	m_BatchMessagesSize = 0;
+}
+
+CDemoPlayer::~CDemoPlayer()
+{
+	for(int i = 0; i < SEEKCACHE_SIZE; i++)
+		mem_free(m_aSeekCache[i].m_pData);
 }
 
 void CDemoPlayer::SetListener(IListener *pListener)
@@ -331,6 +687,96 @@ void CDemoPlayer::SetListener(IListener *pListener)
 }
 
 
+bool CDemoPlayer::LoadBlock(int FilePos)
+{
+	unsigned char aHeader[BLOCK_HEADER_SIZE];
+	io_seek(m_File, FilePos, IOSEEK_START);
+	if(io_read(m_File, aHeader, sizeof(aHeader)) != sizeof(aHeader))
+		return false;
+
+	unsigned long Size = bytes_be_to_uint(aHeader);
+	unsigned CompressedSize = bytes_be_to_uint(aHeader+4);
+	if(Size > BLOCK_SIZE || CompressedSize > compressBound(BLOCK_SIZE) ||
+		io_read(m_File, m_pCompressedBlock, CompressedSize) != CompressedSize ||
+		uncompress((Bytef *)m_pBlock, &Size, (Bytef *)m_pCompressedBlock, CompressedSize) != Z_OK)
+	{
+		m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "demo_player", "error reading block");
+		return false;
+	}
+
+	m_BlockFilePos = FilePos;
+	m_NextBlockFilePos = FilePos+BLOCK_HEADER_SIZE+CompressedSize;
+	m_BlockSize = Size;
+	m_BlockOffset = 0;
+	return true;
+}
+
+bool CDemoPlayer::ReadStream(void *pData, int Size)
+{
+	if(!m_pBlock)
+		return io_read(m_File, pData, Size) == (unsigned)Size;
+
+	unsigned char *pDst = (unsigned char *)pData;
+	while(Size > 0)
+	{
+		if(m_BlockOffset == m_BlockSize && !LoadBlock(m_NextBlockFilePos))
+			return false;
+		int Bytes = min(Size, m_BlockSize-m_BlockOffset);
+		mem_copy(pDst, m_pBlock+m_BlockOffset, Bytes);
+		m_BlockOffset += Bytes;
+		pDst += Bytes;
+		Size -= Bytes;
+	}
+	return true;
+}
+
+void CDemoPlayer::SkipStream(int Size)
+{
+	if(!m_pBlock)
+	{
+		io_skip(m_File, Size);
+		return;
+	}
+
+	while(Size > 0)
+	{
+		if(m_BlockOffset == m_BlockSize && !LoadBlock(m_NextBlockFilePos))
+			return;
+		int Bytes = min(Size, m_BlockSize-m_BlockOffset);
+		m_BlockOffset += Bytes;
+		Size -= Bytes;
+	}
+}
+
+int64 CDemoPlayer::StreamPos() const
+{
+	if(!m_pBlock)
+		return io_tell(m_File);
+	return ((int64)m_BlockFilePos<<BLOCK_POS_SHIFT) | m_BlockOffset;
+}
+
+void CDemoPlayer::SeekStream(int64 Pos)
+{
+	if(!m_pBlock)
+	{
+		io_seek(m_File, (int)Pos, IOSEEK_START);
+		return;
+	}
+
+	int FilePos = (int)(Pos>>BLOCK_POS_SHIFT);
+	if(FilePos != m_BlockFilePos || !m_BlockSize)
+	{
+		if(!LoadBlock(FilePos))
+		{
+			// reading continues at the broken block and fails there
+			m_BlockSize = m_BlockOffset = 0;
+			m_NextBlockFilePos = FilePos;
+			return;
+		}
+	}
+	m_BlockOffset = min((int)(Pos&((1<<BLOCK_POS_SHIFT)-1)), m_BlockSize);
+}
+
 int CDemoPlayer::ReadChunkHeader(int *pType, int *pSize, int *pTick)
 {
 	unsigned char Chunk = 0;
@@ -338,7 +784,7 @@ int CDemoPlayer::ReadChunkHeader(int *pType, int *pSize, int *pTick)
 	*pSize = 0;
 	*pType = 0;
 
-	if(io_read(m_File, &Chunk, sizeof(Chunk)) != sizeof(Chunk))
+	if(!ReadStream(&Chunk, sizeof(Chunk)) || Chunk == CHUNK_END)
 		return -1;
 
 	if(Chunk&CHUNKTYPEFLAG_TICKMARKER)
@@ -350,7 +796,7 @@ int CDemoPlayer::ReadChunkHeader(int *pType, int *pSize, int *pTick)
 		if(Tickdelta == 0)
 		{
 			unsigned char aTickData[4];
-			if(io_read(m_File, aTickData, sizeof(aTickData)) != sizeof(aTickData))
+			if(!ReadStream(aTickData, sizeof(aTickData)))
 				return -1;
 			*pTick = bytes_be_to_uint(aTickData);
 		}
@@ -368,14 +814,14 @@ int CDemoPlayer::ReadChunkHeader(int *pType, int *pSize, int *pTick)
 		if(*pSize == 30)
 		{
 			unsigned char aSizeData[1];
-			if(io_read(m_File, aSizeData, sizeof(aSizeData)) != sizeof(aSizeData))
+			if(!ReadStream(aSizeData, sizeof(aSizeData)))
 				return -1;
 			*pSize = aSizeData[0];
 		}
 		else if(*pSize == 31)
 		{
 			unsigned char aSizeData[2];
-			if(io_read(m_File, aSizeData, sizeof(aSizeData)) != sizeof(aSizeData))
+			if(!ReadStream(aSizeData, sizeof(aSizeData)))
 				return -1;
 			*pSize = (aSizeData[1]<<8) | aSizeData[0];
 		}
@@ -384,6 +830,51 @@ int CDemoPlayer::ReadChunkHeader(int *pType, int *pSize, int *pTick)
 	return 0;
 }
 
+bool CDemoPlayer::ReadIndex(int IndexOffset)
+{
+	if(IndexOffset <= 0)
+		return false;
+
+	long StartPos = io_tell(m_File);
+	long FileLength = io_length(m_File);
+	io_seek(m_File, IndexOffset, IOSEEK_START);
+
+	unsigned char aHeader[INDEX_HEADER_SIZE];
+	bool Valid = io_read(m_File, aHeader, sizeof(aHeader)) == sizeof(aHeader) && mem_comp(aHeader, gs_aIndexMarker, sizeof(gs_aIndexMarker)) == 0;
+	int NumKeyFrames = Valid ? bytes_be_to_uint(aHeader+16) : 0;
+	if(NumKeyFrames < 0 || NumKeyFrames > (FileLength-IndexOffset)/8)
+		Valid = false;
+
+	unsigned char *pData = 0;
+	if(Valid && NumKeyFrames > 0)
+	{
+		pData = (unsigned char *)mem_alloc(NumKeyFrames*8, 1);
+		Valid = io_read(m_File, pData, NumKeyFrames*8) == (unsigned)NumKeyFrames*8;
+	}
+	io_seek(m_File, StartPos, IOSEEK_START);
+
+	if(!Valid)
+	{
+		mem_free(pData);
+		return false;
+	}
+
+	m_pKeyFrames = (CKeyFrame*)mem_alloc(NumKeyFrames*sizeof(CKeyFrame), 1);
+	for(int i = 0; i < NumKeyFrames; i++)
+	{
+		m_pKeyFrames[i].m_Filepos = bytes_be_to_uint(pData+i*8);
+		if(m_pBlock)
+			m_pKeyFrames[i].m_Filepos <<= BLOCK_POS_SHIFT;
+		m_pKeyFrames[i].m_Tick = bytes_be_to_uint(pData+i*8+4);
+	}
+	mem_free(pData);
+
+	m_Info.m_SeekablePoints = NumKeyFrames;
+	m_Info.m_Info.m_FirstTick = bytes_be_to_uint(aHeader+8);
+	m_Info.m_Info.m_LastTick = bytes_be_to_uint(aHeader+12);
+	return true;
+}
+
 void CDemoPlayer::ScanFile()
 {
 	CHeap Heap;
@@ -391,12 +882,12 @@ void CDemoPlayer::ScanFile()
 	CKeyFrameSearch *pCurrentKey = 0;
 	int ChunkTick = 0;
 
-	long StartPos = io_tell(m_File);
+	int64 StartPos = StreamPos();
 	m_Info.m_SeekablePoints = 0;
 
 	while(1)
 	{
-		long CurrentPos = io_tell(m_File);
+		int64 CurrentPos = StreamPos();
 
 		int ChunkSize, ChunkType;
 		if(ReadChunkHeader(&ChunkType, &ChunkSize, &ChunkTick))
@@ -425,7 +916,7 @@ void CDemoPlayer::ScanFile()
 			m_Info.m_Info.m_LastTick = ChunkTick;
 		}
 		else if(ChunkSize)
-			io_skip(m_File, ChunkSize);
+			SkipStream(ChunkSize);
 	}
 
 	// copy all the frames to an array instead for fast access
@@ -435,15 +926,15 @@ void CDemoPlayer::ScanFile()
 		m_pKeyFrames[i] = pCurrentKey->m_Frame;
 
 	// destroy the temporary heap and seek back to the start
-	io_seek(m_File, StartPos, IOSEEK_START);
+	SeekStream(StartPos);
 }
 
 void CDemoPlayer::DoTick()
 {
-	static char aCompressedData[CSnapshot::MAX_SIZE];
-	static char aDecompressed[CSnapshot::MAX_SIZE];
-	static char aData[CSnapshot::MAX_SIZE];
-	static char aNewSnap[CSnapshot::MAX_SIZE];
+	char *pCompressedData = m_aaTickBuffers[0];
+	char *pDecompressed = m_aaTickBuffers[1];
+	char *pData = m_aaTickBuffers[2];
+	char *pNewSnap = m_aaTickBuffers[3];
 	bool GotSnapshot = false;
 
 	// update ticks
@@ -472,7 +963,7 @@ void CDemoPlayer::DoTick()
 		// read the chunk
 		if(ChunkSize)
 		{
-			if(io_read(m_File, aCompressedData, ChunkSize) != (unsigned)ChunkSize)
+			if(!ReadStream(pCompressedData, ChunkSize))
 			{
 				// stop on error or eof
 				m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "demo_player", "error reading chunk");
@@ -480,7 +971,14 @@ void CDemoPlayer::DoTick()
 				break;
 			}
 
-			DataSize = m_Huffman.Decompress(aCompressedData, ChunkSize, aDecompressed, sizeof(aDecompressed));
+			// chunks in blocks are not huffman coded
+			if(m_pBlock)
+			{
+				DataSize = ChunkSize;
+				pDecompressed = pCompressedData;
+			}
+			else
+				DataSize = m_Huffman.Decompress(pCompressedData, ChunkSize, pDecompressed, CSnapshot::MAX_SIZE);
 			if(DataSize < 0)
 			{
 				// stop on error or eof
@@ -489,7 +987,7 @@ void CDemoPlayer::DoTick()
 				break;
 			}
 
-			DataSize = CVariableInt::Decompress(aDecompressed, DataSize, aData, sizeof(aData));
+			DataSize = CVariableInt::Decompress(pDecompressed, DataSize, pData, CSnapshot::MAX_SIZE);
 			if(DataSize < 0)
 			{
 				m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "demo_player", "error during intpack decompression");
@@ -507,14 +1005,13 @@ void CDemoPlayer::DoTick()
 			if(m_LastSnapshotDataSize == -1)
 				continue;
 
-			DataSize = m_pSnapshotDelta->UnpackDelta((CSnapshot*)m_aLastSnapshotData, (CSnapshot*)aNewSnap, aData, DataSize);
+			DataSize = m_pSnapshotDelta->UnpackDelta((CSnapshot*)m_aLastSnapshotData, (CSnapshot*)pNewSnap, pData, DataSize);
 			if(DataSize >= 0)
 			{
-				if(m_pListener)
-					m_pListener->OnDemoPlayerSnapshot(aNewSnap, DataSize);
+				DeliverSnapshot(pNewSnap, DataSize);
 
 				m_LastSnapshotDataSize = DataSize;
-				mem_copy(m_aLastSnapshotData, aNewSnap, DataSize);
+				mem_copy(m_aLastSnapshotData, pNewSnap, DataSize);
 			}
 			else
 			{
@@ -529,17 +1026,16 @@ void CDemoPlayer::DoTick()
 			CSnapshotBuilder Builder;
 			GotSnapshot = true;
 
-			if(Builder.UnserializeSnap(aData, DataSize))
-				DataSize = Builder.Finish(aNewSnap);
+			if(Builder.UnserializeSnap(pData, DataSize))
+				DataSize = Builder.Finish(pNewSnap);
 			else
 				DataSize = -1;
 
 			if(DataSize >= 0)
 			{
 				m_LastSnapshotDataSize = DataSize;
-				mem_copy(m_aLastSnapshotData, aNewSnap, DataSize);
-				if(m_pListener)
-					m_pListener->OnDemoPlayerSnapshot(aNewSnap, DataSize);
+				mem_copy(m_aLastSnapshotData, pNewSnap, DataSize);
+				DeliverSnapshot(pNewSnap, DataSize);
 			}
 			else
 			{
@@ -554,23 +1050,152 @@ void CDemoPlayer::DoTick()
 			if(!GotSnapshot && m_pListener && m_LastSnapshotDataSize != -1)
 			{
 				GotSnapshot = true;
-				m_pListener->OnDemoPlayerSnapshot(m_aLastSnapshotData, m_LastSnapshotDataSize);
+				DeliverSnapshot(m_aLastSnapshotData, m_LastSnapshotDataSize);
 			}
 
 			// check the remaining types
 			if(ChunkType&CHUNKTYPEFLAG_TICKMARKER)
 			{
 				m_Info.m_NextTick = ChunkTick;
+				AddSeekCacheEntry();
 				break;
 			}
 			else if(ChunkType == CHUNKTYPE_MESSAGE && m_pListener && m_LastSnapshotDataSize != -1)
 			{
-				m_pListener->OnDemoPlayerMessage(aData, DataSize);
+				DeliverMessage(pData, DataSize);
 			}
 		}
 	}
 }
 
+void CDemoPlayer::DeliverSnapshot(const void *pData, int Size)
+{
+	if(!m_pListener)
+		return;
+
+	if(!m_Batching)
+	{
+		m_pListener->OnDemoPlayerSnapshot((void *)pData, Size);
+		return;
+	}
+
+	// only the last two snapshots of a batch get delivered, as previous
+	// and current one
+	m_BatchSnapshot ^= 1;
+	mem_copy(m_aaBatchSnapshots[m_BatchSnapshot], pData, Size);
+	m_aBatchSnapshotSizes[m_BatchSnapshot] = Size;
+	m_NumBatchSnapshots++;
+}
+
+void CDemoPlayer::DeliverMessage(const void *pData, int Size)
+{
+	if(!m_Batching)
+	{
+		m_pListener->OnDemoPlayerMessage((void *)pData, Size);
+		return;
+	}
+
+	if(m_BatchMessagesSize+(int)sizeof(int)+Size > (int)sizeof(m_aBatchMessages))
+	{
+		FlushBatch();
+		m_Batching = true;
+	}
+	mem_copy(m_aBatchMessages+m_BatchMessagesSize, &Size, sizeof(int));
+	mem_copy(m_aBatchMessages+m_BatchMessagesSize+sizeof(int), pData, Size);
+	m_BatchMessagesSize += sizeof(int)+Size;
+}
+
+void CDemoPlayer::StartBatch()
+{
+	m_Batching = true;
+	m_NumBatchSnapshots = 0;
+	m_BatchMessagesSize = 0;
+}
+
+void CDemoPlayer::FlushBatch()
+{
+	m_Batching = false;
+	if(!m_pListener)
+		return;
+
+	if(m_NumBatchSnapshots > 1)
+		m_pListener->OnDemoPlayerSnapshot(m_aaBatchSnapshots[m_BatchSnapshot^1], m_aBatchSnapshotSizes[m_BatchSnapshot^1]);
+	if(m_NumBatchSnapshots > 0)
+		m_pListener->OnDemoPlayerSnapshot(m_aaBatchSnapshots[m_BatchSnapshot], m_aBatchSnapshotSizes[m_BatchSnapshot]);
+	m_NumBatchSnapshots = 0;
+
+	for(int Offset = 0; Offset < m_BatchMessagesSize; )
+	{
+		int Size;
+		mem_copy(&Size, m_aBatchMessages+Offset, sizeof(int));
+		m_pListener->OnDemoPlayerMessage(m_aBatchMessages+Offset+sizeof(int), Size);
+		Offset += sizeof(int)+Size;
+	}
+	m_BatchMessagesSize = 0;
+}
+
+void CDemoPlayer::AddSeekCacheEntry()
+{
+	if(m_Info.m_PreviousTick == -1 || m_LastSnapshotDataSize == -1)
+		return;
+
+	int Slot = m_Info.m_Info.m_CurrentTick/SEEKCACHE_SPACING;
+	if(Slot == m_LastSeekCacheSlot)
+		return;
+	m_LastSeekCacheSlot = Slot;
+
+	// keep the first state of each spacing interval
+	for(int i = 0; i < m_NumSeekCacheEntries; i++)
+	{
+		if(m_aSeekCache[i].m_CurrentTick/SEEKCACHE_SPACING == Slot)
+		{
+			m_aSeekCache[i].m_LastUse = ++m_SeekCacheUse;
+			return;
+		}
+	}
+
+	CSeekCacheEntry *pEntry;
+	if(m_NumSeekCacheEntries < SEEKCACHE_SIZE)
+		pEntry = &m_aSeekCache[m_NumSeekCacheEntries++];
+	else
+	{
+		pEntry = &m_aSeekCache[0];
+		for(int i = 1; i < SEEKCACHE_SIZE; i++)
+		{
+			if(m_aSeekCache[i].m_LastUse < pEntry->m_LastUse)
+				pEntry = &m_aSeekCache[i];
+		}
+	}
+
+	if(pEntry->m_DataCapacity < m_LastSnapshotDataSize)
+	{
+		mem_free(pEntry->m_pData);
+		pEntry->m_pData = (unsigned char *)mem_alloc(m_LastSnapshotDataSize, 1);
+		pEntry->m_DataCapacity = m_LastSnapshotDataSize;
+	}
+	mem_copy(pEntry->m_pData, m_aLastSnapshotData, m_LastSnapshotDataSize);
+	pEntry->m_DataSize = m_LastSnapshotDataSize;
+	pEntry->m_Filepos = StreamPos();
+	pEntry->m_PreviousTick = m_Info.m_PreviousTick;
+	pEntry->m_CurrentTick = m_Info.m_Info.m_CurrentTick;
+	pEntry->m_NextTick = m_Info.m_NextTick;
+	pEntry->m_LastUse = ++m_SeekCacheUse;
+}
+
+const CDemoPlayer::CSeekCacheEntry *CDemoPlayer::FindSeekCacheEntry(int WantedTick)
+{
+	// the latest state that still needs at least one tick to reach the wanted one
+	CSeekCacheEntry *pBest = 0;
+	for(int i = 0; i < m_NumSeekCacheEntries; i++)
+	{
+		if(m_aSeekCache[i].m_PreviousTick < WantedTick && (!pBest || m_aSeekCache[i].m_PreviousTick > pBest->m_PreviousTick))
+			pBest = &m_aSeekCache[i];
+	}
+	if(pBest)
+		pBest->m_LastUse = ++m_SeekCacheUse;
+	return pBest;
+}
+
 void CDemoPlayer::Pause()
 {
 	m_Info.m_Info.m_Paused = true;
@@ -606,6 +1231,8 @@ const char *CDemoPlayer::Load(class IStorage *pStorage, class IConsole *pConsole
 	m_Info.m_Info.m_Speed = 1;
 
 	m_LastSnapshotDataSize = -1;
+	m_NumSeekCacheEntries = 0;
+	m_LastSeekCacheSlot = -1;
 
 	// read the header
 	io_read(m_File, &m_Info.m_Header, sizeof(m_Info.m_Header));
@@ -618,7 +1245,7 @@ const char *CDemoPlayer::Load(class IStorage *pStorage, class IConsole *pConsole
 		return m_aErrorMsg;
 	}
 
-	if(m_Info.m_Header.m_Version != gs_ActVersion)
+	if(m_Info.m_Header.m_Version != gs_BlockVersion && m_Info.m_Header.m_Version != gs_ActVersion && m_Info.m_Header.m_Version != gs_OldVersion)
 	{
 		str_format(m_aErrorMsg, sizeof(m_aErrorMsg), "demo version %d is not supported", m_Info.m_Header.m_Version);
 		m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "demo_player", m_aErrorMsg);
@@ -636,6 +1263,12 @@ const char *CDemoPlayer::Load(class IStorage *pStorage, class IConsole *pConsole
 		return m_aErrorMsg;
 	}
 
+	// read the extended header
+	CDemoHeaderExt HeaderExt;
+	mem_zero(&HeaderExt, sizeof(HeaderExt));
+	if(m_Info.m_Header.m_Version >= gs_ActVersion)
+		io_read(m_File, &HeaderExt, sizeof(HeaderExt));
+
 	// get demo type
 	if(!str_comp(m_Info.m_Header.m_aType, "client"))
 		m_DemoType = DEMOTYPE_CLIENT;
@@ -646,18 +1279,32 @@ const char *CDemoPlayer::Load(class IStorage *pStorage, class IConsole *pConsole
 
 	// read map
 	unsigned MapSize = bytes_be_to_uint(m_Info.m_Header.m_aMapSize);
+	m_MapOffset = io_tell(m_File);
+
+	// the map size is only trusted as far as the file goes
+	long FileLength = io_length(m_File);
+	io_seek(m_File, m_MapOffset, IOSEEK_START);
+	if(FileLength < m_MapOffset || MapSize > (unsigned long)(FileLength-m_MapOffset))
+	{
+		str_format(m_aErrorMsg, sizeof(m_aErrorMsg), "'%s' has a truncated map", pFilename);
+		m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "demo_player", m_aErrorMsg);
+		io_close(m_File);
+		m_File = 0;
+		return m_aErrorMsg;
+	}
 
 	// check if we already have the map
 	// TODO: improve map checking (maps folder, check crc)
 	unsigned Crc = bytes_be_to_uint(m_Info.m_Header.m_aMapCrc);
 	char aMapFilename[128];
 	str_format(aMapFilename, sizeof(aMapFilename), "downloadedmaps/%s_%08x.map", m_Info.m_Header.m_aMapName, Crc);
-	IOHANDLE MapFile = pStorage->OpenFile(aMapFilename, IOFLAG_READ, IStorage::TYPE_ALL);
+	IOHANDLE MapFile = m_ExtractMap ? pStorage->OpenFile(aMapFilename, IOFLAG_READ, IStorage::TYPE_ALL) : 0;
 
-	if(MapFile)
+	if(MapFile || !m_ExtractMap)
 	{
 		io_skip(m_File, MapSize);
-		io_close(MapFile);
+		if(MapFile)
+			io_close(MapFile);
 	}
 	else if(MapSize > 0)
 	{
@@ -667,8 +1314,11 @@ const char *CDemoPlayer::Load(class IStorage *pStorage, class IConsole *pConsole
 
 		// save map
 		MapFile = pStorage->OpenFile(aMapFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
-		io_write(MapFile, pMapData, MapSize);
-		io_close(MapFile);
+		if(MapFile)
+		{
+			io_write(MapFile, pMapData, MapSize);
+			io_close(MapFile);
+		}
 
 		// free data
 		mem_free(pMapData);
@@ -681,8 +1331,19 @@ const char *CDemoPlayer::Load(class IStorage *pStorage, class IConsole *pConsole
 		m_Info.m_Info.m_aTimelineMarkers[i] = bytes_be_to_uint(m_Info.m_Header.m_aTimelineMarkers[i]);
 	}
 
-	// scan the file for interesting points
-	ScanFile();
+	// the chunks follow the map
+	if(m_Info.m_Header.m_Version == gs_BlockVersion)
+	{
+		m_pBlock = (unsigned char *)mem_alloc(BLOCK_SIZE, 1);
+		m_pCompressedBlock = (unsigned char *)mem_alloc(compressBound(BLOCK_SIZE), 1);
+		m_BlockFilePos = m_NextBlockFilePos = io_tell(m_File);
+		m_BlockSize = 0;
+		m_BlockOffset = 0;
+	}
+
+	// use the index if the recording was finished, otherwise scan the file for interesting points
+	if(!ReadIndex(bytes_be_to_uint(HeaderExt.m_aIndexOffset)))
+		ScanFile();
 
 	// ready for playback
 	return 0;
@@ -694,6 +1355,28 @@ int CDemoPlayer::NextFrame()
 	return IsPlaying();
 }
 
+void *CDemoPlayer::ReadMapData(unsigned *pSize)
+{
+	if(!m_File)
+		return 0;
+
+	// Load() made sure the file is large enough for the map
+	unsigned MapSize = bytes_be_to_uint(m_Info.m_Header.m_aMapSize);
+	void *pData = mem_alloc(max(MapSize, 1u), 1);
+	long Pos = io_tell(m_File);
+	io_seek(m_File, m_MapOffset, IOSEEK_START);
+	bool Valid = io_read(m_File, pData, MapSize) == MapSize;
+	io_seek(m_File, Pos, IOSEEK_START);
+	if(!Valid)
+	{
+		mem_free(pData);
+		return 0;
+	}
+
+	*pSize = MapSize;
+	return pData;
+}
+
 int CDemoPlayer::Play()
 {
 	// fill in previous and next tick
@@ -724,18 +1407,39 @@ int CDemoPlayer::SetPos(float Percent)
 	while(Keyframe && m_pKeyFrames[Keyframe].m_Tick > WantedTick)
 		Keyframe--;
 
-	// seek to the correct keyframe
-	io_seek(m_File, m_pKeyFrames[Keyframe].m_Filepos, IOSEEK_START);
+	// only the snapshots at the wanted position are of interest
+	StartBatch();
 
-	m_Info.m_NextTick = -1;
-	m_Info.m_Info.m_CurrentTick = -1;
-	m_Info.m_PreviousTick = -1;
+	const CSeekCacheEntry *pEntry = FindSeekCacheEntry(WantedTick);
+	if(pEntry && pEntry->m_PreviousTick >= m_pKeyFrames[Keyframe].m_Tick)
+	{
+		// resume from a decoded state closer than the keyframe
+		SeekStream(pEntry->m_Filepos);
+
+		m_Info.m_NextTick = pEntry->m_NextTick;
+		m_Info.m_Info.m_CurrentTick = pEntry->m_CurrentTick;
+		m_Info.m_PreviousTick = pEntry->m_PreviousTick;
+
+		m_LastSnapshotDataSize = pEntry->m_DataSize;
+		mem_copy(m_aLastSnapshotData, pEntry->m_pData, pEntry->m_DataSize);
+		DeliverSnapshot(m_aLastSnapshotData, m_LastSnapshotDataSize);
+	}
+	else
+	{
+		// seek to the correct keyframe
+		SeekStream(m_pKeyFrames[Keyframe].m_Filepos);
+
+		m_Info.m_NextTick = -1;
+		m_Info.m_Info.m_CurrentTick = -1;
+		m_Info.m_PreviousTick = -1;
+	}
 
 	// playback everything until we hit our tick
-	while(m_Info.m_PreviousTick < WantedTick)
+	while(m_Info.m_PreviousTick < WantedTick && IsPlaying())
 		DoTick();
 
 	Play();
+	FlushBatch();
 
 	return 0;
 }
@@ -757,6 +1461,10 @@ int CDemoPlayer::Update()
 	int64 Freq = time_freq();
 	m_Info.m_CurrentTime += (int64)(Deltatime*(double)m_Info.m_Info.m_Speed);
 
+	// when fast forwarding only the snapshots that get rendered are delivered
+	if(m_Info.m_Info.m_Speed > 1.0f)
+		StartBatch();
+
 	while(1)
 	{
 		int64 CurtickStart = (m_Info.m_Info.m_CurrentTick)*Freq/SERVER_TICK_SPEED;
@@ -769,9 +1477,14 @@ int CDemoPlayer::Update()
 		DoTick();
 
 		if(m_Info.m_Info.m_Paused)
+		{
+			FlushBatch();
 			return 0;
+		}
 	}
 
+	FlushBatch();
+
 	// update intratick
 	{
 		int64 CurtickStart = (m_Info.m_Info.m_CurrentTick)*Freq/SERVER_TICK_SPEED;
@@ -802,6 +1515,12 @@ int CDemoPlayer::Stop()
 	m_File = 0;
 	mem_free(m_pKeyFrames);
 	m_pKeyFrames = 0;
+	mem_free(m_pBlock);
+	mem_free(m_pCompressedBlock);
+	m_pBlock = 0;
+	m_pCompressedBlock = 0;
+	m_NumSeekCacheEntries = 0;
+	m_LastSeekCacheSlot = -1;
 	m_aFilename[0] = '\0';
 	return 0;
 }
@@ -835,7 +1554,7 @@ bool CDemoPlayer::GetDemoInfo(class IStorage *pStorage, const char *pFilename, i
 		return false;
 
 	io_read(File, pDemoHeader, sizeof(CDemoHeader));
-	bool Valid = mem_comp(pDemoHeader->m_aMarker, gs_aHeaderMarker, sizeof(gs_aHeaderMarker)) == 0 && pDemoHeader->m_Version == gs_ActVersion;
+	bool Valid = mem_comp(pDemoHeader->m_aMarker, gs_aHeaderMarker, sizeof(gs_aHeaderMarker)) == 0 && (pDemoHeader->m_Version == gs_BlockVersion || pDemoHeader->m_Version == gs_ActVersion || pDemoHeader->m_Version == gs_OldVersion);
 	io_close(File);
 	return Valid;
 }
@@ -3,6 +3,8 @@
 #ifndef ENGINE_SHARED_DEMO_H
 #define ENGINE_SHARED_DEMO_H
 
+#include <base/tl/array.h>
+
 #include <engine/demo.h>
 #include <engine/shared/protocol.h>
 
@@ -11,30 +13,82 @@
 
 class CDemoRecorder : public IDemoRecorder
 {
+	enum
+	{
+		QUEUE_SIZE=1024*1024, // must be a power of two
+		WRITE_BUFFER_SIZE=64*1024,
+		COMPRESS_BUFFER_SIZE=64*1024,
+	};
+
 	class IConsole *m_pConsole;
 	CHuffman m_Huffman;
 	IOHANDLE m_File;
 	int m_LastTickMarker;
 	int m_LastKeyFrame;
+	int m_KeyFrameInterval;
+	bool m_BlockCompression;
 	int m_FirstTick;
-	unsigned char m_aLastSnapshotData[CSnapshot::MAX_SIZE];
 	class CSnapshotDelta *m_pSnapshotDelta;
 	int m_NumTimelineMarkers;
 	int m_aTimelineMarkers[MAX_TIMELINE_MARKERS];
 
+	// chunks are handed to the writer thread through a bounded ring with
+	// one producer (the recording thread) and one consumer (the writer)
+	unsigned char *m_pQueue;
+	volatile unsigned m_QueueWritePos;
+	volatile unsigned m_QueueReadPos;
+	volatile bool m_StopWriter;
+	void *m_pWriterThread;
+	unsigned m_NumQueueStalls;
+	volatile unsigned m_NumWriteErrors; // counted by both threads
+
+	// only touched by the writer thread while recording
+	unsigned char m_aWriteBuffer[WRITE_BUFFER_SIZE];
+	int m_WriteBufferSize;
+	unsigned char m_aaCompressBuffer[2][COMPRESS_BUFFER_SIZE];
+	unsigned char m_aLastSnapshotData[CSnapshot::MAX_SIZE];
+	CSnapshotDelta m_WriterDelta; // a copy of the static sizes taken at start
+	int m_FilePos;
+	array<int> m_lKeyFrameIndex; // file position and tick of each keyframe
+	unsigned char *m_pBlock; // only with block compression
+	unsigned char *m_pCompressedBlock;
+	int m_BlockSize;
+
 	void WriteTickMarker(int Tick, int Keyframe);
 	void Write(int Type, const void *pData, int Size);
+
+	void QueueCopy(unsigned Pos, const void *pData, int Size);
+	void QueueFetch(unsigned Pos, void *pData, int Size);
+	static void WriterThread(void *pUser);
+	void WriteSnapshot(int Type, const unsigned char *pData, int Size);
+	void WriteChunk(int Type, const unsigned char *pData, int Size);
+	void WriteStream(const void *pData, int Size);
+	void FinishBlock();
+	void WriteBuffered(const void *pData, int Size);
+	void FlushBuffer();
+	void WriteIndex();
+	void WriteHeader(IOHANDLE DemoFile, const char *pNetVersion, const char *pMap, unsigned MapSize, unsigned MapCrc, const char *pType);
+	void StartWriter(IOHANDLE DemoFile, const char *pFilename);
 public:
 	CDemoRecorder(class CSnapshotDelta *pSnapshotDelta);
 
 	int Start(class IStorage *pStorage, class IConsole *pConsole, const char *pFilename, const char *pNetversion, const char *pMap, SHA256_DIGEST MapSha256, unsigned MapCrc, const char *pType);
+	// embeds the given map data instead of looking up the map
+	int Start(class IStorage *pStorage, class IConsole *pConsole, const char *pFilename, const char *pNetversion, const char *pMap, unsigned MapCrc, const char *pType, const void *pMapData, unsigned MapSize);
 	int Stop();
 	void AddDemoMarker();
 
+	// ticks between full snapshots, applies to the next recording
+	void SetKeyFrameInterval(int Ticks);
+	// groups the chunks into zlib compressed blocks, older players can't read these demos
+	void SetBlockCompression(bool Enable);
+
 	void RecordSnapshot(int Tick, const void *pData, int Size);
 	void RecordMessage(const void *pData, int Size);
 
 	bool IsRecording() const { return m_File != 0; }
+	// chunks left out of the last recording
+	unsigned NumWriteErrors() const { return m_NumWriteErrors; }
 
 	int Length() const { return (m_LastTickMarker - m_FirstTick)/SERVER_TICK_SPEED; }
 };
@@ -75,7 +129,7 @@ private:
 	// Playback
 	struct CKeyFrame
 	{
-		long m_Filepos;
+		int64 m_Filepos;
 		int m_Tick;
 	};
 
@@ -91,23 +145,88 @@ private:
 	char m_aFilename[256];
 	char m_aErrorMsg[256];
 	CKeyFrame *m_pKeyFrames;
+	long m_MapOffset;
+	bool m_ExtractMap;
+
+	// the current block of a block compressed demo
+	unsigned char *m_pBlock;
+	unsigned char *m_pCompressedBlock;
+	int m_BlockFilePos;
+	int m_NextBlockFilePos;
+	int m_BlockSize;
+	int m_BlockOffset;
 
 	CPlaybackInfo m_Info;
 	int m_DemoType;
 	unsigned char m_aLastSnapshotData[CSnapshot::MAX_SIZE];
 	int m_LastSnapshotDataSize;
 	class CSnapshotDelta *m_pSnapshotDelta;
+	char m_aaTickBuffers[4][CSnapshot::MAX_SIZE]; // compressed, decompressed, chunk data and new snapshot
+
+	// decoded playback states to resume from when seeking, one per spacing
+	// interval, the least recently used one gets replaced
+	enum
+	{
+		SEEKCACHE_SIZE=256,
+		SEEKCACHE_SPACING=SERVER_TICK_SPEED/5,
+	};
 
+	struct CSeekCacheEntry
+	{
+		int64 m_Filepos;
+		int m_PreviousTick;
+		int m_CurrentTick;
+		int m_NextTick;
+		unsigned m_LastUse;
+		int m_DataSize;
+		int m_DataCapacity;
+		unsigned char *m_pData;
+	};
+
+	CSeekCacheEntry m_aSeekCache[SEEKCACHE_SIZE];
+	int m_NumSeekCacheEntries;
+	unsigned m_SeekCacheUse;
+	int m_LastSeekCacheSlot;
+
+	// while batching, the listener only gets the last two snapshots and
+	// the collected messages on flush
+	enum
+	{
+		BATCH_MESSAGES_SIZE=64*1024,
+	};
+
+	bool m_Batching;
+	int m_BatchSnapshot;
+	int m_NumBatchSnapshots;
+	char m_aaBatchSnapshots[2][CSnapshot::MAX_SIZE];
+	int m_aBatchSnapshotSizes[2];
+	unsigned char m_aBatchMessages[BATCH_MESSAGES_SIZE];
+	int m_BatchMessagesSize;
+
+	bool LoadBlock(int FilePos);
+	bool ReadStream(void *pData, int Size);
+	void SkipStream(int Size);
+	int64 StreamPos() const;
+	void SeekStream(int64 Pos);
 	int ReadChunkHeader(int *pType, int *pSize, int *pTick);
 	void DoTick();
+	void DeliverSnapshot(const void *pData, int Size);
+	void DeliverMessage(const void *pData, int Size);
+	void StartBatch();
+	void FlushBatch();
+	bool ReadIndex(int IndexOffset);
 	void ScanFile();
-	int NextFrame();
+	void AddSeekCacheEntry();
+	const CSeekCacheEntry *FindSeekCacheEntry(int WantedTick);
 
 public:
 
 	CDemoPlayer(class CSnapshotDelta *m_pSnapshotDelta);
+	~CDemoPlayer();
 
 	void SetListener(IListener *pListner);
+	// whether Load() saves the embedded map to downloadedmaps
+	void SetMapExtraction(bool Extract) { m_ExtractMap = Extract; }
 
 	const char *Load(class IStorage *pStorage, class IConsole *pConsole, const char *pFilename, int StorageType, const char *pNetversion);
 	int Play();
@@ -123,6 +242,11 @@ public:
 
 	int Update();
 
+	// advances one tick regardless of the playback time, for headless playback
+	int NextFrame();
+	// returns the embedded map, free it with mem_free
+	void *ReadMapData(unsigned *pSize);
+
 	const CPlaybackInfo *Info() const { return &m_Info; }
 	int IsPlaying() const { return m_File != 0; }
 };
@@ -18,6 +18,7 @@ int CEcon::NewClientCallback(int ClientID, void *pUser)
 	pThis->m_aClients[ClientID].m_State = CClient::STATE_CONNECTED;
 	pThis->m_aClients[ClientID].m_TimeConnected = time_get();
 	pThis->m_aClients[ClientID].m_AuthTries = 0;
+	pThis->m_aClients[ClientID].m_InBatch = false;
 
 	pThis->m_NetConsole.Send(ClientID, "Enter password:");
 	return 0;
@@ -34,6 +35,13 @@ int CEcon::DelClientCallback(int ClientID, const char *pReason, void *pUser)
 	pThis->Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "econ", aBuf);
 
 	pThis->m_aClients[ClientID].m_State = CClient::STATE_EMPTY;
+
+	// drop the commands that are still waiting
+	for(CQueuedCommand *pCommand = pThis->m_CommandQueue.First(); pCommand; pCommand = pThis->m_CommandQueue.Next(pCommand))
+	{
+		if(pCommand->m_ClientID == ClientID)
+			pCommand->m_ClientID = -1;
+	}
 	return 0;
 }
 
@@ -87,6 +95,7 @@ void CEcon::SetDefaultValues()
 	m_Ready = false;
 	m_LastOpenTry = 0;
 	m_UserClientID = -1;
+	m_CommandQueue.Init();
 }
 
 bool CEcon::Open()
@@ -175,12 +184,32 @@ void CEcon::Update()
 		}
 		else if(m_aClients[ClientID].m_State == CClient::STATE_AUTHED)
 		{
-			char aFormatted[256];
-			str_format(aFormatted, sizeof(aFormatted), "cid=%d cmd='%s'", ClientID, aBuf);
-			Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "server", aFormatted);
-			m_UserClientID = ClientID;
-			Console()->ExecuteLine(aBuf);
-			m_UserClientID = -1;
+			CClient *pClient = &m_aClients[ClientID];
+			if(str_comp(aBuf, "batch_begin") == 0)
+			{
+				pClient->m_InBatch = true;
+				pClient->m_BatchSize = 0;
+				pClient->m_BatchDropped = 0;
+			}
+			else if(str_comp(aBuf, "batch_end") == 0 && pClient->m_InBatch)
+			{
+				pClient->m_InBatch = false;
+				str_format(aBuf, sizeof(aBuf), "batch done. commands=%d dropped=%d", pClient->m_BatchSize, pClient->m_BatchDropped);
+				if(!QueueCommand(ClientID, CQueuedCommand::TYPE_BATCH_END, aBuf))
+					m_NetConsole.Send(ClientID, aBuf);
+			}
+			else if(QueueCommand(ClientID, CQueuedCommand::TYPE_COMMAND, aBuf))
+			{
+				if(pClient->m_InBatch)
+					pClient->m_BatchSize++;
+			}
+			else
+			{
+				if(pClient->m_InBatch)
+					pClient->m_BatchDropped++;
+				else
+					m_NetConsole.Send(ClientID, "Command queue is full, command dropped.");
+			}
 		}
 	}
 
@@ -190,6 +219,52 @@ void CEcon::Update()
 			time_get() > m_aClients[i].m_TimeConnected + m_pConfig->m_EcAuthTimeout * time_freq())
 			m_NetConsole.Drop(i, "authentication timeout");
 	}
+
+	// send the output collected since the last update in one go
+	m_NetConsole.Flush();
+}
+
+bool CEcon::QueueCommand(int ClientID, int Type, const char *pLine)
+{
+	int Length = str_length(pLine);
+	CQueuedCommand *pCommand = m_CommandQueue.Allocate(sizeof(CQueuedCommand)+Length);
+	if(!pCommand)
+		return false;
+	pCommand->m_ClientID = ClientID;
+	pCommand->m_Type = Type;
+	mem_copy(pCommand->m_aLine, pLine, Length+1);
+	return true;
+}
+
+void CEcon::ExecuteCommands()
+{
+	int64 Start = time_get();
+	int64 Budget = (int64)m_pConfig->m_EcCommandBudget*time_freq()/1000000;
+	int NumExecuted = 0;
+
+	for(CQueuedCommand *pCommand = m_CommandQueue.First(); pCommand; pCommand = m_CommandQueue.First())
+	{
+		// always make progress, then stop once the budget of this tick is used up
+		if(Budget && NumExecuted && time_get()-Start >= Budget)
+			break;
+
+		if(pCommand->m_ClientID >= 0)
+		{
+			if(pCommand->m_Type == CQueuedCommand::TYPE_BATCH_END)
+				m_NetConsole.Send(pCommand->m_ClientID, pCommand->m_aLine);
+			else
+			{
+				char aFormatted[256];
+				str_format(aFormatted, sizeof(aFormatted), "cid=%d cmd='%s'", pCommand->m_ClientID, pCommand->m_aLine);
+				Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "server", aFormatted);
+				m_UserClientID = pCommand->m_ClientID;
+				Console()->ExecuteLine(pCommand->m_aLine);
+				m_UserClientID = -1;
+				NumExecuted++;
+			}
+		}
+		m_CommandQueue.PopFirst();
+	}
 }
 
 void CEcon::Send(int ClientID, const char *pLine)
@@ -2,6 +2,7 @@
 #define ENGINE_SHARED_ECON_H
 
 #include "network.h"
+#include "ringbuffer.h"
 
 
 class CEcon
@@ -9,6 +10,7 @@ class CEcon
 	enum
 	{
 		MAX_AUTH_TRIES=3,
+		COMMAND_QUEUE_SIZE=256*1024,
 	};
 
 	class CClient
@@ -24,9 +26,31 @@ class CEcon
 		int m_State;
 		int64 m_TimeConnected;
 		int m_AuthTries;
+
+		// lines between "batch_begin" and "batch_end" get acknowledged
+		// together once the last of them was executed
+		bool m_InBatch;
+		int m_BatchSize;
+		int m_BatchDropped;
 	};
 	CClient m_aClients[NET_MAX_CONSOLE_CLIENTS];
 
+	// received commands wait here until there is time left in a tick
+	class CQueuedCommand
+	{
+	public:
+		enum
+		{
+			TYPE_COMMAND=0,
+			TYPE_BATCH_END, // the line holds the reply to the batch sender
+		};
+
+		int m_ClientID; // -1 once the sender is gone
+		int m_Type;
+		char m_aLine[1];
+	};
+	TStaticRingBuffer<CQueuedCommand, COMMAND_QUEUE_SIZE> m_CommandQueue;
+
 	CConfig *m_pConfig;
 	IConsole *m_pConsole;
 	CNetBan *m_pNetBan;
@@ -38,6 +62,7 @@ class CEcon
 	int m_UserClientID;
 
 	void SetDefaultValues();
+	bool QueueCommand(int ClientID, int Type, const char *pLine);
 
 	static void SendLineCB(const char *pLine, void *pUserData, bool Highlighted);
 	static void ConchainEconOutputLevelUpdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData);
@@ -53,6 +78,8 @@ public:
 	void Init(CConfig *pConfig, IConsole *pConsole, class CNetBan *pNetBan);
 	bool Open();
 	void Update();
+	// runs queued commands until ec_command_budget is used up, call once per tick
+	void ExecuteCommands();
 	void Send(int ClientID, const char *pLine);
 	void Shutdown();
 };
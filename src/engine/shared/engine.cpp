@@ -8,6 +8,7 @@
 #include <engine/engine.h>
 #include <engine/storage.h>
 #include <engine/shared/config.h>
+#include <engine/shared/netcapture.h>
 #include <engine/shared/network.h>
 
 
@@ -26,6 +27,7 @@ public:
 	bool m_Logging;
 	IOHANDLE m_DataLogSent;
 	IOHANDLE m_DataLogRecv;
+	CNetCaptureWriter m_NetCapture;
 	const char *m_pAppname;
 
 	static void Con_DbgLognetwork(IConsole::IResult *pResult, void *pUserData)
@@ -48,6 +50,28 @@ public:
 		}
 	}
 
+	static void Con_DbgCapturenetwork(IConsole::IResult *pResult, void *pUserData)
+	{
+		CEngine *pEngine = static_cast<CEngine *>(pUserData);
+
+		if(pEngine->m_NetCapture.IsOpen())
+		{
+			dbg_msg("engine", "stopped network capture, %u records", pEngine->m_NetCapture.NumRecords());
+			pEngine->m_NetCapture.Close();
+		}
+		else
+		{
+			char aBuf[32];
+			str_timestamp(aBuf, sizeof(aBuf));
+			char aFilename[128];
+			str_format(aFilename, sizeof(aFilename), "dumps/%s_capture_%s.twcap", pEngine->m_pAppname, aBuf);
+			if(pEngine->m_NetCapture.Open(pEngine->m_pStorage->OpenFile(aFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE)))
+				dbg_msg("engine", "capturing network to '%s'", aFilename);
+			else
+				dbg_msg("engine", "failed to open '%s' for the network capture", aFilename);
+		}
+	}
+
 	CEngine(const char *pAppname)
 	{
 		srand(time_get());
@@ -88,6 +112,7 @@ public:
 			return;
 
 		m_pConsole->Register("dbg_lognetwork", "", CFGFLAG_SERVER|CFGFLAG_CLIENT, Con_DbgLognetwork, this, "Log the network");
+		m_pConsole->Register("dbg_capturenetwork", "", CFGFLAG_SERVER|CFGFLAG_CLIENT, Con_DbgCapturenetwork, this, "Toggle a structured capture of the network chunks");
 	}
 
 	void InitLogfile()
@@ -116,6 +141,11 @@ public:
 		*pHDLRecv = m_DataLogRecv;
 	}
 
+	CNetCaptureWriter *QueryNetCapture()
+	{
+		return m_NetCapture.IsOpen() ? &m_NetCapture : 0;
+	}
+
 	void StartLogging(IOHANDLE DataLogSent, IOHANDLE DataLogRecv)
 	{
 		if(DataLogSent)
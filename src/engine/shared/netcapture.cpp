@@ -0,0 +1,172 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/system.h>
+
+#include "netcapture.h"
+
+static const char s_aMagic[8] = {'T', 'W', 'N', 'E', 'T', 'C', 'A', 'P'};
+
+static unsigned char *PackInt(unsigned char *pDst, unsigned Value)
+{
+	pDst[0] = (Value>>24)&0xff;
+	pDst[1] = (Value>>16)&0xff;
+	pDst[2] = (Value>>8)&0xff;
+	pDst[3] = Value&0xff;
+	return pDst+4;
+}
+
+static const unsigned char *UnpackInt(const unsigned char *pSrc, int *pValue)
+{
+	*pValue = (int)((pSrc[0]<<24) | (pSrc[1]<<16) | (pSrc[2]<<8) | pSrc[3]);
+	return pSrc+4;
+}
+
+const char *CNetCapture::TypeName(int Type)
+{
+	static const char *s_apNames[NUM_RECORDTYPES] = { "recv", "send", "connect", "drop" };
+	if(Type < 0 || Type >= NUM_RECORDTYPES)
+		return "unknown";
+	return s_apNames[Type];
+}
+
+
+CNetCaptureWriter::CNetCaptureWriter()
+{
+	m_File = 0;
+	m_StartTime = 0;
+	m_NumRecords = 0;
+}
+
+CNetCaptureWriter::~CNetCaptureWriter()
+{
+	Close();
+}
+
+bool CNetCaptureWriter::Open(IOHANDLE File)
+{
+	Close();
+	if(!File)
+		return false;
+
+	unsigned char aHeader[CNetCapture::HEADER_SIZE];
+	mem_copy(aHeader, s_aMagic, sizeof(s_aMagic));
+	PackInt(aHeader+sizeof(s_aMagic), CNetCapture::VERSION);
+	io_write(File, aHeader, sizeof(aHeader));
+
+	m_File = File;
+	m_StartTime = time_get();
+	m_NumRecords = 0;
+	return true;
+}
+
+void CNetCaptureWriter::Close()
+{
+	if(!m_File)
+		return;
+	io_close(m_File);
+	m_File = 0;
+}
+
+void CNetCaptureWriter::Write(int Type, int Flags, int ClientID, const NETADDR *pAddr, const void *pData, int DataSize)
+{
+	if(!m_File)
+		return;
+
+	int64 Time = (time_get()-m_StartTime)*1000000/time_freq();
+
+	unsigned char aHeader[CNetCapture::RECORD_HEADER_SIZE];
+	unsigned char *p = aHeader;
+	p = PackInt(p, (unsigned)(Time>>32));
+	p = PackInt(p, (unsigned)Time);
+	*p++ = Type;
+	*p++ = Flags;
+	p = PackInt(p, ClientID);
+	*p++ = pAddr->type;
+	mem_copy(p, pAddr->ip, sizeof(pAddr->ip));
+	p += sizeof(pAddr->ip);
+	*p++ = (pAddr->port>>8)&0xff;
+	*p++ = pAddr->port&0xff;
+	p = PackInt(p, DataSize);
+	dbg_assert(p-aHeader == CNetCapture::RECORD_HEADER_SIZE, "inconsistency");
+
+	io_write(m_File, aHeader, sizeof(aHeader));
+	if(DataSize > 0)
+		io_write(m_File, pData, DataSize);
+	m_NumRecords++;
+}
+
+
+CNetCaptureReader::CNetCaptureReader()
+{
+	m_File = 0;
+}
+
+CNetCaptureReader::~CNetCaptureReader()
+{
+	Close();
+}
+
+bool CNetCaptureReader::Open(IOHANDLE File)
+{
+	Close();
+	if(!File)
+		return false;
+
+	unsigned char aHeader[CNetCapture::HEADER_SIZE];
+	int Version = 0;
+	if(io_read(File, aHeader, sizeof(aHeader)) != sizeof(aHeader) || mem_comp(aHeader, s_aMagic, sizeof(s_aMagic)) != 0)
+	{
+		io_close(File);
+		return false;
+	}
+	UnpackInt(aHeader+sizeof(s_aMagic), &Version);
+	if(Version != CNetCapture::VERSION)
+	{
+		io_close(File);
+		return false;
+	}
+
+	m_File = File;
+	return true;
+}
+
+void CNetCaptureReader::Close()
+{
+	if(!m_File)
+		return;
+	io_close(m_File);
+	m_File = 0;
+}
+
+bool CNetCaptureReader::Read(CNetCapture::CRecord *pRecord)
+{
+	if(!m_File)
+		return false;
+
+	unsigned char aHeader[CNetCapture::RECORD_HEADER_SIZE];
+	if(io_read(m_File, aHeader, sizeof(aHeader)) != sizeof(aHeader))
+		return false;
+
+	const unsigned char *p = aHeader;
+	int TimeHigh, TimeLow;
+	p = UnpackInt(p, &TimeHigh);
+	p = UnpackInt(p, &TimeLow);
+	pRecord->m_Time = ((int64)TimeHigh<<32) | (unsigned)TimeLow;
+	pRecord->m_Type = *p++;
+	pRecord->m_Flags = *p++;
+	p = UnpackInt(p, &pRecord->m_ClientID);
+	mem_zero(&pRecord->m_Addr, sizeof(pRecord->m_Addr));
+	pRecord->m_Addr.type = *p++;
+	mem_copy(pRecord->m_Addr.ip, p, sizeof(pRecord->m_Addr.ip));
+	p += sizeof(pRecord->m_Addr.ip);
+	pRecord->m_Addr.port = (p[0]<<8) | p[1];
+	p += 2;
+	p = UnpackInt(p, &pRecord->m_DataSize);
+
+	if(pRecord->m_Type >= CNetCapture::NUM_RECORDTYPES || pRecord->m_DataSize < 0 || pRecord->m_DataSize > (int)sizeof(m_aData))
+		return false;
+	if(pRecord->m_DataSize && io_read(m_File, m_aData, pRecord->m_DataSize) != (unsigned)pRecord->m_DataSize)
+		return false;
+	pRecord->m_pData = m_aData;
+	return true;
+}
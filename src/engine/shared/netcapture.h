@@ -0,0 +1,98 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef ENGINE_SHARED_NETCAPTURE_H
+#define ENGINE_SHARED_NETCAPTURE_H
+
+#include <base/system.h>
+
+#include "network.h"
+
+/*
+	Structured network capture on chunk level, the way the chunks are handed
+	to and from CNetServer/CNetClient.
+
+	File layout, integers are stored in network byte order:
+		header:
+			char magic[8] = "TWNETCAP"
+			int32 version
+		record:
+			int64 time          // microseconds since the capture was started
+			uint8 type          // RECORD_*
+			uint8 flags         // NETSENDFLAG_* of the chunk
+			int32 client id     // -1 for connless chunks of unknown peers
+			uint8 addr type
+			uint8 addr ip[16]
+			uint16 addr port
+			int32 data size
+			data
+*/
+class CNetCapture
+{
+public:
+	enum
+	{
+		VERSION=1,
+		HEADER_SIZE=12,
+		RECORD_HEADER_SIZE=8+1+1+4+1+16+2+4,
+
+		RECORD_RECV=0, // chunk returned by Recv()
+		RECORD_SEND, // chunk passed to Send()
+		RECORD_CONNECT, // peer got a connection slot
+		RECORD_DROP, // peer lost its slot, the data holds the reason
+		NUM_RECORDTYPES,
+	};
+
+	class CRecord
+	{
+	public:
+		int64 m_Time;
+		int m_Type;
+		int m_Flags;
+		int m_ClientID;
+		NETADDR m_Addr;
+		int m_DataSize;
+		const unsigned char *m_pData;
+	};
+
+	static const char *TypeName(int Type);
+};
+
+class CNetCaptureWriter
+{
+	IOHANDLE m_File;
+	int64 m_StartTime;
+	unsigned m_NumRecords;
+
+public:
+	CNetCaptureWriter();
+	~CNetCaptureWriter();
+
+	// takes ownership of the file
+	bool Open(IOHANDLE File);
+	void Close();
+	bool IsOpen() const { return m_File != 0; }
+	unsigned NumRecords() const { return m_NumRecords; }
+
+	void Write(int Type, int Flags, int ClientID, const NETADDR *pAddr, const void *pData, int DataSize);
+	void WriteChunk(int Type, const CNetChunk *pChunk) { Write(Type, pChunk->m_Flags, pChunk->m_ClientID, &pChunk->m_Address, pChunk->m_pData, pChunk->m_DataSize); }
+};
+
+class CNetCaptureReader
+{
+	IOHANDLE m_File;
+	unsigned char m_aData[NET_MAX_PACKETSIZE];
+
+public:
+	CNetCaptureReader();
+	~CNetCaptureReader();
+
+	// takes ownership of the file
+	bool Open(IOHANDLE File);
+	void Close();
+
+	// returns false at the end of the file or on broken records, the record
+	// data stays valid until the next call
+	bool Read(CNetCapture::CRecord *pRecord);
+};
+
+#endif
@@ -0,0 +1,191 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+#include <base/system.h>
+
+#include "nettransport.h"
+
+
+void CNetTransportUdp::Close()
+{
+	net_udp_close(m_Socket);
+	net_invalidate_socket(&m_Socket);
+}
+
+
+CNetLoopback::CEndpoint::CEndpoint(CNetLoopback *pLoopback, const NETADDR *pAddr, int RingSize)
+{
+	m_pLoopback = pLoopback;
+	m_Addr = *pAddr;
+	m_Lock = lock_create();
+	m_pRingMemory = mem_alloc(RingSize, 1);
+	m_Ring.Init(m_pRingMemory, RingSize);
+	m_NumQueued = 0;
+	m_NumSent = 0;
+	m_NumRecv = 0;
+	m_NumDropped = 0;
+}
+
+CNetLoopback::CEndpoint::~CEndpoint()
+{
+	Close();
+	lock_destroy(m_Lock);
+	mem_free(m_pRingMemory);
+}
+
+bool CNetLoopback::CEndpoint::Push(const NETADDR *pFrom, const void *pData, int Size)
+{
+	lock_wait(m_Lock);
+	CDatagram *pDatagram = m_Ring.Allocate(sizeof(CDatagram)+Size);
+	if(pDatagram)
+	{
+		pDatagram->m_Addr = *pFrom;
+		pDatagram->m_Size = Size;
+		mem_copy(pDatagram+1, pData, Size);
+		m_NumQueued++;
+	}
+	lock_unlock(m_Lock);
+	return pDatagram != 0;
+}
+
+int CNetLoopback::CEndpoint::Send(const NETADDR *pAddr, const void *pData, int Size)
+{
+	if(!m_pLoopback)
+		return -1;
+
+	// the hub lock keeps the target alive while copying
+	lock_wait(m_pLoopback->m_Lock);
+	CEndpoint *pTarget = m_pLoopback->Find(pAddr);
+	bool Delivered = pTarget && pTarget->Push(&m_Addr, pData, Size);
+	lock_unlock(m_pLoopback->m_Lock);
+
+	if(!Delivered)
+	{
+		m_NumDropped++;
+		return -1;
+	}
+	m_NumSent++;
+	return Size;
+}
+
+int CNetLoopback::CEndpoint::Recv(NETADDR *pAddr, void *pBuffer, int MaxSize)
+{
+	if(!m_NumQueued)
+		return 0;
+
+	lock_wait(m_Lock);
+	int Size = 0;
+	CDatagram *pDatagram = m_Ring.First();
+	if(pDatagram)
+	{
+		*pAddr = pDatagram->m_Addr;
+		Size = min(pDatagram->m_Size, MaxSize);
+		mem_copy(pBuffer, pDatagram+1, Size);
+		m_Ring.PopFirst();
+		m_NumQueued--;
+		m_NumRecv++;
+	}
+	lock_unlock(m_Lock);
+	return Size;
+}
+
+void CNetLoopback::CEndpoint::Wait(int Time)
+{
+	// only sleeps when there is nothing to do, no wakeup on new data
+	int64 End = time_get() + time_freq()*Time/1000;
+	while(!m_NumQueued && time_get() < End)
+		thread_sleep(1);
+}
+
+void CNetLoopback::CEndpoint::Close()
+{
+	if(!m_pLoopback)
+		return;
+
+	lock_wait(m_pLoopback->m_Lock);
+	for(int i = 0; i < MAX_ENDPOINTS; i++)
+	{
+		if(m_pLoopback->m_apEndpoints[i] == this)
+			m_pLoopback->m_apEndpoints[i] = 0;
+	}
+	lock_unlock(m_pLoopback->m_Lock);
+	m_pLoopback = 0;
+}
+
+
+CNetLoopback::CNetLoopback()
+{
+	m_Lock = lock_create();
+	mem_zero(m_apEndpoints, sizeof(m_apEndpoints));
+	m_NextPort = FIRST_AUTO_PORT;
+}
+
+CNetLoopback::~CNetLoopback()
+{
+	// detach the endpoints which are still around
+	for(int i = 0; i < MAX_ENDPOINTS; i++)
+	{
+		if(m_apEndpoints[i])
+			m_apEndpoints[i]->m_pLoopback = 0;
+	}
+	lock_destroy(m_Lock);
+}
+
+CNetLoopback::CEndpoint *CNetLoopback::Find(const NETADDR *pAddr)
+{
+	for(int i = 0; i < MAX_ENDPOINTS; i++)
+	{
+		if(m_apEndpoints[i] && net_addr_comp(&m_apEndpoints[i]->m_Addr, pAddr, true) == 0)
+			return m_apEndpoints[i];
+	}
+	return 0;
+}
+
+CNetLoopback::CEndpoint *CNetLoopback::Bind(int Port, int RingSize)
+{
+	lock_wait(m_Lock);
+
+	NETADDR Addr;
+	int Slot = -1;
+	for(int Tries = 0; Tries < 0x10000; Tries++)
+	{
+		if(Port == 0)
+		{
+			Address(m_NextPort, &Addr);
+			m_NextPort = m_NextPort >= 0xffff ? FIRST_AUTO_PORT : m_NextPort+1;
+		}
+		else
+			Address(Port, &Addr);
+
+		if(!Find(&Addr))
+		{
+			for(int i = 0; i < MAX_ENDPOINTS && Slot == -1; i++)
+			{
+				if(!m_apEndpoints[i])
+					Slot = i;
+			}
+			break;
+		}
+		else if(Port != 0)
+			break; // already in use
+	}
+
+	CEndpoint *pEndpoint = 0;
+	if(Slot != -1)
+	{
+		pEndpoint = new CEndpoint(this, &Addr, RingSize);
+		m_apEndpoints[Slot] = pEndpoint;
+	}
+
+	lock_unlock(m_Lock);
+	return pEndpoint;
+}
+
+void CNetLoopback::Address(int Port, NETADDR *pAddr)
+{
+	mem_zero(pAddr, sizeof(*pAddr));
+	pAddr->type = NETTYPE_IPV4;
+	pAddr->ip[0] = 127;
+	pAddr->ip[3] = 1;
+	pAddr->port = Port;
+}
@@ -0,0 +1,125 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef ENGINE_SHARED_NETTRANSPORT_H
+#define ENGINE_SHARED_NETTRANSPORT_H
+
+#include <base/system.h>
+
+#include "ringbuffer.h"
+
+/*
+	Moves raw datagrams for CNetBase. The default is a UDP socket, the
+	loopback transport below keeps everything inside the process.
+*/
+class INetTransport
+{
+public:
+	virtual ~INetTransport() {}
+
+	virtual int NetType() const = 0;
+	virtual int Send(const NETADDR *pAddr, const void *pData, int Size) = 0;
+	// returns the size of the received datagram, 0 or less if there is none
+	virtual int Recv(NETADDR *pAddr, void *pBuffer, int MaxSize) = 0;
+	// waits at most Time milliseconds for incoming data
+	virtual void Wait(int Time) = 0;
+	virtual void Close() = 0;
+};
+
+class CNetTransportUdp : public INetTransport
+{
+	NETSOCKET m_Socket;
+
+public:
+	CNetTransportUdp(NETSOCKET Socket) : m_Socket(Socket) {}
+
+	virtual int NetType() const { return m_Socket.type; }
+	virtual int Send(const NETADDR *pAddr, const void *pData, int Size) { return net_udp_send(m_Socket, pAddr, pData, Size); }
+	virtual int Recv(NETADDR *pAddr, void *pBuffer, int MaxSize) { return net_udp_recv(m_Socket, pAddr, pBuffer, MaxSize); }
+	virtual void Wait(int Time) { net_socket_read_wait(m_Socket, Time); }
+	virtual void Close();
+};
+
+/*
+	In-process datagram exchange. Every endpoint gets a virtual port on
+	127.0.0.1 and a ring buffer for its incoming datagrams, sending copies the
+	datagram into the ring of the receiving endpoint. No system calls are done
+	on the way, the per endpoint lock is only contended when several threads
+	talk to the same endpoint. Like UDP, datagrams to unknown ports or into a
+	full ring are dropped.
+*/
+class CNetLoopback
+{
+public:
+	enum
+	{
+		MAX_ENDPOINTS=128,
+		FIRST_AUTO_PORT=40000,
+
+		RINGSIZE_CLIENT=64*1024,
+		RINGSIZE_SERVER=1024*1024,
+	};
+
+	class CEndpoint : public INetTransport
+	{
+		friend class CNetLoopback;
+
+		class CDatagram
+		{
+		public:
+			NETADDR m_Addr;
+			int m_Size;
+		};
+
+		class CRing : public CRingBufferBase
+		{
+		public:
+			void Init(void *pMemory, int Size) { CRingBufferBase::Init(pMemory, Size, 0); }
+			CDatagram *Allocate(int Size) { return (CDatagram *)CRingBufferBase::Allocate(Size); }
+			CDatagram *First() { return (CDatagram *)CRingBufferBase::First(); }
+			int PopFirst() { return CRingBufferBase::PopFirst(); }
+		};
+
+		CNetLoopback *m_pLoopback;
+		NETADDR m_Addr;
+		LOCK m_Lock;
+		CRing m_Ring;
+		void *m_pRingMemory;
+		volatile int m_NumQueued;
+
+		bool Push(const NETADDR *pFrom, const void *pData, int Size);
+
+	public:
+		unsigned m_NumSent;
+		unsigned m_NumRecv;
+		unsigned m_NumDropped;
+
+		CEndpoint(CNetLoopback *pLoopback, const NETADDR *pAddr, int RingSize);
+		~CEndpoint();
+
+		const NETADDR *Address() const { return &m_Addr; }
+
+		virtual int NetType() const { return NETTYPE_IPV4; }
+		virtual int Send(const NETADDR *pAddr, const void *pData, int Size);
+		virtual int Recv(NETADDR *pAddr, void *pBuffer, int MaxSize);
+		virtual void Wait(int Time);
+		virtual void Close();
+	};
+
+private:
+	LOCK m_Lock;
+	CEndpoint *m_apEndpoints[MAX_ENDPOINTS];
+	int m_NextPort;
+
+	CEndpoint *Find(const NETADDR *pAddr);
+
+public:
+	CNetLoopback();
+	~CNetLoopback();
+
+	// Port 0 picks the next free port. The endpoint belongs to the caller,
+	// closing it releases the port.
+	CEndpoint *Bind(int Port, int RingSize = RINGSIZE_CLIENT);
+	static void Address(int Port, NETADDR *pAddr);
+};
+
+#endif
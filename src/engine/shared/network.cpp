@@ -7,6 +7,7 @@
 
 #include "config.h"
 #include "console.h"
+#include "netcapture.h"
 #include "network.h"
 #include "huffman.h"
 
@@ -107,39 +108,63 @@ CNetBase::CNetInitializer CNetBase::m_NetInitializer;
 
 CNetBase::CNetBase()
 {
-	net_invalidate_socket(&m_Socket);
+	m_pTransport = 0;
+	m_OwnTransport = false;
 	m_pConfig = 0;
 	m_pEngine = 0;
 	m_DataLogSent = 0;
 	m_DataLogRecv = 0;
+	m_pCapture = 0;
 }
 
 CNetBase::~CNetBase()
 {
-	if(m_Socket.type != NETTYPE_INVALID)
+	if(m_pTransport)
 		Shutdown();
 }
 
-void CNetBase::Init(NETSOCKET Socket, CConfig *pConfig, IConsole *pConsole, IEngine *pEngine)
+INetTransport *CNetBase::CreateUdpTransport(NETADDR BindAddr, int Flags)
 {
-	m_Socket = Socket;
+	int SocketFlags = 0;
+	if(Flags&NETCREATE_FLAG_RANDOMPORT)
+		SocketFlags |= NETSOCKET_FLAG_RANDOMPORT;
+	if(Flags&NETCREATE_FLAG_REUSEPORT)
+		SocketFlags |= NETSOCKET_FLAG_REUSEPORT;
+	NETSOCKET Socket = net_udp_create(BindAddr, SocketFlags);
+	if(!Socket.type)
+		return 0;
+	return new CNetTransportUdp(Socket);
+}
+
+void CNetBase::Init(INetTransport *pTransport, bool Own, CConfig *pConfig, IConsole *pConsole, IEngine *pEngine)
+{
+	m_pTransport = pTransport;
+	m_OwnTransport = Own;
 	m_pConfig = pConfig;
 	m_pEngine = pEngine;
 	m_Huffman.Init();
 	mem_zero(m_aRequestTokenBuf, sizeof(m_aRequestTokenBuf));
 	if(pEngine)
+	{
 		pConsole->Chain("dbg_lognetwork", ConchainDbgLognetwork, this);
+		pConsole->Chain("dbg_capturenetwork", ConchainDbgLognetwork, this);
+		UpdateLogHandles();
+	}
 }
 
 void CNetBase::Shutdown()
 {
-	net_udp_close(m_Socket);
-	net_invalidate_socket(&m_Socket);
+	if(!m_pTransport)
+		return;
+	m_pTransport->Close();
+	if(m_OwnTransport)
+		delete m_pTransport;
+	m_pTransport = 0;
 }
 
 void CNetBase::Wait(int Time)
 {
-	net_socket_read_wait(m_Socket, Time);
+	m_pTransport->Wait(Time);
 }
 
 // packs the data tight and sends it
@@ -165,7 +190,7 @@ void CNetBase::SendPacketConnless(const NETADDR *pAddr, TOKEN Token, TOKEN Respo
 	dbg_assert(i == NET_PACKETHEADERSIZE_CONNLESS, "inconsistency");
 
 	mem_copy(&aBuffer[i], pData, DataSize);
-	net_udp_send(m_Socket, pAddr, aBuffer, i+DataSize);
+	m_pTransport->Send(pAddr, aBuffer, i+DataSize);
 }
 
 void CNetBase::SendPacket(const NETADDR *pAddr, CNetPacketConstruct *pPacket)
@@ -220,7 +245,7 @@ void CNetBase::SendPacket(const NETADDR *pAddr, CNetPacketConstruct *pPacket)
 
 		dbg_assert(i == NET_PACKETHEADERSIZE, "inconsistency");
 
-		net_udp_send(m_Socket, pAddr, aBuffer, FinalSize);
+		m_pTransport->Send(pAddr, aBuffer, FinalSize);
 
 		// log raw socket data
 		if(m_DataLogSent)
@@ -237,7 +262,7 @@ void CNetBase::SendPacket(const NETADDR *pAddr, CNetPacketConstruct *pPacket)
 // TODO: rename this function
 int CNetBase::UnpackPacket(NETADDR *pAddr, unsigned char *pBuffer, CNetPacketConstruct *pPacket)
 {
-	int Size = net_udp_recv(m_Socket, pAddr, pBuffer, NET_MAX_PACKETSIZE);
+	int Size = m_pTransport->Recv(pAddr, pBuffer, NET_MAX_PACKETSIZE);
 	// no more packets for now
 	if(Size <= 0)
 		return 1;
@@ -409,5 +434,20 @@ unsigned char *CNetChunkHeader::Unpack(unsigned char *pData)
 void CNetBase::UpdateLogHandles()
 {
 	if(Engine())
+	{
 		Engine()->QueryNetLogHandles(&m_DataLogSent, &m_DataLogRecv);
+		m_pCapture = Engine()->QueryNetCapture();
+	}
+}
+
+void CNetBase::CaptureChunk(int Type, const CNetChunk *pChunk)
+{
+	if(m_pCapture)
+		m_pCapture->WriteChunk(Type, pChunk);
+}
+
+void CNetBase::CaptureEvent(int Type, int ClientID, const NETADDR *pAddr, const char *pReason)
+{
+	if(m_pCapture)
+		m_pCapture->Write(Type, 0, ClientID, pAddr, pReason, pReason ? str_length(pReason)+1 : 0);
 }
@@ -5,6 +5,7 @@
 
 #include "ringbuffer.h"
 #include "huffman.h"
+#include "nettransport.h"
 
 /*
 
@@ -61,6 +62,7 @@ enum
 	NETBANTYPE_DROP=2,
 
 	NETCREATE_FLAG_RANDOMPORT=1,
+	NETCREATE_FLAG_REUSEPORT=2,
 };
 
 
@@ -108,6 +110,7 @@ enum
 	//
 	NET_MAX_CLIENTS = 64,
 	NET_MAX_CONSOLE_CLIENTS = 4,
+	NET_CONSOLE_SEND_BUFFERSIZE = 64*1024,
 	
 	NET_MAX_SEQUENCE = 1<<10,
 	NET_SEQUENCE_MASK = NET_MAX_SEQUENCE-1,
@@ -201,9 +204,11 @@ class CNetBase
 
 	class CConfig *m_pConfig;
 	class IEngine *m_pEngine;
-	NETSOCKET m_Socket;
+	INetTransport *m_pTransport;
+	bool m_OwnTransport;
 	IOHANDLE m_DataLogSent;
 	IOHANDLE m_DataLogRecv;
+	class CNetCaptureWriter *m_pCapture;
 	CHuffman m_Huffman;
 	unsigned char m_aRequestTokenBuf[NET_TOKENREQUEST_DATASIZE];
 
@@ -212,13 +217,20 @@ public:
 	~CNetBase();
 	CConfig *Config() { return m_pConfig; }
 	class IEngine *Engine() { return m_pEngine; }
-	int NetType() { return m_Socket.type; }
-	
-	void Init(NETSOCKET Socket, class CConfig *pConfig, class IConsole *pConsole, class IEngine *pEngine);
+	int NetType() { return m_pTransport ? m_pTransport->NetType() : NETTYPE_INVALID; }
+	INetTransport *Transport() { return m_pTransport; }
+
+	// takes ownership of the transport if Own is set
+	void Init(INetTransport *pTransport, bool Own, class CConfig *pConfig, class IConsole *pConsole, class IEngine *pEngine);
+	static INetTransport *CreateUdpTransport(NETADDR BindAddr, int Flags);
 	void Shutdown();
 	void UpdateLogHandles();
 	void Wait(int Time);
 
+	// structured capture of the chunks, see netcapture.h
+	void CaptureChunk(int Type, const CNetChunk *pChunk);
+	void CaptureEvent(int Type, int ClientID, const NETADDR *pAddr, const char *pReason);
+
 	void SendControlMsg(const NETADDR *pAddr, TOKEN Token, int Ack, int ControlMsg, const void *pExtra, int ExtraSize);
 	void SendControlMsgWithToken(const NETADDR *pAddr, TOKEN Token, int Ack, int ControlMsg, TOKEN MyToken, bool Extended);
 	void SendPacketConnless(const NETADDR *pAddr, TOKEN Token, TOKEN ResponseToken, const void *pData, int DataSize);
@@ -404,6 +416,10 @@ private:
 	char m_aBuffer[NET_MAX_PACKETSIZE];
 	int m_BufferOffset;
 
+	// outgoing lines are collected and sent together on Flush()
+	char m_aSendBuffer[NET_CONSOLE_SEND_BUFFERSIZE];
+	int m_SendBufferSize;
+
 	char m_aErrorString[256];
 
 	bool m_LineEndingDetected;
@@ -420,6 +436,7 @@ public:
 	void Reset();
 	int Update();
 	int Send(const char *pLine);
+	int Flush();
 	int Recv(char *pLine, int MaxLength);
 };
 
@@ -449,6 +466,7 @@ class CNetServer : public CNetBase
 	{
 	public:
 		CNetConnection m_Connection;
+		int64 m_FlushTime; // scheduled flush of the coalesced chunks (0 = none, -1 = pending in the current batch)
 	};
 
 	class CNetBan *m_pNetBan;
@@ -457,6 +475,11 @@ class CNetServer : public CNetBase
 	int m_MaxClients;
 	int m_MaxClientsPerIP;
 
+	// send scheduling
+	bool m_SendBatch;
+	int m_BatchOffset;
+	int64 m_NextFlushTime;
+
 	NETFUNC_NEWCLIENT m_pfnNewClient;
 	NETFUNC_DELCLIENT m_pfnDelClient;
 	void *m_UserPtr;
@@ -469,7 +492,8 @@ class CNetServer : public CNetBase
 public:
 	//
 	bool Open(NETADDR BindAddr, class CConfig *pConfig, class IConsole *pConsole, class IEngine *pEngine, class CNetBan *pNetBan,
-		int MaxClients, int MaxClientsPerIP, NETFUNC_NEWCLIENT pfnNewClient, NETFUNC_DELCLIENT pfnDelClient, void *pUser);
+		int MaxClients, int MaxClientsPerIP, NETFUNC_NEWCLIENT pfnNewClient, NETFUNC_DELCLIENT pfnDelClient, void *pUser,
+		INetTransport *pTransport = 0);
 	void Close();
 
 	// the token parameter is only used for connless packets
@@ -478,6 +502,13 @@ public:
 	int Update();
 	void AddToken(const NETADDR *pAddr, TOKEN Token) { m_TokenCache.AddToken(pAddr, Token, 0); };
 
+	// send coalescing: flushes requested between begin and end are deferred
+	// and spread over the pacing time, one connection after another
+	void BeginSendBatch();
+	void EndSendBatch(int64 PacingTime);
+	void FlushScheduled();
+	int64 NextScheduledFlush() const { return m_NextFlushTime; }
+
 	//
 	void Drop(int ClientID, const char *pReason);
 
@@ -515,6 +546,7 @@ public:
 	//
 	int Recv(char *pLine, int MaxLength, int *pClientID = 0);
 	int Send(int ClientID, const char *pLine);
+	void Flush();
 	int Update();
 	void SetLingerState(int State);
 
@@ -542,7 +574,8 @@ class CNetClient : public CNetBase
 
 public:
 	// openness
-	bool Open(NETADDR BindAddr, class CConfig *pConfig, class IConsole *pConsole, class IEngine *pEngine, int Flags);
+	// BindAddr is ignored if a transport is given
+	bool Open(NETADDR BindAddr, class CConfig *pConfig, class IConsole *pConsole, class IEngine *pEngine, int Flags, INetTransport *pTransport = 0);
 	void Close();
 
 	// connection state
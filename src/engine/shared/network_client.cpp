@@ -2,22 +2,26 @@
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
 #include <base/system.h>
 
+#include "netcapture.h"
 #include "network.h"
 
 
-bool CNetClient::Open(NETADDR BindAddr, CConfig *pConfig, IConsole *pConsole, IEngine *pEngine, int Flags)
+bool CNetClient::Open(NETADDR BindAddr, CConfig *pConfig, IConsole *pConsole, IEngine *pEngine, int Flags, INetTransport *pTransport)
 {
 	// open socket
-	NETSOCKET Socket;
-	Socket = net_udp_create(BindAddr, (Flags&NETCREATE_FLAG_RANDOMPORT) ? 1 : 0);
-	if(!Socket.type)
-		return false;
+	bool OwnTransport = !pTransport;
+	if(OwnTransport)
+	{
+		pTransport = CreateUdpTransport(BindAddr, Flags);
+		if(!pTransport)
+			return false;
+	}
 
 	// clean it
 	mem_zero(this, sizeof(*this));
 
 	// init
-	Init(Socket, pConfig, pConsole, pEngine);
+	Init(pTransport, OwnTransport, pConfig, pConsole, pEngine);
 	m_Connection.Init(this, false);
 
 	m_TokenManager.Init(this);
@@ -38,6 +42,8 @@ void CNetClient::Close()
 
 int CNetClient::Disconnect(const char *pReason)
 {
+	if(m_Connection.State() != NET_CONNSTATE_OFFLINE)
+		CaptureEvent(CNetCapture::RECORD_DROP, 0, m_Connection.PeerAddress(), pReason);
 	m_Connection.Disconnect(pReason);
 	return 0;
 }
@@ -55,6 +61,7 @@ int CNetClient::Update()
 int CNetClient::Connect(NETADDR *pAddr)
 {
 	m_Connection.Connect(pAddr);
+	CaptureEvent(CNetCapture::RECORD_CONNECT, 0, pAddr, 0);
 	return 0;
 }
 
@@ -70,7 +77,10 @@ int CNetClient::Recv(CNetChunk *pChunk, TOKEN *pResponseToken)
 	{
 		// check for a chunk
 		if(m_RecvUnpacker.FetchChunk(pChunk))
+		{
+			CaptureChunk(CNetCapture::RECORD_RECV, pChunk);
 			return 1;
+		}
 
 		// TODO: empty the recvinfo
 		NETADDR Addr;
@@ -110,6 +120,7 @@ int CNetClient::Recv(CNetChunk *pChunk, TOKEN *pResponseToken)
 
 					if(pResponseToken)
 						*pResponseToken = m_RecvUnpacker.m_Data.m_ResponseToken;
+					CaptureChunk(CNetCapture::RECORD_RECV, pChunk);
 					return 1;
 				}
 			}
@@ -120,6 +131,8 @@ int CNetClient::Recv(CNetChunk *pChunk, TOKEN *pResponseToken)
 
 int CNetClient::Send(CNetChunk *pChunk, TOKEN Token, CSendCBData *pCallbackData)
 {
+	CaptureChunk(CNetCapture::RECORD_SEND, pChunk);
+
 	if(pChunk->m_Flags&NETSENDFLAG_CONNLESS)
 	{
 		if(pChunk->m_DataSize >= NET_MAX_PAYLOAD)
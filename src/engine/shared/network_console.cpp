@@ -150,6 +150,17 @@ int CNetConsole::Send(int ClientID, const char *pLine)
 		return -1;
 }
 
+void CNetConsole::Flush()
+{
+	for(int i = 0; i < NET_MAX_CONSOLE_CLIENTS; i++)
+	{
+		if(m_aSlots[i].m_Connection.State() == NET_CONNSTATE_ONLINE)
+			m_aSlots[i].m_Connection.Flush();
+		if(m_aSlots[i].m_Connection.State() == NET_CONNSTATE_ERROR)
+			Drop(i, m_aSlots[i].m_Connection.ErrorString());
+	}
+}
+
 void CNetConsole::SetLingerState(int State)
 {
 	net_tcp_set_linger(m_Socket, State);
@@ -14,6 +14,7 @@ void CConsoleNetConnection::Reset()
 	m_Socket.ipv6sock = -1;
 	m_aBuffer[0] = 0;
 	m_BufferOffset = 0;
+	m_SendBufferSize = 0;
 
 	m_LineEndingDetected = false;
 	#if defined(CONF_FAMILY_WINDOWS)
@@ -45,6 +46,7 @@ void CConsoleNetConnection::Disconnect(const char *pReason)
 
 	if(pReason && pReason[0])
 		Send(pReason);
+	Flush();
 
 	net_tcp_close(m_Socket);
 
@@ -163,24 +165,50 @@ int CConsoleNetConnection::Send(const char *pLine)
 	aBuf[Length+1] = m_aLineEnding[1];
 	aBuf[Length+2] = m_aLineEnding[2];
 	Length += 3;
-	const char *pData = aBuf;
 
-	while(true)
+	// make room if the line doesn't fit anymore
+	if(m_SendBufferSize+Length > (int)sizeof(m_aSendBuffer))
 	{
-		int Send = net_tcp_send(m_Socket, pData, Length);
-		if(Send < 0)
+		if(Flush() != 0)
+			return -1;
+		if(m_SendBufferSize+Length > (int)sizeof(m_aSendBuffer))
 		{
 			m_State = NET_CONNSTATE_ERROR;
-			str_copy(m_aErrorString, "failed to send packet", sizeof(m_aErrorString));
+			str_copy(m_aErrorString, "too weak connection (out of send buffer)", sizeof(m_aErrorString));
 			return -1;
 		}
+	}
+
+	mem_copy(m_aSendBuffer+m_SendBufferSize, aBuf, Length);
+	m_SendBufferSize += Length;
+	return 0;
+}
+
+int CConsoleNetConnection::Flush()
+{
+	if(State() != NET_CONNSTATE_ONLINE)
+		return -1;
 
-		if(Send >= Length)
-			break;
+	int Offset = 0;
+	while(Offset < m_SendBufferSize)
+	{
+		int Send = net_tcp_send(m_Socket, m_aSendBuffer+Offset, m_SendBufferSize-Offset);
+		if(Send < 0)
+		{
+			if(net_would_block()) // keep the rest for the next flush
+				break;
 
-		pData += Send;
-		Length -= Send;
+			m_State = NET_CONNSTATE_ERROR;
+			str_copy(m_aErrorString, "failed to send packet", sizeof(m_aErrorString));
+			return -1;
+		}
+		Offset += Send;
 	}
 
+	if(Offset > 0)
+	{
+		mem_move(m_aSendBuffer, m_aSendBuffer+Offset, m_SendBufferSize-Offset);
+		m_SendBufferSize -= Offset;
+	}
 	return 0;
 }
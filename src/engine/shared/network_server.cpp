@@ -6,23 +6,29 @@
 #include <engine/console.h>
 
 #include "netban.h"
+#include "netcapture.h"
 #include "network.h"
 
 
 bool CNetServer::Open(NETADDR BindAddr, CConfig *pConfig, IConsole *pConsole, IEngine *pEngine, CNetBan *pNetBan,
-	int MaxClients, int MaxClientsPerIP, NETFUNC_NEWCLIENT pfnNewClient, NETFUNC_DELCLIENT pfnDelClient, void *pUser)
+	int MaxClients, int MaxClientsPerIP, NETFUNC_NEWCLIENT pfnNewClient, NETFUNC_DELCLIENT pfnDelClient, void *pUser,
+	INetTransport *pTransport)
 {
 	// zero out the whole structure
 	mem_zero(this, sizeof(*this));
 
 	// open socket
-	NETSOCKET Socket = net_udp_create(BindAddr, 0);
-	if(!Socket.type)
-		return false;
+	bool OwnTransport = !pTransport;
+	if(OwnTransport)
+	{
+		pTransport = CreateUdpTransport(BindAddr, 0);
+		if(!pTransport)
+			return false;
+	}
 
 	// init
 	m_pNetBan = pNetBan;
-	Init(Socket, pConfig, pConsole, pEngine);
+	Init(pTransport, OwnTransport, pConfig, pConsole, pEngine);
 
 	m_TokenManager.Init(this);
 	m_TokenCache.Init(this, &m_TokenManager);
@@ -32,7 +38,14 @@ bool CNetServer::Open(NETADDR BindAddr, CConfig *pConfig, IConsole *pConsole, IE
 	SetMaxClientsPerIP(MaxClientsPerIP);
 
 	for(int i = 0; i < NET_MAX_CLIENTS; i++)
+	{
 		m_aSlots[i].m_Connection.Init(this, true);
+		m_aSlots[i].m_FlushTime = 0;
+	}
+
+	m_SendBatch = false;
+	m_BatchOffset = 0;
+	m_NextFlushTime = 0;
 
 	m_pfnNewClient = pfnNewClient;
 	m_pfnDelClient = pfnDelClient;
@@ -56,13 +69,80 @@ void CNetServer::Drop(int ClientID, const char *pReason)
 
 	if(m_pfnDelClient)
 		m_pfnDelClient(ClientID, pReason, m_UserPtr);
+	CaptureEvent(CNetCapture::RECORD_DROP, ClientID, ClientAddr(ClientID), pReason);
 
 	m_aSlots[ClientID].m_Connection.Disconnect(pReason);
+	m_aSlots[ClientID].m_FlushTime = 0;
 	m_NumClients--;
 }
 
+void CNetServer::BeginSendBatch()
+{
+	m_SendBatch = true;
+}
+
+void CNetServer::EndSendBatch(int64 PacingTime)
+{
+	m_SendBatch = false;
+
+	int NumPending = 0;
+	for(int i = 0; i < NET_MAX_CLIENTS; i++)
+	{
+		if(m_aSlots[i].m_FlushTime == -1)
+			NumPending++;
+	}
+	if(!NumPending)
+		return;
+
+	// rotate the order so the same clients don't always get their packets last
+	int64 Now = time_get();
+	int Num = 0;
+	for(int n = 0; n < NET_MAX_CLIENTS; n++)
+	{
+		int i = (n+m_BatchOffset)%NET_MAX_CLIENTS;
+		if(m_aSlots[i].m_FlushTime != -1)
+			continue;
+
+		if(PacingTime > 0)
+			m_aSlots[i].m_FlushTime = Now + PacingTime*Num/NumPending;
+		else
+			m_aSlots[i].m_FlushTime = Now;
+		Num++;
+	}
+	m_BatchOffset = (m_BatchOffset+1)%NET_MAX_CLIENTS;
+	m_NextFlushTime = Now;
+
+	FlushScheduled();
+}
+
+void CNetServer::FlushScheduled()
+{
+	if(!m_NextFlushTime)
+		return;
+
+	int64 Now = time_get();
+	m_NextFlushTime = 0;
+	for(int i = 0; i < NET_MAX_CLIENTS; i++)
+	{
+		int64 FlushTime = m_aSlots[i].m_FlushTime;
+		if(FlushTime <= 0)
+			continue;
+
+		if(FlushTime <= Now)
+		{
+			m_aSlots[i].m_FlushTime = 0;
+			if(m_aSlots[i].m_Connection.State() != NET_CONNSTATE_OFFLINE)
+				m_aSlots[i].m_Connection.Flush();
+		}
+		else if(!m_NextFlushTime || FlushTime < m_NextFlushTime)
+			m_NextFlushTime = FlushTime;
+	}
+}
+
 int CNetServer::Update()
 {
+	FlushScheduled();
+
 	int64 Now = time_get();
 	for(int i = 0; i < NET_MAX_CLIENTS; i++)
 	{
@@ -97,7 +177,10 @@ int CNetServer::Recv(CNetChunk *pChunk, TOKEN *pResponseToken)
 	{
 		// check for a chunk
 		if(m_RecvUnpacker.IsActive() && m_RecvUnpacker.FetchChunk(pChunk))
+		{
+			CaptureChunk(CNetCapture::RECORD_RECV, pChunk);
 			return 1;
+		}
 
 		// TODO: empty the recvinfo
 		NETADDR Addr;
@@ -146,6 +229,7 @@ int CNetServer::Recv(CNetChunk *pChunk, TOKEN *pResponseToken)
 								pChunk->m_pData = m_RecvUnpacker.m_Data.m_aChunkData;
 								if(pResponseToken)
 									*pResponseToken = NET_TOKEN_NONE;
+								CaptureChunk(CNetCapture::RECORD_RECV, pChunk);
 								return 1;
 							}
 						}
@@ -205,6 +289,7 @@ int CNetServer::Recv(CNetChunk *pChunk, TOKEN *pResponseToken)
 							m_NumClients++;
 							m_aSlots[i].m_Connection.SetToken(m_RecvUnpacker.m_Data.m_Token);
 							m_aSlots[i].m_Connection.Feed(&m_RecvUnpacker.m_Data, &Addr);
+							CaptureEvent(CNetCapture::RECORD_CONNECT, i, &Addr, 0);
 							if(m_pfnNewClient)
 								m_pfnNewClient(i, m_UserPtr);
 							break;
@@ -223,6 +308,7 @@ int CNetServer::Recv(CNetChunk *pChunk, TOKEN *pResponseToken)
 				pChunk->m_pData = m_RecvUnpacker.m_Data.m_aChunkData;
 				if(pResponseToken)
 					*pResponseToken = m_RecvUnpacker.m_Data.m_ResponseToken;
+				CaptureChunk(CNetCapture::RECORD_RECV, pChunk);
 				return 1;
 			}
 		}
@@ -232,6 +318,8 @@ int CNetServer::Recv(CNetChunk *pChunk, TOKEN *pResponseToken)
 
 int CNetServer::Send(CNetChunk *pChunk, TOKEN Token)
 {
+	CaptureChunk(CNetCapture::RECORD_SEND, pChunk);
+
 	if(pChunk->m_Flags&NETSENDFLAG_CONNLESS)
 	{
 		if(pChunk->m_DataSize >= NET_MAX_PAYLOAD)
@@ -292,10 +380,19 @@ int CNetServer::Send(CNetChunk *pChunk, TOKEN Token)
 		if(pChunk->m_Flags&NETSENDFLAG_VITAL)
 			Flags = NET_CHUNKFLAG_VITAL;
 
-		if(m_aSlots[pChunk->m_ClientID].m_Connection.QueueChunk(Flags, pChunk->m_DataSize, pChunk->m_pData) == 0)
+		CSlot *pSlot = &m_aSlots[pChunk->m_ClientID];
+		if(pSlot->m_Connection.QueueChunk(Flags, pChunk->m_DataSize, pChunk->m_pData) == 0)
 		{
 			if(pChunk->m_Flags&NETSENDFLAG_FLUSH)
-				m_aSlots[pChunk->m_ClientID].m_Connection.Flush();
+			{
+				if(m_SendBatch)
+					pSlot->m_FlushTime = -1; // coalesce with the following chunks, flushed by EndSendBatch()
+				else
+				{
+					pSlot->m_Connection.Flush();
+					pSlot->m_FlushTime = 0;
+				}
+			}
 		}
 		else
 		{
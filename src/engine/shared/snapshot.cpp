@@ -4,6 +4,7 @@
 #include <base/tl/algorithm.h>
 #include "snapshot.h"
 #include "compression.h"
+#include "protocol.h"
 
 // CSnapshot
 
@@ -177,6 +178,11 @@ void CSnapshotDelta::SetStaticsize(int ItemType, int Size)
 	m_aItemSizes[ItemType] = Size;
 }
 
+void CSnapshotDelta::CopyStaticsizes(const CSnapshotDelta *pFrom)
+{
+	mem_copy(m_aItemSizes, pFrom->m_aItemSizes, sizeof(m_aItemSizes));
+}
+
 CSnapshotDelta::CData *CSnapshotDelta::EmptyDelta()
 {
 	return &m_Empty;
@@ -515,6 +521,63 @@ int CSnapshotStorage::Get(int Tick, int64 *pTagtime, CSnapshot **ppData, CSnapsh
 	return -1;
 }
 
+// CSnapshotAssembler
+
+void CSnapshotAssembler::Reset()
+{
+	mem_zero(m_aReceived, sizeof(m_aReceived));
+	m_NumReceived = 0;
+	m_NumParts = 0;
+	m_LastPartSize = 0;
+	m_Tick = -1;
+}
+
+int CSnapshotAssembler::AddPart(int Tick, int Part, int NumParts, const void *pData, int PartSize)
+{
+	if(NumParts < 1 || NumParts > CSnapshot::MAX_PARTS || Part < 0 || Part >= NumParts || PartSize < 0 || PartSize > MAX_SNAPSHOT_PACKSIZE)
+		return -1;
+
+	// start over when a new tick begins
+	if(Tick != m_Tick || NumParts != m_NumParts)
+	{
+		Reset();
+		m_Tick = Tick;
+		m_NumParts = NumParts;
+	}
+
+	mem_copy(m_aData + Part*MAX_SNAPSHOT_PACKSIZE, pData, PartSize);
+	if(Part == NumParts-1)
+		m_LastPartSize = PartSize;
+	if(!m_aReceived[Part])
+	{
+		m_aReceived[Part] = true;
+		m_NumReceived++;
+	}
+	if(m_NumReceived < m_NumParts)
+		return -1;
+
+	int Size = (m_NumParts-1)*MAX_SNAPSHOT_PACKSIZE + m_LastPartSize;
+	Reset();
+	return Size;
+}
+
+int CSnapshotAssembler::Unpack(CSnapshotDelta *pDelta, const CSnapshot *pFrom, CSnapshot *pTo, int DataSize) const
+{
+	const void *pDeltaData = pDelta->EmptyDelta();
+	int DeltaSize = sizeof(int)*3;
+	unsigned char aDeltaData[CSnapshot::MAX_SIZE];
+
+	if(DataSize)
+	{
+		DeltaSize = CVariableInt::Decompress(m_aData, DataSize, aDeltaData, sizeof(aDeltaData));
+		if(DeltaSize < 0)
+			return -1;
+		pDeltaData = aDeltaData;
+	}
+
+	return pDelta->UnpackDelta(pFrom, pTo, pDeltaData, DeltaSize);
+}
+
 // CSnapshotBuilder
 
 void CSnapshotBuilder::Init()
@@ -87,6 +87,7 @@ public:
 	int GetDataRate(int Index) const { return m_aSnapshotDataRate[Index]; }
 	int GetDataUpdates(int Index) const { return m_aSnapshotDataUpdates[Index]; }
 	void SetStaticsize(int ItemType, int Size);
+	void CopyStaticsizes(const CSnapshotDelta *pFrom);
 	CData *EmptyDelta();
 	int CreateDelta(const class CSnapshot *pFrom, class CSnapshot *pTo, void *pData);
 	int UnpackDelta(const class CSnapshot *pFrom, class CSnapshot *pTo, const void *pData, int DataSize);
@@ -123,6 +124,29 @@ public:
 	int Get(int Tick, int64 *pTagtime, CSnapshot **ppData, CSnapshot **ppAltData);
 };
 
+// CSnapshotAssembler
+
+// collects the parts of a snapshot that was split over several packets
+class CSnapshotAssembler
+{
+	unsigned char m_aData[CSnapshot::MAX_SIZE];
+	bool m_aReceived[CSnapshot::MAX_PARTS];
+	int m_NumReceived;
+	int m_NumParts;
+	int m_LastPartSize;
+	int m_Tick;
+
+public:
+	CSnapshotAssembler() { Reset(); }
+	void Reset();
+
+	// returns the size of the snapshot data once all parts of the tick are there, -1 before
+	int AddPart(int Tick, int Part, int NumParts, const void *pData, int PartSize);
+
+	// decompresses the collected data and applies it to the delta snapshot
+	int Unpack(CSnapshotDelta *pDelta, const CSnapshot *pFrom, CSnapshot *pTo, int DataSize) const;
+};
+
 class CSnapshotBuilder
 {
 	enum
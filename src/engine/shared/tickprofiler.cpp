@@ -0,0 +1,132 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <algorithm>
+
+#include <base/math.h>
+#include <base/tl/threading.h>
+
+#include "tickprofiler.h"
+
+
+CTickProfiler::CTickProfiler()
+{
+	Reset();
+}
+
+void CTickProfiler::Reset()
+{
+	mem_zero(m_aSamples, sizeof(m_aSamples));
+	mem_zero(m_aaHistogram, sizeof(m_aaHistogram));
+	mem_zero(&m_Current, sizeof(m_Current));
+	m_NumWritten = 0;
+	m_Active = false;
+}
+
+void CTickProfiler::BeginTick(int Tick)
+{
+	EndTick();
+
+	mem_zero(&m_Current, sizeof(m_Current));
+	m_Current.m_Tick = Tick;
+	m_Active = true;
+}
+
+void CTickProfiler::EndTick()
+{
+	if(!m_Active)
+		return;
+
+	for(int p = 0; p < NUM_PHASES; p++)
+	{
+		int Bucket = 0;
+		while(Bucket < NUM_BUCKETS-1 && (1<<Bucket) <= m_Current.m_aTime[p])
+			Bucket++;
+		m_aaHistogram[p][Bucket]++;
+	}
+
+	// publish the sample before advancing the write counter
+	m_aSamples[m_NumWritten&(MAX_SAMPLES-1)] = m_Current;
+	sync_barrier();
+	m_NumWritten = m_NumWritten+1;
+	m_Active = false;
+}
+
+void CTickProfiler::Add(int Phase, int64 Time)
+{
+	if(m_Active)
+		m_Current.m_aTime[Phase] += (int)(Time*1000000/time_freq());
+}
+
+int CTickProfiler::CopySamples(CSample *pSamples, int MaxSamples) const
+{
+	// leave some room for the writer to advance while copying
+	unsigned End = m_NumWritten;
+	sync_barrier();
+	int Num = clamp(MaxSamples, 0, min((int)End, MAX_SAMPLES/2));
+	for(int i = 0; i < Num; i++)
+		pSamples[i] = m_aSamples[(End-Num+i)&(MAX_SAMPLES-1)];
+	sync_barrier();
+
+	// drop samples which might have been overwritten in the meantime
+	int Overwritten = (int)(m_NumWritten-End) - (MAX_SAMPLES-Num) + 1;
+	if(Overwritten > 0)
+	{
+		Overwritten = min(Overwritten, Num);
+		mem_move(pSamples, pSamples+Overwritten, (Num-Overwritten)*sizeof(CSample));
+		Num -= Overwritten;
+	}
+	return Num;
+}
+
+int CTickProfiler::GetStats(CPhaseStats *pStats, int MaxSamples) const
+{
+	CSample aSamples[MAX_SAMPLES/2];
+	int Num = CopySamples(aSamples, min(MaxSamples, (int)MAX_SAMPLES/2));
+	int aTimes[MAX_SAMPLES/2];
+
+	for(int p = 0; p < NUM_PHASES; p++)
+	{
+		mem_zero(&pStats[p], sizeof(pStats[p]));
+		if(Num <= 0)
+			continue;
+
+		int64 Sum = 0;
+		for(int i = 0; i < Num; i++)
+		{
+			aTimes[i] = aSamples[i].m_aTime[p];
+			Sum += aTimes[i];
+		}
+		std::sort(aTimes, aTimes+Num);
+
+		pStats[p].m_Avg = (int)(Sum/Num);
+		pStats[p].m_P50 = aTimes[(Num-1)*50/100];
+		pStats[p].m_P90 = aTimes[(Num-1)*90/100];
+		pStats[p].m_P99 = aTimes[(Num-1)*99/100];
+		pStats[p].m_Max = aTimes[Num-1];
+	}
+	return Num;
+}
+
+int CTickProfiler::FormatLine(char *pBuffer, int BufferSize, int MaxSamples) const
+{
+	CPhaseStats aStats[NUM_PHASES];
+	int Num = GetStats(aStats, MaxSamples);
+
+	str_format(pBuffer, BufferSize, "perf_stats samples=%d", Num);
+	for(int p = 0; p < NUM_PHASES; p++)
+	{
+		char aBuf[128];
+		str_format(aBuf, sizeof(aBuf), " %s=%d/%d/%d/%d/%d", PhaseName(p),
+			aStats[p].m_Avg, aStats[p].m_P50, aStats[p].m_P90, aStats[p].m_P99, aStats[p].m_Max);
+		str_append(pBuffer, aBuf, BufferSize);
+	}
+	return Num;
+}
+
+const char *CTickProfiler::PhaseName(int Phase)
+{
+	static const char *s_apNames[NUM_PHASES] = { "input", "tick", "snap", "delta", "compress", "send", "network", "slack" };
+	if(Phase < 0 || Phase >= NUM_PHASES)
+		return "unknown";
+	return s_apNames[Phase];
+}
@@ -0,0 +1,80 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef ENGINE_SHARED_TICKPROFILER_H
+#define ENGINE_SHARED_TICKPROFILER_H
+
+#include <base/system.h>
+
+/*
+	Collects the time spent in the phases of each server tick.
+
+	The samples are written into a fixed ring by the tick thread only, readers
+	never block the writer: they copy the newest samples and discard the ones
+	that got overwritten while copying. Additionally a log2 histogram of every
+	phase is kept since the last reset.
+*/
+class CTickProfiler
+{
+public:
+	enum
+	{
+		PHASE_INPUT=0,
+		PHASE_TICK,
+		PHASE_SNAP,
+		PHASE_DELTA,
+		PHASE_COMPRESS,
+		PHASE_SEND,
+		PHASE_NETWORK,
+		PHASE_SLACK,
+		NUM_PHASES,
+
+		MAX_SAMPLES=512, // must be a power of two
+		NUM_BUCKETS=24, // bucket n counts times below 2^n microseconds
+	};
+
+	class CSample
+	{
+	public:
+		int m_Tick;
+		int m_aTime[NUM_PHASES]; // in microseconds
+	};
+
+	class CPhaseStats
+	{
+	public:
+		int m_Avg;
+		int m_P50;
+		int m_P90;
+		int m_P99;
+		int m_Max;
+	};
+
+private:
+	CSample m_aSamples[MAX_SAMPLES];
+	volatile unsigned m_NumWritten;
+
+	CSample m_Current;
+	bool m_Active;
+
+	unsigned m_aaHistogram[NUM_PHASES][NUM_BUCKETS];
+
+public:
+	CTickProfiler();
+
+	void Reset();
+
+	// writer side, only called from the tick thread
+	void BeginTick(int Tick);
+	void EndTick();
+	void Add(int Phase, int64 Time);
+
+	// reader side
+	int CopySamples(CSample *pSamples, int MaxSamples) const;
+	int GetStats(CPhaseStats *pStats, int MaxSamples) const;
+	unsigned HistogramCount(int Phase, int Bucket) const { return m_aaHistogram[Phase][Bucket]; }
+	int FormatLine(char *pBuffer, int BufferSize, int MaxSamples) const;
+
+	static const char *PhaseName(int Phase);
+};
+
+#endif
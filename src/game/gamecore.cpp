@@ -55,6 +55,36 @@ float VelocityRamp(float Value, float Start, float Range, float Curvature)
 	return 1.0f/powf(Curvature, (Value-Start)/Range);
 }
 
+int CWorldCore::FindCharacters(vec2 Pos0, vec2 Pos1, float Radius, const CCharacterCore *pNotThis, int IncludeID, int *pIDs, float *pPosX, float *pPosY) const
+{
+	// the margin keeps the rounding of the exact checks on the safe side,
+	// the callers must only skip characters that can't pass them
+	float Range = Radius+1.0f;
+	float MinX = min(Pos0.x, Pos1.x)-Range;
+	float MaxX = max(Pos0.x, Pos1.x)+Range;
+	float MinY = min(Pos0.y, Pos1.y)-Range;
+	float MaxY = max(Pos0.y, Pos1.y)+Range;
+
+	int Num = 0;
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		const CCharacterCore *pCharCore = m_apCharacters[i];
+		if(!pCharCore || pCharCore == pNotThis)
+			continue;
+
+		vec2 Pos = pCharCore->m_Pos;
+		if(i != IncludeID && (Pos.x < MinX || Pos.x > MaxX || Pos.y < MinY || Pos.y > MaxY))
+			continue;
+
+		if(pIDs)
+			pIDs[Num] = i;
+		pPosX[Num] = Pos.x;
+		pPosY[Num] = Pos.y;
+		Num++;
+	}
+	return Num;
+}
+
 const float CCharacterCore::PHYS_SIZE = 28.0f;
 
 void CCharacterCore::Init(CWorldCore *pWorld, CCollision *pCollision)
@@ -200,22 +230,23 @@ void CCharacterCore::Tick(bool UseInput)
 		// Check against other players first
 		if(m_pWorld && m_pWorld->m_Tuning.m_PlayerHooking)
 		{
+			int aIDs[MAX_CLIENTS];
+			float aPosX[MAX_CLIENTS], aPosY[MAX_CLIENTS];
+			int Num = m_pWorld->FindCharacters(m_HookPos, NewPos, PHYS_SIZE+2.0f, this, -1, aIDs, aPosX, aPosY);
+
 			float Distance = 0.0f;
-			for(int i = 0; i < MAX_CLIENTS; i++)
+			for(int c = 0; c < Num; c++)
 			{
-				CCharacterCore *pCharCore = m_pWorld->m_apCharacters[i];
-				if(!pCharCore || pCharCore == this)
-					continue;
-
-				vec2 ClosestPoint = closest_point_on_line(m_HookPos, NewPos, pCharCore->m_Pos);
-				if(distance(pCharCore->m_Pos, ClosestPoint) < PHYS_SIZE+2.0f)
+				vec2 CharPos = vec2(aPosX[c], aPosY[c]);
+				vec2 ClosestPoint = closest_point_on_line(m_HookPos, NewPos, CharPos);
+				if(distance(CharPos, ClosestPoint) < PHYS_SIZE+2.0f)
 				{
-					if (m_HookedPlayer == -1 || distance(m_HookPos, pCharCore->m_Pos) < Distance)
+					if (m_HookedPlayer == -1 || distance(m_HookPos, CharPos) < Distance)
 					{
 						m_TriggeredEvents |= COREEVENTFLAG_HOOK_ATTACH_PLAYER;
 						m_HookState = HOOK_GRABBED;
-						m_HookedPlayer = i;
-						Distance = distance(m_HookPos, pCharCore->m_Pos);
+						m_HookedPlayer = aIDs[c];
+						Distance = distance(m_HookPos, CharPos);
 					}
 				}
 			}
@@ -295,19 +326,21 @@ void CCharacterCore::Tick(bool UseInput)
 
 	if(m_pWorld)
 	{
-		for(int i = 0; i < MAX_CLIENTS; i++)
+		// only close characters and the hooked one have an influence,
+		// make sure that we don't nudge our self
+		int aIDs[MAX_CLIENTS];
+		float aPosX[MAX_CLIENTS], aPosY[MAX_CLIENTS];
+		int Num = m_pWorld->FindCharacters(m_Pos, m_Pos, PHYS_SIZE*1.25f, this, m_HookedPlayer, aIDs, aPosX, aPosY);
+
+		for(int c = 0; c < Num; c++)
 		{
+			int i = aIDs[c];
 			CCharacterCore *pCharCore = m_pWorld->m_apCharacters[i];
-			if(!pCharCore)
-				continue;
-
-			//player *p = (player*)ent;
-			if(pCharCore == this) // || !(p->flags&FLAG_ALIVE)
-				continue; // make sure that we don't nudge our self
+			vec2 CharPos = vec2(aPosX[c], aPosY[c]);
 
 			// handle player <-> player collision
-			float Distance = distance(m_Pos, pCharCore->m_Pos);
-			vec2 Dir = normalize(m_Pos - pCharCore->m_Pos);
+			float Distance = distance(m_Pos, CharPos);
+			vec2 Dir = normalize(m_Pos - CharPos);
 			if(m_pWorld->m_Tuning.m_PlayerCollision && Distance < PHYS_SIZE*1.25f && Distance > 0.0f)
 			{
 				float a = (PHYS_SIZE*1.45f - Distance);
@@ -374,25 +407,27 @@ void CCharacterCore::Move()
 
 	if(m_pWorld->m_Tuning.m_PlayerCollision)
 	{
+		// only the characters close to the path can block it
+		float aPosX[MAX_CLIENTS], aPosY[MAX_CLIENTS];
+		int Num = m_pWorld->FindCharacters(m_Pos, NewPos, PHYS_SIZE, this, -1, 0, aPosX, aPosY);
+
 		// check player collision
 		float Distance = distance(m_Pos, NewPos);
-		int End = Distance+1;
+		int End = Num ? Distance+1 : 0;
 		vec2 LastPos = m_Pos;
 		for(int i = 0; i < End; i++)
 		{
 			float a = i/Distance;
 			vec2 Pos = mix(m_Pos, NewPos, a);
-			for(int p = 0; p < MAX_CLIENTS; p++)
+			for(int c = 0; c < Num; c++)
 			{
-				CCharacterCore *pCharCore = m_pWorld->m_apCharacters[p];
-				if(!pCharCore || pCharCore == this)
-					continue;
-				float D = distance(Pos, pCharCore->m_Pos);
+				vec2 CharPos = vec2(aPosX[c], aPosY[c]);
+				float D = distance(Pos, CharPos);
 				if(D < PHYS_SIZE && D >= 0.0f)
 				{
 					if(a > 0.0f)
 						m_Pos = LastPos;
-					else if(distance(NewPos, pCharCore->m_Pos) > D)
+					else if(distance(NewPos, CharPos) > D)
 						m_Pos = NewPos;
 					return;
 				}
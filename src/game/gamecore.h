@@ -140,6 +140,11 @@ public:
 
 	CTuningParams m_Tuning;
 	class CCharacterCore *m_apCharacters[MAX_CLIENTS];
+
+	// gathers the characters within Radius of the box spanned by Pos0 and Pos1 in slot order,
+	// IncludeID is taken regardless of its position. the positions are stored as structure of
+	// arrays, so the interaction checks run over contiguous data instead of the character cores
+	int FindCharacters(vec2 Pos0, vec2 Pos1, float Radius, const class CCharacterCore *pNotThis, int IncludeID, int *pIDs, float *pPosX, float *pPosY) const;
 };
 
 class CCharacterCore
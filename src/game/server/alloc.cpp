@@ -0,0 +1,97 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+
+#include "alloc.h"
+
+CAllocPool *CAllocPool::ms_pFirstPool = 0;
+
+CAllocPool::CAllocPool(const char *pName, int ObjectSize)
+{
+	m_pName = pName;
+	// keep the objects aligned and big enough for the free list
+	m_ObjectSize = (max(ObjectSize, (int)sizeof(CFreeObject))+15)&~15;
+	m_pFirstBlock = 0;
+	m_pFirstFree = 0;
+	m_NumBlocks = 0;
+	m_Capacity = 0;
+	m_NumUsed = 0;
+	m_PeakUsed = 0;
+	m_NumAllocs = 0;
+
+	m_pNextPool = ms_pFirstPool;
+	ms_pFirstPool = this;
+}
+
+CAllocPool::~CAllocPool()
+{
+	while(m_pFirstBlock)
+	{
+		CBlock *pNext = m_pFirstBlock->m_pNext;
+		mem_free(m_pFirstBlock);
+		m_pFirstBlock = pNext;
+	}
+
+	for(CAllocPool **ppPool = &ms_pFirstPool; *ppPool; ppPool = &(*ppPool)->m_pNextPool)
+	{
+		if(*ppPool == this)
+		{
+			*ppPool = m_pNextPool;
+			break;
+		}
+	}
+}
+
+void CAllocPool::AddBlock(int NumObjects)
+{
+	// the block header is padded to the object alignment
+	char *pData = (char *)mem_alloc(16+NumObjects*m_ObjectSize, 16);
+	CBlock *pBlock = (CBlock *)pData;
+	pBlock->m_pNext = m_pFirstBlock;
+	pBlock->m_NumObjects = NumObjects;
+	m_pFirstBlock = pBlock;
+
+	// hand out the new objects in address order
+	for(int i = NumObjects-1; i >= 0; i--)
+	{
+		CFreeObject *pObject = (CFreeObject *)(pData+16+i*m_ObjectSize);
+		pObject->m_pNext = m_pFirstFree;
+		m_pFirstFree = pObject;
+	}
+
+	m_NumBlocks++;
+	m_Capacity += NumObjects;
+}
+
+void CAllocPool::Reserve(int Capacity)
+{
+	if(Capacity > m_Capacity)
+		AddBlock(Capacity-m_Capacity);
+}
+
+void *CAllocPool::Alloc()
+{
+	// grow by half of the capacity, so busy pools need few blocks
+	if(!m_pFirstFree)
+		AddBlock(max((int)MIN_BLOCK_SIZE, m_Capacity/2));
+
+	CFreeObject *pObject = m_pFirstFree;
+	m_pFirstFree = pObject->m_pNext;
+
+	m_NumUsed++;
+	m_PeakUsed = max(m_PeakUsed, m_NumUsed);
+	m_NumAllocs++;
+	mem_zero(pObject, m_ObjectSize);
+	return pObject;
+}
+
+void CAllocPool::Free(void *pPtr)
+{
+	if(!pPtr)
+		return;
+
+	CFreeObject *pObject = (CFreeObject *)pPtr;
+	pObject->m_pNext = m_pFirstFree;
+	m_pFirstFree = pObject;
+	m_NumUsed--;
+}
@@ -23,6 +23,96 @@
 	} \
 	private:
 
+/*
+	Class: Alloc Pool
+		Keeps the objects of one type in blocks. Freed objects go to a free
+		list and are handed out again by the next allocation, so creating and
+		destroying entities doesn't go through the heap each time. Objects
+		are handed out cleared, like the heap allocations they replace.
+*/
+class CAllocPool
+{
+	enum
+	{
+		MIN_BLOCK_SIZE=16,
+	};
+
+	struct CBlock
+	{
+		CBlock *m_pNext;
+		int m_NumObjects;
+	};
+
+	struct CFreeObject
+	{
+		CFreeObject *m_pNext;
+	};
+
+	const char *m_pName;
+	int m_ObjectSize;
+	CBlock *m_pFirstBlock;
+	CFreeObject *m_pFirstFree;
+	CAllocPool *m_pNextPool;
+
+	int m_NumBlocks;
+	int m_Capacity;
+	int m_NumUsed;
+	int m_PeakUsed;
+	unsigned m_NumAllocs;
+
+	static CAllocPool *ms_pFirstPool;
+
+	void AddBlock(int NumObjects);
+
+public:
+	CAllocPool(const char *pName, int ObjectSize);
+	~CAllocPool();
+
+	void *Alloc();
+	void Free(void *pPtr);
+
+	// makes room for at least Capacity objects
+	void Reserve(int Capacity);
+
+	const char *Name() const { return m_pName; }
+	int NumBlocks() const { return m_NumBlocks; }
+	int Capacity() const { return m_Capacity; }
+	int NumUsed() const { return m_NumUsed; }
+	int PeakUsed() const { return m_PeakUsed; }
+	unsigned NumAllocs() const { return m_NumAllocs; }
+
+	static CAllocPool *First() { return ms_pFirstPool; }
+	CAllocPool *Next() const { return m_pNextPool; }
+};
+
+// subclasses (e.g. of mods) don't fit into the pool and go to the heap, the
+// virtual destructor of the entities passes their real size to delete
+#define MACRO_ALLOC_POOL() \
+	public: \
+	void *operator new(size_t Size); \
+	void operator delete(void *pPtr, size_t Size); \
+	private:
+
+#define MACRO_ALLOC_POOL_IMPL(POOLTYPE) \
+	static CAllocPool ms_Pool##POOLTYPE(#POOLTYPE, sizeof(POOLTYPE)); \
+	void *POOLTYPE::operator new(size_t Size) \
+	{ \
+		if(Size != sizeof(POOLTYPE)) \
+		{ \
+			void *p = mem_alloc(Size, 1); \
+			mem_zero(p, Size); \
+			return p; \
+		} \
+		return ms_Pool##POOLTYPE.Alloc(); \
+	} \
+	void POOLTYPE::operator delete(void *pPtr, size_t Size) \
+	{ \
+		if(Size != sizeof(POOLTYPE)) \
+			mem_free(pPtr); \
+		else \
+			ms_Pool##POOLTYPE.Free(pPtr); \
+	}
+
 #define MACRO_ALLOC_POOL_ID() \
 	public: \
 	void *operator new(size_t Size, int id); \
@@ -6,11 +6,14 @@
 #include "character.h"
 #include "flag.h"
 
+MACRO_ALLOC_POOL_IMPL(CFlag)
+
 CFlag::CFlag(CGameWorld *pGameWorld, int Team, vec2 StandPos)
 : CEntity(pGameWorld, CGameWorld::ENTTYPE_FLAG, StandPos, ms_PhysSize)
 {
 	m_Team = Team;
 	m_StandPos = StandPos;
+	m_DropTick = 0;
 
 	GameWorld()->InsertEntity(this);
 
@@ -7,6 +7,8 @@
 
 class CFlag : public CEntity
 {
+	MACRO_ALLOC_POOL()
+
 private:
 	/* Identity */
 	int m_Team;
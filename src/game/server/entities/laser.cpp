@@ -6,9 +6,12 @@
 #include "character.h"
 #include "laser.h"
 
+MACRO_ALLOC_POOL_IMPL(CLaser)
+
 CLaser::CLaser(CGameWorld *pGameWorld, vec2 Pos, vec2 Direction, float StartEnergy, int Owner)
 : CEntity(pGameWorld, CGameWorld::ENTTYPE_LASER, Pos)
 {
+	m_From = Pos;
 	m_Owner = Owner;
 	m_Energy = StartEnergy;
 	m_Dir = Direction;
@@ -7,6 +7,8 @@
 #include "character.h"
 #include "pickup.h"
 
+MACRO_ALLOC_POOL_IMPL(CPickup)
+
 CPickup::CPickup(CGameWorld *pGameWorld, int Type, vec2 Pos)
 : CEntity(pGameWorld, CGameWorld::ENTTYPE_PICKUP, Pos, PickupPhysSize)
 {
@@ -6,6 +6,8 @@
 #include "character.h"
 #include "projectile.h"
 
+MACRO_ALLOC_POOL_IMPL(CProjectile)
+
 CProjectile::CProjectile(CGameWorld *pGameWorld, int Type, int Owner, vec2 Pos, vec2 Dir, int Span,
 		int Damage, bool Explosive, float Force, int SoundImpact, int Weapon)
 : CEntity(pGameWorld, CGameWorld::ENTTYPE_PROJECTILE, vec2(round_to_int(Pos.x), round_to_int(Pos.y)))
@@ -22,6 +24,7 @@ CProjectile::CProjectile(CGameWorld *pGameWorld, int Type, int Owner, vec2 Pos,
 	m_Weapon = Weapon;
 	m_StartTick = Server()->Tick();
 	m_Explosive = Explosive;
+	CalculateImpact(0);
 
 	GameWorld()->InsertEntity(this);
 }
@@ -39,46 +42,83 @@ void CProjectile::LoseOwner()
 		m_Owner = PLAYER_TEAM_RED;
 }
 
-vec2 CProjectile::GetPos(float Time)
+void CProjectile::GetTuning(float *pCurvature, float *pSpeed)
 {
-	float Curvature = 0;
-	float Speed = 0;
+	*pCurvature = 0;
+	*pSpeed = 0;
 
 	switch(m_Type)
 	{
 		case WEAPON_GRENADE:
-			Curvature = GameServer()->Tuning()->m_GrenadeCurvature;
-			Speed = GameServer()->Tuning()->m_GrenadeSpeed;
+			*pCurvature = GameServer()->Tuning()->m_GrenadeCurvature;
+			*pSpeed = GameServer()->Tuning()->m_GrenadeSpeed;
 			break;
 
 		case WEAPON_SHOTGUN:
-			Curvature = GameServer()->Tuning()->m_ShotgunCurvature;
-			Speed = GameServer()->Tuning()->m_ShotgunSpeed;
+			*pCurvature = GameServer()->Tuning()->m_ShotgunCurvature;
+			*pSpeed = GameServer()->Tuning()->m_ShotgunSpeed;
 			break;
 
 		case WEAPON_GUN:
-			Curvature = GameServer()->Tuning()->m_GunCurvature;
-			Speed = GameServer()->Tuning()->m_GunSpeed;
+			*pCurvature = GameServer()->Tuning()->m_GunCurvature;
+			*pSpeed = GameServer()->Tuning()->m_GunSpeed;
 			break;
 	}
+}
 
+vec2 CProjectile::GetPos(float Time)
+{
+	float Curvature, Speed;
+	GetTuning(&Curvature, &Speed);
 	return CalcPos(m_Pos, m_Direction, Curvature, Speed, Time);
 }
 
+// walks the path against the map ahead of time, so ticking only has to
+// test characters. the steps match the per tick test exactly, the window
+// is limited so long living projectiles don't cause a spike at spawn
+void CProjectile::CalculateImpact(int FromTick)
+{
+	GetTuning(&m_PathCurvature, &m_PathSpeed);
+	m_PathEndTick = min(FromTick + Server()->TickSpeed()*2, m_LifeSpan + 1 + (Server()->Tick()-m_StartTick));
+	m_ImpactTick = -1;
+
+	vec2 PrevPos = CalcPos(m_Pos, m_Direction, m_PathCurvature, m_PathSpeed, (FromTick-1)/(float)Server()->TickSpeed());
+	for(int Tick = FromTick; Tick <= m_PathEndTick; Tick++)
+	{
+		vec2 CurPos = CalcPos(m_Pos, m_Direction, m_PathCurvature, m_PathSpeed, Tick/(float)Server()->TickSpeed());
+		vec2 ImpactPos;
+		if(GameServer()->Collision()->IntersectLine(PrevPos, CurPos, &ImpactPos, 0) || GameLayerClipped(ImpactPos))
+		{
+			m_ImpactTick = Tick;
+			m_ImpactPos = ImpactPos;
+			m_PathEndTick = Tick;
+			return;
+		}
+		PrevPos = CurPos;
+	}
+}
 
 void CProjectile::Tick()
 {
-	float Pt = (Server()->Tick()-m_StartTick-1)/(float)Server()->TickSpeed();
-	float Ct = (Server()->Tick()-m_StartTick)/(float)Server()->TickSpeed();
-	vec2 PrevPos = GetPos(Pt);
-	vec2 CurPos = GetPos(Ct);
-	int Collide = GameServer()->Collision()->IntersectLine(PrevPos, CurPos, &CurPos, 0);
+	int Tick = Server()->Tick()-m_StartTick;
+	float Curvature, Speed;
+	GetTuning(&Curvature, &Speed);
+	if(Tick < 0 || Tick > m_PathEndTick || Curvature != m_PathCurvature || Speed != m_PathSpeed)
+		CalculateImpact(Tick);
+
+	float Pt = (Tick-1)/(float)Server()->TickSpeed();
+	float Ct = Tick/(float)Server()->TickSpeed();
+	vec2 PrevPos = CalcPos(m_Pos, m_Direction, Curvature, Speed, Pt);
+	vec2 CurPos = CalcPos(m_Pos, m_Direction, Curvature, Speed, Ct);
+	bool Collide = Tick == m_ImpactTick;
+	if(Collide)
+		CurPos = m_ImpactPos;
 	CCharacter *OwnerChar = GameServer()->GetPlayerChar(m_Owner);
 	CCharacter *TargetChr = GameWorld()->IntersectCharacter(PrevPos, CurPos, 6.0f, CurPos, OwnerChar);
 
 	m_LifeSpan--;
 
-	if(TargetChr || Collide || m_LifeSpan < 0 || GameLayerClipped(CurPos))
+	if(TargetChr || Collide || m_LifeSpan < 0)
 	{
 		if(m_LifeSpan >= 0 || m_Weapon == WEAPON_GRENADE)
 			GameServer()->CreateSound(CurPos, m_SoundImpact);
@@ -11,6 +11,8 @@ enum
 
 class CProjectile : public CEntity
 {
+	MACRO_ALLOC_POOL()
+
 public:
 	CProjectile(CGameWorld *pGameWorld, int Type, int Owner, vec2 Pos, vec2 Dir, int Span,
 		int Damage, bool Explosive, float Force, int SoundImpact, int Weapon);
@@ -27,6 +29,9 @@ public:
 	virtual void Snap(int SnappingClient);
 
 private:
+	void GetTuning(float *pCurvature, float *pSpeed);
+	void CalculateImpact(int FromTick);
+
 	vec2 m_Direction;
 	int m_LifeSpan;
 	int m_Owner;
@@ -38,6 +43,13 @@ private:
 	float m_Force;
 	int m_StartTick;
 	bool m_Explosive;
+
+	// precomputed collision with the map, ticks are relative to m_StartTick
+	float m_PathCurvature;
+	float m_PathSpeed;
+	int m_PathEndTick;
+	int m_ImpactTick;
+	vec2 m_ImpactPos;
 };
 
 #endif
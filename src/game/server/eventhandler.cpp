@@ -1,5 +1,6 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
 #include <base/system.h>
 #include "eventhandler.h"
 #include "gamecontext.h"
@@ -11,9 +12,24 @@
 CEventHandler::CEventHandler()
 {
 	m_pGameServer = 0;
+	m_MaxEvents = MIN_EVENTS;
+	m_pEvents = (CEvent *)mem_alloc(m_MaxEvents*sizeof(CEvent), sizeof(int64));
+	m_pBucketEvents = (int *)mem_alloc(m_MaxEvents*sizeof(int), sizeof(int));
+	m_DataSize = MIN_DATASIZE;
+	m_pData = (char *)mem_alloc(m_DataSize, sizeof(int64));
+	m_NumDropped = 0;
+	m_NumSnapDropped = 0;
+	m_PeakEvents = 0;
 	Clear();
 }
 
+CEventHandler::~CEventHandler()
+{
+	mem_free(m_pEvents);
+	mem_free(m_pBucketEvents);
+	mem_free(m_pData);
+}
+
 void CEventHandler::SetGameServer(CGameContext *pGameServer)
 {
 	m_pGameServer = pGameServer;
@@ -22,17 +38,46 @@ void CEventHandler::SetGameServer(CGameContext *pGameServer)
 void *CEventHandler::Create(int Type, int Size, int64 Mask)
 {
 	if(m_NumEvents == MAX_EVENTS)
+	{
+		m_NumDropped++;
 		return 0;
-	if(m_CurrentOffset+Size >= MAX_DATASIZE)
-		return 0;
+	}
+
+	// grow the buffers instead of dropping events
+	if(m_NumEvents == m_MaxEvents)
+	{
+		int NewMax = min(m_MaxEvents*2, (int)MAX_EVENTS);
+		CEvent *pNewEvents = (CEvent *)mem_alloc(NewMax*sizeof(CEvent), sizeof(int64));
+		mem_copy(pNewEvents, m_pEvents, m_NumEvents*sizeof(CEvent));
+		mem_free(m_pEvents);
+		mem_free(m_pBucketEvents);
+		m_pEvents = pNewEvents;
+		m_pBucketEvents = (int *)mem_alloc(NewMax*sizeof(int), sizeof(int));
+		m_MaxEvents = NewMax;
+		m_BucketsValid = false;
+	}
+
+	if(m_CurrentOffset+Size > m_DataSize)
+	{
+		int NewSize = max(m_DataSize*2, m_CurrentOffset+Size);
+		char *pNewData = (char *)mem_alloc(NewSize, sizeof(int64));
+		mem_copy(pNewData, m_pData, m_CurrentOffset);
+		mem_free(m_pData);
+		m_pData = pNewData;
+		m_DataSize = NewSize;
+	}
 
-	void *p = &m_aData[m_CurrentOffset];
-	m_aOffsets[m_NumEvents] = m_CurrentOffset;
-	m_aTypes[m_NumEvents] = Type;
-	m_aSizes[m_NumEvents] = Size;
-	m_aClientMasks[m_NumEvents] = Mask;
+	void *p = &m_pData[m_CurrentOffset];
+	CEvent *pEvent = &m_pEvents[m_NumEvents++];
+	pEvent->m_Type = Type;
+	pEvent->m_Offset = m_CurrentOffset;
+	pEvent->m_Size = Size;
+	pEvent->m_CellX = 0;
+	pEvent->m_CellY = 0;
+	pEvent->m_ClientMask = Mask;
 	m_CurrentOffset += Size;
-	m_NumEvents++;
+	m_PeakEvents = max(m_PeakEvents, m_NumEvents);
+	m_BucketsValid = false;
 	return p;
 }
 
@@ -40,20 +85,77 @@ void CEventHandler::Clear()
 {
 	m_NumEvents = 0;
 	m_CurrentOffset = 0;
+	m_BucketsValid = false;
 }
 
-void CEventHandler::Snap(int SnappingClient)
+void CEventHandler::SortIntoBuckets()
 {
+	// the positions are only known once the events are filled in, so this
+	// runs with the first snapshot that includes them
+	mem_zero(m_aBucketStart, sizeof(m_aBucketStart));
 	for(int i = 0; i < m_NumEvents; i++)
 	{
-		if(SnappingClient == -1 || CmaskIsSet(m_aClientMasks[i], SnappingClient))
+		CEvent *pEvent = &m_pEvents[i];
+		const CNetEvent_Common *pCommon = (const CNetEvent_Common *)&m_pData[pEvent->m_Offset];
+		pEvent->m_CellX = pCommon->m_X >> CELL_SHIFT;
+		pEvent->m_CellY = pCommon->m_Y >> CELL_SHIFT;
+		m_aBucketStart[Bucket(pEvent->m_CellX, pEvent->m_CellY)+1]++;
+	}
+	for(int b = 0; b < NUM_BUCKETS; b++)
+		m_aBucketStart[b+1] += m_aBucketStart[b];
+
+	int aFill[NUM_BUCKETS];
+	mem_copy(aFill, m_aBucketStart, sizeof(aFill));
+	for(int i = 0; i < m_NumEvents; i++)
+		m_pBucketEvents[aFill[Bucket(m_pEvents[i].m_CellX, m_pEvents[i].m_CellY)]++] = i;
+	m_BucketsValid = true;
+}
+
+bool CEventHandler::SnapEvent(int Index)
+{
+	const CEvent *pEvent = &m_pEvents[Index];
+	void *d = GameServer()->Server()->SnapNewItem(pEvent->m_Type, Index, pEvent->m_Size);
+	if(!d)
+	{
+		m_NumSnapDropped++;
+		return false;
+	}
+	mem_copy(d, &m_pData[pEvent->m_Offset], pEvent->m_Size);
+	return true;
+}
+
+void CEventHandler::Snap(int SnappingClient)
+{
+	if(SnappingClient == -1)
+	{
+		for(int i = 0; i < m_NumEvents; i++)
+			SnapEvent(i);
+		return;
+	}
+
+	if(!m_BucketsValid)
+		SortIntoBuckets();
+
+	// only the events in the cells around the view position can be close enough
+	vec2 ViewPos = GameServer()->m_apPlayers[SnappingClient]->m_ViewPos;
+	int ViewCellX = round_to_int(ViewPos.x) >> CELL_SHIFT;
+	int ViewCellY = round_to_int(ViewPos.y) >> CELL_SHIFT;
+	for(int y = ViewCellY-1; y <= ViewCellY+1; y++)
+	{
+		for(int x = ViewCellX-1; x <= ViewCellX+1; x++)
 		{
-			CNetEvent_Common *ev = (CNetEvent_Common *)&m_aData[m_aOffsets[i]];
-			if(SnappingClient == -1 || distance(GameServer()->m_apPlayers[SnappingClient]->m_ViewPos, vec2(ev->m_X, ev->m_Y)) < 1500.0f)
+			int b = Bucket(x, y);
+			for(int j = m_aBucketStart[b]; j < m_aBucketStart[b+1]; j++)
 			{
-				void *d = GameServer()->Server()->SnapNewItem(m_aTypes[i], i, m_aSizes[i]);
-				if(d)
-					mem_copy(d, &m_aData[m_aOffsets[i]], m_aSizes[i]);
+				int i = m_pBucketEvents[j];
+				const CEvent *pEvent = &m_pEvents[i];
+				// buckets are shared by several cells
+				if(pEvent->m_CellX != x || pEvent->m_CellY != y || !CmaskIsSet(pEvent->m_ClientMask, SnappingClient))
+					continue;
+
+				const CNetEvent_Common *pCommon = (const CNetEvent_Common *)&m_pData[pEvent->m_Offset];
+				if(distance(ViewPos, vec2(pCommon->m_X, pCommon->m_Y)) < 1500.0f)
+					SnapEvent(i);
 			}
 		}
 	}
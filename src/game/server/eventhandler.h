@@ -6,27 +6,66 @@
 //
 class CEventHandler
 {
-	static const int MAX_EVENTS = 128;
-	static const int MAX_DATASIZE = 128*64;
+	enum
+	{
+		MAX_EVENTS = 0x10000, // the event index is used as snap id
+		MIN_EVENTS = 128,
+		MIN_DATASIZE = 128*64,
 
-	int m_aTypes[MAX_EVENTS]; // TODO: remove some of these arrays
-	int m_aOffsets[MAX_EVENTS];
-	int m_aSizes[MAX_EVENTS];
-	int64 m_aClientMasks[MAX_EVENTS];
-	char m_aData[MAX_DATASIZE];
+		// events are sorted into a grid for snapping, a client only looks at
+		// the cells around its view position, so the cells have to be larger
+		// than the view distance
+		CELL_SHIFT = 11,
+		NUM_BUCKETS = 64,
+	};
+
+	struct CEvent
+	{
+		int m_Type;
+		int m_Offset;
+		int m_Size;
+		int m_CellX;
+		int m_CellY;
+		int64 m_ClientMask;
+	};
+
+	CEvent *m_pEvents;
+	int m_NumEvents;
+	int m_MaxEvents;
+	char *m_pData;
+	int m_DataSize;
+
+	// event indices sorted by bucket
+	int m_aBucketStart[NUM_BUCKETS+1];
+	int *m_pBucketEvents;
+	bool m_BucketsValid;
 
 	class CGameContext *m_pGameServer;
 
 	int m_CurrentOffset;
-	int m_NumEvents;
+
+	// statistics
+	int m_NumDropped;
+	int m_NumSnapDropped;
+	int m_PeakEvents;
+
+	static int Bucket(int CellX, int CellY) { return ((unsigned)CellX*73856093u ^ (unsigned)CellY*19349663u) & (NUM_BUCKETS-1); }
+	void SortIntoBuckets();
+	bool SnapEvent(int Index);
+
 public:
 	CGameContext *GameServer() const { return m_pGameServer; }
 	void SetGameServer(CGameContext *pGameServer);
 
 	CEventHandler();
+	~CEventHandler();
 	void *Create(int Type, int Size, int64 Mask = -1);
 	void Clear();
 	void Snap(int SnappingClient);
+
+	int NumDropped() const { return m_NumDropped; }
+	int NumSnapDropped() const { return m_NumSnapDropped; }
+	int PeakEvents() const { return m_PeakEvents; }
 };
 
 #endif
@@ -42,10 +42,15 @@ void CGameContext::Construct(int Resetting)
 	m_pVoteOptionFirst = 0;
 	m_pVoteOptionLast = 0;
 	m_NumVoteOptions = 0;
+	m_NumVoteOptionsRemoved = 0;
 	m_LockTeams = 0;
 
 	if(Resetting==NO_RESET)
+	{
 		m_pVoteOptionHeap = new CHeap();
+		m_apVoteOptionHash = (CVoteOptionServer **)mem_alloc(VOTE_OPTION_HASH_SIZE*sizeof(CVoteOptionServer *), 1);
+		mem_zero(m_apVoteOptionHash, VOTE_OPTION_HASH_SIZE*sizeof(CVoteOptionServer *));
+	}
 }
 
 CGameContext::CGameContext(int Resetting)
@@ -63,7 +68,10 @@ CGameContext::~CGameContext()
 	for(int i = 0; i < MAX_CLIENTS; i++)
 		delete m_apPlayers[i];
 	if(!m_Resetting)
+	{
 		delete m_pVoteOptionHeap;
+		mem_free(m_apVoteOptionHash);
+	}
 }
 
 void CGameContext::Clear()
@@ -71,7 +79,9 @@ void CGameContext::Clear()
 	CHeap *pVoteOptionHeap = m_pVoteOptionHeap;
 	CVoteOptionServer *pVoteOptionFirst = m_pVoteOptionFirst;
 	CVoteOptionServer *pVoteOptionLast = m_pVoteOptionLast;
+	CVoteOptionServer **apVoteOptionHash = m_apVoteOptionHash;
 	int NumVoteOptions = m_NumVoteOptions;
+	int NumVoteOptionsRemoved = m_NumVoteOptionsRemoved;
 	CTuningParams Tuning = m_Tuning;
 
 	m_Resetting = true;
@@ -82,10 +92,133 @@ void CGameContext::Clear()
 	m_pVoteOptionHeap = pVoteOptionHeap;
 	m_pVoteOptionFirst = pVoteOptionFirst;
 	m_pVoteOptionLast = pVoteOptionLast;
+	m_apVoteOptionHash = apVoteOptionHash;
 	m_NumVoteOptions = NumVoteOptions;
+	m_NumVoteOptionsRemoved = NumVoteOptionsRemoved;
 	m_Tuning = Tuning;
 }
 
+static unsigned VoteOptionHash(const char *pDescription)
+{
+	// case insensitive like the str_comp_nocase the options are compared with
+	unsigned Hash = 5381;
+	for(; *pDescription; pDescription++)
+	{
+		char c = *pDescription;
+		if(c >= 'A' && c <= 'Z')
+			c += 'a'-'A';
+		Hash = Hash*33 + (unsigned char)c;
+	}
+	return Hash&(VOTE_OPTION_HASH_SIZE-1);
+}
+
+CVoteOptionServer *CGameContext::FindVoteOption(const char *pDescription)
+{
+	for(CVoteOptionServer *pOption = m_apVoteOptionHash[VoteOptionHash(pDescription)]; pOption; pOption = pOption->m_pNextHash)
+	{
+		if(str_comp_nocase(pDescription, pOption->m_aDescription) == 0)
+			return pOption;
+	}
+	return 0;
+}
+
+void CGameContext::RemoveVoteOption(CVoteOptionServer *pOption)
+{
+	for(CVoteOptionServer **ppOption = &m_apVoteOptionHash[VoteOptionHash(pOption->m_aDescription)]; *ppOption; ppOption = &(*ppOption)->m_pNextHash)
+	{
+		if(*ppOption == pOption)
+		{
+			*ppOption = pOption->m_pNextHash;
+			break;
+		}
+	}
+
+	// clients that didn't get the option yet continue after it
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		if(m_apPlayers[i] && m_apPlayers[i]->m_pSendVoteOption == pOption)
+			m_apPlayers[i]->m_pSendVoteOption = pOption->m_pNext;
+	}
+
+	if(pOption->m_pPrev)
+		pOption->m_pPrev->m_pNext = pOption->m_pNext;
+	else
+		m_pVoteOptionFirst = pOption->m_pNext;
+	if(pOption->m_pNext)
+		pOption->m_pNext->m_pPrev = pOption->m_pPrev;
+	else
+		m_pVoteOptionLast = pOption->m_pPrev;
+	--m_NumVoteOptions;
+
+	// the heap can't free single options, rebuild it once it's mostly unused
+	if(++m_NumVoteOptionsRemoved > m_NumVoteOptions)
+		CompactVoteOptions();
+}
+
+void CGameContext::CompactVoteOptions()
+{
+	CHeap *pVoteOptionHeap = new CHeap();
+	CVoteOptionServer *pVoteOptionFirst = 0;
+	CVoteOptionServer *pVoteOptionLast = 0;
+	mem_zero(m_apVoteOptionHash, VOTE_OPTION_HASH_SIZE*sizeof(CVoteOptionServer *));
+	for(CVoteOptionServer *pSrc = m_pVoteOptionFirst; pSrc; pSrc = pSrc->m_pNext)
+	{
+		// copy option
+		int Len = str_length(pSrc->m_aCommand);
+		CVoteOptionServer *pDst = (CVoteOptionServer *)pVoteOptionHeap->Allocate(sizeof(CVoteOptionServer) + Len);
+		pDst->m_pNext = 0;
+		pDst->m_pPrev = pVoteOptionLast;
+		if(pDst->m_pPrev)
+			pDst->m_pPrev->m_pNext = pDst;
+		pVoteOptionLast = pDst;
+		if(!pVoteOptionFirst)
+			pVoteOptionFirst = pDst;
+
+		pDst->m_Order = pSrc->m_Order;
+		str_copy(pDst->m_aDescription, pSrc->m_aDescription, sizeof(pDst->m_aDescription));
+		mem_copy(pDst->m_aCommand, pSrc->m_aCommand, Len+1);
+
+		unsigned Hash = VoteOptionHash(pDst->m_aDescription);
+		pDst->m_pNextHash = m_apVoteOptionHash[Hash];
+		m_apVoteOptionHash[Hash] = pDst;
+
+		for(int i = 0; i < MAX_CLIENTS; i++)
+		{
+			if(m_apPlayers[i] && m_apPlayers[i]->m_pSendVoteOption == pSrc)
+				m_apPlayers[i]->m_pSendVoteOption = pDst;
+		}
+	}
+
+	// clean up
+	delete m_pVoteOptionHeap;
+	m_pVoteOptionHeap = pVoteOptionHeap;
+	m_pVoteOptionFirst = pVoteOptionFirst;
+	m_pVoteOptionLast = pVoteOptionLast;
+	m_NumVoteOptionsRemoved = 0;
+}
+
+void CGameContext::SendVoteOptions(int ClientID)
+{
+	// a few packets per tick, so large lists don't flood the connection
+	CPlayer *pPlayer = m_apPlayers[ClientID];
+	for(int Batch = 0; Batch < Config()->m_SvVoteOptionBatches && pPlayer->m_pSendVoteOption; Batch++)
+	{
+		// count options for actual packet
+		int NumOptions = 0;
+		for(CVoteOptionServer *p = pPlayer->m_pSendVoteOption; p && NumOptions < MAX_VOTE_OPTION_ADD; p = p->m_pNext, ++NumOptions);
+
+		// pack and send vote list packet
+		CMsgPacker Msg(NETMSGTYPE_SV_VOTEOPTIONLISTADD);
+		Msg.AddInt(NumOptions);
+		while(pPlayer->m_pSendVoteOption && NumOptions--)
+		{
+			Msg.AddString(pPlayer->m_pSendVoteOption->m_aDescription, VOTE_DESC_LENGTH);
+			pPlayer->m_pSendVoteOption = pPlayer->m_pSendVoteOption->m_pNext;
+		}
+		Server()->SendMsg(&Msg, MSGFLAG_VITAL|MSGFLAG_NORECORD, ClientID);
+	}
+}
+
 
 class CCharacter *CGameContext::GetPlayerChar(int ClientID)
 {
@@ -521,6 +654,13 @@ void CGameContext::OnTick()
 		}
 	}
 
+	// vote options for clients that don't have all of them yet
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		if(m_apPlayers[i] && m_apPlayers[i]->m_pSendVoteOption)
+			SendVoteOptions(i);
+	}
+
 	// update voting
 	if(m_VoteCloseTime)
 	{
@@ -882,37 +1022,28 @@ void CGameContext::OnMessage(int MsgID, CUnpacker *pUnpacker, int ClientID)
 
 			if(str_comp_nocase(pMsg->m_Type, "option") == 0)
 			{
-				CVoteOptionServer *pOption = m_pVoteOptionFirst;
-				while(pOption)
-				{
-					if(str_comp_nocase(pMsg->m_Value, pOption->m_aDescription) == 0)
-					{
-						str_format(aDesc, sizeof(aDesc), "%s", pOption->m_aDescription);
-						str_format(aCmd, sizeof(aCmd), "%s", pOption->m_aCommand);
-						char aBuf[128];
-						str_format(aBuf, sizeof(aBuf),
-							"'%d:%s' voted %s '%s' reason='%s' cmd='%s' force=%d",
-							ClientID, Server()->ClientName(ClientID), pMsg->m_Type,
-							aDesc, pReason, aCmd, pMsg->m_Force
-						);
-						Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
-						if(pMsg->m_Force)
-						{
-							Server()->SetRconCID(ClientID);
-							Console()->ExecuteLine(aCmd);
-							Server()->SetRconCID(IServer::RCON_CID_SERV);
-							ForceVote(VOTE_START_OP, aDesc, pReason);
-							return;
-						}
-						m_VoteType = VOTE_START_OP;
-						break;
-					}
-
-					pOption = pOption->m_pNext;
-				}
-
+				CVoteOptionServer *pOption = FindVoteOption(pMsg->m_Value);
 				if(!pOption)
 					return;
+
+				str_format(aDesc, sizeof(aDesc), "%s", pOption->m_aDescription);
+				str_format(aCmd, sizeof(aCmd), "%s", pOption->m_aCommand);
+				char aBuf[128];
+				str_format(aBuf, sizeof(aBuf),
+					"'%d:%s' voted %s '%s' reason='%s' cmd='%s' force=%d",
+					ClientID, Server()->ClientName(ClientID), pMsg->m_Type,
+					aDesc, pReason, aCmd, pMsg->m_Force
+				);
+				Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
+				if(pMsg->m_Force)
+				{
+					Server()->SetRconCID(ClientID);
+					Console()->ExecuteLine(aCmd);
+					Server()->SetRconCID(IServer::RCON_CID_SERV);
+					ForceVote(VOTE_START_OP, aDesc, pReason);
+					return;
+				}
+				m_VoteType = VOTE_START_OP;
 			}
 			else if(str_comp_nocase(pMsg->m_Type, "kick") == 0)
 			{
@@ -1130,23 +1261,9 @@ void CGameContext::OnMessage(int MsgID, CUnpacker *pUnpacker, int ClientID)
 			CNetMsg_Sv_VoteClearOptions ClearMsg;
 			Server()->SendPackMsg(&ClearMsg, MSGFLAG_VITAL, ClientID);
 
-			CVoteOptionServer *pCurrent = m_pVoteOptionFirst;
-			while(pCurrent)
-			{
-				// count options for actual packet
-				int NumOptions = 0;
-				for(CVoteOptionServer *p = pCurrent; p && NumOptions < MAX_VOTE_OPTION_ADD; p = p->m_pNext, ++NumOptions);
-
-				// pack and send vote list packet
-				CMsgPacker Msg(NETMSGTYPE_SV_VOTEOPTIONLISTADD);
-				Msg.AddInt(NumOptions);
-				while(pCurrent && NumOptions--)
-				{
-					Msg.AddString(pCurrent->m_aDescription, VOTE_DESC_LENGTH);
-					pCurrent = pCurrent->m_pNext;
-				}
-				Server()->SendMsg(&Msg, MSGFLAG_VITAL, ClientID);
-			}
+			// the rest follows with the next ticks
+			pPlayer->m_pSendVoteOption = m_pVoteOptionFirst;
+			SendVoteOptions(ClientID);
 
 			// send tuning parameters to client
 			SendTuningParams(ClientID);
@@ -1346,15 +1463,12 @@ void CGameContext::ConAddVote(IConsole::IResult *pResult, void *pUserData)
 	}
 
 	// check for duplicate entry
-	for(CVoteOptionServer *pOption = pSelf->m_pVoteOptionFirst; pOption; pOption = pOption->m_pNext)
+	if(pSelf->FindVoteOption(pDescription))
 	{
-		if(str_comp_nocase(pDescription, pOption->m_aDescription) == 0)
-		{
-			char aBuf[256];
-			str_format(aBuf, sizeof(aBuf), "option '%s' already exists", pDescription);
-			pSelf->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
-			return;
-		}
+		char aBuf[256];
+		str_format(aBuf, sizeof(aBuf), "option '%s' already exists", pDescription);
+		pSelf->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
+		return;
 	}
 
 	// add the option
@@ -1364,6 +1478,7 @@ void CGameContext::ConAddVote(IConsole::IResult *pResult, void *pUserData)
 	CVoteOptionServer *pOption = (CVoteOptionServer *)pSelf->m_pVoteOptionHeap->Allocate(sizeof(CVoteOptionServer) + Len);
 	pOption->m_pNext = 0;
 	pOption->m_pPrev = pSelf->m_pVoteOptionLast;
+	pOption->m_Order = pOption->m_pPrev ? pOption->m_pPrev->m_Order+1 : 0;
 	if(pOption->m_pPrev)
 		pOption->m_pPrev->m_pNext = pOption;
 	pSelf->m_pVoteOptionLast = pOption;
@@ -1372,14 +1487,21 @@ void CGameContext::ConAddVote(IConsole::IResult *pResult, void *pUserData)
 
 	str_copy(pOption->m_aDescription, pDescription, sizeof(pOption->m_aDescription));
 	mem_copy(pOption->m_aCommand, pCommand, Len+1);
+	unsigned Hash = VoteOptionHash(pOption->m_aDescription);
+	pOption->m_pNextHash = pSelf->m_apVoteOptionHash[Hash];
+	pSelf->m_apVoteOptionHash[Hash] = pOption;
 	char aBuf[256];
 	str_format(aBuf, sizeof(aBuf), "added option '%s' '%s'", pOption->m_aDescription, pOption->m_aCommand);
 	pSelf->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
 
-	// inform clients about added option
-	CNetMsg_Sv_VoteOptionAdd OptionMsg;
-	OptionMsg.m_pDescription = pOption->m_aDescription;
-	pSelf->Server()->SendPackMsg(&OptionMsg, MSGFLAG_VITAL, -1);
+	// inform clients about added option, the ones that are up to date get it
+	// with the next batch, so adding many options doesn't flood them
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		CPlayer *pPlayer = pSelf->m_apPlayers[i];
+		if(pPlayer && pPlayer->m_IsReadyToEnter && !pPlayer->IsDummy() && !pPlayer->m_pSendVoteOption)
+			pPlayer->m_pSendVoteOption = pOption;
+	}
 }
 
 void CGameContext::ConRemoveVote(IConsole::IResult *pResult, void *pUserData)
@@ -1388,13 +1510,7 @@ void CGameContext::ConRemoveVote(IConsole::IResult *pResult, void *pUserData)
 	const char *pDescription = pResult->GetString(0);
 
 	// check for valid option
-	CVoteOptionServer *pOption = pSelf->m_pVoteOptionFirst;
-	while(pOption)
-	{
-		if(str_comp_nocase(pDescription, pOption->m_aDescription) == 0)
-			break;
-		pOption = pOption->m_pNext;
-	}
+	CVoteOptionServer *pOption = pSelf->FindVoteOption(pDescription);
 	if(!pOption)
 	{
 		char aBuf[256];
@@ -1403,48 +1519,21 @@ void CGameContext::ConRemoveVote(IConsole::IResult *pResult, void *pUserData)
 		return;
 	}
 
-	// inform clients about removed option
+	// inform the clients that got the option already
 	CNetMsg_Sv_VoteOptionRemove OptionMsg;
 	OptionMsg.m_pDescription = pOption->m_aDescription;
-	pSelf->Server()->SendPackMsg(&OptionMsg, MSGFLAG_VITAL, -1);
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		CPlayer *pPlayer = pSelf->m_apPlayers[i];
+		if(pPlayer && pPlayer->m_IsReadyToEnter && !pPlayer->IsDummy() && (!pPlayer->m_pSendVoteOption || pPlayer->m_pSendVoteOption->m_Order > pOption->m_Order))
+			pSelf->Server()->SendPackMsg(&OptionMsg, MSGFLAG_VITAL|MSGFLAG_NORECORD, i);
+	}
 
-	// TODO: improve this
 	// remove the option
-	--pSelf->m_NumVoteOptions;
 	char aBuf[256];
 	str_format(aBuf, sizeof(aBuf), "removed option '%s' '%s'", pOption->m_aDescription, pOption->m_aCommand);
 	pSelf->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
-
-	CHeap *pVoteOptionHeap = new CHeap();
-	CVoteOptionServer *pVoteOptionFirst = 0;
-	CVoteOptionServer *pVoteOptionLast = 0;
-	int NumVoteOptions = pSelf->m_NumVoteOptions;
-	for(CVoteOptionServer *pSrc = pSelf->m_pVoteOptionFirst; pSrc; pSrc = pSrc->m_pNext)
-	{
-		if(pSrc == pOption)
-			continue;
-
-		// copy option
-		int Len = str_length(pSrc->m_aCommand);
-		CVoteOptionServer *pDst = (CVoteOptionServer *)pVoteOptionHeap->Allocate(sizeof(CVoteOptionServer) + Len);
-		pDst->m_pNext = 0;
-		pDst->m_pPrev = pVoteOptionLast;
-		if(pDst->m_pPrev)
-			pDst->m_pPrev->m_pNext = pDst;
-		pVoteOptionLast = pDst;
-		if(!pVoteOptionFirst)
-			pVoteOptionFirst = pDst;
-
-		str_copy(pDst->m_aDescription, pSrc->m_aDescription, sizeof(pDst->m_aDescription));
-		mem_copy(pDst->m_aCommand, pSrc->m_aCommand, Len+1);
-	}
-
-	// clean up
-	delete pSelf->m_pVoteOptionHeap;
-	pSelf->m_pVoteOptionHeap = pVoteOptionHeap;
-	pSelf->m_pVoteOptionFirst = pVoteOptionFirst;
-	pSelf->m_pVoteOptionLast = pVoteOptionLast;
-	pSelf->m_NumVoteOptions = NumVoteOptions;
+	pSelf->RemoveVoteOption(pOption);
 }
 
 void CGameContext::ConClearVotes(IConsole::IResult *pResult, void *pUserData)
@@ -1458,6 +1547,13 @@ void CGameContext::ConClearVotes(IConsole::IResult *pResult, void *pUserData)
 	pSelf->m_pVoteOptionFirst = 0;
 	pSelf->m_pVoteOptionLast = 0;
 	pSelf->m_NumVoteOptions = 0;
+	pSelf->m_NumVoteOptionsRemoved = 0;
+	mem_zero(pSelf->m_apVoteOptionHash, VOTE_OPTION_HASH_SIZE*sizeof(CVoteOptionServer *));
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		if(pSelf->m_apPlayers[i])
+			pSelf->m_apPlayers[i]->m_pSendVoteOption = 0;
+	}
 }
 
 void CGameContext::ConVote(IConsole::IResult *pResult, void *pUserData)
@@ -1477,6 +1573,27 @@ void CGameContext::ConVote(IConsole::IResult *pResult, void *pUserData)
 	pSelf->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
 }
 
+void CGameContext::ConEntityPools(IConsole::IResult *pResult, void *pUserData)
+{
+	CGameContext *pSelf = (CGameContext *)pUserData;
+	for(const CAllocPool *pPool = CAllocPool::First(); pPool; pPool = pPool->Next())
+	{
+		char aBuf[256];
+		str_format(aBuf, sizeof(aBuf), "%s: used=%d peak=%d capacity=%d blocks=%d allocs=%u",
+			pPool->Name(), pPool->NumUsed(), pPool->PeakUsed(), pPool->Capacity(), pPool->NumBlocks(), pPool->NumAllocs());
+		pSelf->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
+	}
+}
+
+void CGameContext::ConEventStats(IConsole::IResult *pResult, void *pUserData)
+{
+	CGameContext *pSelf = (CGameContext *)pUserData;
+	char aBuf[256];
+	str_format(aBuf, sizeof(aBuf), "events: peak=%d dropped=%d snap_dropped=%d",
+		pSelf->m_Events.PeakEvents(), pSelf->m_Events.NumDropped(), pSelf->m_Events.NumSnapDropped());
+	pSelf->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
+}
+
 void CGameContext::ConchainSpecialMotdupdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData)
 {
 	pfnCallback(pResult, pCallbackUserData);
@@ -1534,6 +1651,8 @@ void CGameContext::OnConsoleInit()
 	Console()->Register("remove_vote", "s[option]", CFGFLAG_SERVER, ConRemoveVote, this, "remove a voting option");
 	Console()->Register("clear_votes", "", CFGFLAG_SERVER, ConClearVotes, this, "Clears the voting options");
 	Console()->Register("vote", "r['yes'|'no']", CFGFLAG_SERVER, ConVote, this, "Force a vote to yes/no");
+	Console()->Register("entity_pools", "", CFGFLAG_SERVER, ConEntityPools, this, "Show the usage of the entity pools");
+	Console()->Register("event_stats", "", CFGFLAG_SERVER, ConEventStats, this, "Show how many events were created and dropped");
 }
 
 void CGameContext::NewCommandHook(const CCommandManager::CCommand *pCommand, void *pContext)
@@ -1583,6 +1702,10 @@ void CGameContext::OnInit()
 
 	m_pController->RegisterChatCommands(CommandManager());
 
+	// allocate the entity pools ahead so the first rounds don't grow them
+	for(CAllocPool *pPool = CAllocPool::First(); pPool; pPool = pPool->Next())
+		pPool->Reserve(Config()->m_SvEntityPoolSize);
+
 	// create all entities from the game layer
 	CMapItemLayerTilemap *pTileMap = m_Layers.GameLayer();
 	CTile *pTiles = (CTile *)Kernel()->RequestInterface<IMap>()->GetData(pTileMap->m_Data);
@@ -62,6 +62,8 @@ class CGameContext : public IGameServer
 	static void ConRemoveVote(IConsole::IResult *pResult, void *pUserData);
 	static void ConClearVotes(IConsole::IResult *pResult, void *pUserData);
 	static void ConVote(IConsole::IResult *pResult, void *pUserData);
+	static void ConEntityPools(IConsole::IResult *pResult, void *pUserData);
+	static void ConEventStats(IConsole::IResult *pResult, void *pUserData);
 	static void ConchainSpecialMotdupdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData);
 	static void ConchainSettingUpdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData);
 	static void ConchainGameinfoUpdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData);
@@ -135,6 +137,13 @@ public:
 	class CHeap *m_pVoteOptionHeap;
 	CVoteOptionServer *m_pVoteOptionFirst;
 	CVoteOptionServer *m_pVoteOptionLast;
+	CVoteOptionServer **m_apVoteOptionHash; // VOTE_OPTION_HASH_SIZE buckets by description
+	int m_NumVoteOptionsRemoved; // still taking heap space
+
+	CVoteOptionServer *FindVoteOption(const char *pDescription);
+	void RemoveVoteOption(CVoteOptionServer *pOption);
+	void CompactVoteOptions();
+	void SendVoteOptions(int ClientID);
 
 	// helper functions
 	void CreateDamage(vec2 Pos, int Id, vec2 Source, int HealthAmount, int ArmorAmount, bool Self);
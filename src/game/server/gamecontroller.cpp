@@ -48,9 +48,7 @@ IGameController::IGameController(CGameContext *pGameServer)
 	m_aMapWish[0] = 0;
 
 	// spawn
-	m_aNumSpawnPoints[0] = 0;
-	m_aNumSpawnPoints[1] = 0;
-	m_aNumSpawnPoints[2] = 0;
+	m_SpawnDangerTick = -1;
 }
 
 //activity
@@ -217,6 +215,9 @@ void IGameController::DoTeamBalance()
 // event
 int IGameController::OnCharacterDeath(CCharacter *pVictim, CPlayer *pKiller, int Weapon)
 {
+	// the victim leaves the world, rebuild the danger field on the next spawn
+	m_SpawnDangerTick = -1;
+
 	// do scoreing
 	if(!pKiller || Weapon == WEAPON_GAME)
 		return 0;
@@ -246,6 +247,10 @@ int IGameController::OnCharacterDeath(CCharacter *pVictim, CPlayer *pKiller, int
 
 void IGameController::OnCharacterSpawn(CCharacter *pChr)
 {
+	// spawns later in this tick have to keep away from the new character
+	if(m_SpawnDangerTick == Server()->Tick())
+		AddSpawnDanger(pChr->GetPos(), pChr->GetPlayer()->GetTeam());
+
 	// default health
 	pChr->IncreaseHealth(10);
 
@@ -272,13 +277,14 @@ bool IGameController::OnEntity(int Index, vec2 Pos)
 	switch(Index)
 	{
 	case ENTITY_SPAWN:
-		m_aaSpawnPoints[0][m_aNumSpawnPoints[0]++] = Pos;
-		break;
 	case ENTITY_SPAWN_RED:
-		m_aaSpawnPoints[1][m_aNumSpawnPoints[1]++] = Pos;
-		break;
 	case ENTITY_SPAWN_BLUE:
-		m_aaSpawnPoints[2][m_aNumSpawnPoints[2]++] = Pos;
+		{
+			CSpawnPoint Spawn;
+			mem_zero(&Spawn, sizeof(Spawn));
+			Spawn.m_Pos = Pos;
+			m_aSpawnPoints[Index-ENTITY_SPAWN].add(Spawn);
+		}
 		break;
 	case ENTITY_ARMOR_1:
 		Type = PICKUP_ARMOR;
@@ -996,12 +1002,14 @@ void IGameController::CycleMap()
 }
 
 // spawn
-bool IGameController::CanSpawn(int Team, vec2 *pOutPos) const
+bool IGameController::CanSpawn(int Team, vec2 *pOutPos)
 {
 	// spectators can't spawn
 	if(Team == TEAM_SPECTATORS || GameServer()->m_World.m_Paused || GameServer()->m_World.m_ResetRequested)
 		return false;
 
+	UpdateSpawnDanger();
+
 	CSpawnEval Eval;
 	Eval.m_RandomSpawn = IsSurvival();
 
@@ -1029,6 +1037,49 @@ bool IGameController::CanSpawn(int Team, vec2 *pOutPos) const
 	return Eval.m_Got;
 }
 
+void IGameController::AddSpawnDanger(vec2 Pos, int Team)
+{
+	for(int Type = 0; Type < 3; Type++)
+	{
+		for(int i = 0; i < m_aSpawnPoints[Type].size(); i++)
+		{
+			CSpawnPoint *pSpawn = &m_aSpawnPoints[Type][i];
+			float d = distance(pSpawn->m_Pos, Pos);
+			float Danger = d == 0 ? 1000000000.0f : 1.0f/d;
+
+			// team mates are not as dangerous as enemies
+			pSpawn->m_aDanger[0] += Danger;
+			for(int t = 0; t < NUM_TEAMS; t++)
+				pSpawn->m_aDanger[1+t] += (t == Team ? 0.5f : 1.0f) * Danger;
+			pSpawn->m_NearestDistance = min(pSpawn->m_NearestDistance, d);
+		}
+	}
+}
+
+void IGameController::UpdateSpawnDanger()
+{
+	// the characters only move in the world tick, so the field stays valid
+	// for the rest of the tick as long as spawns are added to it
+	if(m_SpawnDangerTick == Server()->Tick())
+		return;
+
+	for(int Type = 0; Type < 3; Type++)
+	{
+		for(int i = 0; i < m_aSpawnPoints[Type].size(); i++)
+		{
+			CSpawnPoint *pSpawn = &m_aSpawnPoints[Type][i];
+			mem_zero(pSpawn->m_aDanger, sizeof(pSpawn->m_aDanger));
+			pSpawn->m_NearestDistance = 1000000000.0f;
+		}
+	}
+
+	CCharacter *pC = static_cast<CCharacter *>(GameServer()->m_World.FindFirst(CGameWorld::ENTTYPE_CHARACTER));
+	for(; pC; pC = (CCharacter *)pC->TypeNext())
+		AddSpawnDanger(pC->GetPos(), pC->GetPlayer()->GetTeam());
+
+	m_SpawnDangerTick = Server()->Tick();
+}
+
 float IGameController::EvaluateSpawnPos(CSpawnEval *pEval, vec2 Pos) const
 {
 	float Score = 0.0f;
@@ -1049,30 +1100,43 @@ float IGameController::EvaluateSpawnPos(CSpawnEval *pEval, vec2 Pos) const
 
 void IGameController::EvaluateSpawnType(CSpawnEval *pEval, int Type) const
 {
+	vec2 Positions[5] = { vec2(0.0f, 0.0f), vec2(-32.0f, 0.0f), vec2(0.0f, -32.0f), vec2(32.0f, 0.0f), vec2(0.0f, 32.0f) };	// start, left, up, right, down
+
 	// get spawn point
-	for(int i = 0; i < m_aNumSpawnPoints[Type]; i++)
+	for(int i = 0; i < m_aSpawnPoints[Type].size(); i++)
 	{
-		// check if the position is occupado
-		CCharacter *aEnts[MAX_CLIENTS];
-		int Num = GameServer()->m_World.FindEntities(m_aaSpawnPoints[Type][i], 64, (CEntity**)aEnts, MAX_CLIENTS, CGameWorld::ENTTYPE_CHARACTER);
-		vec2 Positions[5] = { vec2(0.0f, 0.0f), vec2(-32.0f, 0.0f), vec2(0.0f, -32.0f), vec2(32.0f, 0.0f), vec2(0.0f, 32.0f) };	// start, left, up, right, down
-		int Result = -1;
-		for(int Index = 0; Index < 5 && Result == -1; ++Index)
+		const CSpawnPoint *pSpawn = &m_aSpawnPoints[Type][i];
+
+		// check if the position is occupado, only possible with a character close by
+		int Result = 0;
+		if(pSpawn->m_NearestDistance < 64+CCharacter::ms_PhysSize)
 		{
-			Result = Index;
-			for(int c = 0; c < Num; ++c)
-				if(GameServer()->Collision()->CheckPoint(m_aaSpawnPoints[Type][i]+Positions[Index]) ||
-					distance(aEnts[c]->GetPos(), m_aaSpawnPoints[Type][i]+Positions[Index]) <= aEnts[c]->GetProximityRadius())
-				{
-					Result = -1;
-					break;
-				}
+			CCharacter *aEnts[MAX_CLIENTS];
+			int Num = GameServer()->m_World.FindEntities(pSpawn->m_Pos, 64, (CEntity**)aEnts, MAX_CLIENTS, CGameWorld::ENTTYPE_CHARACTER);
+			Result = -1;
+			for(int Index = 0; Index < 5 && Result == -1; ++Index)
+			{
+				Result = Index;
+				for(int c = 0; c < Num; ++c)
+					if(GameServer()->Collision()->CheckPoint(pSpawn->m_Pos+Positions[Index]) ||
+						distance(aEnts[c]->GetPos(), pSpawn->m_Pos+Positions[Index]) <= aEnts[c]->GetProximityRadius())
+					{
+						Result = -1;
+						break;
+					}
+			}
+			if(Result == -1)
+				continue;	// try next spawn point
 		}
-		if(Result == -1)
-			continue;	// try next spawn point
 
-		vec2 P = m_aaSpawnPoints[Type][i]+Positions[Result];
-		float S = pEval->m_RandomSpawn ? (Result + frandom()) : EvaluateSpawnPos(pEval, P);
+		vec2 P = pSpawn->m_Pos+Positions[Result];
+		float S;
+		if(pEval->m_RandomSpawn)
+			S = Result + frandom();
+		else if(Result == 0)
+			S = pSpawn->m_aDanger[1+pEval->m_FriendlyTeam];	// the spawn point itself is in the danger field
+		else
+			S = EvaluateSpawnPos(pEval, P);
 		if(!pEval->m_Got || pEval->m_Score > S)
 		{
 			pEval->m_Got = true;
@@ -87,9 +87,17 @@ class IGameController
 		int m_FriendlyTeam;
 		float m_Score;
 	};
-	vec2 m_aaSpawnPoints[3][64];
-	int m_aNumSpawnPoints[3];
+	struct CSpawnPoint
+	{
+		vec2 m_Pos;
+		float m_aDanger[1+NUM_TEAMS];	// summed inverse distance of the characters, without a friendly team and for each team
+		float m_NearestDistance;	// distance of the closest character
+	};
+	array<CSpawnPoint> m_aSpawnPoints[3];
+	int m_SpawnDangerTick;	// tick the danger field is valid for, -1 when it has to be rebuilt
 
+	void AddSpawnDanger(vec2 Pos, int Team);
+	void UpdateSpawnDanger();
 	float EvaluateSpawnPos(CSpawnEval *pEval, vec2 Pos) const;
 	void EvaluateSpawnType(CSpawnEval *pEval, int Type) const;
 
@@ -216,7 +224,7 @@ public:
 	void ChangeMap(const char *pToMap);
 
 	//spawn
-	bool CanSpawn(int Team, vec2 *pPos) const;
+	bool CanSpawn(int Team, vec2 *pPos);
 	bool GetStartRespawnState() const;
 
 	// team
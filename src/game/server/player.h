@@ -67,6 +67,7 @@ public:
 	//
 	int m_Vote;
 	int m_VotePos;
+	struct CVoteOptionServer *m_pSendVoteOption; // first option the client doesn't have yet
 	//
 	int m_LastVoteCall;
 	int m_LastVoteTry;
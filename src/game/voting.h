@@ -10,8 +10,9 @@ enum
 	VOTE_SEARCH_LENGTH=64,
 	VOTE_REASON_LENGTH=16,
 
-	MAX_VOTE_OPTIONS=128,
+	MAX_VOTE_OPTIONS=8192,
 	MAX_VOTE_OPTION_ADD=21,
+	VOTE_OPTION_HASH_SIZE=2048,
 
 	VOTE_COOLDOWN=60,
 };
@@ -30,6 +31,8 @@ struct CVoteOptionServer
 {
 	CVoteOptionServer *m_pNext;
 	CVoteOptionServer *m_pPrev;
+	CVoteOptionServer *m_pNextHash;
+	int m_Order; // grows along the list
 	char m_aDescription[VOTE_DESC_LENGTH];
 	char m_aCommand[1];
 };
@@ -1,6 +1,8 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
 #include <base/system.h>
+#include <base/tl/array.h>
 
 #include <engine/config.h>
 #include <engine/console.h>
@@ -17,33 +19,255 @@
 enum {
 	MTU = 1400,
 	MAX_SERVERS_PER_PACKET=75,
-	MAX_PACKETS=16,
-	MAX_SERVERS=MAX_SERVERS_PER_PACKET*MAX_PACKETS,
-	EXPIRE_TIME = 90
+	EXPIRE_TIME = 90,
+	CHECK_TRIES = 10,
+	CHECK_INTERVAL = 1,
+	WHEEL_SIZE = 128, // seconds, has to be larger than EXPIRE_TIME
+	MIN_CHANGES = 1024,
 };
 
+/*
+	Servers and pending firewall checks live in pools that only grow. Both
+	are indexed by address and kept on a timer wheel with one slot per
+	second, so heartbeats, responses and expiry don't depend on the number
+	of servers. The list packets are updated in place when servers come
+	and go.
+*/
+
+// chained hash from addresses to pool indices, a key may be added more than once
+class CAddrIndex
+{
+	struct CNode
+	{
+		NETADDR m_Addr;
+		int m_Value;
+		int m_Next;
+	};
+
+	array<CNode> m_aNodes;
+	array<int> m_aBuckets;
+	int m_FirstFree;
+	int m_NumNodes;
+
+	unsigned Bucket(const NETADDR *pAddr) const
+	{
+		unsigned Hash = 2166136261u^pAddr->type;
+		int Size = pAddr->type == NETTYPE_IPV4 ? NETADDR_SIZE_IPV4 : NETADDR_SIZE_IPV6;
+		for(int i = 0; i < Size; i++)
+			Hash = (Hash^pAddr->ip[i])*16777619u;
+		Hash = (Hash^(pAddr->port&0xff))*16777619u;
+		Hash = (Hash^(pAddr->port>>8))*16777619u;
+		return Hash&(m_aBuckets.size()-1);
+	}
+
+	void Rehash(int NumBuckets)
+	{
+		m_aBuckets.set_size(NumBuckets);
+		for(int i = 0; i < NumBuckets; i++)
+			m_aBuckets[i] = -1;
+		for(int i = 0; i < m_aNodes.size(); i++)
+		{
+			if(m_aNodes[i].m_Value < 0)
+				continue;
+			unsigned b = Bucket(&m_aNodes[i].m_Addr);
+			m_aNodes[i].m_Next = m_aBuckets[b];
+			m_aBuckets[b] = i;
+		}
+	}
+
+public:
+	CAddrIndex()
+	{
+		m_FirstFree = -1;
+		m_NumNodes = 0;
+		Rehash(1024);
+	}
+
+	int Find(const NETADDR *pAddr) const
+	{
+		int Node = -1;
+		return FindNext(pAddr, &Node);
+	}
+
+	// walks all values stored for the address, start with a node of -1
+	int FindNext(const NETADDR *pAddr, int *pNode) const
+	{
+		for(int i = *pNode < 0 ? m_aBuckets[Bucket(pAddr)] : m_aNodes[*pNode].m_Next; i >= 0; i = m_aNodes[i].m_Next)
+		{
+			if(net_addr_comp(&m_aNodes[i].m_Addr, pAddr, true) == 0)
+			{
+				*pNode = i;
+				return m_aNodes[i].m_Value;
+			}
+		}
+		return -1;
+	}
+
+	void Insert(const NETADDR *pAddr, int Value)
+	{
+		// keep the chains short
+		if(m_NumNodes >= m_aBuckets.size())
+			Rehash(m_aBuckets.size()*2);
+
+		int i = m_FirstFree;
+		if(i >= 0)
+			m_FirstFree = m_aNodes[i].m_Next;
+		else
+		{
+			CNode Node;
+			mem_zero(&Node, sizeof(Node));
+			i = m_aNodes.add(Node);
+		}
+		unsigned b = Bucket(pAddr);
+		m_aNodes[i].m_Addr = *pAddr;
+		m_aNodes[i].m_Value = Value;
+		m_aNodes[i].m_Next = m_aBuckets[b];
+		m_aBuckets[b] = i;
+		m_NumNodes++;
+	}
+
+	void Remove(const NETADDR *pAddr, int Value)
+	{
+		for(int *pLink = &m_aBuckets[Bucket(pAddr)]; *pLink >= 0; pLink = &m_aNodes[*pLink].m_Next)
+		{
+			CNode *pNode = &m_aNodes[*pLink];
+			if(pNode->m_Value == Value && net_addr_comp(&pNode->m_Addr, pAddr, true) == 0)
+			{
+				int i = *pLink;
+				*pLink = pNode->m_Next;
+				pNode->m_Value = -1;
+				pNode->m_Next = m_FirstFree;
+				m_FirstFree = i;
+				m_NumNodes--;
+				return;
+			}
+		}
+	}
+};
+
+// pool of T with a free list, T needs m_WheelPrev/m_WheelNext/m_WheelSecond/m_WheelSlot
+// for the timer wheel, the free list reuses m_WheelNext
+template<typename T>
+class CTimerPool
+{
+	array<T> m_aItems;
+	int m_FirstFree;
+	int m_aWheel[WHEEL_SIZE];
+	int64 m_Second; // the slots before this second are done
+	int m_NumUsed;
+
+public:
+	CTimerPool()
+	{
+		m_FirstFree = -1;
+		m_Second = 0;
+		m_NumUsed = 0;
+		for(int i = 0; i < WHEEL_SIZE; i++)
+			m_aWheel[i] = -1;
+	}
+
+	T *Get(int Index) { return &m_aItems[Index]; }
+	int NumUsed() const { return m_NumUsed; }
+
+	int Alloc()
+	{
+		m_NumUsed++;
+		int i = m_FirstFree;
+		if(i >= 0)
+		{
+			m_FirstFree = m_aItems[i].m_WheelNext;
+			return i;
+		}
+		T Item;
+		mem_zero(&Item, sizeof(Item));
+		return m_aItems.add(Item);
+	}
+
+	void Free(int Index)
+	{
+		m_NumUsed--;
+		m_aItems[Index].m_WheelNext = m_FirstFree;
+		m_FirstFree = Index;
+	}
+
+	void Schedule(int Index, int64 Second)
+	{
+		// timers beyond the wheel wait in its last slot and get moved on from there
+		T *pItem = &m_aItems[Index];
+		int Slot = clamp(Second, m_Second, m_Second+WHEEL_SIZE-1)%WHEEL_SIZE;
+		pItem->m_WheelSecond = Second;
+		pItem->m_WheelSlot = Slot;
+		pItem->m_WheelPrev = -1;
+		pItem->m_WheelNext = m_aWheel[Slot];
+		if(pItem->m_WheelNext >= 0)
+			m_aItems[pItem->m_WheelNext].m_WheelPrev = Index;
+		m_aWheel[Slot] = Index;
+	}
+
+	void Unschedule(int Index)
+	{
+		T *pItem = &m_aItems[Index];
+		if(pItem->m_WheelPrev >= 0)
+			m_aItems[pItem->m_WheelPrev].m_WheelNext = pItem->m_WheelNext;
+		else
+			m_aWheel[pItem->m_WheelSlot] = pItem->m_WheelNext;
+		if(pItem->m_WheelNext >= 0)
+			m_aItems[pItem->m_WheelNext].m_WheelPrev = pItem->m_WheelPrev;
+	}
+
+	// unschedules and returns an item that is due at Second, -1 if there is none
+	int PopDue(int64 Second)
+	{
+		// after a long stall every slot has to be looked at once
+		m_Second = max(m_Second, Second-WHEEL_SIZE+1);
+		for(; m_Second <= Second; m_Second++)
+		{
+			int i;
+			while((i = m_aWheel[m_Second%WHEEL_SIZE]) >= 0)
+			{
+				Unschedule(i);
+				if(m_aItems[i].m_WheelSecond <= Second)
+					return i;
+				Schedule(i, m_aItems[i].m_WheelSecond);
+			}
+		}
+		return -1;
+	}
+};
+
+static int64 Seconds() { return time_get()/time_freq(); }
+
 struct CCheckServer
 {
 	enum ServerType m_Type;
 	NETADDR m_Address;
 	NETADDR m_AltAddress;
 	int m_TryCount;
-	int64 m_TryTime;
 	TOKEN m_Token;
+
+	int m_WheelPrev;
+	int m_WheelNext;
+	int64 m_WheelSecond; // next try
+	int m_WheelSlot;
 };
 
-static CCheckServer m_aCheckServers[MAX_SERVERS];
-static int m_NumCheckServers = 0;
+static CTimerPool<CCheckServer> m_CheckServers;
+static CAddrIndex m_CheckIndex; // by address and by alternative address
 
 struct CServerEntry
 {
 	enum ServerType m_Type;
 	NETADDR m_Address;
-	int64 m_Expire;
+	int m_ListPos;
+
+	int m_WheelPrev;
+	int m_WheelNext;
+	int64 m_WheelSecond; // expiry
+	int m_WheelSlot;
 };
 
-static CServerEntry m_aServers[MAX_SERVERS];
-static int m_NumServers = 0;
+static CTimerPool<CServerEntry> m_Servers;
+static CAddrIndex m_ServerIndex;
 
 struct CPacketData
 {
@@ -54,8 +278,17 @@ struct CPacketData
 	} m_Data;
 };
 
-CPacketData m_aPackets[MAX_PACKETS];
+// the servers in list order, position i is entry i%MAX_SERVERS_PER_PACKET of packet i/MAX_SERVERS_PER_PACKET
+static array<int> m_aListServers;
+static array<CPacketData> m_aPackets;
 static int m_NumPackets = 0;
+static bool m_ListChanged = false;
+
+// every change of the list counts a generation, the log keeps the latest
+// ones for delta requests, m_aChanges[i] led to generation m_Generation-m_aChanges.size()+1+i
+static unsigned m_Epoch = 0;
+static unsigned m_Generation = 1;
+static array<CMastersrvDelta> m_aChanges;
 
 
 struct CCountPacketData
@@ -65,7 +298,39 @@ struct CCountPacketData
 	unsigned char m_Low;
 };
 
-static CCountPacketData m_CountData;
+/*
+	List requests are answered by the main thread and optionally by worker
+	threads, each with its own socket on the master port. They read an
+	immutable copy of the list packets that the main thread replaces when
+	the list changed. Readers hold a reference to the copy they use, the
+	last one to drop it frees it, so the main thread never waits for them.
+	Heartbeats that arrive at a worker are handed to the main thread.
+*/
+struct CListSnapshot
+{
+	int m_RefCount;
+	int m_NumServers;
+	int m_NumPackets;
+	CPacketData *m_pPackets;
+	unsigned m_Generation;
+	int m_NumChanges;
+	CMastersrvDelta *m_pChanges;
+};
+
+static LOCK m_SnapshotLock;
+static CListSnapshot *m_pSnapshot = 0;
+
+struct CHeartbeat
+{
+	NETADDR m_Address;
+	NETADDR m_AltAddress;
+	TOKEN m_Token;
+};
+
+static LOCK m_HeartbeatLock;
+static array<CHeartbeat> m_aHeartbeats;
+
+static LOCK m_BanLock;
 
 
 CNetBan m_NetBan;
@@ -75,58 +340,307 @@ static CNetClient m_NetOp; // main
 
 IConsole *m_pConsole;
 
-void BuildPackets()
+static CListSnapshot *AcquireSnapshot()
+{
+	lock_wait(m_SnapshotLock);
+	CListSnapshot *pSnapshot = m_pSnapshot;
+	pSnapshot->m_RefCount++;
+	lock_unlock(m_SnapshotLock);
+	return pSnapshot;
+}
+
+static void ReleaseSnapshot(CListSnapshot *pSnapshot)
+{
+	lock_wait(m_SnapshotLock);
+	bool Unused = --pSnapshot->m_RefCount == 0;
+	lock_unlock(m_SnapshotLock);
+	if(Unused)
+	{
+		mem_free(pSnapshot->m_pPackets);
+		mem_free(pSnapshot->m_pChanges);
+		mem_free(pSnapshot);
+	}
+}
+
+static void PublishSnapshot()
+{
+	CListSnapshot *pSnapshot = (CListSnapshot *)mem_alloc(sizeof(CListSnapshot), 1);
+	pSnapshot->m_RefCount = 1; // held by m_pSnapshot
+	pSnapshot->m_NumServers = m_aListServers.size();
+	pSnapshot->m_NumPackets = m_NumPackets;
+	pSnapshot->m_pPackets = (CPacketData *)mem_alloc(max(m_NumPackets, 1)*sizeof(CPacketData), 1);
+	if(m_NumPackets)
+		mem_copy(pSnapshot->m_pPackets, m_aPackets.base_ptr(), m_NumPackets*sizeof(CPacketData));
+	pSnapshot->m_Generation = m_Generation;
+	pSnapshot->m_NumChanges = m_aChanges.size();
+	pSnapshot->m_pChanges = (CMastersrvDelta *)mem_alloc(max(m_aChanges.size(), 1)*sizeof(CMastersrvDelta), 1);
+	if(m_aChanges.size())
+		mem_copy(pSnapshot->m_pChanges, m_aChanges.base_ptr(), m_aChanges.size()*sizeof(CMastersrvDelta));
+
+	lock_wait(m_SnapshotLock);
+	CListSnapshot *pOld = m_pSnapshot;
+	m_pSnapshot = pSnapshot;
+	lock_unlock(m_SnapshotLock);
+
+	if(pOld)
+		ReleaseSnapshot(pOld);
+	m_ListChanged = false;
+}
+
+static bool IsBanned(const NETADDR *pAddr)
+{
+	lock_wait(m_BanLock);
+	bool Banned = m_NetBan.IsBanned(pAddr, 0, 0, 0);
+	lock_unlock(m_BanLock);
+	return Banned;
+}
+
+static bool UnpackHeartbeat(const CNetChunk *pPacket, TOKEN Token, CHeartbeat *pHeartbeat)
+{
+	if(pPacket->m_DataSize != sizeof(SERVERBROWSE_HEARTBEAT)+2 ||
+		mem_comp(pPacket->m_pData, SERVERBROWSE_HEARTBEAT, sizeof(SERVERBROWSE_HEARTBEAT)) != 0)
+		return false;
+
+	const unsigned char *d = (const unsigned char *)pPacket->m_pData;
+	pHeartbeat->m_Address = pPacket->m_Address;
+	pHeartbeat->m_AltAddress = pPacket->m_Address;
+	pHeartbeat->m_AltAddress.port =
+		(d[sizeof(SERVERBROWSE_HEARTBEAT)]<<8) |
+		d[sizeof(SERVERBROWSE_HEARTBEAT)+1];
+	pHeartbeat->m_Token = Token;
+	return true;
+}
+
+static void PackInt(unsigned char *pDst, unsigned Value)
+{
+	pDst[0] = (Value>>24)&0xff;
+	pDst[1] = (Value>>16)&0xff;
+	pDst[2] = (Value>>8)&0xff;
+	pDst[3] = Value&0xff;
+}
+
+static unsigned UnpackInt(const unsigned char *pSrc)
+{
+	return (pSrc[0]<<24) | (pSrc[1]<<16) | (pSrc[2]<<8) | pSrc[3];
+}
+
+static void SendList(CNetClient *pNet, const NETADDR *pAddr, TOKEN Token, const CListSnapshot *pSnapshot)
+{
+	CNetChunk p;
+	p.m_ClientID = -1;
+	p.m_Address = *pAddr;
+	p.m_Flags = NETSENDFLAG_CONNLESS;
+
+	for(int i = 0; i < pSnapshot->m_NumPackets; i++)
+	{
+		p.m_DataSize = pSnapshot->m_pPackets[i].m_Size;
+		p.m_pData = &pSnapshot->m_pPackets[i].m_Data;
+		pNet->Send(&p, Token);
+	}
+}
+
+static void SendDelta(CNetClient *pNet, const NETADDR *pAddr, TOKEN Token, const CListSnapshot *pSnapshot, unsigned Epoch, unsigned Generation)
+{
+	unsigned char aData[SERVERBROWSE_DELTA_HEADER_SIZE+SERVERBROWSE_MAX_DELTAS_PER_PACKET*sizeof(CMastersrvDelta)];
+	mem_copy(aData, SERVERBROWSE_DELTA, sizeof(SERVERBROWSE_DELTA));
+	PackInt(aData+sizeof(SERVERBROWSE_DELTA), m_Epoch);
+	PackInt(aData+sizeof(SERVERBROWSE_DELTA)+8, pSnapshot->m_Generation);
+
+	CNetChunk p;
+	p.m_ClientID = -1;
+	p.m_Address = *pAddr;
+	p.m_Flags = NETSENDFLAG_CONNLESS;
+	p.m_pData = aData;
+
+	// the full list goes out if the log doesn't reach back far enough or
+	// if the delta would be larger than the list
+	unsigned NumChanges = pSnapshot->m_Generation-Generation;
+	bool Full = Epoch != m_Epoch || Generation > pSnapshot->m_Generation || NumChanges > (unsigned)pSnapshot->m_NumChanges;
+	int NumPackets = Full ? 0 : max(((int)NumChanges+SERVERBROWSE_MAX_DELTAS_PER_PACKET-1)/SERVERBROWSE_MAX_DELTAS_PER_PACKET, 1);
+	if(Full || NumPackets > max(pSnapshot->m_NumPackets, 1) || NumPackets > SERVERBROWSE_MAX_DELTA_PACKETS)
+	{
+		dbg_msg("mastersrv", "delta requested, responding with %d servers", pSnapshot->m_NumServers);
+
+		PackInt(aData+sizeof(SERVERBROWSE_DELTA)+4, 0);
+		aData[sizeof(SERVERBROWSE_DELTA)+12] = 0;
+		aData[sizeof(SERVERBROWSE_DELTA)+13] = 0;
+		aData[sizeof(SERVERBROWSE_DELTA)+14] = (pSnapshot->m_NumPackets>>8)&0xff;
+		aData[sizeof(SERVERBROWSE_DELTA)+15] = pSnapshot->m_NumPackets&0xff;
+		p.m_DataSize = SERVERBROWSE_DELTA_HEADER_SIZE;
+		pNet->Send(&p, Token);
+		SendList(pNet, pAddr, Token, pSnapshot);
+		return;
+	}
+
+	dbg_msg("mastersrv", "delta requested, responding with %d changes", NumChanges);
+
+	PackInt(aData+sizeof(SERVERBROWSE_DELTA)+4, Generation);
+	aData[sizeof(SERVERBROWSE_DELTA)+14] = (NumPackets>>8)&0xff;
+	aData[sizeof(SERVERBROWSE_DELTA)+15] = NumPackets&0xff;
+	const CMastersrvDelta *pChanges = pSnapshot->m_pChanges+pSnapshot->m_NumChanges-NumChanges;
+	for(int i = 0; i < NumPackets; i++)
+	{
+		int Num = min((int)NumChanges-i*SERVERBROWSE_MAX_DELTAS_PER_PACKET, (int)SERVERBROWSE_MAX_DELTAS_PER_PACKET);
+		aData[sizeof(SERVERBROWSE_DELTA)+12] = (i>>8)&0xff;
+		aData[sizeof(SERVERBROWSE_DELTA)+13] = i&0xff;
+		if(Num > 0)
+			mem_copy(aData+SERVERBROWSE_DELTA_HEADER_SIZE, pChanges+i*SERVERBROWSE_MAX_DELTAS_PER_PACKET, Num*sizeof(CMastersrvDelta));
+		p.m_DataSize = SERVERBROWSE_DELTA_HEADER_SIZE+max(Num, 0)*sizeof(CMastersrvDelta);
+		pNet->Send(&p, Token);
+	}
+}
+
+static void ProcessListRequest(CNetClient *pNet, const CNetChunk *pPacket, TOKEN Token, const CListSnapshot *pSnapshot)
 {
-	CServerEntry *pCurrent = &m_aServers[0];
-	int ServersLeft = m_NumServers;
-	m_NumPackets = 0;
-	int PacketIndex = 0;
-	while(ServersLeft-- && m_NumPackets < MAX_PACKETS)
+	if(pPacket->m_DataSize == sizeof(SERVERBROWSE_GETCOUNT) &&
+		mem_comp(pPacket->m_pData, SERVERBROWSE_GETCOUNT, sizeof(SERVERBROWSE_GETCOUNT)) == 0)
+	{
+		dbg_msg("mastersrv", "count requested, responding with %d", pSnapshot->m_NumServers);
+
+		CCountPacketData CountData;
+		int NumServers = min(pSnapshot->m_NumServers, 0xffff);
+		mem_copy(CountData.m_Header, SERVERBROWSE_COUNT, sizeof(SERVERBROWSE_COUNT));
+		CountData.m_High = (NumServers>>8)&0xff;
+		CountData.m_Low = NumServers&0xff;
+
+		CNetChunk p;
+		p.m_ClientID = -1;
+		p.m_Address = pPacket->m_Address;
+		p.m_Flags = NETSENDFLAG_CONNLESS;
+		p.m_DataSize = sizeof(CountData);
+		p.m_pData = &CountData;
+		pNet->Send(&p, Token);
+	}
+	else if(pPacket->m_DataSize == sizeof(SERVERBROWSE_GETLIST) &&
+		mem_comp(pPacket->m_pData, SERVERBROWSE_GETLIST, sizeof(SERVERBROWSE_GETLIST)) == 0)
 	{
-		if(pCurrent->m_Type == SERVERTYPE_NORMAL)
+		// someone requested the list
+		dbg_msg("mastersrv", "requested, responding with %d servers", pSnapshot->m_NumServers);
+		SendList(pNet, &pPacket->m_Address, Token, pSnapshot);
+	}
+	else if(pPacket->m_DataSize == sizeof(SERVERBROWSE_GETDELTA)+8 &&
+		mem_comp(pPacket->m_pData, SERVERBROWSE_GETDELTA, sizeof(SERVERBROWSE_GETDELTA)) == 0)
+	{
+		const unsigned char *pData = (const unsigned char *)pPacket->m_pData+sizeof(SERVERBROWSE_GETDELTA);
+		SendDelta(pNet, &pPacket->m_Address, Token, pSnapshot, UnpackInt(pData), UnpackInt(pData+4));
+	}
+}
+
+static void ListWorkerThread(void *pUser)
+{
+	CNetClient *pNet = (CNetClient *)pUser;
+	while(1)
+	{
+		pNet->Wait(100);
+		pNet->Update();
+
+		// one snapshot for everything that arrived meanwhile
+		CListSnapshot *pSnapshot = 0;
+		CNetChunk Packet;
+		TOKEN Token;
+		while(pNet->Recv(&Packet, &Token))
 		{
-			if(PacketIndex % MAX_SERVERS_PER_PACKET == 0)
+			if(IsBanned(&Packet.m_Address))
+				continue;
+
+			CHeartbeat Heartbeat;
+			if(UnpackHeartbeat(&Packet, Token, &Heartbeat))
 			{
-				PacketIndex = 0;
-				m_NumPackets++;
+				lock_wait(m_HeartbeatLock);
+				m_aHeartbeats.add(Heartbeat);
+				lock_unlock(m_HeartbeatLock);
+				continue;
 			}
 
-			// copy header
-			mem_copy(m_aPackets[m_NumPackets-1].m_Data.m_aHeader, SERVERBROWSE_LIST, sizeof(SERVERBROWSE_LIST));
+			if(!pSnapshot)
+				pSnapshot = AcquireSnapshot();
+			ProcessListRequest(pNet, &Packet, Token, pSnapshot);
+		}
+		if(pSnapshot)
+			ReleaseSnapshot(pSnapshot);
+	}
+}
 
-			// copy server addresses
-			if(pCurrent->m_Address.type == NETTYPE_IPV6)
-			{
-				mem_copy(m_aPackets[m_NumPackets-1].m_Data.m_aServers[PacketIndex].m_aIp, pCurrent->m_Address.ip,
-					sizeof(m_aPackets[m_NumPackets-1].m_Data.m_aServers[PacketIndex].m_aIp));
-			}
-			else
-			{
-				static unsigned char s_aIPV4Mapping[] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF};
+static void PackAddr(CMastersrvAddr *pDst, const NETADDR *pAddr)
+{
+	if(pAddr->type == NETTYPE_IPV6)
+	{
+		mem_copy(pDst->m_aIp, pAddr->ip, sizeof(pDst->m_aIp));
+	}
+	else
+	{
+		static unsigned char s_aIPV4Mapping[] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF};
 
-				mem_copy(m_aPackets[m_NumPackets-1].m_Data.m_aServers[PacketIndex].m_aIp, s_aIPV4Mapping, sizeof(s_aIPV4Mapping));
-				m_aPackets[m_NumPackets-1].m_Data.m_aServers[PacketIndex].m_aIp[12] = pCurrent->m_Address.ip[0];
-				m_aPackets[m_NumPackets-1].m_Data.m_aServers[PacketIndex].m_aIp[13] = pCurrent->m_Address.ip[1];
-				m_aPackets[m_NumPackets-1].m_Data.m_aServers[PacketIndex].m_aIp[14] = pCurrent->m_Address.ip[2];
-				m_aPackets[m_NumPackets-1].m_Data.m_aServers[PacketIndex].m_aIp[15] = pCurrent->m_Address.ip[3];
-			}
+		mem_copy(pDst->m_aIp, s_aIPV4Mapping, sizeof(s_aIPV4Mapping));
+		pDst->m_aIp[12] = pAddr->ip[0];
+		pDst->m_aIp[13] = pAddr->ip[1];
+		pDst->m_aIp[14] = pAddr->ip[2];
+		pDst->m_aIp[15] = pAddr->ip[3];
+	}
 
-			m_aPackets[m_NumPackets-1].m_Data.m_aServers[PacketIndex].m_aPort[0] = (pCurrent->m_Address.port>>8)&0xff;
-			m_aPackets[m_NumPackets-1].m_Data.m_aServers[PacketIndex].m_aPort[1] = pCurrent->m_Address.port&0xff;
+	pDst->m_aPort[0] = (pAddr->port>>8)&0xff;
+	pDst->m_aPort[1] = pAddr->port&0xff;
+}
 
-			PacketIndex++;
+static void SetListAddr(int Pos, const NETADDR *pAddr)
+{
+	PackAddr(&m_aPackets[Pos/MAX_SERVERS_PER_PACKET].m_Data.m_aServers[Pos%MAX_SERVERS_PER_PACKET], pAddr);
+}
+
+static void LogChange(int Type, const NETADDR *pAddr)
+{
+	// a delta longer than the list is useless, keep about as many changes as servers
+	int Keep = max(m_aListServers.size(), (int)MIN_CHANGES);
+	if(m_aChanges.size() >= 2*Keep)
+	{
+		int Drop = m_aChanges.size()-Keep;
+		mem_move(m_aChanges.base_ptr(), m_aChanges.base_ptr()+Drop, Keep*sizeof(CMastersrvDelta));
+		m_aChanges.set_size(Keep);
+	}
 
-			m_aPackets[m_NumPackets-1].m_Size = sizeof(SERVERBROWSE_LIST) + sizeof(CMastersrvAddr)*PacketIndex;
+	CMastersrvDelta Change;
+	Change.m_Type = Type;
+	PackAddr(&Change.m_Addr, pAddr);
+	m_aChanges.add(Change);
+	m_Generation++;
+}
 
-			pCurrent++;
-		}
-		else
-		{
-			*pCurrent = m_aServers[m_NumServers-1];
-			m_NumServers--;
-			dbg_msg("mastersrv", "error: server of invalid type, dropping it");
-		}
+static void UpdatePacketSizes()
+{
+	// only the last packet changes its size
+	m_NumPackets = (m_aListServers.size()+MAX_SERVERS_PER_PACKET-1)/MAX_SERVERS_PER_PACKET;
+	if(m_NumPackets > m_aPackets.size())
+	{
+		CPacketData Packet;
+		mem_copy(Packet.m_Data.m_aHeader, SERVERBROWSE_LIST, sizeof(SERVERBROWSE_LIST));
+		m_aPackets.add(Packet);
 	}
+	if(m_NumPackets)
+		m_aPackets[m_NumPackets-1].m_Size = sizeof(SERVERBROWSE_LIST) + sizeof(CMastersrvAddr)*(m_aListServers.size()-(m_NumPackets-1)*MAX_SERVERS_PER_PACKET);
+}
+
+static void ListAdd(int Index)
+{
+	CServerEntry *pEntry = m_Servers.Get(Index);
+	pEntry->m_ListPos = m_aListServers.add(Index);
+	UpdatePacketSizes();
+	SetListAddr(pEntry->m_ListPos, &pEntry->m_Address);
+	LogChange(CMastersrvDelta::TYPE_ADDED, &pEntry->m_Address);
+	m_ListChanged = true;
+}
+
+static void ListRemove(int Index)
+{
+	// the last server takes the free position
+	LogChange(CMastersrvDelta::TYPE_REMOVED, &m_Servers.Get(Index)->m_Address);
+	int Pos = m_Servers.Get(Index)->m_ListPos;
+	int Last = m_aListServers[m_aListServers.size()-1];
+	m_aListServers[Pos] = Last;
+	m_Servers.Get(Last)->m_ListPos = Pos;
+	SetListAddr(Pos, &m_Servers.Get(Last)->m_Address);
+	m_aListServers.remove_index_fast(m_aListServers.size()-1);
+	UpdatePacketSizes();
+	m_ListChanged = true;
 }
 
 void SendOk(NETADDR *pAddr, TOKEN Token)
@@ -167,11 +681,17 @@ void SendCheck(NETADDR *pAddr, TOKEN Token)
 
 void AddCheckserver(NETADDR *pInfo, NETADDR *pAlt, ServerType Type, TOKEN Token)
 {
-	// add server
-	if(m_NumCheckServers == MAX_SERVERS)
+	// a check for this server is running already, answer with the new token.
+	// the address can also be the alternative address of other checks
+	int Node = -1;
+	int Index;
+	while((Index = m_CheckIndex.FindNext(pInfo, &Node)) >= 0)
 	{
-		dbg_msg("mastersrv", "error: mastersrv is full");
-		return;
+		if(net_addr_comp(&m_CheckServers.Get(Index)->m_Address, pInfo, true) == 0)
+		{
+			m_CheckServers.Get(Index)->m_Token = Token;
+			return;
+		}
 	}
 
 	char aAddrStr[NETADDR_MAXSTRSIZE];
@@ -179,116 +699,128 @@ void AddCheckserver(NETADDR *pInfo, NETADDR *pAlt, ServerType Type, TOKEN Token)
 	char aAltAddrStr[NETADDR_MAXSTRSIZE];
 	net_addr_str(pAlt, aAltAddrStr, sizeof(aAltAddrStr), true);
 	dbg_msg("mastersrv", "checking: %s (%s)", aAddrStr, aAltAddrStr);
-	m_aCheckServers[m_NumCheckServers].m_Address = *pInfo;
-	m_aCheckServers[m_NumCheckServers].m_AltAddress = *pAlt;
-	m_aCheckServers[m_NumCheckServers].m_TryCount = 0;
-	m_aCheckServers[m_NumCheckServers].m_TryTime = 0;
-	m_aCheckServers[m_NumCheckServers].m_Type = Type;
-	m_aCheckServers[m_NumCheckServers].m_Token = Token;
-	m_NumCheckServers++;
+
+	Index = m_CheckServers.Alloc();
+	CCheckServer *pCheck = m_CheckServers.Get(Index);
+	pCheck->m_Address = *pInfo;
+	pCheck->m_AltAddress = *pAlt;
+	pCheck->m_TryCount = 0;
+	pCheck->m_Type = Type;
+	pCheck->m_Token = Token;
+	m_CheckIndex.Insert(pInfo, Index);
+	m_CheckIndex.Insert(pAlt, Index);
+
+	// the first check goes out with the next update
+	m_CheckServers.Schedule(Index, Seconds());
+}
+
+static void RemoveCheckserver(int Index)
+{
+	CCheckServer *pCheck = m_CheckServers.Get(Index);
+	m_CheckIndex.Remove(&pCheck->m_Address, Index);
+	m_CheckIndex.Remove(&pCheck->m_AltAddress, Index);
+	m_CheckServers.Free(Index);
 }
 
 void AddServer(NETADDR *pInfo, ServerType Type)
 {
+	char aAddrStr[NETADDR_MAXSTRSIZE];
+	net_addr_str(pInfo, aAddrStr, sizeof(aAddrStr), true);
+
 	// see if server already exists in list
-	for(int i = 0; i < m_NumServers; i++)
+	int Index = m_ServerIndex.Find(pInfo);
+	if(Index >= 0)
 	{
-		if(net_addr_comp(&m_aServers[i].m_Address, pInfo, true) == 0)
-		{
-			char aAddrStr[NETADDR_MAXSTRSIZE];
-			net_addr_str(pInfo, aAddrStr, sizeof(aAddrStr), true);
-			dbg_msg("mastersrv", "updated: %s", aAddrStr);
-			m_aServers[i].m_Expire = time_get()+time_freq()*EXPIRE_TIME;
-			return;
-		}
+		dbg_msg("mastersrv", "updated: %s", aAddrStr);
+		m_Servers.Unschedule(Index);
+		m_Servers.Schedule(Index, Seconds()+EXPIRE_TIME);
+		return;
 	}
 
-	// add server
-	if(m_NumServers == MAX_SERVERS)
+	if(Type != SERVERTYPE_NORMAL)
 	{
-		dbg_msg("mastersrv", "error: mastersrv is full");
+		dbg_msg("mastersrv", "error: server of invalid type, dropping it");
 		return;
 	}
 
-	char aAddrStr[NETADDR_MAXSTRSIZE];
-	net_addr_str(pInfo, aAddrStr, sizeof(aAddrStr), true);
+	// add server
 	dbg_msg("mastersrv", "added: %s", aAddrStr);
-	m_aServers[m_NumServers].m_Address = *pInfo;
-	m_aServers[m_NumServers].m_Expire = time_get()+time_freq()*EXPIRE_TIME;
-	m_aServers[m_NumServers].m_Type = Type;
-	m_NumServers++;
+	Index = m_Servers.Alloc();
+	CServerEntry *pEntry = m_Servers.Get(Index);
+	pEntry->m_Address = *pInfo;
+	pEntry->m_Type = Type;
+	m_ServerIndex.Insert(pInfo, Index);
+	m_Servers.Schedule(Index, Seconds()+EXPIRE_TIME);
+	ListAdd(Index);
 }
 
 void UpdateServers()
 {
-	int64 Now = time_get();
-	int64 Freq = time_freq();
-	for(int i = 0; i < m_NumCheckServers; i++)
+	int64 Now = Seconds();
+	int Index;
+	while((Index = m_CheckServers.PopDue(Now)) >= 0)
 	{
-		if(Now > m_aCheckServers[i].m_TryTime+Freq)
+		CCheckServer *pCheck = m_CheckServers.Get(Index);
+		if(pCheck->m_TryCount == CHECK_TRIES)
 		{
-			if(m_aCheckServers[i].m_TryCount == 10)
-			{
-				char aAddrStr[NETADDR_MAXSTRSIZE];
-				net_addr_str(&m_aCheckServers[i].m_Address, aAddrStr, sizeof(aAddrStr), true);
-				char aAltAddrStr[NETADDR_MAXSTRSIZE];
-				net_addr_str(&m_aCheckServers[i].m_AltAddress, aAltAddrStr, sizeof(aAltAddrStr), true);
-				dbg_msg("mastersrv", "check failed: %s (%s)", aAddrStr, aAltAddrStr);
-
-				// FAIL!!
-				SendError(&m_aCheckServers[i].m_Address, m_aCheckServers[i].m_Token);
-				m_aCheckServers[i] = m_aCheckServers[m_NumCheckServers-1];
-				m_NumCheckServers--;
-				i--;
-			}
+			char aAddrStr[NETADDR_MAXSTRSIZE];
+			net_addr_str(&pCheck->m_Address, aAddrStr, sizeof(aAddrStr), true);
+			char aAltAddrStr[NETADDR_MAXSTRSIZE];
+			net_addr_str(&pCheck->m_AltAddress, aAltAddrStr, sizeof(aAltAddrStr), true);
+			dbg_msg("mastersrv", "check failed: %s (%s)", aAddrStr, aAltAddrStr);
+
+			// FAIL!!
+			SendError(&pCheck->m_Address, pCheck->m_Token);
+			RemoveCheckserver(Index);
+		}
+		else
+		{
+			pCheck->m_TryCount++;
+			if(pCheck->m_TryCount&1)
+				SendCheck(&pCheck->m_Address, pCheck->m_Token);
 			else
-			{
-				m_aCheckServers[i].m_TryCount++;
-				m_aCheckServers[i].m_TryTime = Now;
-				if(m_aCheckServers[i].m_TryCount&1)
-					SendCheck(&m_aCheckServers[i].m_Address, m_aCheckServers[i].m_Token);
-				else
-					SendCheck(&m_aCheckServers[i].m_AltAddress, m_aCheckServers[i].m_Token);
-			}
+				SendCheck(&pCheck->m_AltAddress, pCheck->m_Token);
+			m_CheckServers.Schedule(Index, Now+CHECK_INTERVAL);
 		}
 	}
 }
 
 void PurgeServers()
 {
-	int64 Now = time_get();
-	int i = 0;
-	while(i < m_NumServers)
+	int Index;
+	while((Index = m_Servers.PopDue(Seconds())) >= 0)
 	{
-		if(m_aServers[i].m_Expire < Now)
-		{
-			// remove server
-			char aAddrStr[NETADDR_MAXSTRSIZE];
-			net_addr_str(&m_aServers[i].m_Address, aAddrStr, sizeof(aAddrStr), true);
-			dbg_msg("mastersrv", "expired: %s", aAddrStr);
-			m_aServers[i] = m_aServers[m_NumServers-1];
-			m_NumServers--;
-		}
-		else
-			i++;
+		// remove server
+		CServerEntry *pEntry = m_Servers.Get(Index);
+		char aAddrStr[NETADDR_MAXSTRSIZE];
+		net_addr_str(&pEntry->m_Address, aAddrStr, sizeof(aAddrStr), true);
+		dbg_msg("mastersrv", "expired: %s", aAddrStr);
+		m_ServerIndex.Remove(&pEntry->m_Address, Index);
+		ListRemove(Index);
+		m_Servers.Free(Index);
 	}
 }
 
 void ReloadBans()
 {
+	lock_wait(m_BanLock);
 	m_NetBan.UnbanAll();
 	m_pConsole->ExecuteFile("master.cfg");
+	lock_unlock(m_BanLock);
 }
 
 int main(int argc, const char **argv) // ignore_convention
 {
-	int64 LastBuild = 0, LastBanReload = 0;
+	int64 LastUpdate = 0, LastBanReload = 0, LastPublish = 0;
 	ServerType Type = SERVERTYPE_INVALID;
 	NETADDR BindAddr;
 
 	dbg_logger_stdout();
 	
-	mem_copy(m_CountData.m_Header, SERVERBROWSE_COUNT, sizeof(SERVERBROWSE_COUNT));
+	m_SnapshotLock = lock_create();
+	m_HeartbeatLock = lock_create();
+	m_BanLock = lock_create();
+	PublishSnapshot();
 
 	int FlagMask = CFGFLAG_MASTER;
 	IKernel *pKernel = IKernel::Create();
@@ -328,11 +860,27 @@ int main(int argc, const char **argv) // ignore_convention
 		dbg_msg("mastersrv", "could not initialize secure RNG");
 		return -1;
 	}
-	if(!m_NetOp.Open(BindAddr, pConfig, m_pConsole, 0, 0))
+	// lets clients tell the generations of this run from older ones
+	while(!m_Epoch)
+		secure_random_fill(&m_Epoch, sizeof(m_Epoch));
+	int NumThreads = pConfig->m_MsThreads;
+	int OpFlags = NumThreads > 1 ? NETCREATE_FLAG_REUSEPORT : 0;
+	if(!m_NetOp.Open(BindAddr, pConfig, m_pConsole, 0, OpFlags))
 	{
 		dbg_msg("mastersrv", "couldn't start network (op)");
 		return -1;
 	}
+	for(int i = 1; i < NumThreads; i++)
+	{
+		CNetClient *pWorkerNet = new CNetClient();
+		if(!pWorkerNet->Open(BindAddr, pConfig, m_pConsole, 0, OpFlags))
+		{
+			dbg_msg("mastersrv", "couldn't start network (worker %d), continuing with %d threads", i, i);
+			delete pWorkerNet;
+			break;
+		}
+		thread_detach(thread_init(ListWorkerThread, pWorkerNet));
+	}
 	BindAddr.port = MASTERSERVER_PORT+1;
 	if(!m_NetChecker.Open(BindAddr, pConfig, m_pConsole, 0, 0))
 	{
@@ -356,62 +904,31 @@ int main(int argc, const char **argv) // ignore_convention
 		while(m_NetOp.Recv(&Packet, &Token))
 		{
 			// check if the server is banned
-			if(m_NetBan.IsBanned(&Packet.m_Address, 0, 0, 0))
+			if(IsBanned(&Packet.m_Address))
 				continue;
 
-			if(Packet.m_DataSize == sizeof(SERVERBROWSE_HEARTBEAT)+2 &&
-				mem_comp(Packet.m_pData, SERVERBROWSE_HEARTBEAT, sizeof(SERVERBROWSE_HEARTBEAT)) == 0)
+			CHeartbeat Heartbeat;
+			if(UnpackHeartbeat(&Packet, Token, &Heartbeat))
 			{
-				NETADDR Alt;
-				unsigned char *d = (unsigned char *)Packet.m_pData;
-				Alt = Packet.m_Address;
-				Alt.port =
-					(d[sizeof(SERVERBROWSE_HEARTBEAT)]<<8) |
-					d[sizeof(SERVERBROWSE_HEARTBEAT)+1];
-
 				// add it
-				AddCheckserver(&Packet.m_Address, &Alt, SERVERTYPE_NORMAL, Token);
-			}
-			else if(Packet.m_DataSize == sizeof(SERVERBROWSE_GETCOUNT) &&
-				mem_comp(Packet.m_pData, SERVERBROWSE_GETCOUNT, sizeof(SERVERBROWSE_GETCOUNT)) == 0)
-			{
-				dbg_msg("mastersrv", "count requested, responding with %d", m_NumServers);
-
-				CNetChunk p;
-				p.m_ClientID = -1;
-				p.m_Address = Packet.m_Address;
-				p.m_Flags = NETSENDFLAG_CONNLESS;
-				p.m_DataSize = sizeof(m_CountData);
-				p.m_pData = &m_CountData;
-				m_CountData.m_High = (m_NumServers>>8)&0xff;
-				m_CountData.m_Low = m_NumServers&0xff;
-				m_NetOp.Send(&p, Token);
-			}
-			else if(Packet.m_DataSize == sizeof(SERVERBROWSE_GETLIST) &&
-				mem_comp(Packet.m_pData, SERVERBROWSE_GETLIST, sizeof(SERVERBROWSE_GETLIST)) == 0)
-			{
-				// someone requested the list
-				dbg_msg("mastersrv", "requested, responding with %d servers", m_NumServers);
-
-				CNetChunk p;
-				p.m_ClientID = -1;
-				p.m_Address = Packet.m_Address;
-				p.m_Flags = NETSENDFLAG_CONNLESS;
-
-				for(int i = 0; i < m_NumPackets; i++)
-				{
-					p.m_DataSize = m_aPackets[i].m_Size;
-					p.m_pData = &m_aPackets[i].m_Data;
-					m_NetOp.Send(&p, Token);
-				}
+				AddCheckserver(&Heartbeat.m_Address, &Heartbeat.m_AltAddress, SERVERTYPE_NORMAL, Heartbeat.m_Token);
 			}
+			else
+				ProcessListRequest(&m_NetOp, &Packet, Token, m_pSnapshot);
 		}
 
+		// heartbeats the workers received
+		lock_wait(m_HeartbeatLock);
+		for(int i = 0; i < m_aHeartbeats.size(); i++)
+			AddCheckserver(&m_aHeartbeats[i].m_Address, &m_aHeartbeats[i].m_AltAddress, SERVERTYPE_NORMAL, m_aHeartbeats[i].m_Token);
+		m_aHeartbeats.clear();
+		lock_unlock(m_HeartbeatLock);
+
 		// process packets
 		while(m_NetChecker.Recv(&Packet, &Token))
 		{
 			// check if the server is banned
-			if(m_NetBan.IsBanned(&Packet.m_Address, 0, 0, 0))
+			if(IsBanned(&Packet.m_Address))
 				continue;
 
 			if(Packet.m_DataSize == sizeof(SERVERBROWSE_FWRESPONSE) &&
@@ -419,16 +936,12 @@ int main(int argc, const char **argv) // ignore_convention
 			{
 				Type = SERVERTYPE_INVALID;
 				// remove it from checking
-				for(int i = 0; i < m_NumCheckServers; i++)
+				int Index = m_CheckIndex.Find(&Packet.m_Address);
+				if(Index >= 0)
 				{
-					if(net_addr_comp(&m_aCheckServers[i].m_Address, &Packet.m_Address, true) == 0 ||
-						net_addr_comp(&m_aCheckServers[i].m_AltAddress, &Packet.m_Address, true) == 0)
-					{
-						Type = m_aCheckServers[i].m_Type;
-						m_NumCheckServers--;
-						m_aCheckServers[i] = m_aCheckServers[m_NumCheckServers];
-						break;
-					}
+					Type = m_CheckServers.Get(Index)->m_Type;
+					m_CheckServers.Unschedule(Index);
+					RemoveCheckserver(Index);
 				}
 
 				// drops servers that were not in the CheckServers list
@@ -447,13 +960,19 @@ int main(int argc, const char **argv) // ignore_convention
 			ReloadBans();
 		}
 
-		if(time_get()-LastBuild > time_freq()*5)
+		if(time_get()-LastUpdate > time_freq()*5)
 		{
-			LastBuild = time_get();
+			LastUpdate = time_get();
 
 			PurgeServers();
 			UpdateServers();
-			BuildPackets();
+		}
+
+		// give the request threads the new list
+		if(m_ListChanged && time_get()-LastPublish > time_freq())
+		{
+			LastPublish = time_get();
+			PublishSnapshot();
 		}
 
 		// be nice to the CPU
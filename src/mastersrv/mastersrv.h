@@ -16,11 +16,51 @@ struct CMastersrvAddr
 	unsigned char m_aPort[2];
 };
 
+/*
+	Delta lists: the client sends SERVERBROWSE_GETDELTA with the epoch and
+	generation of the list it has from this master, all integers in network
+	byte order:
+		int32 epoch
+		int32 generation
+	The master counts a generation for every server that is added or
+	removed. It answers with SERVERBROWSE_DELTA packets, each starting with
+		int32 epoch         // random per master start
+		int32 from          // generation of the client, 0 for a full list
+		int32 to            // generation the client has afterwards
+		int16 index         // of this packet
+		int16 num packets
+	followed by the changes after 'from' in order, which have to be applied
+	in packet order once all packets arrived. If the master can't build the
+	delta, 'from' is 0 and 'num packets' counts the SERVERBROWSE_LIST packets
+	of the full list that follow.
+*/
+struct CMastersrvDelta
+{
+	enum
+	{
+		TYPE_REMOVED=0,
+		TYPE_ADDED,
+	};
+
+	unsigned char m_Type;
+	CMastersrvAddr m_Addr;
+};
+
+enum
+{
+	SERVERBROWSE_DELTA_HEADER_SIZE=8+4+4+4+2+2,
+	SERVERBROWSE_MAX_DELTAS_PER_PACKET=70,
+	SERVERBROWSE_MAX_DELTA_PACKETS=256, // larger deltas are sent as the full list
+};
+
 static const unsigned char SERVERBROWSE_HEARTBEAT[] = {255, 255, 255, 255, 'b', 'e', 'a', '2'};
 
 static const unsigned char SERVERBROWSE_GETLIST[] = {255, 255, 255, 255, 'r', 'e', 'q', '2'};
 static const unsigned char SERVERBROWSE_LIST[] = {255, 255, 255, 255, 'l', 'i', 's', '2'};
 
+static const unsigned char SERVERBROWSE_GETDELTA[] = {255, 255, 255, 255, 'r', 'e', 'q', 'd'};
+static const unsigned char SERVERBROWSE_DELTA[] = {255, 255, 255, 255, 'l', 'i', 's', 'd'};
+
 static const unsigned char SERVERBROWSE_GETCOUNT[] = {255, 255, 255, 255, 'c', 'o', 'u', '2'};
 static const unsigned char SERVERBROWSE_COUNT[] = {255, 255, 255, 255, 's', 'i', 'z', '2'};
 
@@ -0,0 +1,320 @@
+#include "test.h"
+
+#include <gtest/gtest.h>
+
+#include <base/system.h>
+#include <engine/config.h>
+#include <engine/console.h>
+#include <engine/kernel.h>
+#include <engine/storage.h>
+#include <engine/shared/config.h>
+
+static void ConCount(IConsole::IResult *pResult, void *pUserData)
+{
+	int *pCount = (int *)pUserData;
+	*pCount += pResult->NumArguments() ? pResult->GetInteger(0) : 1;
+}
+
+TEST(Console, CommandLookup)
+{
+	IConsole *pConsole = CreateConsole(CFGFLAG_SERVER);
+
+	static const int NUM_COMMANDS = 500;
+	int aCounts[NUM_COMMANDS] = {0};
+	// the console keeps the name pointers
+	static char s_aaNames[NUM_COMMANDS][32];
+	for(int i = 0; i < NUM_COMMANDS; i++)
+	{
+		str_format(s_aaNames[i], sizeof(s_aaNames[i]), "test_cmd_%d", i);
+		pConsole->Register(s_aaNames[i], "?i", CFGFLAG_SERVER, ConCount, &aCounts[i], "");
+	}
+
+	// lookups are case insensitive
+	pConsole->ExecuteLine("test_cmd_0; TEST_CMD_17 5; Test_Cmd_499 2");
+	EXPECT_EQ(aCounts[0], 1);
+	EXPECT_EQ(aCounts[17], 5);
+	EXPECT_EQ(aCounts[499], 2);
+	EXPECT_EQ(aCounts[1], 0);
+
+	// the flag mask is respected
+	EXPECT_TRUE(pConsole->GetCommandInfo("test_cmd_42", CFGFLAG_SERVER, false));
+	EXPECT_FALSE(pConsole->GetCommandInfo("test_cmd_42", CFGFLAG_CLIENT, false));
+	EXPECT_FALSE(pConsole->GetCommandInfo("test_cmd_42", CFGFLAG_SERVER, true));
+	EXPECT_FALSE(pConsole->GetCommandInfo("test_cmd_500", CFGFLAG_SERVER, false));
+
+	// temporary commands come and go without touching the registered ones
+	char aName[32];
+	for(int i = 0; i < NUM_COMMANDS; i++)
+	{
+		str_format(aName, sizeof(aName), "temp_cmd_%d", i);
+		pConsole->RegisterTemp(aName, "", CFGFLAG_SERVER, "");
+	}
+	EXPECT_TRUE(pConsole->GetCommandInfo("temp_cmd_7", CFGFLAG_SERVER, true));
+	pConsole->DeregisterTemp("temp_cmd_7");
+	EXPECT_FALSE(pConsole->GetCommandInfo("temp_cmd_7", CFGFLAG_SERVER, true));
+	EXPECT_TRUE(pConsole->GetCommandInfo("temp_cmd_8", CFGFLAG_SERVER, true));
+
+	// recycled entries have to be found under their new name
+	pConsole->RegisterTemp("temp_cmd_recycled", "", CFGFLAG_SERVER, "");
+	EXPECT_TRUE(pConsole->GetCommandInfo("temp_cmd_recycled", CFGFLAG_SERVER, true));
+
+	pConsole->DeregisterTempAll();
+	EXPECT_FALSE(pConsole->GetCommandInfo("temp_cmd_8", CFGFLAG_SERVER, true));
+	EXPECT_FALSE(pConsole->GetCommandInfo("temp_cmd_recycled", CFGFLAG_SERVER, true));
+	EXPECT_TRUE(pConsole->GetCommandInfo("test_cmd_42", CFGFLAG_SERVER, false));
+
+	pConsole->ExecuteLine("test_cmd_42 3");
+	EXPECT_EQ(aCounts[42], 3);
+
+	delete pConsole;
+}
+
+class ConsoleExec : public ::testing::Test
+{
+protected:
+	enum
+	{
+		MAX_RUNS=64,
+		LINE_TIME=2000, // microseconds each test_run line takes
+		BUDGET=1000,
+	};
+
+	CTestInfo m_Info;
+	IKernel *m_pKernel;
+	IStorage *m_pStorage;
+	IConfigManager *m_pConfigManager;
+	IConsole *m_pConsole;
+
+	int m_aRuns[MAX_RUNS];
+	int m_aRunContexts[MAX_RUNS];
+	int m_NumRuns;
+	int m_Context;
+
+	ConsoleExec()
+	{
+		m_pKernel = IKernel::Create();
+		m_pStorage = CreateTestStorage();
+		m_pConfigManager = CreateConfigManager();
+		m_pConsole = CreateConsole(CFGFLAG_SERVER);
+		m_pKernel->RegisterInterface(m_pStorage);
+		m_pKernel->RegisterInterface(m_pConfigManager);
+		m_pKernel->RegisterInterface(m_pConsole);
+		m_pConfigManager->Init(CFGFLAG_SERVER);
+		m_pConsole->Init();
+		m_pConsole->Register("test_run", "i", CFGFLAG_SERVER, ConRun, this, "");
+		m_pConsole->SetContextCallbacks(GetContext, SetContext, this);
+		m_NumRuns = 0;
+		m_Context = 0;
+	}
+
+	~ConsoleExec()
+	{
+		delete m_pConsole;
+		delete m_pConfigManager;
+		delete m_pStorage;
+		delete m_pKernel;
+	}
+
+	static void ConRun(IConsole::IResult *pResult, void *pUserData)
+	{
+		ConsoleExec *pThis = (ConsoleExec *)pUserData;
+		if(pThis->m_NumRuns < MAX_RUNS)
+		{
+			pThis->m_aRuns[pThis->m_NumRuns] = pResult->GetInteger(0);
+			pThis->m_aRunContexts[pThis->m_NumRuns] = pThis->m_Context;
+		}
+		pThis->m_NumRuns++;
+
+		int64 End = time_get()+(int64)LINE_TIME*time_freq()/1000000;
+		while(time_get() < End);
+	}
+
+	static int GetContext(void *pUser) { return ((ConsoleExec *)pUser)->m_Context; }
+	static bool SetContext(int Context, void *pUser)
+	{
+		// negative contexts stand for issuers that are gone
+		if(Context < 0)
+			return false;
+		((ConsoleExec *)pUser)->m_Context = Context;
+		return true;
+	}
+
+	void WriteFile(char *pFilename, int FilenameSize, const char *pSuffix, const char *pContent)
+	{
+		m_Info.Filename(pFilename, FilenameSize, pSuffix);
+		IOHANDLE File = io_open(pFilename, IOFLAG_WRITE);
+		ASSERT_TRUE(File);
+		io_write(File, pContent, str_length(pContent));
+		io_close(File);
+	}
+
+	int QueueDepth()
+	{
+		IConsole::CDeferredStats Stats;
+		m_pConsole->GetDeferredStats(&Stats);
+		return Stats.m_QueueDepth;
+	}
+
+	// returns the number of ExecuteDeferred() calls it took
+	int DrainQueue()
+	{
+		int NumCalls = 0;
+		while(QueueDepth() && NumCalls < 100)
+		{
+			m_pConsole->ExecuteDeferred();
+			NumCalls++;
+		}
+		return NumCalls;
+	}
+};
+
+TEST_F(ConsoleExec, DeferredOrder)
+{
+	char aInner[64];
+	WriteFile(aInner, sizeof(aInner), "-inner.cfg", "test_run 3\ntest_run 4\n");
+	char aContent[256];
+	str_format(aContent, sizeof(aContent), "test_run 1\ntest_run 2\nexec %s\ntest_run 5\n", aInner);
+	char aOuter[64];
+	WriteFile(aOuter, sizeof(aOuter), "-outer.cfg", aContent);
+
+	m_pConsole->SetExecutionBudget(BUDGET);
+	m_Context = 7;
+	EXPECT_TRUE(m_pConsole->ExecuteFile(aOuter));
+	m_Context = 0;
+	EXPECT_LT(m_NumRuns, 5);
+	DrainQueue();
+	EXPECT_EQ(QueueDepth(), 0);
+
+	// same order as without a budget, in the context the file was started in
+	ASSERT_EQ(m_NumRuns, 5);
+	for(int i = 0; i < m_NumRuns; i++)
+	{
+		EXPECT_EQ(m_aRuns[i], i+1);
+		EXPECT_EQ(m_aRunContexts[i], 7);
+	}
+	EXPECT_EQ(m_Context, 0);
+
+	fs_remove(aInner);
+	fs_remove(aOuter);
+}
+
+TEST_F(ConsoleExec, DeferredLineParts)
+{
+	char aFile[64];
+	WriteFile(aFile, sizeof(aFile), ".cfg", "test_run 1\ntest_run 2\ntest_run 3\n");
+	char aLine[256];
+	str_format(aLine, sizeof(aLine), "exec %s; test_run 4; test_run 5", aFile);
+
+	// the parts after a deferred exec wait for the rest of the file
+	m_pConsole->SetExecutionBudget(BUDGET);
+	m_pConsole->ExecuteLine(aLine);
+	EXPECT_EQ(m_NumRuns, 1);
+	DrainQueue();
+	EXPECT_EQ(QueueDepth(), 0);
+
+	ASSERT_EQ(m_NumRuns, 5);
+	for(int i = 0; i < m_NumRuns; i++)
+		EXPECT_EQ(m_aRuns[i], i+1);
+
+	fs_remove(aFile);
+}
+
+TEST_F(ConsoleExec, DroppedContext)
+{
+	char aFile[64];
+	WriteFile(aFile, sizeof(aFile), ".cfg", "test_run 1\ntest_run 2\ntest_run 3\n");
+
+	// lines of an issuer that is gone don't run at all
+	m_pConsole->SetExecutionBudget(BUDGET);
+	m_Context = -1;
+	EXPECT_TRUE(m_pConsole->ExecuteFile(aFile));
+	m_Context = 0;
+	EXPECT_EQ(m_NumRuns, 1);
+	DrainQueue();
+	EXPECT_EQ(QueueDepth(), 0);
+	EXPECT_EQ(m_NumRuns, 1);
+
+	IConsole::CDeferredStats Stats;
+	m_pConsole->GetDeferredStats(&Stats);
+	EXPECT_EQ(Stats.m_NumDropped, 2);
+	EXPECT_EQ(m_Context, 0);
+
+	fs_remove(aFile);
+}
+
+TEST_F(ConsoleExec, BudgetLimit)
+{
+	char aFile[64];
+	WriteFile(aFile, sizeof(aFile), ".cfg", "test_run 1\ntest_run 2\ntest_run 3\ntest_run 4\ntest_run 5\n");
+
+	// without a budget everything runs at once
+	EXPECT_TRUE(m_pConsole->ExecuteFile(aFile));
+	EXPECT_EQ(m_NumRuns, 5);
+	EXPECT_EQ(QueueDepth(), 0);
+
+	// each line uses up the budget, one line runs per call
+	m_NumRuns = 0;
+	m_pConsole->SetExecutionBudget(BUDGET);
+	m_pConsole->ExecuteDeferred();
+	EXPECT_TRUE(m_pConsole->ExecuteFile(aFile));
+	EXPECT_EQ(m_NumRuns, 1);
+	EXPECT_EQ(QueueDepth(), 4);
+	for(int i = 0; i < 4; i++)
+	{
+		m_pConsole->ExecuteDeferred();
+		IConsole::CDeferredStats Stats;
+		m_pConsole->GetDeferredStats(&Stats);
+		EXPECT_EQ(Stats.m_LastExecuted, 1);
+		EXPECT_EQ(m_NumRuns, i+2);
+	}
+	EXPECT_EQ(QueueDepth(), 0);
+
+	// the budget covers everything until the next call, so a second file
+	// in the same tick has to wait
+	char aShort[64];
+	WriteFile(aShort, sizeof(aShort), "-short.cfg", "test_run 6\n");
+	m_pConsole->ExecuteDeferred();
+	EXPECT_TRUE(m_pConsole->ExecuteFile(aShort));
+	EXPECT_EQ(QueueDepth(), 0);
+	EXPECT_TRUE(m_pConsole->ExecuteFile(aShort));
+	EXPECT_EQ(QueueDepth(), 1);
+	EXPECT_EQ(m_NumRuns, 6);
+	m_pConsole->ExecuteDeferred();
+	EXPECT_EQ(m_NumRuns, 7);
+
+	fs_remove(aFile);
+	fs_remove(aShort);
+}
+
+TEST_F(ConsoleExec, RecursiveExec)
+{
+	char aSelf[64];
+	m_Info.Filename(aSelf, sizeof(aSelf), "-self.cfg");
+	char aContent[256];
+	str_format(aContent, sizeof(aContent), "test_run 1\ntest_run 2\nexec %s\ntest_run 3\n", aSelf);
+	WriteFile(aSelf, sizeof(aSelf), "-self.cfg", aContent);
+
+	char aFirst[64];
+	char aSecond[64];
+	m_Info.Filename(aFirst, sizeof(aFirst), "-first.cfg");
+	m_Info.Filename(aSecond, sizeof(aSecond), "-second.cfg");
+	str_format(aContent, sizeof(aContent), "test_run 4\nexec %s\n", aSecond);
+	WriteFile(aFirst, sizeof(aFirst), "-first.cfg", aContent);
+	str_format(aContent, sizeof(aContent), "test_run 5\nexec %s\n", aFirst);
+	WriteFile(aSecond, sizeof(aSecond), "-second.cfg", aContent);
+
+	// deferred lines keep the exec stack of their files
+	m_pConsole->SetExecutionBudget(BUDGET);
+	EXPECT_TRUE(m_pConsole->ExecuteFile(aSelf));
+	EXPECT_LT(DrainQueue(), 100);
+	EXPECT_TRUE(m_pConsole->ExecuteFile(aFirst));
+	EXPECT_LT(DrainQueue(), 100);
+
+	ASSERT_EQ(m_NumRuns, 5);
+	for(int i = 0; i < m_NumRuns; i++)
+		EXPECT_EQ(m_aRuns[i], i+1);
+
+	fs_remove(aSelf);
+	fs_remove(aFirst);
+	fs_remove(aSecond);
+}
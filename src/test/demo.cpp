@@ -0,0 +1,391 @@
+#include "test.h"
+
+#include <gtest/gtest.h>
+
+#include <base/hash.h>
+#include <base/tl/array.h>
+#include <engine/console.h>
+#include <engine/storage.h>
+#include <engine/shared/demo.h>
+#include <engine/shared/snapshot.h>
+
+static const char s_aNetVersion[] = "0.7 test";
+
+static void RecordDemo(IStorage *pStorage, IConsole *pConsole, CSnapshotDelta *pDelta, const char *pFilename, const char *pMap, SHA256_DIGEST MapSha256, int FirstTick, int NumTicks, int KeyFrameInterval = SERVER_TICK_SPEED*5, bool BlockCompression = false)
+{
+	CDemoRecorder *pRecorder = new CDemoRecorder(pDelta);
+	pRecorder->SetKeyFrameInterval(KeyFrameInterval);
+	pRecorder->SetBlockCompression(BlockCompression);
+	ASSERT_EQ(pRecorder->Start(pStorage, pConsole, pFilename, s_aNetVersion, pMap, MapSha256, 0, "server"), 0);
+
+	for(int Tick = FirstTick; Tick < FirstTick+NumTicks; Tick++)
+	{
+		CSnapshotBuilder Builder;
+		Builder.Init();
+		int *pItem = (int *)Builder.NewItem(1, 0, 2*sizeof(int));
+		pItem[0] = Tick;
+		pItem[1] = Tick/10;
+		char aSnap[CSnapshot::MAX_SIZE];
+		int Size = Builder.Finish(aSnap);
+		pRecorder->RecordSnapshot(Tick, aSnap, Size);
+		if(Tick%10 == 0)
+			pRecorder->RecordMessage(&Tick, sizeof(Tick));
+	}
+
+	EXPECT_EQ(pRecorder->Stop(), 0);
+	delete pRecorder;
+}
+
+class CSnapshotListener : public CDemoPlayer::IListener
+{
+public:
+	int m_aLastItem[2];
+	int m_NumSnapshots;
+
+	CSnapshotListener() { m_NumSnapshots = 0; }
+
+	virtual void OnDemoPlayerSnapshot(void *pData, int Size)
+	{
+		const CSnapshot *pSnap = (const CSnapshot *)pData;
+		ASSERT_EQ(pSnap->NumItems(), 1);
+		mem_copy(m_aLastItem, pSnap->GetItem(0)->Data(), sizeof(m_aLastItem));
+		m_NumSnapshots++;
+	}
+	virtual void OnDemoPlayerMessage(void *pData, int Size) {}
+};
+
+static const char s_aMapData[] = "not a real map";
+
+static bool CreateMap(const char *pMapFile)
+{
+	// the recorder embeds the map
+	bool CreatedMapDir = !fs_is_dir("maps") && fs_makedir("maps") == 0;
+	IOHANDLE MapFile = io_open(pMapFile, IOFLAG_WRITE);
+	EXPECT_TRUE(MapFile);
+	io_write(MapFile, s_aMapData, sizeof(s_aMapData));
+	io_close(MapFile);
+	return CreatedMapDir;
+}
+
+TEST(Demo, KeyframeIndex)
+{
+	CTestInfo Info;
+	char aDemo[64];
+	Info.Filename(aDemo, sizeof(aDemo), ".demo");
+	char aMapFile[128];
+	str_format(aMapFile, sizeof(aMapFile), "maps/%s.map", Info.m_aFilenamePrefix);
+	bool CreatedMapDir = CreateMap(aMapFile);
+
+	IStorage *pStorage = CreateTestStorage();
+	IConsole *pConsole = CreateConsole(0);
+	CSnapshotDelta Delta;
+	RecordDemo(pStorage, pConsole, &Delta, aDemo, Info.m_aFilenamePrefix, sha256(s_aMapData, sizeof(s_aMapData)), 100, 1000);
+
+	CDemoPlayer *pPlayer = new CDemoPlayer(&Delta);
+	pPlayer->SetListener(0);
+	ASSERT_FALSE(pPlayer->Load(pStorage, pConsole, aDemo, IStorage::TYPE_ALL, s_aNetVersion));
+	EXPECT_EQ(pPlayer->BaseInfo()->m_FirstTick, 100);
+	EXPECT_EQ(pPlayer->BaseInfo()->m_LastTick, 1099);
+	int NumKeyFrames = pPlayer->Info()->m_SeekablePoints;
+	EXPECT_GT(NumKeyFrames, 1);
+	pPlayer->SetPos(0.5f);
+	int IndexedTick = pPlayer->BaseInfo()->m_CurrentTick;
+	pPlayer->Stop();
+
+	// remove the index pointer like an unfinished recording, the player has to scan the file
+	void *pDemoData;
+	unsigned DemoSize;
+	ASSERT_EQ(fs_read(aDemo, &pDemoData, &DemoSize), 0);
+	ASSERT_GT(DemoSize, sizeof(CDemoHeader)+sizeof(CDemoHeaderExt));
+	mem_zero((char *)pDemoData+sizeof(CDemoHeader), sizeof(CDemoHeaderExt));
+	IOHANDLE DemoFile = io_open(aDemo, IOFLAG_WRITE);
+	io_write(DemoFile, pDemoData, DemoSize);
+	io_close(DemoFile);
+	mem_free(pDemoData);
+
+	ASSERT_FALSE(pPlayer->Load(pStorage, pConsole, aDemo, IStorage::TYPE_ALL, s_aNetVersion));
+	EXPECT_EQ(pPlayer->BaseInfo()->m_FirstTick, 100);
+	EXPECT_EQ(pPlayer->BaseInfo()->m_LastTick, 1099);
+	EXPECT_EQ(pPlayer->Info()->m_SeekablePoints, NumKeyFrames);
+	pPlayer->SetPos(0.5f);
+	EXPECT_EQ(pPlayer->BaseInfo()->m_CurrentTick, IndexedTick);
+	pPlayer->Stop();
+
+	delete pPlayer;
+	delete pConsole;
+	delete pStorage;
+
+	fs_remove(aDemo);
+	fs_remove(aMapFile);
+	if(CreatedMapDir)
+		fs_remove("maps");
+}
+
+TEST(Demo, SeekCache)
+{
+	CTestInfo Info;
+	char aDemo[64];
+	Info.Filename(aDemo, sizeof(aDemo), ".demo");
+	char aMapFile[128];
+	str_format(aMapFile, sizeof(aMapFile), "maps/%s.map", Info.m_aFilenamePrefix);
+	bool CreatedMapDir = CreateMap(aMapFile);
+
+	IStorage *pStorage = CreateTestStorage();
+	IConsole *pConsole = CreateConsole(0);
+	CSnapshotDelta Delta;
+	RecordDemo(pStorage, pConsole, &Delta, aDemo, Info.m_aFilenamePrefix, sha256(s_aMapData, sizeof(s_aMapData)), 0, 3000, SERVER_TICK_SPEED*20);
+
+	CSnapshotListener Listener;
+	CDemoPlayer *pPlayer = new CDemoPlayer(&Delta);
+	pPlayer->SetListener(&Listener);
+	ASSERT_FALSE(pPlayer->Load(pStorage, pConsole, aDemo, IStorage::TYPE_ALL, s_aNetVersion));
+	EXPECT_EQ(pPlayer->Info()->m_SeekablePoints, 3);
+
+	// the first pass decodes from the keyframes, the second one resumes
+	// from cached states and has to end up in the same place
+	static const float s_aPositions[] = { 0.9f, 0.3f, 0.31f, 0.6f, 0.05f, 0.75f };
+	int aTicks[2][6];
+	for(int Pass = 0; Pass < 2; Pass++)
+	{
+		for(unsigned i = 0; i < sizeof(s_aPositions)/sizeof(s_aPositions[0]); i++)
+		{
+			int NumSnapshots = Listener.m_NumSnapshots;
+			ASSERT_EQ(pPlayer->SetPos(s_aPositions[i]), 0);
+			aTicks[Pass][i] = pPlayer->BaseInfo()->m_CurrentTick;
+			EXPECT_EQ(Listener.m_aLastItem[0], aTicks[Pass][i]);
+			EXPECT_EQ(Listener.m_aLastItem[1], aTicks[Pass][i]/10);
+			// seeking only delivers the previous and the current snapshot
+			EXPECT_EQ(Listener.m_NumSnapshots-NumSnapshots, 2);
+			if(Pass == 1)
+			{
+				EXPECT_EQ(aTicks[1][i], aTicks[0][i]);
+			}
+		}
+	}
+	pPlayer->Stop();
+
+	delete pPlayer;
+	delete pConsole;
+	delete pStorage;
+
+	fs_remove(aDemo);
+	fs_remove(aMapFile);
+	if(CreatedMapDir)
+		fs_remove("maps");
+}
+
+TEST(Demo, BlockCompression)
+{
+	CTestInfo Info;
+	char aDemo[64];
+	Info.Filename(aDemo, sizeof(aDemo), ".demo");
+	char aBlockDemo[64];
+	Info.Filename(aBlockDemo, sizeof(aBlockDemo), "_block.demo");
+	char aMapFile[128];
+	str_format(aMapFile, sizeof(aMapFile), "maps/%s.map", Info.m_aFilenamePrefix);
+	bool CreatedMapDir = CreateMap(aMapFile);
+
+	IStorage *pStorage = CreateTestStorage();
+	IConsole *pConsole = CreateConsole(0);
+	CSnapshotDelta Delta;
+	RecordDemo(pStorage, pConsole, &Delta, aDemo, Info.m_aFilenamePrefix, sha256(s_aMapData, sizeof(s_aMapData)), 0, 3000, SERVER_TICK_SPEED);
+	RecordDemo(pStorage, pConsole, &Delta, aBlockDemo, Info.m_aFilenamePrefix, sha256(s_aMapData, sizeof(s_aMapData)), 0, 3000, SERVER_TICK_SPEED, true);
+
+	IOHANDLE File = io_open(aDemo, IOFLAG_READ);
+	IOHANDLE BlockFile = io_open(aBlockDemo, IOFLAG_READ);
+	ASSERT_TRUE(File && BlockFile);
+	EXPECT_LT(io_length(BlockFile), io_length(File));
+	io_close(File);
+	io_close(BlockFile);
+
+	// both have to play back the same, from the index and from a scan
+	CSnapshotListener Listener;
+	CDemoPlayer *pPlayer = new CDemoPlayer(&Delta);
+	pPlayer->SetListener(&Listener);
+	for(int Scan = 0; Scan < 2; Scan++)
+	{
+		if(Scan)
+		{
+			void *pDemoData;
+			unsigned DemoSize;
+			ASSERT_EQ(fs_read(aBlockDemo, &pDemoData, &DemoSize), 0);
+			mem_zero((char *)pDemoData+sizeof(CDemoHeader), sizeof(CDemoHeaderExt));
+			IOHANDLE DemoFile = io_open(aBlockDemo, IOFLAG_WRITE);
+			io_write(DemoFile, pDemoData, DemoSize);
+			io_close(DemoFile);
+			mem_free(pDemoData);
+		}
+
+		int aTicks[2];
+		int aSeekablePoints[2];
+		const char *apDemos[2] = { aDemo, aBlockDemo };
+		for(int i = 0; i < 2; i++)
+		{
+			ASSERT_FALSE(pPlayer->Load(pStorage, pConsole, apDemos[i], IStorage::TYPE_ALL, s_aNetVersion));
+			EXPECT_EQ(pPlayer->BaseInfo()->m_FirstTick, 0);
+			EXPECT_EQ(pPlayer->BaseInfo()->m_LastTick, 2999);
+			aSeekablePoints[i] = pPlayer->Info()->m_SeekablePoints;
+			ASSERT_EQ(pPlayer->SetPos(0.7f), 0);
+			aTicks[i] = pPlayer->BaseInfo()->m_CurrentTick;
+			EXPECT_EQ(Listener.m_aLastItem[0], aTicks[i]);
+			EXPECT_EQ(Listener.m_aLastItem[1], aTicks[i]/10);
+
+			// play to the end
+			int NumSnapshots = Listener.m_NumSnapshots;
+			while(pPlayer->IsPlaying() && !pPlayer->BaseInfo()->m_Paused)
+				pPlayer->NextFrame();
+			EXPECT_GT(Listener.m_NumSnapshots-NumSnapshots, 800);
+			EXPECT_EQ(Listener.m_aLastItem[0], 2999);
+			pPlayer->Stop();
+		}
+		EXPECT_EQ(aTicks[1], aTicks[0]);
+		EXPECT_EQ(aSeekablePoints[1], aSeekablePoints[0]);
+	}
+
+	delete pPlayer;
+	delete pConsole;
+	delete pStorage;
+
+	fs_remove(aDemo);
+	fs_remove(aBlockDemo);
+	fs_remove(aMapFile);
+	if(CreatedMapDir)
+		fs_remove("maps");
+}
+
+TEST(Demo, OversizedMap)
+{
+	CTestInfo Info;
+	char aDemo[64];
+	Info.Filename(aDemo, sizeof(aDemo), ".demo");
+	char aMapFile[128];
+	str_format(aMapFile, sizeof(aMapFile), "maps/%s.map", Info.m_aFilenamePrefix);
+	bool CreatedMapDir = CreateMap(aMapFile);
+
+	IStorage *pStorage = CreateTestStorage();
+	IConsole *pConsole = CreateConsole(0);
+	CSnapshotDelta Delta;
+	RecordDemo(pStorage, pConsole, &Delta, aDemo, Info.m_aFilenamePrefix, sha256(s_aMapData, sizeof(s_aMapData)), 0, 100);
+
+	// claim a map larger than the whole file
+	void *pDemoData;
+	unsigned DemoSize;
+	ASSERT_EQ(fs_read(aDemo, &pDemoData, &DemoSize), 0);
+	ASSERT_GT(DemoSize, sizeof(CDemoHeader));
+	uint_to_bytes_be(((CDemoHeader *)pDemoData)->m_aMapSize, 0x7fffffff);
+	IOHANDLE DemoFile = io_open(aDemo, IOFLAG_WRITE);
+	io_write(DemoFile, pDemoData, DemoSize);
+	io_close(DemoFile);
+	mem_free(pDemoData);
+
+	CDemoPlayer *pPlayer = new CDemoPlayer(&Delta);
+	pPlayer->SetListener(0);
+	EXPECT_TRUE(pPlayer->Load(pStorage, pConsole, aDemo, IStorage::TYPE_ALL, s_aNetVersion));
+	EXPECT_FALSE(pPlayer->IsPlaying());
+
+	delete pPlayer;
+	delete pConsole;
+	delete pStorage;
+
+	fs_remove(aDemo);
+	fs_remove(aMapFile);
+	if(CreatedMapDir)
+		fs_remove("maps");
+}
+
+class CMessageListener : public CDemoPlayer::IListener
+{
+public:
+	array<int> m_lSizes;
+	array<unsigned> m_lHashes;
+
+	virtual void OnDemoPlayerSnapshot(void *pData, int Size) {}
+	virtual void OnDemoPlayerMessage(void *pData, int Size)
+	{
+		unsigned Hash = 0;
+		for(int i = 0; i < Size; i++)
+			Hash = Hash*31 + ((unsigned char *)pData)[i];
+		m_lSizes.add(Size);
+		m_lHashes.add(Hash);
+	}
+};
+
+// fills a message that compresses to exactly CompressedSize bytes, big ints take 5 bytes, small ones 1
+static int FillMessage(int *pData, int CompressedSize)
+{
+	int NumBig = CompressedSize/5;
+	int NumSmall = CompressedSize%5;
+	for(int i = 0; i < NumBig; i++)
+		pData[i] = 0x40000000+i;
+	for(int i = 0; i < NumSmall; i++)
+		pData[NumBig+i] = i;
+	return (NumBig+NumSmall)*sizeof(int);
+}
+
+TEST(Demo, BlockCompressionLargestChunk)
+{
+	CTestInfo Info;
+	char aDemo[64];
+	Info.Filename(aDemo, sizeof(aDemo), ".demo");
+	char aMapFile[128];
+	str_format(aMapFile, sizeof(aMapFile), "maps/%s.map", Info.m_aFilenamePrefix);
+	bool CreatedMapDir = CreateMap(aMapFile);
+
+	IStorage *pStorage = CreateTestStorage();
+	IConsole *pConsole = CreateConsole(0);
+	CSnapshotDelta Delta;
+
+	// the largest chunk the header can describe has to play back, larger ones
+	// are left out and counted without corrupting the chunks that follow
+	static int s_aMessage[16*1024];
+	int LargestSize = FillMessage(s_aMessage, 0xffff);
+	unsigned LargestHash = 0;
+	for(int i = 0; i < LargestSize; i++)
+		LargestHash = LargestHash*31 + ((unsigned char *)s_aMessage)[i];
+
+	CDemoRecorder *pRecorder = new CDemoRecorder(&Delta);
+	pRecorder->SetBlockCompression(true);
+	ASSERT_EQ(pRecorder->Start(pStorage, pConsole, aDemo, s_aNetVersion, Info.m_aFilenamePrefix, sha256(s_aMapData, sizeof(s_aMapData)), 0, "server"), 0);
+	for(int Tick = 0; Tick < 3; Tick++)
+	{
+		CSnapshotBuilder Builder;
+		Builder.Init();
+		int *pItem = (int *)Builder.NewItem(1, 0, sizeof(int));
+		pItem[0] = Tick;
+		char aSnap[CSnapshot::MAX_SIZE];
+		int Size = Builder.Finish(aSnap);
+		pRecorder->RecordSnapshot(Tick, aSnap, Size);
+		if(Tick == 1)
+		{
+			pRecorder->RecordMessage(s_aMessage, FillMessage(s_aMessage, 0xffff));
+			pRecorder->RecordMessage(s_aMessage, FillMessage(s_aMessage, 0x10000));
+			pRecorder->RecordMessage(s_aMessage, sizeof(s_aMessage)); // doesn't fit the compression buffers
+			pRecorder->RecordMessage(&Tick, sizeof(Tick));
+		}
+	}
+	EXPECT_EQ(pRecorder->Stop(), 0);
+	EXPECT_EQ(pRecorder->NumWriteErrors(), 2u);
+	delete pRecorder;
+
+	CMessageListener Listener;
+	CDemoPlayer *pPlayer = new CDemoPlayer(&Delta);
+	pPlayer->SetListener(&Listener);
+	ASSERT_FALSE(pPlayer->Load(pStorage, pConsole, aDemo, IStorage::TYPE_ALL, s_aNetVersion));
+	pPlayer->Play();
+	while(pPlayer->IsPlaying() && !pPlayer->BaseInfo()->m_Paused)
+		pPlayer->NextFrame();
+	ASSERT_EQ(Listener.m_lSizes.size(), 2);
+	EXPECT_EQ(Listener.m_lSizes[0], LargestSize);
+	EXPECT_EQ(Listener.m_lHashes[0], LargestHash);
+	EXPECT_EQ(Listener.m_lSizes[1], (int)sizeof(int));
+	pPlayer->Stop();
+
+	delete pPlayer;
+	delete pConsole;
+	delete pStorage;
+
+	fs_remove(aDemo);
+	fs_remove(aMapFile);
+	if(CreatedMapDir)
+		fs_remove("maps");
+}
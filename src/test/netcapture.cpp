@@ -0,0 +1,49 @@
+#include "test.h"
+
+#include <gtest/gtest.h>
+
+#include <engine/shared/netcapture.h>
+
+TEST(NetCapture, Roundtrip)
+{
+	CTestInfo Info;
+	char aFilename[64];
+	Info.Filename(aFilename, sizeof(aFilename), ".twcap");
+
+	NETADDR Addr;
+	ASSERT_EQ(net_addr_from_str(&Addr, "[2001:db8::1]:8303"), 0);
+
+	CNetCaptureWriter Writer;
+	ASSERT_TRUE(Writer.Open(io_open(aFilename, IOFLAG_WRITE)));
+	CNetChunk Chunk;
+	mem_zero(&Chunk, sizeof(Chunk));
+	Chunk.m_ClientID = 3;
+	Chunk.m_Address = Addr;
+	Chunk.m_Flags = NETSENDFLAG_VITAL;
+	Chunk.m_pData = "chunk";
+	Chunk.m_DataSize = 6;
+	Writer.WriteChunk(CNetCapture::RECORD_RECV, &Chunk);
+	Writer.Write(CNetCapture::RECORD_DROP, 0, -1, &Addr, 0, 0);
+	EXPECT_EQ(Writer.NumRecords(), 2u);
+	Writer.Close();
+
+	CNetCaptureReader Reader;
+	ASSERT_TRUE(Reader.Open(io_open(aFilename, IOFLAG_READ)));
+	CNetCapture::CRecord Record;
+	ASSERT_TRUE(Reader.Read(&Record));
+	EXPECT_EQ(Record.m_Type, CNetCapture::RECORD_RECV);
+	EXPECT_EQ(Record.m_Flags, NETSENDFLAG_VITAL);
+	EXPECT_EQ(Record.m_ClientID, 3);
+	EXPECT_EQ(net_addr_comp(&Record.m_Addr, &Addr, true), 0);
+	ASSERT_EQ(Record.m_DataSize, 6);
+	EXPECT_STREQ((const char *)Record.m_pData, "chunk");
+
+	ASSERT_TRUE(Reader.Read(&Record));
+	EXPECT_EQ(Record.m_Type, CNetCapture::RECORD_DROP);
+	EXPECT_EQ(Record.m_ClientID, -1);
+	EXPECT_EQ(Record.m_DataSize, 0);
+	EXPECT_FALSE(Reader.Read(&Record));
+	Reader.Close();
+
+	fs_remove(aFilename);
+}
@@ -0,0 +1,72 @@
+#include <gtest/gtest.h>
+
+#include <engine/shared/nettransport.h>
+
+TEST(NetLoopback, SendRecv)
+{
+	CNetLoopback Loopback;
+	CNetLoopback::CEndpoint *pServer = Loopback.Bind(8303);
+	CNetLoopback::CEndpoint *pClient = Loopback.Bind(0);
+	ASSERT_TRUE(pServer && pClient);
+	EXPECT_FALSE(Loopback.Bind(8303));
+
+	char aBuf[64];
+	NETADDR Addr;
+	EXPECT_EQ(pServer->Recv(&Addr, aBuf, sizeof(aBuf)), 0);
+
+	EXPECT_EQ(pClient->Send(pServer->Address(), "first", 6), 6);
+	EXPECT_EQ(pClient->Send(pServer->Address(), "second", 7), 7);
+
+	EXPECT_EQ(pServer->Recv(&Addr, aBuf, sizeof(aBuf)), 6);
+	EXPECT_STREQ(aBuf, "first");
+	EXPECT_EQ(net_addr_comp(&Addr, pClient->Address(), true), 0);
+	EXPECT_EQ(pServer->Recv(&Addr, aBuf, sizeof(aBuf)), 7);
+	EXPECT_STREQ(aBuf, "second");
+	EXPECT_EQ(pServer->Recv(&Addr, aBuf, sizeof(aBuf)), 0);
+
+	// the reply goes back to the sender address
+	EXPECT_EQ(pServer->Send(&Addr, "reply", 6), 6);
+	EXPECT_EQ(pClient->Recv(&Addr, aBuf, sizeof(aBuf)), 6);
+	EXPECT_STREQ(aBuf, "reply");
+
+	delete pClient;
+	delete pServer;
+}
+
+TEST(NetLoopback, Drops)
+{
+	CNetLoopback Loopback;
+	CNetLoopback::CEndpoint *pServer = Loopback.Bind(8303, 4096);
+	CNetLoopback::CEndpoint *pClient = Loopback.Bind(0);
+	ASSERT_TRUE(pServer && pClient);
+
+	// unknown port
+	NETADDR Addr;
+	CNetLoopback::Address(1, &Addr);
+	EXPECT_LT(pClient->Send(&Addr, "lost", 5), 0);
+	EXPECT_EQ(pClient->m_NumDropped, 1u);
+
+	// full ring
+	char aData[1000] = {0};
+	int NumSent = 0;
+	while(pClient->Send(pServer->Address(), aData, sizeof(aData)) > 0)
+		NumSent++;
+	EXPECT_GT(NumSent, 0);
+	EXPECT_EQ(pClient->m_NumDropped, 2u);
+
+	char aBuf[1000];
+	int NumRecv = 0;
+	while(pServer->Recv(&Addr, aBuf, sizeof(aBuf)) > 0)
+		NumRecv++;
+	EXPECT_EQ(NumRecv, NumSent);
+
+	// closed endpoints release their port
+	NETADDR ServerAddr = *pServer->Address();
+	delete pServer;
+	EXPECT_LT(pClient->Send(&ServerAddr, "lost", 5), 0);
+	pServer = Loopback.Bind(8303);
+	EXPECT_TRUE(pServer);
+
+	delete pClient;
+	delete pServer;
+}
@@ -0,0 +1,78 @@
+#include <gtest/gtest.h>
+
+#include <base/math.h>
+#include <base/system.h>
+#include <engine/shared/compression.h>
+#include <engine/shared/protocol.h>
+#include <engine/shared/snapshot.h>
+
+static int BuildSnapshot(CSnapshot *pSnap, int NumItems, int ItemInts, unsigned Seed)
+{
+	CSnapshotBuilder Builder;
+	Builder.Init();
+	for(int i = 0; i < NumItems; i++)
+	{
+		int *pItem = (int *)Builder.NewItem(1, i, ItemInts*sizeof(int));
+		for(int j = 0; j < ItemInts; j++)
+		{
+			Seed = Seed*1103515245+12345;
+			pItem[j] = (int)(Seed>>2);
+		}
+	}
+	return Builder.Finish(pSnap);
+}
+
+TEST(Snapshot, AssembleManyParts)
+{
+	static unsigned char s_aSnap[CSnapshot::MAX_SIZE];
+	static unsigned char s_aDelta[CSnapshot::MAX_SIZE];
+	static unsigned char s_aPacked[CSnapshot::MAX_SIZE];
+	static unsigned char s_aResult[CSnapshot::MAX_SIZE];
+	CSnapshot *pSnap = (CSnapshot *)s_aSnap;
+	CSnapshot *pResult = (CSnapshot *)s_aResult;
+	int Size = BuildSnapshot(pSnap, 360, 18, 1);
+
+	CSnapshotDelta Delta;
+	CSnapshot Empty;
+	Empty.Clear();
+	int DeltaSize = Delta.CreateDelta(&Empty, pSnap, s_aDelta);
+	ASSERT_GT(DeltaSize, 0);
+	int PackedSize = CVariableInt::Compress(s_aDelta, DeltaSize, s_aPacked, sizeof(s_aPacked));
+	ASSERT_GT(PackedSize, 0);
+
+	// more parts than fit into a 32 bit mask
+	int NumParts = (PackedSize+MAX_SNAPSHOT_PACKSIZE-1)/MAX_SNAPSHOT_PACKSIZE;
+	ASSERT_GT(NumParts, 32);
+	ASSERT_LE(NumParts, (int)CSnapshot::MAX_PARTS);
+
+	// send the parts backwards, with one of them twice
+	CSnapshotAssembler Assembler;
+	int CompleteSize = -1;
+	for(int n = 0; n <= NumParts; n++)
+	{
+		int Part = n < NumParts ? NumParts-1-n : NumParts/2;
+		int PartSize = min((int)MAX_SNAPSHOT_PACKSIZE, PackedSize-Part*MAX_SNAPSHOT_PACKSIZE);
+		int Result = Assembler.AddPart(100, Part, NumParts, s_aPacked+Part*MAX_SNAPSHOT_PACKSIZE, PartSize);
+		if(n < NumParts-1)
+			EXPECT_EQ(Result, -1);
+		else if(n == NumParts-1)
+			CompleteSize = Result;
+	}
+	ASSERT_EQ(CompleteSize, PackedSize);
+
+	int SnapSize = Assembler.Unpack(&Delta, &Empty, pResult, CompleteSize);
+	ASSERT_EQ(SnapSize, Size);
+	EXPECT_EQ(pResult->Crc(), pSnap->Crc());
+	EXPECT_EQ(mem_comp(pResult, pSnap, SnapSize), 0);
+}
+
+TEST(Snapshot, AssembleRejectsInvalidParts)
+{
+	CSnapshotAssembler Assembler;
+	char aData[MAX_SNAPSHOT_PACKSIZE] = {0};
+	EXPECT_EQ(Assembler.AddPart(1, 0, 0, aData, 1), -1);
+	EXPECT_EQ(Assembler.AddPart(1, 0, CSnapshot::MAX_PARTS+1, aData, 1), -1);
+	EXPECT_EQ(Assembler.AddPart(1, 2, 2, aData, 1), -1);
+	EXPECT_EQ(Assembler.AddPart(1, 0, 1, aData, MAX_SNAPSHOT_PACKSIZE+1), -1);
+	EXPECT_EQ(Assembler.AddPart(1, 0, 1, aData, 0), 0);
+}
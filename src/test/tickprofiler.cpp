@@ -0,0 +1,65 @@
+#include <gtest/gtest.h>
+
+#include <engine/shared/tickprofiler.h>
+
+TEST(TickProfiler, Empty)
+{
+	CTickProfiler Profiler;
+	CTickProfiler::CPhaseStats aStats[CTickProfiler::NUM_PHASES];
+	EXPECT_EQ(Profiler.GetStats(aStats, 100), 0);
+	EXPECT_EQ(aStats[CTickProfiler::PHASE_TICK].m_Max, 0);
+}
+
+TEST(TickProfiler, NegativeCount)
+{
+	CTickProfiler Profiler;
+	Profiler.BeginTick(1);
+	Profiler.EndTick();
+
+	CTickProfiler::CSample aSamples[CTickProfiler::MAX_SAMPLES];
+	EXPECT_EQ(Profiler.CopySamples(aSamples, -5), 0);
+	CTickProfiler::CPhaseStats aStats[CTickProfiler::NUM_PHASES];
+	EXPECT_EQ(Profiler.GetStats(aStats, -5), 0);
+	EXPECT_EQ(aStats[CTickProfiler::PHASE_TICK].m_Max, 0);
+}
+
+TEST(TickProfiler, Percentiles)
+{
+	CTickProfiler Profiler;
+	for(int i = 1; i <= 100; i++)
+	{
+		Profiler.BeginTick(i);
+		Profiler.Add(CTickProfiler::PHASE_TICK, i*time_freq()/1000000);
+	}
+	Profiler.EndTick();
+
+	CTickProfiler::CPhaseStats aStats[CTickProfiler::NUM_PHASES];
+	EXPECT_EQ(Profiler.GetStats(aStats, 100), 100);
+	EXPECT_EQ(aStats[CTickProfiler::PHASE_TICK].m_Avg, 50);
+	EXPECT_EQ(aStats[CTickProfiler::PHASE_TICK].m_P50, 50);
+	EXPECT_EQ(aStats[CTickProfiler::PHASE_TICK].m_P90, 90);
+	EXPECT_EQ(aStats[CTickProfiler::PHASE_TICK].m_P99, 99);
+	EXPECT_EQ(aStats[CTickProfiler::PHASE_TICK].m_Max, 100);
+	EXPECT_EQ(aStats[CTickProfiler::PHASE_SNAP].m_Max, 0);
+}
+
+TEST(TickProfiler, Wraparound)
+{
+	CTickProfiler Profiler;
+	for(int i = 0; i < CTickProfiler::MAX_SAMPLES*3; i++)
+	{
+		Profiler.BeginTick(i);
+		Profiler.EndTick();
+	}
+
+	CTickProfiler::CSample aSamples[CTickProfiler::MAX_SAMPLES];
+	int Num = Profiler.CopySamples(aSamples, 10);
+	ASSERT_EQ(Num, 10);
+	EXPECT_EQ(aSamples[0].m_Tick, CTickProfiler::MAX_SAMPLES*3-10);
+	EXPECT_EQ(aSamples[9].m_Tick, CTickProfiler::MAX_SAMPLES*3-1);
+
+	unsigned Total = 0;
+	for(int b = 0; b < CTickProfiler::NUM_BUCKETS; b++)
+		Total += Profiler.HistogramCount(CTickProfiler::PHASE_INPUT, b);
+	EXPECT_EQ(Total, (unsigned)CTickProfiler::MAX_SAMPLES*3);
+}
@@ -0,0 +1,410 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+#include <base/system.h>
+#include <base/tl/array.h>
+
+#include <engine/console.h>
+#include <engine/kernel.h>
+#include <engine/storage.h>
+
+#include <engine/shared/demo.h>
+#include <engine/shared/jobs.h>
+#include <engine/shared/snapshot.h>
+
+#include <game/version.h>
+#include <generated/protocol.h>
+
+/*
+	Plays demos without a client, as fast as possible.
+
+	Every demo is decoded on a pool of worker threads, each with its own
+	player and snapshot delta. Optionally the decoded snapshot items of
+	every tick are written out, either as csv or as binary columns, and the
+	demo can be re-encoded with only the ticks of a range or with block
+	compression.
+
+	Binary column file, integers are stored in network byte order:
+		char marker[8] = "TWDCOLS1"
+		int32 num rows
+		int32 num data ints
+		int32 tick[num rows]
+		int32 type[num rows]
+		int32 id[num rows]
+		int32 size[num rows] // in ints
+		int32 data[num data ints]
+*/
+
+enum
+{
+	FORMAT_NONE=0,
+	FORMAT_CSV,
+	FORMAT_BINARY,
+};
+
+static const unsigned char gs_aColumnMarker[8] = {'T', 'W', 'D', 'C', 'O', 'L', 'S', '1'};
+
+static IStorage *s_pStorage = 0;
+static IConsole *s_pConsole = 0;
+static int s_Format = FORMAT_NONE;
+static int s_TrimStart = -1;
+static int s_TrimEnd = -1;
+static bool s_BlockCompression = false;
+
+class CDemoJob : public CDemoPlayer::IListener
+{
+	CSnapshotDelta m_SnapshotDelta;
+	CDemoPlayer *m_pPlayer;
+	CDemoRecorder *m_pRecorder;
+	CNetObjHandler m_NetObjHandler;
+	IOHANDLE m_OutputFile;
+
+	array<int> m_lTicks;
+	array<int> m_lTypes;
+	array<int> m_lIDs;
+	array<int> m_lSizes;
+	array<int> m_lData;
+
+	void WriteCsv(const CSnapshot *pSnap, int Tick)
+	{
+		for(int i = 0; i < pSnap->NumItems(); i++)
+		{
+			const CSnapshotItem *pItem = pSnap->GetItem(i);
+			int Size = pSnap->GetItemSize(i)/sizeof(int);
+			char aBuf[1024];
+			str_format(aBuf, sizeof(aBuf), "%d,%d,%s,%d,", Tick, pItem->Type(), m_NetObjHandler.GetObjName(pItem->Type()), pItem->ID());
+			int Length = str_length(aBuf);
+			for(int d = 0; d < Size && Length < (int)sizeof(aBuf)-16; d++)
+			{
+				str_format(aBuf+Length, sizeof(aBuf)-Length, d ? " %d" : "%d", pItem->Data()[d]);
+				Length += str_length(aBuf+Length);
+			}
+			aBuf[Length++] = '\n';
+			io_write(m_OutputFile, aBuf, Length);
+		}
+	}
+
+	void AddColumns(const CSnapshot *pSnap, int Tick)
+	{
+		for(int i = 0; i < pSnap->NumItems(); i++)
+		{
+			const CSnapshotItem *pItem = pSnap->GetItem(i);
+			int Size = pSnap->GetItemSize(i)/sizeof(int);
+			m_lTicks.add(Tick);
+			m_lTypes.add(pItem->Type());
+			m_lIDs.add(pItem->ID());
+			m_lSizes.add(Size);
+			for(int d = 0; d < Size; d++)
+				m_lData.add(pItem->Data()[d]);
+		}
+	}
+
+	static void WriteColumn(IOHANDLE File, const array<int> &lValues)
+	{
+		unsigned char aBuf[1024];
+		int Used = 0;
+		for(int i = 0; i < lValues.size(); i++)
+		{
+			uint_to_bytes_be(aBuf+Used, lValues[i]);
+			Used += 4;
+			if(Used == sizeof(aBuf))
+			{
+				io_write(File, aBuf, Used);
+				Used = 0;
+			}
+		}
+		io_write(File, aBuf, Used);
+	}
+
+	void WriteColumns()
+	{
+		unsigned char aHeader[16];
+		mem_copy(aHeader, gs_aColumnMarker, sizeof(gs_aColumnMarker));
+		uint_to_bytes_be(aHeader+8, m_lTicks.size());
+		uint_to_bytes_be(aHeader+12, m_lData.size());
+		io_write(m_OutputFile, aHeader, sizeof(aHeader));
+		WriteColumn(m_OutputFile, m_lTicks);
+		WriteColumn(m_OutputFile, m_lTypes);
+		WriteColumn(m_OutputFile, m_lIDs);
+		WriteColumn(m_OutputFile, m_lSizes);
+		WriteColumn(m_OutputFile, m_lData);
+	}
+
+	bool InRange(int Tick) const
+	{
+		return Tick >= s_TrimStart && (s_TrimEnd < 0 || Tick <= s_TrimEnd);
+	}
+
+public:
+	const char *m_pFilename;
+	CJob m_Job;
+
+	// results
+	bool m_Failed;
+	int m_FileSize;
+	int m_NumTicks;
+	int m_NumSnapshots;
+	int m_NumMessages;
+	int m_NumItems;
+	int64 m_DecodeTime;
+
+	CDemoJob()
+	{
+		m_pPlayer = 0;
+		m_pRecorder = 0;
+		m_OutputFile = 0;
+		m_pFilename = 0;
+		m_Failed = true;
+		m_FileSize = 0;
+		m_NumTicks = 0;
+		m_NumSnapshots = 0;
+		m_NumMessages = 0;
+		m_NumItems = 0;
+		m_DecodeTime = 0;
+	}
+
+	virtual void OnDemoPlayerSnapshot(void *pData, int Size)
+	{
+		const CSnapshot *pSnap = (const CSnapshot *)pData;
+		int Tick = m_pPlayer->BaseInfo()->m_CurrentTick;
+		m_NumSnapshots++;
+		m_NumItems += pSnap->NumItems();
+
+		if(s_Format == FORMAT_CSV)
+			WriteCsv(pSnap, Tick);
+		else if(s_Format == FORMAT_BINARY)
+			AddColumns(pSnap, Tick);
+
+		if(m_pRecorder && InRange(Tick))
+			m_pRecorder->RecordSnapshot(Tick, pData, Size);
+	}
+
+	virtual void OnDemoPlayerMessage(void *pData, int Size)
+	{
+		m_NumMessages++;
+		if(m_pRecorder && InRange(m_pPlayer->BaseInfo()->m_CurrentTick))
+			m_pRecorder->RecordMessage(pData, Size);
+	}
+
+	void Process()
+	{
+		static const int OLD_NUM_NETOBJTYPES = 23;
+		for(int i = 0; i < OLD_NUM_NETOBJTYPES; i++)
+			m_SnapshotDelta.SetStaticsize(i, m_NetObjHandler.GetObjSize(i));
+
+		m_pPlayer = new CDemoPlayer(&m_SnapshotDelta);
+		m_pPlayer->SetListener(this);
+		// jobs of demos on the same map would write the same file at once
+		m_pPlayer->SetMapExtraction(false);
+		if(m_pPlayer->Load(s_pStorage, s_pConsole, m_pFilename, IStorage::TYPE_ALL, GAME_NETVERSION))
+		{
+			delete m_pPlayer;
+			m_pPlayer = 0;
+			return;
+		}
+
+		char aName[128];
+		m_pPlayer->GetDemoName(aName, sizeof(aName));
+
+		if(s_Format != FORMAT_NONE)
+		{
+			char aOutput[IO_MAX_PATH_LENGTH];
+			str_format(aOutput, sizeof(aOutput), "%s.%s", aName, s_Format == FORMAT_CSV ? "csv" : "twcols");
+			m_OutputFile = s_pStorage->OpenFile(aOutput, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+			if(m_OutputFile && s_Format == FORMAT_CSV)
+			{
+				static const char s_aCsvHeader[] = "tick,type,name,id,data\n";
+				io_write(m_OutputFile, s_aCsvHeader, sizeof(s_aCsvHeader)-1);
+			}
+		}
+
+		if(s_TrimStart >= 0)
+		{
+			unsigned MapSize;
+			void *pMapData = m_pPlayer->ReadMapData(&MapSize);
+			if(pMapData)
+			{
+				const CDemoHeader *pHeader = &m_pPlayer->Info()->m_Header;
+				char aOutput[IO_MAX_PATH_LENGTH];
+				str_format(aOutput, sizeof(aOutput), "%s_%s.demo", aName, s_TrimStart > 0 || s_TrimEnd >= 0 ? "trimmed" : "recoded");
+				m_pRecorder = new CDemoRecorder(&m_SnapshotDelta);
+				m_pRecorder->SetBlockCompression(s_BlockCompression);
+				if(m_pRecorder->Start(s_pStorage, s_pConsole, aOutput, pHeader->m_aNetversion, pHeader->m_aMapName,
+					bytes_be_to_uint(pHeader->m_aMapCrc), pHeader->m_aType, pMapData, MapSize) != 0)
+				{
+					delete m_pRecorder;
+					m_pRecorder = 0;
+				}
+				mem_free(pMapData);
+			}
+		}
+
+		IOHANDLE File = s_pStorage->OpenFile(m_pFilename, IOFLAG_READ, IStorage::TYPE_ALL);
+		if(File)
+		{
+			m_FileSize = io_length(File);
+			io_close(File);
+		}
+
+		int64 Start = time_get();
+		m_pPlayer->Play();
+		while(m_pPlayer->IsPlaying() && !m_pPlayer->BaseInfo()->m_Paused)
+		{
+			if(s_TrimEnd >= 0 && m_pPlayer->BaseInfo()->m_CurrentTick > s_TrimEnd && s_Format == FORMAT_NONE)
+				break;
+			m_pPlayer->NextFrame();
+			m_NumTicks++;
+		}
+		m_DecodeTime = time_get()-Start;
+		m_Failed = false;
+
+		if(m_pRecorder)
+		{
+			m_pRecorder->Stop();
+			delete m_pRecorder;
+			m_pRecorder = 0;
+		}
+		if(m_OutputFile)
+		{
+			if(s_Format == FORMAT_BINARY)
+				WriteColumns();
+			io_close(m_OutputFile);
+			m_OutputFile = 0;
+		}
+		m_pPlayer->Stop();
+		delete m_pPlayer;
+		m_pPlayer = 0;
+	}
+
+	static int Run(void *pUser)
+	{
+		((CDemoJob *)pUser)->Process();
+		return 0;
+	}
+};
+
+static void Usage(const char *pName)
+{
+	dbg_msg("usage", "%s [-j threads] [-f csv|bin] [-t first_tick:last_tick] [-z] demo...", pName);
+	dbg_msg("usage", "  -z re-encodes the demo with block compression");
+	dbg_msg("usage", "  demos are looked up in the storage paths, the outputs go to the save directory");
+	dbg_msg("usage", "  as <demo>.csv, <demo>.twcols and <demo>_trimmed.demo or <demo>_recoded.demo");
+}
+
+int main(int argc, const char **argv) // ignore_convention
+{
+	dbg_logger_stdout();
+
+	int NumThreads = 4;
+	array<const char *> lpFiles;
+	for(int i = 1; i < argc; i++) // ignore_convention
+	{
+		const char *pArg = argv[i]; // ignore_convention
+		const char *pValue = i+1 < argc ? argv[i+1] : 0; // ignore_convention
+		if(pArg[0] != '-')
+			lpFiles.add(pArg);
+		else if(pValue && str_comp(pArg, "-j") == 0)
+		{
+			NumThreads = clamp(str_toint(pValue), 1, 32);
+			i++;
+		}
+		else if(pValue && str_comp(pArg, "-f") == 0)
+		{
+			if(str_comp(pValue, "csv") == 0)
+				s_Format = FORMAT_CSV;
+			else if(str_comp(pValue, "bin") == 0)
+				s_Format = FORMAT_BINARY;
+			else
+			{
+				dbg_msg("demo_tool", "unknown format '%s'", pValue);
+				Usage(argv[0]); // ignore_convention
+				return -1;
+			}
+			i++;
+		}
+		else if(str_comp(pArg, "-z") == 0)
+			s_BlockCompression = true;
+		else if(pValue && str_comp(pArg, "-t") == 0)
+		{
+			s_TrimStart = max(str_toint(pValue), 0);
+			const char *pEnd = str_find(pValue, ":");
+			s_TrimEnd = pEnd && pEnd[1] ? str_toint(pEnd+1) : -1;
+			i++;
+		}
+		else
+		{
+			Usage(argv[0]); // ignore_convention
+			return -1;
+		}
+	}
+
+	if(s_BlockCompression && s_TrimStart < 0)
+		s_TrimStart = 0;
+
+	if(!lpFiles.size())
+	{
+		Usage(argv[0]); // ignore_convention
+		return -1;
+	}
+
+	IKernel *pKernel = IKernel::Create();
+	s_pStorage = CreateStorage("Teeworlds", IStorage::STORAGETYPE_BASIC, argc, argv); // ignore_convention
+	s_pConsole = CreateConsole(0);
+	if(!s_pStorage || !pKernel->RegisterInterface(s_pStorage))
+		return -1;
+
+	CDemoJob *pJobs = new CDemoJob[lpFiles.size()];
+	int64 Start = time_get();
+	{
+		CJobPool Pool;
+		Pool.Init(min(NumThreads, lpFiles.size()));
+		for(int i = 0; i < lpFiles.size(); i++)
+		{
+			pJobs[i].m_pFilename = lpFiles[i];
+			Pool.Add(&pJobs[i].m_Job, CDemoJob::Run, &pJobs[i]);
+		}
+
+		for(int i = 0; i < lpFiles.size(); i++)
+		{
+			while(pJobs[i].m_Job.Status() != CJob::STATE_DONE)
+				thread_sleep(1);
+		}
+	}
+	int64 WallTime = time_get()-Start;
+
+	int NumFailed = 0;
+	int64 TotalBytes = 0;
+	int64 TotalTicks = 0;
+	int64 TotalSnapshots = 0;
+	int64 TotalDecodeTime = 0;
+	for(int i = 0; i < lpFiles.size(); i++)
+	{
+		const CDemoJob *pJob = &pJobs[i];
+		if(pJob->m_Failed)
+		{
+			dbg_msg("demo_tool", "%s: failed", pJob->m_pFilename);
+			NumFailed++;
+			continue;
+		}
+
+		double Seconds = pJob->m_DecodeTime/(double)time_freq();
+		dbg_msg("demo_tool", "%s: ticks=%d snapshots=%d items=%d messages=%d decode=%.3fs %.1f ticks/s %.2f MB/s", pJob->m_pFilename,
+			pJob->m_NumTicks, pJob->m_NumSnapshots, pJob->m_NumItems, pJob->m_NumMessages, Seconds,
+			Seconds > 0 ? pJob->m_NumTicks/Seconds : 0.0, Seconds > 0 ? pJob->m_FileSize/Seconds/(1024*1024) : 0.0);
+		TotalBytes += pJob->m_FileSize;
+		TotalTicks += pJob->m_NumTicks;
+		TotalSnapshots += pJob->m_NumSnapshots;
+		TotalDecodeTime += pJob->m_DecodeTime;
+	}
+
+	double WallSeconds = WallTime/(double)time_freq();
+	dbg_msg("demo_tool", "demos=%d failed=%d threads=%d ticks=%lld snapshots=%lld wall=%.3fs decode=%.3fs %.1f ticks/s %.2f MB/s",
+		lpFiles.size(), NumFailed, NumThreads, TotalTicks, TotalSnapshots, WallSeconds, TotalDecodeTime/(double)time_freq(),
+		WallSeconds > 0 ? TotalTicks/WallSeconds : 0.0, WallSeconds > 0 ? TotalBytes/WallSeconds/(1024*1024) : 0.0);
+
+	delete[] pJobs;
+	delete s_pConsole;
+	delete s_pStorage;
+	delete pKernel;
+	return NumFailed ? -1 : 0;
+}
@@ -0,0 +1,575 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <stdlib.h>
+#include <algorithm>
+
+#include <base/math.h>
+#include <base/system.h>
+
+#include <engine/config.h>
+#include <engine/console.h>
+#include <engine/engine.h>
+#include <engine/map.h>
+#include <engine/masterserver.h>
+#include <engine/storage.h>
+
+#include <engine/shared/compression.h>
+#include <engine/shared/config.h>
+#include <engine/shared/demo.h>
+#include <engine/shared/econ.h>
+#include <engine/shared/mapchecker.h>
+#include <engine/shared/netban.h>
+#include <engine/shared/netcapture.h>
+#include <engine/shared/network.h>
+#include <engine/shared/packer.h>
+#include <engine/shared/protocol.h>
+#include <engine/shared/snapshot.h>
+#include <engine/shared/tickprofiler.h>
+
+#include <engine/server/register.h>
+#include <engine/server/server.h>
+
+#include <generated/protocol.h>
+
+/*
+	Replays a capture made with dbg_capturenetwork as fast as possible.
+
+	Server captures are fed to an in-process server: every captured client
+	gets a loopback connection of its own which sends the chunks the server
+	received, so they go through CNetServer::Recv and ProcessClientPacket
+	again. The server ticks follow the capture timestamps, the tick fields of
+	the inputs are adjusted to the replayed server.
+
+	Client mode runs the captured snapshots through the client's snapshot
+	unpack path, this works with client and server captures.
+*/
+
+static int64 Micros(int64 Time)
+{
+	return Time*1000000/time_freq();
+}
+
+// reassembles and unpacks snapshots through the same path as the client
+class CSnapshotReceiver
+{
+	CSnapshotDelta *m_pDelta;
+	CSnapshotStorage m_Storage;
+	CSnapshotAssembler m_Assembler;
+	int m_CurrentRecvTick;
+
+public:
+	int m_LastTick;
+	int m_NumSnapshots;
+	int m_NumErrors;
+	int64 m_UnpackTime;
+
+	void Init(CSnapshotDelta *pDelta)
+	{
+		m_pDelta = pDelta;
+		m_Storage.Init();
+		m_Assembler.Reset();
+		m_CurrentRecvTick = 0;
+		m_LastTick = -1;
+		m_NumSnapshots = 0;
+		m_NumErrors = 0;
+		m_UnpackTime = 0;
+	}
+
+	void Reset()
+	{
+		m_Storage.PurgeAll();
+		m_Assembler.Reset();
+		m_CurrentRecvTick = 0;
+		m_LastTick = -1;
+	}
+
+	// takes the message after the message id
+	void OnMessage(int Msg, CUnpacker *pUnpacker)
+	{
+		int NumParts = 1;
+		int Part = 0;
+		int GameTick = pUnpacker->GetInt();
+		int DeltaTick = GameTick-pUnpacker->GetInt();
+		int PartSize = 0;
+		int Crc = 0;
+
+		if(Msg == NETMSG_SNAP)
+		{
+			NumParts = pUnpacker->GetInt();
+			Part = pUnpacker->GetInt();
+		}
+		if(Msg != NETMSG_SNAPEMPTY)
+		{
+			Crc = pUnpacker->GetInt();
+			PartSize = pUnpacker->GetInt();
+		}
+		const unsigned char *pData = (const unsigned char *)pUnpacker->GetRaw(PartSize);
+
+		if(pUnpacker->Error() || NumParts < 1 || NumParts > CSnapshot::MAX_PARTS || Part < 0 || Part >= NumParts || PartSize < 0 || PartSize > MAX_SNAPSHOT_PACKSIZE)
+		{
+			m_NumErrors++;
+			return;
+		}
+		if(GameTick < m_CurrentRecvTick)
+			return;
+
+		int64 Start = time_get();
+		m_CurrentRecvTick = GameTick;
+		int CompleteSize = m_Assembler.AddPart(GameTick, Part, NumParts, pData, PartSize);
+		if(CompleteSize < 0)
+			return;
+
+		static CSnapshot s_EmptySnap;
+		s_EmptySnap.Clear();
+		CSnapshot *pDeltaShot = &s_EmptySnap;
+		if(DeltaTick >= 0 && m_Storage.Get(DeltaTick, 0, &pDeltaShot, 0) < 0)
+		{
+			// the delta snapshot is not part of the capture, resync
+			m_LastTick = -1;
+			m_NumErrors++;
+			return;
+		}
+
+		unsigned char aSnap[CSnapshot::MAX_SIZE];
+		CSnapshot *pSnap = (CSnapshot *)aSnap;
+		int SnapSize = m_Assembler.Unpack(m_pDelta, pDeltaShot, pSnap, CompleteSize);
+		if(SnapSize < 0 || (Msg != NETMSG_SNAPEMPTY && pSnap->Crc() != Crc))
+		{
+			m_NumErrors++;
+			return;
+		}
+
+		m_Storage.PurgeUntil(min(DeltaTick, m_LastTick));
+		m_Storage.Add(GameTick, time_get(), SnapSize, pSnap, 0);
+		m_LastTick = GameTick;
+		m_NumSnapshots++;
+		m_UnpackTime += time_get()-Start;
+	}
+};
+
+static void InitSnapshotDelta(CSnapshotDelta *pDelta)
+{
+	static const int OLD_NUM_NETOBJTYPES = 23;
+	CNetObjHandler NetObjHandler;
+	for(int i = 0; i < OLD_NUM_NETOBJTYPES; i++)
+		pDelta->SetStaticsize(i, NetObjHandler.GetObjSize(i));
+}
+
+static bool IsSnapMsg(int Msg)
+{
+	return Msg == NETMSG_SNAP || Msg == NETMSG_SNAPSINGLE || Msg == NETMSG_SNAPEMPTY;
+}
+
+// one captured client, connected to the replayed server
+class CReplayClient
+{
+	CNetClient m_Net;
+	INetTransport *m_pTransport;
+
+public:
+	CSnapshotReceiver m_Receiver;
+
+	bool Open(CNetLoopback *pLoopback, const NETADDR *pServerAddr, CSnapshotDelta *pDelta, CConfig *pConfig, IConsole *pConsole)
+	{
+		m_pTransport = pLoopback->Bind(0);
+		NETADDR BindAddr;
+		mem_zero(&BindAddr, sizeof(BindAddr));
+		// no engine, a capture running during the replay only sees the server
+		if(!m_pTransport || !m_Net.Open(BindAddr, pConfig, pConsole, 0, 0, m_pTransport))
+		{
+			delete m_pTransport;
+			m_pTransport = 0;
+			return false;
+		}
+		m_Receiver.Init(pDelta);
+		if(pServerAddr)
+			m_Net.Connect((NETADDR *)pServerAddr);
+		return true;
+	}
+
+	void Close(const char *pReason)
+	{
+		m_Net.Disconnect(pReason);
+		m_Net.Close();
+		delete m_pTransport;
+		m_pTransport = 0;
+	}
+
+	bool Online() const { return m_Net.State() == NETSTATE_ONLINE; }
+
+	void Pump()
+	{
+		m_Net.Update();
+
+		CNetChunk Packet;
+		while(m_Net.Recv(&Packet))
+		{
+			if(Packet.m_ClientID == -1)
+				continue;
+
+			CUnpacker Unpacker;
+			Unpacker.Reset(Packet.m_pData, Packet.m_DataSize);
+			int Msg = Unpacker.GetInt();
+			if(!Unpacker.Error() && (Msg&1) && IsSnapMsg(Msg>>1))
+				m_Receiver.OnMessage(Msg>>1, &Unpacker);
+		}
+	}
+
+	void Send(const CNetCapture::CRecord *pRecord, int PredTick)
+	{
+		CNetChunk Packet;
+		mem_zero(&Packet, sizeof(Packet));
+		Packet.m_ClientID = 0;
+		Packet.m_pData = pRecord->m_pData;
+		Packet.m_DataSize = pRecord->m_DataSize;
+		Packet.m_Flags = (pRecord->m_Flags&NETSENDFLAG_VITAL) | NETSENDFLAG_FLUSH;
+
+		// inputs have to match the ticks of this server
+		CUnpacker Unpacker;
+		Unpacker.Reset(pRecord->m_pData, pRecord->m_DataSize);
+		int Msg = Unpacker.GetInt();
+		CPacker Packer;
+		if(!Unpacker.Error() && Msg == ((NETMSG_INPUT<<1)|1))
+		{
+			Unpacker.GetInt(); // ack game tick
+			Unpacker.GetInt(); // intended tick
+			int Size = Unpacker.GetInt();
+			Packer.Reset();
+			Packer.AddInt(Msg);
+			Packer.AddInt(m_Receiver.m_LastTick);
+			Packer.AddInt(PredTick);
+			Packer.AddInt(Size);
+			for(int i = 0; i < Size/4+1 && !Unpacker.Error(); i++) // input and ping correction
+				Packer.AddInt(Unpacker.GetInt());
+			if(!Unpacker.Error() && !Packer.Error())
+			{
+				Packet.m_pData = Packer.Data();
+				Packet.m_DataSize = Packer.Size();
+			}
+		}
+		m_Net.Send(&Packet);
+	}
+
+	void SendConnless(const CNetCapture::CRecord *pRecord, const NETADDR *pServerAddr)
+	{
+		CNetChunk Packet;
+		mem_zero(&Packet, sizeof(Packet));
+		Packet.m_ClientID = -1;
+		Packet.m_Address = *pServerAddr;
+		Packet.m_pData = pRecord->m_pData;
+		Packet.m_DataSize = pRecord->m_DataSize;
+		Packet.m_Flags = NETSENDFLAG_CONNLESS;
+		m_Net.Send(&Packet);
+	}
+};
+
+static int ReplayServer(CServer *pServer, CNetCaptureReader *pReader)
+{
+	CConfig *pConfig = pServer->Config();
+
+	CNetLoopback Loopback;
+	CNetLoopback::CEndpoint *pServerEndpoint = Loopback.Bind(pConfig->m_SvPort, CNetLoopback::RINGSIZE_SERVER);
+	NETADDR ServerAddr = *pServerEndpoint->Address();
+	pServer->m_pNetTransport = pServerEndpoint;
+	if(pServer->Start() != 0)
+	{
+		delete pServerEndpoint;
+		return -1;
+	}
+
+	CSnapshotDelta *pDelta = new CSnapshotDelta();
+	InitSnapshotDelta(pDelta);
+
+	// one connection per captured slot and one for connless chunks
+	CReplayClient *pClients = new CReplayClient[NET_MAX_CLIENTS+1];
+	bool aActive[NET_MAX_CLIENTS+1] = {false};
+	CReplayClient *pConnless = &pClients[NET_MAX_CLIENTS];
+	aActive[NET_MAX_CLIENTS] = pConnless->Open(&Loopback, 0, pDelta, pConfig, pServer->Console());
+
+	int aNumRecords[CNetCapture::NUM_RECORDTYPES] = {0};
+	int NumReplayed = 0;
+	int NumSkipped = 0;
+	int NumTicks = 0;
+	int64 StartTime = -1;
+	int64 PumpTime = 0;
+	int64 TickTime = 0;
+
+	pServer->m_TickProfiler.Reset();
+	int64 RunStart = time_get();
+
+	CNetCapture::CRecord Record;
+	bool Done = false;
+	while(!Done)
+	{
+		Done = !pReader->Read(&Record);
+		if(!Done)
+		{
+			aNumRecords[Record.m_Type]++;
+			if(StartTime < 0)
+				StartTime = Record.m_Time;
+		}
+
+		// advance the server up to the time of the record
+		int64 RecordTime = Done ? (NumTicks+1)*1000000/SERVER_TICK_SPEED : Record.m_Time-StartTime;
+		while(RecordTime >= (int64)(NumTicks+1)*1000000/SERVER_TICK_SPEED)
+		{
+			int64 Start = time_get();
+			pServer->PumpNetwork();
+			int64 Now = time_get();
+			PumpTime += Now-Start;
+
+			pServer->DoTick();
+			if(pServer->Tick()%2 == 0)
+				pServer->DoSnapshot();
+			TickTime += time_get()-Now;
+			NumTicks++;
+
+			for(int i = 0; i <= NET_MAX_CLIENTS; i++)
+			{
+				if(aActive[i])
+					pClients[i].Pump();
+			}
+			if(Done)
+				break;
+		}
+		if(Done)
+			break;
+
+		if(Record.m_Type == CNetCapture::RECORD_CONNECT && Record.m_ClientID >= 0 && Record.m_ClientID < NET_MAX_CLIENTS)
+		{
+			CReplayClient *pClient = &pClients[Record.m_ClientID];
+			if(aActive[Record.m_ClientID])
+				pClient->Close("replaced");
+			aActive[Record.m_ClientID] = pClient->Open(&Loopback, &ServerAddr, pDelta, pConfig, pServer->Console());
+
+			// finish the handshake right away
+			for(int i = 0; i < 10 && aActive[Record.m_ClientID] && !pClient->Online(); i++)
+			{
+				pClient->Pump();
+				pServer->PumpNetwork();
+			}
+		}
+		else if(Record.m_Type == CNetCapture::RECORD_DROP && Record.m_ClientID >= 0 && Record.m_ClientID < NET_MAX_CLIENTS)
+		{
+			if(aActive[Record.m_ClientID])
+				pClients[Record.m_ClientID].Close("dropped in capture");
+			aActive[Record.m_ClientID] = false;
+		}
+		else if(Record.m_Type == CNetCapture::RECORD_RECV)
+		{
+			if(Record.m_Flags&NETSENDFLAG_CONNLESS)
+			{
+				if(aActive[NET_MAX_CLIENTS])
+				{
+					pConnless->SendConnless(&Record, &ServerAddr);
+					NumReplayed++;
+				}
+			}
+			else if(Record.m_ClientID >= 0 && Record.m_ClientID < NET_MAX_CLIENTS && aActive[Record.m_ClientID])
+			{
+				pClients[Record.m_ClientID].Send(&Record, pServer->Tick()+1);
+				NumReplayed++;
+			}
+			else
+				NumSkipped++;
+		}
+	}
+
+	int64 RunTime = time_get()-RunStart;
+	pServer->m_TickProfiler.EndTick();
+
+	dbg_msg("replay", "records: recv=%d send=%d connect=%d drop=%d", aNumRecords[CNetCapture::RECORD_RECV], aNumRecords[CNetCapture::RECORD_SEND],
+		aNumRecords[CNetCapture::RECORD_CONNECT], aNumRecords[CNetCapture::RECORD_DROP]);
+	dbg_msg("replay", "replayed=%d skipped=%d ticks=%d captured=%.3fs wall=%.3fs", NumReplayed, NumSkipped, NumTicks,
+		NumTicks/(double)SERVER_TICK_SPEED, RunTime/(double)time_freq());
+	dbg_msg("replay", "recv+process: total=%dus per_chunk=%.2fus, ticks: total=%dus per_tick=%.2fus", (int)Micros(PumpTime),
+		NumReplayed ? Micros(PumpTime)/(double)NumReplayed : 0.0, (int)Micros(TickTime), NumTicks ? Micros(TickTime)/(double)NumTicks : 0.0);
+
+	CTickProfiler::CPhaseStats aStats[CTickProfiler::NUM_PHASES];
+	int NumSamples = pServer->m_TickProfiler.GetStats(aStats, NumTicks);
+	dbg_msg("replay", "phase times over the last %d ticks (us): avg/p50/p90/p99/max", NumSamples);
+	for(int p = 0; p < CTickProfiler::NUM_PHASES; p++)
+	{
+		if(p == CTickProfiler::PHASE_NETWORK || p == CTickProfiler::PHASE_SLACK)
+			continue; // not measured by the replay loop
+		dbg_msg("replay", "  %-8s %d/%d/%d/%d/%d", CTickProfiler::PhaseName(p),
+			aStats[p].m_Avg, aStats[p].m_P50, aStats[p].m_P90, aStats[p].m_P99, aStats[p].m_Max);
+	}
+
+	for(int i = 0; i <= NET_MAX_CLIENTS; i++)
+	{
+		if(aActive[i])
+			pClients[i].Close("replay done");
+	}
+	delete[] pClients;
+	delete pDelta;
+
+	pServer->Stop();
+	delete pServerEndpoint;
+	return 0;
+}
+
+static int ReplayClient(CNetCaptureReader *pReader)
+{
+	CSnapshotDelta *pDelta = new CSnapshotDelta();
+	InitSnapshotDelta(pDelta);
+
+	// snapshots show up as received chunks in client captures and as sent
+	// chunks in server captures, the latter get one receiver per client
+	CSnapshotReceiver *apReceivers[NET_MAX_CLIENTS] = {0};
+
+	int NumChunks = 0;
+	int NumSnapChunks = 0;
+	int64 RunStart = time_get();
+
+	CNetCapture::CRecord Record;
+	while(pReader->Read(&Record))
+	{
+		if(Record.m_ClientID < 0 || Record.m_ClientID >= NET_MAX_CLIENTS)
+			continue;
+
+		CSnapshotReceiver *pReceiver = apReceivers[Record.m_ClientID];
+		if(Record.m_Type == CNetCapture::RECORD_CONNECT && pReceiver)
+			pReceiver->Reset();
+		if((Record.m_Type != CNetCapture::RECORD_RECV && Record.m_Type != CNetCapture::RECORD_SEND) || (Record.m_Flags&NETSENDFLAG_CONNLESS))
+			continue;
+
+		NumChunks++;
+		CUnpacker Unpacker;
+		Unpacker.Reset(Record.m_pData, Record.m_DataSize);
+		int Msg = Unpacker.GetInt();
+		if(Unpacker.Error() || !(Msg&1) || !IsSnapMsg(Msg>>1))
+			continue;
+
+		if(!pReceiver)
+		{
+			pReceiver = apReceivers[Record.m_ClientID] = new CSnapshotReceiver();
+			pReceiver->Init(pDelta);
+		}
+		NumSnapChunks++;
+		pReceiver->OnMessage(Msg>>1, &Unpacker);
+	}
+
+	int64 RunTime = time_get()-RunStart;
+	int NumSnapshots = 0;
+	int NumErrors = 0;
+	int64 UnpackTime = 0;
+	for(int i = 0; i < NET_MAX_CLIENTS; i++)
+	{
+		if(!apReceivers[i])
+			continue;
+		NumSnapshots += apReceivers[i]->m_NumSnapshots;
+		NumErrors += apReceivers[i]->m_NumErrors;
+		UnpackTime += apReceivers[i]->m_UnpackTime;
+		delete apReceivers[i];
+	}
+
+	dbg_msg("replay", "chunks=%d snapshot_chunks=%d snapshots=%d errors=%d wall=%.3fs", NumChunks, NumSnapChunks,
+		NumSnapshots, NumErrors, RunTime/(double)time_freq());
+	dbg_msg("replay", "unpack: total=%dus per_snapshot=%.2fus", (int)Micros(UnpackTime),
+		NumSnapshots ? Micros(UnpackTime)/(double)NumSnapshots : 0.0);
+
+	delete pDelta;
+	return 0;
+}
+
+static void Usage(const char *pName)
+{
+	dbg_msg("usage", "%s [-k server|client] [-m map] [-p port] capture [-- server commands]", pName);
+}
+
+int main(int argc, const char **argv) // ignore_convention
+{
+	const char *pMap = "dm1";
+	const char *pCapture = 0;
+	bool ClientCapture = false;
+	int Port = 8404;
+	int FirstCommandArg = argc; // ignore_convention
+
+	for(int i = 1; i < argc; i++) // ignore_convention
+	{
+		const char *pArg = argv[i]; // ignore_convention
+		const char *pValue = i+1 < argc ? argv[i+1] : 0; // ignore_convention
+		if(str_comp(pArg, "--") == 0)
+		{
+			FirstCommandArg = i+1;
+			break;
+		}
+		else if(pArg[0] != '-' && !pCapture)
+			pCapture = pArg;
+		else if(pValue && str_comp(pArg, "-k") == 0)
+		{
+			ClientCapture = str_comp(pValue, "client") == 0;
+			i++;
+		}
+		else if(pValue && str_comp(pArg, "-m") == 0)
+		{
+			pMap = pValue;
+			i++;
+		}
+		else if(pValue && str_comp(pArg, "-p") == 0)
+		{
+			Port = str_toint(pValue);
+			i++;
+		}
+		else
+		{
+			Usage(argv[0]); // ignore_convention
+			return -1;
+		}
+	}
+
+	if(!pCapture)
+	{
+		Usage(argv[0]); // ignore_convention
+		return -1;
+	}
+
+	if(secure_random_init() != 0)
+	{
+		dbg_msg("secure", "could not initialize secure RNG");
+		return -1;
+	}
+
+	CNetCaptureReader Reader;
+	if(!Reader.Open(io_open(pCapture, IOFLAG_READ)))
+	{
+		dbg_msg("replay", "could not open capture '%s'", pCapture);
+		return -1;
+	}
+
+	if(ClientCapture)
+	{
+		dbg_logger_stdout();
+		return ReplayClient(&Reader);
+	}
+
+	srand(0);
+
+	CServerKernel Kernel;
+	if(!Kernel.Init("Teeworlds_Replay", argc, argv)) // ignore_convention
+		return -1;
+
+	CServer *pServer = Kernel.m_pServer;
+	IConsole *pConsole = Kernel.m_pConsole;
+	IConfigManager *pConfigManager = Kernel.m_pConfigManager;
+	pServer->RegisterCommands();
+
+	CConfig *pConfig = pConfigManager->Values();
+	str_copy(pConfig->m_SvMap, pMap, sizeof(pConfig->m_SvMap));
+	pConfig->m_SvPort = Port;
+	pConfig->m_SvMaxClients = MAX_CLIENTS;
+	pConfig->m_SvMaxClientsPerIP = MAX_CLIENTS;
+	pConfig->m_SvRegister = 0;
+	pConfig->m_SvSnapPacing = 0;
+	pConfig->m_EcPerfStats = 0;
+
+	if(FirstCommandArg < argc) // ignore_convention
+		pConsole->ParseArguments(argc-FirstCommandArg, &argv[FirstCommandArg]); // ignore_convention
+
+	pConfigManager->RestoreStrings();
+	pServer->InitRconPasswordIfUnset();
+
+	dbg_msg("replay", "capture=%s map=%s", pCapture, pConfig->m_SvMap);
+	return ReplayServer(pServer, &Reader);
+}
@@ -0,0 +1,564 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <new>
+#include <stdlib.h>
+#include <algorithm>
+
+#include <base/math.h>
+#include <base/system.h>
+#include <base/tl/threading.h>
+
+#include <engine/config.h>
+#include <engine/console.h>
+#include <engine/engine.h>
+#include <engine/map.h>
+#include <engine/masterserver.h>
+#include <engine/storage.h>
+
+#include <engine/shared/config.h>
+#include <engine/shared/demo.h>
+#include <engine/shared/econ.h>
+#include <engine/shared/mapchecker.h>
+#include <engine/shared/netban.h>
+#include <engine/shared/network.h>
+#include <engine/shared/packer.h>
+#include <engine/shared/protocol.h>
+#include <engine/shared/snapshot.h>
+#include <engine/shared/tickprofiler.h>
+
+#include <engine/server/register.h>
+#include <engine/server/server.h>
+
+#include <game/version.h>
+#include <generated/protocol.h>
+
+/*
+	Headless server benchmark.
+
+	Boots the complete server in-process, connects a number of simulated
+	clients and then advances a fixed number of ticks as fast as possible.
+	Nothing depends on the wall clock during the measured ticks, so the same
+	map, client count, input mode and seed give comparable runs. The packets
+	go through the in-process loopback transport by default.
+*/
+
+// count all allocations done through new/delete, mem_alloc keeps its own count
+static volatile unsigned s_NumAllocs = 0;
+static volatile unsigned s_NumFrees = 0;
+
+void *operator new(size_t Size)
+{
+	atomic_inc(&s_NumAllocs);
+	void *p = malloc(Size ? Size : 1);
+	if(!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void *operator new[](size_t Size)
+{
+	return operator new(Size);
+}
+
+void operator delete(void *p) throw()
+{
+	if(p)
+		atomic_inc(&s_NumFrees);
+	free(p);
+}
+
+void operator delete[](void *p) throw()
+{
+	operator delete(p);
+}
+
+#if defined(__cpp_sized_deallocation)
+void operator delete(void *p, size_t Size) throw()
+{
+	operator delete(p);
+}
+
+void operator delete[](void *p, size_t Size) throw()
+{
+	operator delete(p);
+}
+#endif
+
+enum
+{
+	INPUT_IDLE=0,
+	INPUT_RANDOM,
+	INPUT_SCRIPT,
+};
+
+static unsigned s_RandomState = 1;
+
+static int BenchRandom()
+{
+	// own generator so the game's rand() sequence stays untouched
+	s_RandomState = s_RandomState*1103515245+12345;
+	return (s_RandomState>>16)&0x7fff;
+}
+
+class CBenchClient
+{
+	enum
+	{
+		STATE_CONNECTING=0,
+		STATE_LOADING,
+		STATE_ENTERING,
+		STATE_INGAME,
+	};
+
+	CNetClient m_Net;
+	INetTransport *m_pTransport;
+	int m_State;
+	int m_ID;
+	int m_AckGameTick;
+
+	void SendMsg(CMsgPacker *pMsg, int Flags)
+	{
+		CNetChunk Packet;
+		mem_zero(&Packet, sizeof(Packet));
+		Packet.m_ClientID = 0;
+		Packet.m_pData = pMsg->Data();
+		Packet.m_DataSize = pMsg->Size();
+		if(Flags&MSGFLAG_VITAL)
+			Packet.m_Flags |= NETSENDFLAG_VITAL;
+		if(Flags&MSGFLAG_FLUSH)
+			Packet.m_Flags |= NETSENDFLAG_FLUSH;
+		m_Net.Send(&Packet);
+	}
+
+	void SendStartInfo()
+	{
+		static const char *s_apSkinParts[NUM_SKINPARTS] = { "standard", "", "", "standard", "standard", "standard" };
+		char aName[MAX_NAME_LENGTH];
+		str_format(aName, sizeof(aName), "bot%d", m_ID);
+
+		CNetMsg_Cl_StartInfo Msg;
+		Msg.m_pName = aName;
+		Msg.m_pClan = "";
+		Msg.m_Country = -1;
+		for(int p = 0; p < NUM_SKINPARTS; p++)
+		{
+			Msg.m_apSkinPartNames[p] = s_apSkinParts[p];
+			Msg.m_aUseCustomColors[p] = 0;
+			Msg.m_aSkinPartColors[p] = 0;
+		}
+		CMsgPacker Packer(Msg.MsgID());
+		Msg.Pack(&Packer);
+		SendMsg(&Packer, MSGFLAG_VITAL|MSGFLAG_FLUSH);
+	}
+
+public:
+	int m_SnapshotBytes;
+	int m_OtherBytes;
+
+	bool Init(int ID, NETADDR *pServerAddr, INetTransport *pTransport, CConfig *pConfig, IConsole *pConsole, IEngine *pEngine, const char *pNetVersion)
+	{
+		m_ID = ID;
+		m_pTransport = pTransport;
+		m_State = STATE_CONNECTING;
+		m_AckGameTick = -1;
+		m_SnapshotBytes = 0;
+		m_OtherBytes = 0;
+
+		NETADDR BindAddr;
+		mem_zero(&BindAddr, sizeof(BindAddr));
+		BindAddr.type = pServerAddr->type;
+		if(!m_Net.Open(BindAddr, pConfig, pConsole, pEngine, 0, pTransport))
+			return false;
+		m_Net.Connect(pServerAddr);
+
+		CMsgPacker Msg(NETMSG_INFO, true);
+		Msg.AddString(pNetVersion, 128);
+		Msg.AddString(pConfig->m_Password, 128);
+		Msg.AddInt(CLIENT_VERSION);
+		SendMsg(&Msg, MSGFLAG_VITAL|MSGFLAG_FLUSH);
+		return true;
+	}
+
+	void Close()
+	{
+		m_Net.Disconnect("benchmark done");
+		m_Net.Close();
+		delete m_pTransport;
+		m_pTransport = 0;
+	}
+
+	bool Ingame() const { return m_State == STATE_INGAME; }
+	bool Connected() const { return m_Net.State() == NETSTATE_ONLINE; }
+
+	void Pump()
+	{
+		m_Net.Update();
+
+		CNetChunk Packet;
+		while(m_Net.Recv(&Packet))
+		{
+			if(Packet.m_ClientID == -1)
+				continue;
+
+			CUnpacker Unpacker;
+			Unpacker.Reset(Packet.m_pData, Packet.m_DataSize);
+			int Msg = Unpacker.GetInt();
+			int Sys = Msg&1;
+			Msg >>= 1;
+			if(Unpacker.Error())
+				continue;
+
+			if(Sys && (Msg == NETMSG_SNAP || Msg == NETMSG_SNAPSINGLE || Msg == NETMSG_SNAPEMPTY))
+			{
+				m_SnapshotBytes += Packet.m_DataSize;
+				int GameTick = Unpacker.GetInt();
+				if(!Unpacker.Error() && GameTick > m_AckGameTick)
+					m_AckGameTick = GameTick;
+				continue;
+			}
+
+			m_OtherBytes += Packet.m_DataSize;
+			if(Sys && Msg == NETMSG_MAP_CHANGE && m_State == STATE_CONNECTING)
+			{
+				// the map is already on disk
+				CMsgPacker Ready(NETMSG_READY, true);
+				SendMsg(&Ready, MSGFLAG_VITAL|MSGFLAG_FLUSH);
+				m_State = STATE_LOADING;
+			}
+			else if(Sys && Msg == NETMSG_CON_READY && m_State == STATE_LOADING)
+			{
+				SendStartInfo();
+				m_State = STATE_ENTERING;
+			}
+			else if(!Sys && Msg == NETMSGTYPE_SV_READYTOENTER && m_State == STATE_ENTERING)
+			{
+				CMsgPacker Enter(NETMSG_ENTERGAME, true);
+				SendMsg(&Enter, MSGFLAG_VITAL|MSGFLAG_FLUSH);
+				m_State = STATE_INGAME;
+			}
+		}
+	}
+
+	void SendInput(int PredTick, int Mode)
+	{
+		if(m_State != STATE_INGAME)
+			return;
+
+		CNetObj_PlayerInput Input;
+		mem_zero(&Input, sizeof(Input));
+		Input.m_TargetX = 100;
+		if(Mode == INPUT_RANDOM)
+		{
+			Input.m_Direction = BenchRandom()%3-1;
+			Input.m_TargetX = BenchRandom()%512-256;
+			Input.m_TargetY = BenchRandom()%512-256;
+			Input.m_Jump = (BenchRandom()%16) == 0;
+			Input.m_Fire = BenchRandom()%4;
+			Input.m_Hook = (BenchRandom()%8) != 0;
+			Input.m_WantedWeapon = (BenchRandom()%64) == 0 ? BenchRandom()%NUM_WEAPONS+1 : 0;
+		}
+		else if(Mode == INPUT_SCRIPT)
+		{
+			// run back and forth, jump now and then and keep firing
+			int Phase = (PredTick+m_ID*7)%(SERVER_TICK_SPEED*2);
+			Input.m_Direction = Phase < SERVER_TICK_SPEED ? -1 : 1;
+			Input.m_TargetX = Input.m_Direction*100;
+			Input.m_TargetY = -40;
+			Input.m_Jump = (Phase%25) < 3;
+			Input.m_Fire = PredTick/5;
+			Input.m_Hook = (Phase%40) < 20;
+		}
+
+		CMsgPacker Msg(NETMSG_INPUT, true);
+		Msg.AddInt(m_AckGameTick);
+		Msg.AddInt(PredTick);
+		Msg.AddInt(sizeof(Input));
+		const int *pData = (const int *)&Input;
+		for(unsigned i = 0; i < sizeof(Input)/sizeof(int); i++)
+			Msg.AddInt(pData[i]);
+		Msg.AddInt(0); // ping correction
+		SendMsg(&Msg, MSGFLAG_FLUSH);
+	}
+};
+
+static int Percentile(const int64 *pSorted, int Num, int Percent)
+{
+	return Num ? (int)pSorted[(Num-1)*Percent/100] : 0;
+}
+
+static int Run(CServer *pServer, IKernel *pKernel, int NumClients, int NumTicks, int InputMode, bool Udp)
+{
+	CConfig *pConfig = pServer->Config();
+
+	// exchange the packets in-process unless real sockets are wanted
+	CNetLoopback Loopback;
+	CNetLoopback::CEndpoint *pServerEndpoint = 0;
+	NETADDR ServerAddr;
+	if(Udp)
+	{
+		net_addr_from_str(&ServerAddr, "127.0.0.1");
+		ServerAddr.port = pConfig->m_SvPort;
+	}
+	else
+	{
+		pServerEndpoint = Loopback.Bind(pConfig->m_SvPort, CNetLoopback::RINGSIZE_SERVER);
+		ServerAddr = *pServerEndpoint->Address();
+		pServer->m_pNetTransport = pServerEndpoint;
+	}
+
+	if(pServer->Start() != 0)
+	{
+		delete pServerEndpoint;
+		return -1;
+	}
+
+	const char *pNetVersion = pServer->GameServer()->NetVersion();
+
+	CBenchClient *pClients = new CBenchClient[NumClients];
+	for(int i = 0; i < NumClients; i++)
+	{
+		// no engine, the clients stay out of the network logs and captures of the server
+		INetTransport *pTransport = Udp ? 0 : Loopback.Bind(0);
+		if(!pClients[i].Init(i, &ServerAddr, pTransport, pConfig, pServer->Console(), 0, pNetVersion))
+		{
+			dbg_msg("bench", "could not open client socket");
+			delete pTransport;
+			delete[] pClients;
+			pServer->Stop();
+			delete pServerEndpoint;
+			return -1;
+		}
+	}
+
+	// warm up until every client is in game, udp needs the normal wall clock pacing
+	int64 WarmupEnd = time_get()+time_freq()*10;
+	int NumIngame = 0;
+	while(NumIngame < NumClients && time_get() < WarmupEnd)
+	{
+		pServer->DoTick();
+		for(int i = 0; i < NumClients; i++)
+		{
+			pClients[i].Pump();
+			pClients[i].SendInput(pServer->Tick()+1, INPUT_IDLE);
+		}
+		pServer->PumpNetwork();
+		if(pServer->Tick()%2 == 0)
+			pServer->DoSnapshot();
+
+		NumIngame = 0;
+		for(int i = 0; i < NumClients; i++)
+			NumIngame += pClients[i].Ingame();
+		if(Udp)
+			thread_sleep(1000/SERVER_TICK_SPEED);
+	}
+	if(NumIngame < NumClients)
+		dbg_msg("bench", "only %d of %d clients entered the game", NumIngame, NumClients);
+
+	for(int i = 0; i < NumClients; i++)
+	{
+		pClients[i].m_SnapshotBytes = 0;
+		pClients[i].m_OtherBytes = 0;
+	}
+	pServer->m_TickProfiler.Reset();
+
+	// measured run
+	int64 *pTickTimes = new int64[NumTicks];
+	unsigned AllocsStart = s_NumAllocs;
+	unsigned FreesStart = s_NumFrees;
+	unsigned MemAllocsStart = mem_stats()->total_allocations;
+	unsigned MemFreesStart = mem_stats()->total_frees;
+	int64 RunStart = time_get();
+
+	for(int t = 0; t < NumTicks; t++)
+	{
+		for(int i = 0; i < NumClients; i++)
+		{
+			pClients[i].Pump();
+			pClients[i].SendInput(pServer->Tick()+1, InputMode);
+		}
+
+		// the server tick includes receiving the inputs sent above
+		int64 TickStart = time_get();
+		pServer->PumpNetwork();
+		int64 NetworkTime = time_get()-TickStart;
+		pServer->DoTick();
+		pServer->m_TickProfiler.Add(CTickProfiler::PHASE_NETWORK, NetworkTime);
+		if(pServer->Tick()%2 == 0)
+			pServer->DoSnapshot();
+		pTickTimes[t] = (time_get()-TickStart)*1000000/time_freq();
+	}
+	pServer->m_TickProfiler.EndTick();
+
+	int64 RunTime = time_get()-RunStart;
+	unsigned NumAllocs = s_NumAllocs-AllocsStart;
+	unsigned NumFrees = s_NumFrees-FreesStart;
+	unsigned NumMemAllocs = mem_stats()->total_allocations-MemAllocsStart;
+	unsigned NumMemFrees = mem_stats()->total_frees-MemFreesStart;
+
+	// collect the trailing snapshots
+	for(int i = 0; i < NumClients; i++)
+		pClients[i].Pump();
+
+	// report
+	int64 Sum = 0;
+	for(int t = 0; t < NumTicks; t++)
+		Sum += pTickTimes[t];
+	std::sort(pTickTimes, pTickTimes+NumTicks);
+
+	int64 SnapBytes = 0, OtherBytes = 0;
+	int NumConnected = 0;
+	for(int i = 0; i < NumClients; i++)
+	{
+		SnapBytes += pClients[i].m_SnapshotBytes;
+		OtherBytes += pClients[i].m_OtherBytes;
+		NumConnected += pClients[i].Connected();
+	}
+
+	dbg_msg("bench", "clients=%d connected=%d ingame=%d ticks=%d wall=%.3fs", NumClients, NumConnected, NumIngame, NumTicks, RunTime/(double)time_freq());
+	dbg_msg("bench", "tick time (us): avg=%d p50=%d p90=%d p99=%d max=%d", (int)(Sum/NumTicks),
+		Percentile(pTickTimes, NumTicks, 50), Percentile(pTickTimes, NumTicks, 90), Percentile(pTickTimes, NumTicks, 99), (int)pTickTimes[NumTicks-1]);
+	dbg_msg("bench", "snapshot bytes per client: total=%d per_tick=%.1f, other bytes per client: %d",
+		(int)(SnapBytes/NumClients), SnapBytes/(double)NumClients/NumTicks, (int)(OtherBytes/NumClients));
+	dbg_msg("bench", "allocations: new=%u delete=%u mem_alloc=%u mem_free=%u per_tick=%.2f", NumAllocs, NumFrees,
+		NumMemAllocs, NumMemFrees, (NumAllocs+NumMemAllocs)/(double)NumTicks);
+
+	CTickProfiler::CPhaseStats aStats[CTickProfiler::NUM_PHASES];
+	int NumSamples = pServer->m_TickProfiler.GetStats(aStats, NumTicks);
+	dbg_msg("bench", "phase times over the last %d ticks (us): avg/p50/p90/p99/max", NumSamples);
+	for(int p = 0; p < CTickProfiler::NUM_PHASES; p++)
+	{
+		if(p == CTickProfiler::PHASE_SLACK)
+			continue; // the benchmark loop never waits
+		dbg_msg("bench", "  %-8s %d/%d/%d/%d/%d", CTickProfiler::PhaseName(p),
+			aStats[p].m_Avg, aStats[p].m_P50, aStats[p].m_P90, aStats[p].m_P99, aStats[p].m_Max);
+	}
+
+	delete[] pTickTimes;
+	for(int i = 0; i < NumClients; i++)
+		pClients[i].Close();
+	delete[] pClients;
+
+	if(pServerEndpoint)
+		dbg_msg("bench", "loopback: server recv=%u sent=%u dropped=%u", pServerEndpoint->m_NumRecv, pServerEndpoint->m_NumSent, pServerEndpoint->m_NumDropped);
+
+	pServer->Stop();
+	delete pServerEndpoint;
+	return 0;
+}
+
+static void Usage(const char *pName)
+{
+	// the engine is not up yet to set up the logging
+	dbg_logger_stdout();
+	dbg_msg("usage", "%s [-m map] [-c clients] [-t ticks] [-s seed] [-i idle|random|script] [-n loopback|udp] [-p port] [-- server commands]", pName);
+}
+
+int main(int argc, const char **argv) // ignore_convention
+{
+	const char *pMap = "dm1";
+	int NumClients = 16;
+	int NumTicks = 50*60;
+	int Seed = 1;
+	int InputMode = INPUT_RANDOM;
+	int Port = 8404;
+	bool Udp = false;
+	int FirstCommandArg = argc; // ignore_convention
+
+	for(int i = 1; i < argc; i++) // ignore_convention
+	{
+		const char *pArg = argv[i]; // ignore_convention
+		const char *pValue = i+1 < argc ? argv[i+1] : 0; // ignore_convention
+		if(str_comp(pArg, "--") == 0)
+		{
+			FirstCommandArg = i+1;
+			break;
+		}
+		else if(!pValue)
+		{
+			Usage(argv[0]); // ignore_convention
+			return -1;
+		}
+		else if(str_comp(pArg, "-m") == 0)
+			pMap = pValue;
+		else if(str_comp(pArg, "-c") == 0)
+			NumClients = clamp(str_toint(pValue), 1, (int)MAX_CLIENTS);
+		else if(str_comp(pArg, "-t") == 0)
+			NumTicks = max(str_toint(pValue), 1);
+		else if(str_comp(pArg, "-s") == 0)
+			Seed = str_toint(pValue);
+		else if(str_comp(pArg, "-p") == 0)
+			Port = str_toint(pValue);
+		else if(str_comp(pArg, "-n") == 0)
+		{
+			if(str_comp(pValue, "loopback") == 0)
+				Udp = false;
+			else if(str_comp(pValue, "udp") == 0)
+				Udp = true;
+			else
+			{
+				Usage(argv[0]); // ignore_convention
+				return -1;
+			}
+		}
+		else if(str_comp(pArg, "-i") == 0)
+		{
+			if(str_comp(pValue, "idle") == 0)
+				InputMode = INPUT_IDLE;
+			else if(str_comp(pValue, "random") == 0)
+				InputMode = INPUT_RANDOM;
+			else if(str_comp(pValue, "script") == 0)
+				InputMode = INPUT_SCRIPT;
+			else
+			{
+				Usage(argv[0]); // ignore_convention
+				return -1;
+			}
+		}
+		else
+		{
+			Usage(argv[0]); // ignore_convention
+			return -1;
+		}
+		i++;
+	}
+
+	if(secure_random_init() != 0)
+	{
+		dbg_msg("secure", "could not initialize secure RNG");
+		return -1;
+	}
+
+	srand(Seed);
+	s_RandomState = Seed;
+
+	CServerKernel Kernel;
+	if(!Kernel.Init("Teeworlds_Bench", argc, argv)) // ignore_convention
+		return -1;
+
+	CServer *pServer = Kernel.m_pServer;
+	IConsole *pConsole = Kernel.m_pConsole;
+	IConfigManager *pConfigManager = Kernel.m_pConfigManager;
+	pServer->RegisterCommands();
+
+	// fixed settings, no config files are read to keep runs comparable
+	CConfig *pConfig = pConfigManager->Values();
+	str_copy(pConfig->m_SvMap, pMap, sizeof(pConfig->m_SvMap));
+	str_copy(pConfig->m_Bindaddr, "127.0.0.1", sizeof(pConfig->m_Bindaddr));
+	pConfig->m_SvPort = Port;
+	pConfig->m_SvMaxClients = NumClients;
+	pConfig->m_SvMaxClientsPerIP = NumClients;
+	pConfig->m_SvRegister = 0;
+	pConfig->m_SvSnapPacing = 0;
+	pConfig->m_EcPerfStats = 0;
+	pConfig->m_ConsoleOutputLevel = 0;
+
+	if(FirstCommandArg < argc) // ignore_convention
+		pConsole->ParseArguments(argc-FirstCommandArg, &argv[FirstCommandArg]); // ignore_convention
+
+	pConfigManager->RestoreStrings();
+	pServer->InitRconPasswordIfUnset();
+
+	dbg_msg("bench", "map=%s clients=%d ticks=%d seed=%d input=%s", pConfig->m_SvMap, NumClients, NumTicks, Seed,
+		InputMode == INPUT_IDLE ? "idle" : InputMode == INPUT_RANDOM ? "random" : "script");
+	return Run(pServer, Kernel.m_pKernel, NumClients, NumTicks, InputMode, Udp);
+}